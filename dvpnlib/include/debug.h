@@ -2,6 +2,25 @@
 #define __DEBUG_H__
 
 #include <stdio.h>
+#include <glib.h>
+
+/*
+ * Log levels, checked at run time before any message is formatted.
+ * Both the dvpnlib and the CAPI layers log through this gate.
+ */
+enum dvpnlib_log_level {
+	DVPNLIB_LOG_NONE = 0,
+	DVPNLIB_LOG_ERROR,
+	DVPNLIB_LOG_WARN,
+	DVPNLIB_LOG_INFO,
+	DVPNLIB_LOG_DEBUG,
+};
+
+#define DVPNLIB_LOG_DEFAULT_LEVEL	DVPNLIB_LOG_WARN
+
+extern gint dvpnlib_log_level;
+
+void dvpnlib_set_log_level(enum dvpnlib_log_level level);
 
 #ifndef RELEASE
 
@@ -10,18 +29,42 @@
 #undef LOG_TAG
 #define LOG_TAG "DVPN_LIB"
 
-#define DBG(fmt, arg...) SLOGD(fmt, ##arg)
+#define LOG_ENABLED(level) \
+	G_UNLIKELY(g_atomic_int_get(&dvpnlib_log_level) >= (level))
 
-#define WARN(fmt, arg...) SLOGI(fmt, ##arg)
+#define DBG(fmt, arg...) \
+	do { \
+		if (LOG_ENABLED(DVPNLIB_LOG_DEBUG)) \
+			SLOGD(fmt, ##arg); \
+	} while (0)
 
-#define ERROR(fmt, arg...) SLOGE(fmt, ##arg)
+#define WARN(fmt, arg...) \
+	do { \
+		if (LOG_ENABLED(DVPNLIB_LOG_WARN)) \
+			SLOGI(fmt, ##arg); \
+	} while (0)
+
+#define ERROR(fmt, arg...) \
+	do { \
+		if (LOG_ENABLED(DVPNLIB_LOG_ERROR)) \
+			SLOGE(fmt, ##arg); \
+	} while (0)
 
 #else
 
+/* Release builds drop the logging code altogether */
+#define LOG_ENABLED(level) 0
+
 #define DBG(fmt, arg...)
 #define WARN(fmt, arg...)
 #define ERROR(fmt, arg...)
 
 #endif
 
+/*
+ * Guards work done only to produce a debug message, such as
+ * g_variant_print() on a D-Bus payload.
+ */
+#define DBG_ENABLED() LOG_ENABLED(DVPNLIB_LOG_DEBUG)
+
 #endif
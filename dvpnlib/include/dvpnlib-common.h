@@ -41,6 +41,39 @@ enum dvpnlib_err {
 	DVPNLIB_ERR_UNKNOWN_METHOD,
 };
 
+/*
+ * D-Bus method call timeouts (milliseconds)
+ */
+#define DVPNLIB_TIMEOUT_DEFAULT		(-1)	/* library-wide default */
+#define DVPNLIB_TIMEOUT_INFINITE	G_MAXINT
+
+/*
+ * D-Bus method call statistics
+ */
+enum dvpnlib_method {
+	DVPNLIB_METHOD_CREATE,
+	DVPNLIB_METHOD_REMOVE,
+	DVPNLIB_METHOD_CONNECT,
+	DVPNLIB_METHOD_DISCONNECT,
+	DVPNLIB_METHOD_SET_PROPERTY,
+	DVPNLIB_METHOD_CLEAR_PROPERTY,
+	DVPNLIB_METHOD_GET_CONNECTIONS,
+	DVPNLIB_METHOD_REGISTER_AGENT,
+	DVPNLIB_METHOD_UNREGISTER_AGENT,
+	DVPNLIB_METHOD_OTHER,
+	DVPNLIB_METHOD_MAX,
+};
+
+/* latency[i] counts round trips of [2^i, 2^(i+1)) microseconds */
+#define DVPNLIB_STATS_LATENCY_BUCKETS	26
+
+struct dvpnlib_method_stats {
+	unsigned int calls;
+	unsigned int errors;
+	int in_flight;
+	unsigned int latency[DVPNLIB_STATS_LATENCY_BUCKETS];
+};
+
 /*
  * Common
  */
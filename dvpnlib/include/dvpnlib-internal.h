@@ -3,12 +3,16 @@
 
 #include <gio/gio.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connect-queue.h"
 
 struct vpn_manager;
 struct vpn_connection;
+struct watchdog_attempt;
 
 extern struct vpn_manager *vpn_manager;
 
@@ -17,11 +21,15 @@ extern struct vpn_manager *vpn_manager;
 #define VPN_CONNECTION_INTERFACE "net.connman.vpn.Connection"
 #define VPN_MANAGER_PATH "/"
 
+/* Same as the D-Bus default, used until the application sets its own */
+#define DVPNLIB_DEFAULT_CALL_TIMEOUT 25000
+
 struct common_reply_data {
 	void *cb;
 	void *data;
 	void *user;
 	bool flag;		/*TODO: */
+	struct watchdog_attempt *attempt;	/* Connect under watch */
 };
 
 struct error_map_t {
@@ -34,17 +42,28 @@ struct error_map_t {
  */
 enum dvpnlib_err common_set_property(GDBusProxy *dbus_proxy,
 					 const char *property,
-					 GVariant *value);
+					 GVariant *value,
+					 gint timeout,
+					 GCancellable *cancellable);
 GVariant *common_get_call_method_result(GDBusProxy *dbus_proxy,
-					  const char *method);
+					  const char *method,
+					  gint timeout,
+					  GCancellable *cancellable);
 enum dvpnlib_err common_set_interface_call_method_sync(
 						GDBusProxy *dbus_proxy,
 						const char *method,
-						GVariant **parameters);
+						GVariant **parameters,
+						gint timeout,
+						GCancellable *cancellable);
+typedef void (*common_call_reply_cb)(enum dvpnlib_err result,
+					GVariant *reply,
+					gpointer user_data);
 enum dvpnlib_err common_set_interface_call_method(GDBusProxy *dbus_proxy,
 						const char *method,
 						GVariant **parameters,
-						GAsyncReadyCallback callback,
+						gint timeout,
+						GCancellable *cancellable,
+						common_call_reply_cb callback,
 						gpointer user_data);
 
 /*
@@ -53,20 +72,170 @@ enum dvpnlib_err common_set_interface_call_method(GDBusProxy *dbus_proxy,
 struct vpn_manager *create_vpn_manager(void);
 void free_vpn_manager(struct vpn_manager *manager);
 GDBusProxy *get_vpn_manager_dbus_proxy(void);
+GCancellable *get_vpn_manager_cancellable(void);
 
 /*
  * VPN Connection
  */
 void sync_vpn_connections(void);
+void resync_vpn_connections(GVariant *connections, GList **added,
+				GList **stale);
 void destroy_vpn_connections(void);
 struct vpn_connection *get_connection_by_path(const gchar *path);
 gboolean add_vpn_connection(GVariant **parameters,
 			    struct vpn_connection **connection);
 void remove_vpn_connection(struct vpn_connection *connection);
+void cancel_vpn_connections(void);
 
 struct common_reply_data *common_reply_data_new(void *cb,
 						void *data,
 						void *user, bool flag);
+void common_reply_dispatch(dvpnlib_reply_cb callback,
+				enum dvpnlib_err result,
+				void *user_data);
+
+/*
+ * Statistics
+ */
+enum dvpnlib_method dvpnlib_stats_method(const char *method);
+const char *dvpnlib_stats_method_name(enum dvpnlib_method method);
+gint64 dvpnlib_stats_call_begin(enum dvpnlib_method method);
+void dvpnlib_stats_call_end(enum dvpnlib_method method, gint64 start,
+				enum dvpnlib_err result);
+
+/*
+ * Deferred reclamation
+ */
+void dvpnlib_rcu_read_lock(void);
+void dvpnlib_rcu_read_unlock(void);
+void dvpnlib_rcu_retire(gpointer data, GDestroyNotify destroy);
+void dvpnlib_rcu_synchronize(void);
+
+/*
+ * Connection index, guarded by the connection index lock
+ */
+struct connection_index_node {
+	gpointer connection;
+	gboolean linked;
+	gint state;
+	const gchar *type;	/* interned */
+	gchar *domain;		/* copies, the records may be retired first */
+	gchar *name;
+	GSequenceIter *name_iter;
+};
+
+void connection_index_add(struct connection_index_node *node,
+				gpointer connection, gint state,
+				const gchar *type, const gchar *domain,
+				const gchar *name);
+void connection_index_update(struct connection_index_node *node,
+				gint state, const gchar *type,
+				const gchar *domain, const gchar *name);
+void connection_index_remove(struct connection_index_node *node);
+void connection_index_clear(void);
+GList *connection_index_query(gint state, const gchar *type,
+				const gchar *domain, const gchar *name_prefix);
+
+/*
+ * Automatic reconnect, hooks of the connection table
+ */
+void connection_reconnect_state_changed(struct vpn_connection *connection,
+					gint state);
+void connection_reconnect_reset(struct vpn_connection *connection);
+void connection_reconnect_forget(struct vpn_connection *connection);
+void connection_reconnect_handoff(struct vpn_connection *connection);
+enum dvpnlib_err connection_connect(struct vpn_connection *connection,
+				int timeout,
+				enum dvpnlib_connect_priority priority,
+				dvpnlib_reply_cb callback,
+				void *user_data);
+
+/*
+ * Connect queue, bounding the Connect calls in flight
+ */
+typedef void (*connect_queue_func)(gpointer data, enum dvpnlib_err result);
+void connect_queue_submit(struct vpn_connection *connection,
+				enum dvpnlib_connect_priority priority,
+				connect_queue_func start, gpointer data);
+void connect_queue_release(void);
+void connect_queue_abort(struct vpn_connection *connection);
+
+/*
+ * Connect watchdog, hooks of the connection table
+ */
+void dvpnlib_watchdog_start(void);
+void dvpnlib_watchdog_stop(void);
+struct watchdog_attempt *connection_watchdog_arm(
+				struct vpn_connection *connection,
+				dvpnlib_reply_cb callback, void *user_data);
+gboolean connection_watchdog_settle(struct vpn_connection *connection,
+				struct watchdog_attempt *attempt,
+				enum dvpnlib_err result);
+void connection_watchdog_disarm(struct vpn_connection *connection);
+void connection_watchdog_forget(struct vpn_connection *connection);
+void connection_abort_connect(struct vpn_connection *connection);
+
+/*
+ * Connect races, hook of the connection table
+ */
+void connection_race_state_changed(struct vpn_connection *connection,
+					gint state);
+
+/*
+ * Credential agent, exported in the D-Bus dispatch context
+ */
+void dvpnlib_agent_export(GDBusConnection *connection);
+void dvpnlib_agent_unexport(void);
+void connection_agent_forget(struct vpn_connection *connection);
+void connection_agent_owner_changed(gboolean present);
+
+/*
+ * Event journal
+ */
+#define DVPNLIB_JOURNAL_SIZE	64	/* power of two */
+
+enum dvpnlib_journal_event {
+	DVPNLIB_JOURNAL_STATE,		/* a: old state, b: new state */
+	DVPNLIB_JOURNAL_PROPERTY,	/* code: property type */
+	DVPNLIB_JOURNAL_CALL,		/* code: method, a: timeout */
+	DVPNLIB_JOURNAL_REPLY,		/* code: method, a: dvpnlib_err */
+	DVPNLIB_JOURNAL_CANCEL,
+};
+
+struct dvpnlib_journal_entry {
+	gint seq;		/* slot + 1 once written, 0 while written */
+	gint16 event;
+	gint16 code;
+	gint32 a;
+	gint32 b;
+	gint64 time;		/* monotonic, microseconds */
+};
+
+struct dvpnlib_journal {
+	gint head;		/* slots handed out so far */
+	struct dvpnlib_journal_entry entries[DVPNLIB_JOURNAL_SIZE];
+};
+
+void dvpnlib_journal_record(struct dvpnlib_journal *journal,
+				enum dvpnlib_journal_event event,
+				int code, int a, int b);
+int dvpnlib_journal_dump(struct dvpnlib_journal *journal,
+				const char *path, int fd);
+/* Lower case name of an enum vpn_connection_state, async-signal-safe */
+const char *dvpnlib_state_name(int state);
+
+/*
+ * Worker thread
+ */
+int dvpnlib_worker_start(int (*init_func)(void), void (*deinit_func)(void),
+				guint queue_size);
+void dvpnlib_worker_stop(void);
+gboolean dvpnlib_worker_is_enabled(void);
+void dvpnlib_worker_invoke(GSourceFunc func, gpointer data,
+				GDestroyNotify notify);
+void dvpnlib_event_post(GSourceFunc func, gpointer data,
+				GDestroyNotify notify, gboolean droppable);
+
 /*
  * Error
  */
@@ -0,0 +1,52 @@
+#ifndef __DVPNLIB_TRACE_H__
+#define __DVPNLIB_TRACE_H__
+
+/*
+ * Static tracepoints
+ *
+ * Configured with -DENABLE_USDT=ON, the probes are SystemTap SDT notes
+ * of provider "dvpnlib" which perf, bpftrace and stap attach to on the
+ * installed library. An unattached probe is a single nop and its
+ * arguments are only computed into registers. Without the option they
+ * compile to nothing and their arguments are not evaluated.
+ *
+ *   api__entry(func, handle)
+ *   api__exit(func, handle, error)		error: vpn_error_e
+ *   dbus__call(path, method)
+ *   dbus__reply(path, method, error, usec)	error: enum dvpnlib_err
+ *   signal(path, signal_name)
+ *   state(handle, path, old, new)		enum vpn_connection_state
+ *
+ * e.g. bpftrace -e 'usdt:/usr/lib/libcapi-network-vpn-setting.so:\
+ *	dvpnlib:dbus__reply { @[str(arg1)] = hist(arg3); }'
+ */
+
+#ifdef ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define TRACE_API_ENTRY(handle) \
+	DTRACE_PROBE2(dvpnlib, api__entry, __func__, handle)
+#define TRACE_API_EXIT(handle, error) \
+	DTRACE_PROBE3(dvpnlib, api__exit, __func__, handle, error)
+#define TRACE_DBUS_CALL(path, method) \
+	DTRACE_PROBE2(dvpnlib, dbus__call, path, method)
+#define TRACE_DBUS_REPLY(path, method, error, usec) \
+	DTRACE_PROBE4(dvpnlib, dbus__reply, path, method, error, usec)
+#define TRACE_SIGNAL(path, signal_name) \
+	DTRACE_PROBE2(dvpnlib, signal, path, signal_name)
+#define TRACE_STATE(handle, path, old_state, new_state) \
+	DTRACE_PROBE4(dvpnlib, state, handle, path, old_state, new_state)
+
+#else
+
+#define TRACE_API_ENTRY(handle) do { } while (0)
+#define TRACE_API_EXIT(handle, error) do { } while (0)
+#define TRACE_DBUS_CALL(path, method) do { } while (0)
+#define TRACE_DBUS_REPLY(path, method, error, usec) do { } while (0)
+#define TRACE_SIGNAL(path, signal_name) do { } while (0)
+#define TRACE_STATE(handle, path, old_state, new_state) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __VPN_AGENT_H__
+#define __VPN_AGENT_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Built-in net.connman.vpn.Agent
+ *
+ * The agent answers RequestInput from secrets the application cached for
+ * each connection, so a reconnect after a transient drop does not wait
+ * for a prompt. The secrets of a connection expire together, ttl seconds
+ * after the last one was set (0 keeps them until cleared), and are wiped
+ * when connman-vpn reports an error for the connection or the connection
+ * is removed.
+ *
+ * When a mandatory field is missing, the request is kept pending and the
+ * input callback is told which fields are needed; it is answered as soon
+ * as they have been set, or canceled by connman-vpn. Without an input
+ * callback the request is canceled right away.
+ *
+ * The registration outlives connman-vpn: a restarted daemon gets the
+ * agent registered again, the requests of the old one are canceled.
+ */
+#define DVPNLIB_AGENT_PATH	"/net/connman/vpn/dvpnlib/agent"
+
+typedef void (*dvpnlib_agent_input_cb)(struct vpn_connection *connection,
+					const char **fields,
+					void *user_data);
+
+enum dvpnlib_err dvpnlib_agent_register(dvpnlib_agent_input_cb callback,
+					void *user_data);
+enum dvpnlib_err dvpnlib_agent_unregister(void);
+
+enum dvpnlib_err vpn_connection_set_secret(
+				struct vpn_connection *connection,
+				const char *field, const char *value,
+				unsigned int ttl);
+void vpn_connection_clear_secrets(struct vpn_connection *connection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
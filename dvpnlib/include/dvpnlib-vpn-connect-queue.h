@@ -0,0 +1,55 @@
+#ifndef __VPN_CONNECT_QUEUE_H__
+#define __VPN_CONNECT_QUEUE_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded Connect concurrency
+ *
+ * Once a concurrency is set, at most that many Connect calls are in
+ * flight; the connects beyond are queued until a reply frees a slot.
+ * A queued connect of a higher priority always goes first. Within a
+ * priority the callers, told apart by the thread-default main context
+ * they connect from, take turns, so that one caller queueing hundreds
+ * of profiles does not starve the others. 0, the default, does not
+ * limit anything.
+ */
+enum dvpnlib_connect_priority {
+	DVPNLIB_CONNECT_PRIORITY_HIGH,
+	DVPNLIB_CONNECT_PRIORITY_NORMAL,
+	DVPNLIB_CONNECT_PRIORITY_LOW,
+	DVPNLIB_CONNECT_PRIORITY_MAX,
+};
+
+/* wait[i] counts connects queued for [2^i, 2^(i+1)) microseconds */
+struct dvpnlib_connect_queue_stats {
+	unsigned int concurrency;
+	unsigned int in_flight;
+	unsigned int queued;
+	unsigned int dispatched;
+	guint64 wait_total_us;
+	guint64 wait_max_us;
+	unsigned int wait[DVPNLIB_STATS_LATENCY_BUCKETS];
+};
+
+void dvpnlib_connect_queue_set_concurrency(unsigned int concurrency);
+void dvpnlib_connect_queue_get_stats(
+				struct dvpnlib_connect_queue_stats *stats);
+
+enum dvpnlib_err vpn_connection_connect_with_priority(
+				struct vpn_connection *connection,
+				int timeout,
+				enum dvpnlib_connect_priority priority,
+				dvpnlib_reply_cb callback,
+				void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
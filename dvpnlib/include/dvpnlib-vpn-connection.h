@@ -72,6 +72,63 @@ struct vpn_connection_route {
 	gchar *gateway;
 };
 
+/*
+ * Properties of a connection as one consistent record. The type is
+ * interned, since it takes few values; the other strings belong to the
+ * record and are retired with it once they change. version grows with
+ * every change.
+ */
+struct vpn_connection_snapshot {
+	guint version;
+	enum vpn_connection_state state;
+	const gchar *type;
+	gchar *name;
+	gchar *domain;
+	gchar *host;
+	gboolean immutable;
+	gint index;
+	struct vpn_connection_ipv4 *ipv4;
+	struct vpn_connection_ipv6 *ipv6;
+	gchar **nameservers;
+	GSList *user_routes;
+	GSList *server_routes;
+};
+
+/*
+ * Connect timing, in microseconds from the Connect call
+ */
+struct vpn_connection_latency {
+	gint64 last;
+	gint64 min;
+	gint64 max;
+	/* Percentiles over the most recent samples */
+	gint64 p50;
+	gint64 p90;
+	gint64 p99;
+	guint samples;		/* all time */
+};
+
+struct vpn_connection_timing {
+	guint attempts;
+	/* Phases of the last attempt, -1 if not reached */
+	gint64 connect_reply;
+	gint64 configuration;
+	gint64 ipv4;
+	gint64 nameservers;
+	struct vpn_connection_latency time_to_ready;
+	struct vpn_connection_latency time_to_failure;
+};
+
+/*
+ * Query filters, NULL or -1 for any
+ */
+struct vpn_connection_query {
+	int state;		/* enum vpn_connection_state */
+	const char *type;
+	const char *domain;
+	const char *name_prefix;
+};
+
 /*
  * Callback prototype
  */
@@ -84,15 +141,34 @@ typedef void (*vpn_connection_property_changed_cb)(
 */
 /* experimental */
 GList *vpn_get_connections(void);
+void vpn_connections_lock_read(void);
+void vpn_connections_unlock_read(void);
+struct vpn_connection *vpn_connection_ref(
+				struct vpn_connection *connection);
+void vpn_connection_unref(struct vpn_connection *connection);
+struct vpn_connection *vpn_connection_lookup_ref(
+				struct vpn_connection *connection);
 struct vpn_connection *vpn_get_connection(
 				const char *host, const char *domain);
+struct vpn_connection *vpn_get_connection_ref(
+				const char *host, const char *domain);
+GList *vpn_connections_query(const struct vpn_connection_query *query);
 enum dvpnlib_err vpn_connection_clear_property(
 				struct vpn_connection *connection);
 enum dvpnlib_err vpn_connection_connect(struct vpn_connection *connection,
 				dvpnlib_reply_cb callback,
 				void *user_data);
+enum dvpnlib_err vpn_connection_connect_with_timeout(
+				struct vpn_connection *connection,
+				int timeout,
+				dvpnlib_reply_cb callback,
+				void *user_data);
 enum dvpnlib_err
 vpn_connection_disconnect(struct vpn_connection *connection);
+void vpn_connection_cancel(struct vpn_connection *connection);
+void vpn_connection_get_timing(struct vpn_connection *connection,
+				struct vpn_connection_timing *timing);
+int vpn_connection_dump_journal(struct vpn_connection *connection, int fd);
 
 /*
  * Properties
@@ -103,12 +179,22 @@ vpn_connection_set_user_routes(struct vpn_connection *connection,
 			struct vpn_connection_route **user_routes);
 
 /* Get */
+/*
+ * Type/Path/Immutable/Index/State can be read from any thread: their
+ * getters take a read section of their own and return a copy, or an
+ * interned string. The pointers returned for the other properties
+ * (Name/Domain/Host/IPv4/IPv6/Nameservers/Routes) are freed once the
+ * property changes: use them inside vpn_connections_lock_read(), or in
+ * the thread that dispatches the VPN signals.
+ */
 const char *vpn_connection_get_type(
 				struct vpn_connection *connection);
 const char *vpn_connection_get_name(
 				struct vpn_connection *connection);
 const char *vpn_connection_get_path(
 				struct vpn_connection *connection);
+/* TRUE once the connection has left the table, for reference holders */
+gboolean vpn_connection_is_removed(struct vpn_connection *connection);
 const char *vpn_connection_get_domain(
 				struct vpn_connection *connection);
 const char *vpn_connection_get_host(
@@ -130,6 +216,9 @@ GSList *vpn_connection_get_user_routes(
 				struct vpn_connection *connection);
 GSList *vpn_connection_get_server_routes(
 				struct vpn_connection *connection);
+/* Valid until vpn_connections_unlock_read() */
+const struct vpn_connection_snapshot *vpn_connection_get_snapshot(
+				struct vpn_connection *connection);
 /*
  * Signals
  */
@@ -0,0 +1,56 @@
+#ifndef __VPN_EXPORT_H__
+#define __VPN_EXPORT_H__
+
+#include "dvpnlib-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Export of the connection table, one record per connection.
+ *
+ * DVPNLIB_EXPORT_JSON writes one JSON object per line.
+ *
+ * DVPNLIB_EXPORT_BINARY starts with the magic "DVPN" and a u32 version,
+ * then each record is a u32 byte length followed by, in this order:
+ *
+ *   str path, str name, str type, str host, str domain,
+ *   i32 state, i32 index, u8 immutable,
+ *   u8 has_ipv4 [str address, str netmask, str gateway, str peer],
+ *   u8 has_ipv6 [str address, str prefix_length, str gateway, str peer],
+ *   u16 count, count * str nameserver,
+ *   u16 count, count * (i32 family, str network, str netmask,
+ *                      str gateway) user routes,
+ *   u16 count, ... server routes, same layout
+ *
+ * Integers are little endian. A str is a u16 length and the bytes with
+ * no terminator, 0xffff for none. Later versions only append fields, so
+ * readers skip what they do not know using the record length.
+ */
+enum dvpnlib_export_format {
+	DVPNLIB_EXPORT_JSON,
+	DVPNLIB_EXPORT_BINARY,
+};
+
+#define DVPNLIB_EXPORT_BINARY_VERSION	1
+
+/* Returns false to stop the export */
+typedef bool (*dvpnlib_export_write_cb)(const void *data, size_t len,
+					void *user_data);
+
+/*
+ * write_cb is called with the connection table read-locked, and must not
+ * call back into the library.
+ */
+enum dvpnlib_err vpn_connections_export(enum dvpnlib_export_format format,
+				dvpnlib_export_write_cb write_cb,
+				void *user_data);
+enum dvpnlib_err vpn_connections_export_fd(
+				enum dvpnlib_export_format format, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __VPN_IMPORT_H__
+#define __VPN_IMPORT_H__
+
+#include "dvpnlib-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bulk import of profiles from a file, read one record at a time.
+ *
+ * A record is either a key file style group:
+ *
+ *   [name]
+ *   Type=openvpn
+ *   Host=vpn.example.com
+ *
+ * or a line holding a flat JSON object of strings:
+ *
+ *   {"Type": "openvpn", "Name": "name", "Host": "vpn.example.com"}
+ *
+ * Lines starting with '#' or ';' are comments. The group name is used as
+ * Name unless the group sets one. Type, Name and Host are required.
+ */
+struct dvpnlib_import_record {
+	unsigned int index;	/* 0 for the first record of the file */
+	unsigned int line;	/* where the record starts */
+	const char *name;
+	enum dvpnlib_err result;
+};
+
+typedef void (*dvpnlib_import_record_cb)(
+				const struct dvpnlib_import_record *record,
+				void *user_data);
+typedef void (*dvpnlib_import_done_cb)(enum dvpnlib_err result,
+				unsigned int succeeded,
+				unsigned int failed,
+				void *user_data);
+
+/*
+ * Keeps up to max_in_flight Manager.Create calls outstanding. record_cb
+ * runs once per record, done_cb once at the end of the file; either may
+ * run before this returns.
+ */
+enum dvpnlib_err dvpnlib_vpn_manager_import(const char *path,
+				unsigned int max_in_flight,
+				dvpnlib_import_record_cb record_cb,
+				dvpnlib_import_done_cb done_cb,
+				void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
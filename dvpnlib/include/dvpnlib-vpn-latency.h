@@ -0,0 +1,52 @@
+#ifndef __VPN_LATENCY_H__
+#define __VPN_LATENCY_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Latency of the servers of the connections
+ *
+ * The latency of a connection is the time a TCP handshake with its Host
+ * takes, on the given port or on the usual one of its Type. A refused
+ * connection answers as fast as an accepted one, so it counts as
+ * reachable: no server has to listen on the port, and UDP based types
+ * are measured as well. Results are cached per endpoint for ttl
+ * seconds, also across restarts once a cache file is set.
+ */
+#define DVPNLIB_LATENCY_TTL_DEFAULT	300	/* seconds */
+#define DVPNLIB_LATENCY_UNREACHABLE	(-1)
+
+/*
+ * connections are ordered by latency, unreachable ones last, and the
+ * list is freed after the callback returns.
+ */
+typedef void (*dvpnlib_rank_cb)(GList *connections, void *user_data);
+
+enum dvpnlib_err vpn_connections_rank_by_latency(
+				struct vpn_connection **connections,
+				unsigned int count,
+				unsigned short port,
+				int timeout,
+				dvpnlib_rank_cb callback,
+				void *user_data);
+
+/* Cached latency in microseconds, or DVPNLIB_LATENCY_UNREACHABLE */
+enum dvpnlib_err vpn_connection_get_latency(
+				struct vpn_connection *connection,
+				unsigned short port,
+				gint64 *latency);
+
+/* Loads path, where the results are saved from now on; NULL stops */
+enum dvpnlib_err dvpnlib_latency_set_cache(const char *path,
+				unsigned int ttl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
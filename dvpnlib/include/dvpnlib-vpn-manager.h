@@ -9,11 +9,7 @@ extern "C" {
 
 struct vpn_manager;
 struct vpn_connection;
-
-struct vpn_setting_entry {
-	gchar *key;
-	gchar *value;
-};
+struct dvpnlib_settings;
 
 /*
  * Callback prototype
@@ -28,7 +24,8 @@ typedef void (*vpn_connection_removed_cb)(
 * Methods
 */
 GList *vpn_get_connections(void);
-enum dvpnlib_err dvpnlib_vpn_manager_create(GHashTable *settings,
+enum dvpnlib_err dvpnlib_vpn_manager_create(
+				struct dvpnlib_settings *settings,
 				dvpnlib_reply_cb callback,
 				void *user_data);
 enum dvpnlib_err dvpnlib_vpn_manager_remove(const char *path,
@@ -36,6 +33,7 @@ enum dvpnlib_err dvpnlib_vpn_manager_remove(const char *path,
 				void *user_data);
 enum dvpnlib_err dvpnlib_vpn_manager_register_agent(const char *path);
 enum dvpnlib_err dvpnlib_vpn_manager_unregister_agent(const char *path);
+void dvpnlib_vpn_manager_cancel(void);
 
 /*
  * Signals
@@ -0,0 +1,39 @@
+#ifndef __VPN_RACE_H__
+#define __VPN_RACE_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Connects the first of several equivalent connections to come up.
+ *
+ * The connections are started in order, stagger_ms apart, and the next
+ * one is started at once when one fails. The first to reach ready wins;
+ * the others that were started are disconnected and the ones left are
+ * not started. The callback gets the winner, or NULL and the error of
+ * the last failure once they have all failed. Everything runs and is
+ * reported in the thread-default main context of the caller.
+ *
+ * A connection takes part in one race at a time.
+ */
+typedef void (*dvpnlib_connect_any_cb)(struct vpn_connection *winner,
+					enum dvpnlib_err result,
+					void *user_data);
+
+enum dvpnlib_err vpn_connections_connect_any(
+				struct vpn_connection **connections,
+				unsigned int count,
+				unsigned int stagger_ms,
+				int timeout,
+				dvpnlib_connect_any_cb callback,
+				void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __VPN_RECONNECT_H__
+#define __VPN_RECONNECT_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Automatic reconnect of a connection which drops unexpectedly.
+ *
+ * Once the connection has been ready, a State change to failure, idle or
+ * disconnect that was not requested with vpn_connection_disconnect()
+ * schedules a Connect. The delay grows exponentially from
+ * initial_delay_ms up to max_delay_ms and is spread by +/- jitter_percent
+ * so that many profiles dropping together do not reconnect in lockstep.
+ * The engine gives up after max_attempts failed attempts in a row, 0 for
+ * no limit, and is armed again by the next ready.
+ */
+struct dvpnlib_reconnect_policy {
+	unsigned int max_attempts;
+	unsigned int initial_delay_ms;
+	unsigned int max_delay_ms;
+	unsigned int jitter_percent;	/* 0 to 100 */
+	int connect_timeout;		/* ms, or DVPNLIB_TIMEOUT_DEFAULT */
+};
+
+enum dvpnlib_reconnect_event {
+	DVPNLIB_RECONNECT_SCHEDULED,	/* delay_ms before the attempt */
+	DVPNLIB_RECONNECT_STARTED,
+	DVPNLIB_RECONNECT_FAILED,	/* result of the attempt */
+	DVPNLIB_RECONNECT_SUCCEEDED,
+	DVPNLIB_RECONNECT_GAVE_UP,
+};
+
+struct dvpnlib_reconnect_info {
+	enum dvpnlib_reconnect_event event;
+	unsigned int attempt;		/* 1 for the first after a drop */
+	unsigned int delay_ms;
+	enum dvpnlib_err result;
+};
+
+typedef void (*dvpnlib_reconnect_cb)(struct vpn_connection *connection,
+				const struct dvpnlib_reconnect_info *info,
+				void *user_data);
+
+/*
+ * Replaces the policy of the connection. The attempts are made and
+ * reported in the thread-default main context of the caller; destroy is
+ * called on user_data once the policy is replaced, unset or the
+ * connection removed.
+ */
+enum dvpnlib_err vpn_connection_set_reconnect_policy(
+				struct vpn_connection *connection,
+				const struct dvpnlib_reconnect_policy *policy,
+				dvpnlib_reconnect_cb callback,
+				void *user_data, GDestroyNotify destroy);
+void vpn_connection_unset_reconnect_policy(
+				struct vpn_connection *connection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __VPN_SETTINGS_H__
+#define __VPN_SETTINGS_H__
+
+#include "dvpnlib-common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Profile settings handed to Manager.Create
+ */
+struct dvpnlib_settings;
+
+struct dvpnlib_settings *dvpnlib_settings_new(void);
+struct dvpnlib_settings *dvpnlib_settings_ref(
+				struct dvpnlib_settings *settings);
+void dvpnlib_settings_unref(struct dvpnlib_settings *settings);
+/*
+ * Copy-on-write copy: the clone shares the source's extra keys until it
+ * overrides them
+ */
+struct dvpnlib_settings *dvpnlib_settings_clone(
+				struct dvpnlib_settings *settings);
+
+/* A NULL value removes the key */
+enum dvpnlib_err dvpnlib_settings_set(struct dvpnlib_settings *settings,
+				const char *key, const char *value);
+/* Returns a new reference to the (a{sv}) parameters of Manager.Create */
+GVariant *dvpnlib_settings_get_parameters(
+				struct dvpnlib_settings *settings);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
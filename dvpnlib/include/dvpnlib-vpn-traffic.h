@@ -0,0 +1,51 @@
+#ifndef __VPN_TRAFFIC_H__
+#define __VPN_TRAFFIC_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Traffic counters of the tunnel interface of a connection, its Index.
+ *
+ * The counters of every interface are read with one rtnetlink link dump
+ * (/sys/class/net when netlink is not available), which is reused for
+ * DVPNLIB_TRAFFIC_CACHE_USEC: walking all ready connections costs one
+ * dump. The rates are per second over the last sampling interval, and
+ * stay 0 while sampling is off.
+ */
+#define DVPNLIB_TRAFFIC_CACHE_USEC	100000
+
+struct dvpnlib_traffic_stats {
+	guint64 rx_bytes;
+	guint64 tx_bytes;
+	guint64 rx_packets;
+	guint64 tx_packets;
+	guint64 rx_errors;
+	guint64 tx_errors;
+	guint64 rx_bytes_rate;
+	guint64 tx_bytes_rate;
+	guint64 rx_packets_rate;
+	guint64 tx_packets_rate;
+};
+
+enum dvpnlib_err dvpnlib_traffic_get_stats(int ifindex,
+				struct dvpnlib_traffic_stats *stats);
+enum dvpnlib_err vpn_connection_get_traffic_stats(
+				struct vpn_connection *connection,
+				struct dvpnlib_traffic_stats *stats);
+
+/*
+ * Samples the counters every interval_ms in the thread-default main
+ * context of the caller to compute the rates, 0 stops.
+ */
+void dvpnlib_traffic_set_rate_interval(unsigned int interval_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __VPN_WATCHDOG_H__
+#define __VPN_WATCHDOG_H__
+
+#include "dvpnlib-common.h"
+#include "dvpnlib-vpn-connection.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Connect watchdog
+ *
+ * Once a deadline is set for a connection, each Connect must bring its
+ * State to ready within deadline_ms. Otherwise the watchdog issues a
+ * Disconnect and completes the pending connect callbacks with
+ * DVPNLIB_ERR_OPERATION_TIMEOUT; their Connect replies, when they come,
+ * are dropped. With reconnect, an explicit connect which timed out is
+ * then handed to the reconnect policy of the connection, if it has one;
+ * the attempts of the reconnect engine are retried by it anyway.
+ *
+ * A repeated Connect does not move the deadline of the attempt in
+ * progress. All the deadlines share one timer in the context which
+ * dispatches the D-Bus traffic.
+ */
+enum dvpnlib_err vpn_connection_set_connect_deadline(
+				struct vpn_connection *connection,
+				unsigned int deadline_ms,
+				gboolean reconnect);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
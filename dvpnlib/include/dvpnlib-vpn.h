@@ -1,13 +1,32 @@
 #ifndef __VPN_LIB_H__
 #define __VPN_LIB_H__
 
+#include "dvpnlib-common.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+enum dvpnlib_thread_mode {
+	/* D-Bus traffic is dispatched by the caller's main context */
+	DVPNLIB_THREAD_MODE_DEFAULT,
+	/* The library runs its own event-loop thread */
+	DVPNLIB_THREAD_MODE_WORKER,
+};
+
 int dvpnlib_vpn_init(void);
+int dvpnlib_vpn_init_with_mode(enum dvpnlib_thread_mode mode,
+				unsigned int event_queue_size);
 void dvpnlib_vpn_deinit(void);
 
+enum dvpnlib_err dvpnlib_set_default_timeout(int timeout);
+int dvpnlib_get_default_timeout(void);
+void dvpnlib_cancel_all(void);
+
+enum dvpnlib_err dvpnlib_get_method_stats(enum dvpnlib_method method,
+				struct dvpnlib_method_stats *stats);
+void dvpnlib_reset_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
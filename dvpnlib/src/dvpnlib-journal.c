@@ -0,0 +1,168 @@
+#include <unistd.h>
+
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+
+/*
+ * Event journal
+ *
+ * A fixed ring of the most recent events of a connection. Writers claim
+ * a slot with an atomic add and publish it through its sequence number,
+ * so recording takes no lock and no allocation and never blocks the
+ * thread dispatching D-Bus. Readers copy a slot and keep it only if its
+ * sequence number is the expected one before and after the copy.
+ *
+ * Dumping only uses write(2) and stack buffers, so it can be done from a
+ * fatal signal handler as long as the connection is known to be alive.
+ */
+
+void dvpnlib_journal_record(struct dvpnlib_journal *journal,
+				enum dvpnlib_journal_event event,
+				int code, int a, int b)
+{
+	struct dvpnlib_journal_entry *entry;
+	guint slot;
+
+	slot = (guint)g_atomic_int_add(&journal->head, 1);
+	entry = &journal->entries[slot & (DVPNLIB_JOURNAL_SIZE - 1)];
+
+	g_atomic_int_set(&entry->seq, 0);
+	entry->event = event;
+	entry->code = code;
+	entry->a = a;
+	entry->b = b;
+	entry->time = g_get_monotonic_time();
+	g_atomic_int_set(&entry->seq, (gint)(slot + 1));
+}
+
+struct journal_line {
+	char buf[192];
+	size_t len;
+};
+
+static void line_put_str(struct journal_line *line, const char *str)
+{
+	if (str == NULL)
+		str = "(null)";
+
+	while (*str && line->len < sizeof(line->buf) - 1)
+		line->buf[line->len++] = *str++;
+}
+
+static void line_put_int(struct journal_line *line, gint64 value)
+{
+	char digits[24];
+	int n = 0;
+	guint64 v = value < 0 ? -(guint64)value : (guint64)value;
+
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	if (value < 0)
+		line_put_str(line, "-");
+
+	while (n > 0 && line->len < sizeof(line->buf) - 1)
+		line->buf[line->len++] = digits[--n];
+}
+
+const char *dvpnlib_state_name(int state)
+{
+	switch (state) {
+	case VPN_CONN_STATE_IDLE:
+		return "idle";
+	case VPN_CONN_STATE_READY:
+		return "ready";
+	case VPN_CONN_STATE_CONFIGURATION:
+		return "configuration";
+	case VPN_CONN_STATE_DISCONNECT:
+		return "disconnect";
+	case VPN_CONN_STATE_FAILURE:
+		return "failure";
+	default:
+		return "unknown";
+	}
+}
+
+static void format_entry(struct journal_line *line, const char *path,
+				struct dvpnlib_journal_entry *entry)
+{
+	line_put_int(line, entry->time);
+	line_put_str(line, " ");
+	line_put_str(line, path);
+	line_put_str(line, " ");
+
+	switch (entry->event) {
+	case DVPNLIB_JOURNAL_STATE:
+		line_put_str(line, "state ");
+		line_put_str(line, dvpnlib_state_name(entry->a));
+		line_put_str(line, " -> ");
+		line_put_str(line, dvpnlib_state_name(entry->b));
+		break;
+	case DVPNLIB_JOURNAL_PROPERTY:
+		line_put_str(line, "property ");
+		line_put_int(line, entry->code);
+		break;
+	case DVPNLIB_JOURNAL_CALL:
+		line_put_str(line, "call ");
+		line_put_str(line, dvpnlib_stats_method_name(entry->code));
+		line_put_str(line, " timeout ");
+		line_put_int(line, entry->a);
+		break;
+	case DVPNLIB_JOURNAL_REPLY:
+		line_put_str(line, "reply ");
+		line_put_str(line, dvpnlib_stats_method_name(entry->code));
+		line_put_str(line, " error ");
+		line_put_int(line, entry->a);
+		break;
+	case DVPNLIB_JOURNAL_CANCEL:
+		line_put_str(line, "cancel");
+		break;
+	default:
+		line_put_str(line, "event ");
+		line_put_int(line, entry->event);
+		break;
+	}
+
+	line->buf[line->len++] = '\n';
+}
+
+/*
+ * Writes the journal to fd, oldest event first, one line per event.
+ * Returns the number of events written or -1 if writing failed.
+ */
+int dvpnlib_journal_dump(struct dvpnlib_journal *journal,
+				const char *path, int fd)
+{
+	struct dvpnlib_journal_entry copy, *entry;
+	struct journal_line line;
+	guint head, slot;
+	gint seq;
+	int count = 0;
+
+	head = (guint)g_atomic_int_get(&journal->head);
+	slot = head > DVPNLIB_JOURNAL_SIZE ? head - DVPNLIB_JOURNAL_SIZE : 0;
+
+	for (; slot != head; slot++) {
+		entry = &journal->entries[slot & (DVPNLIB_JOURNAL_SIZE - 1)];
+
+		seq = g_atomic_int_get(&entry->seq);
+		if (seq != (gint)(slot + 1))
+			continue;	/* being rewritten */
+
+		copy = *entry;
+		if (g_atomic_int_get(&entry->seq) != seq)
+			continue;
+
+		line.len = 0;
+		format_entry(&line, path, &copy);
+
+		if (write(fd, line.buf, line.len) < 0)
+			return -1;
+
+		count++;
+	}
+
+	return count;
+}
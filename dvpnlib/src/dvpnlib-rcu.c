@@ -0,0 +1,189 @@
+#include "dvpnlib-internal.h"
+
+/*
+ * Epoch based deferred reclamation
+ *
+ * Data shared with readers is replaced, never modified: the writer
+ * publishes the new version with an atomic store and retires the old
+ * one. Readers bracket their accesses with dvpnlib_rcu_read_lock() and
+ * dvpnlib_rcu_read_unlock(), which only store the current epoch in a
+ * per-thread record and never wait.
+ *
+ * Every retirement is stamped with the epoch it happened in and moves
+ * the epoch forward. An object is freed once no thread is still inside
+ * a read section that started in its epoch or before, since such a
+ * thread may have loaded the pointer before it was replaced.
+ * Reclamation runs on the writer side, when something is retired.
+ */
+struct rcu_reader {
+	gint epoch;		/* of the outermost read section, 0 if none */
+	guint nesting;
+	struct rcu_reader *next;
+};
+
+struct rcu_retired {
+	gpointer data;
+	GDestroyNotify destroy;
+	gint epoch;
+};
+
+static void rcu_reader_unregister(gpointer data);
+
+static GPrivate rcu_reader_key = G_PRIVATE_INIT(rcu_reader_unregister);
+static gint rcu_epoch = 1;
+
+/* Guards the reader registry and the retired queue */
+G_LOCK_DEFINE_STATIC(rcu);
+static struct rcu_reader *rcu_readers;
+static GQueue rcu_retired_queue = G_QUEUE_INIT;
+
+static void rcu_reader_unregister(gpointer data)
+{
+	struct rcu_reader *reader = data, **prev;
+
+	G_LOCK(rcu);
+	for (prev = &rcu_readers; *prev != NULL; prev = &(*prev)->next) {
+		if (*prev == reader) {
+			*prev = reader->next;
+			break;
+		}
+	}
+	G_UNLOCK(rcu);
+
+	g_free(reader);
+}
+
+static struct rcu_reader *rcu_reader_get(void)
+{
+	struct rcu_reader *reader;
+
+	reader = g_private_get(&rcu_reader_key);
+	if (reader != NULL)
+		return reader;
+
+	/* First read section of this thread */
+	reader = g_new0(struct rcu_reader, 1);
+
+	G_LOCK(rcu);
+	reader->next = rcu_readers;
+	rcu_readers = reader;
+	G_UNLOCK(rcu);
+
+	g_private_set(&rcu_reader_key, reader);
+
+	return reader;
+}
+
+void dvpnlib_rcu_read_lock(void)
+{
+	struct rcu_reader *reader = rcu_reader_get();
+
+	if (reader->nesting++ == 0)
+		g_atomic_int_set(&reader->epoch,
+				g_atomic_int_get(&rcu_epoch));
+}
+
+void dvpnlib_rcu_read_unlock(void)
+{
+	struct rcu_reader *reader = g_private_get(&rcu_reader_key);
+
+	assert(reader != NULL && reader->nesting > 0);
+
+	if (--reader->nesting == 0)
+		g_atomic_int_set(&reader->epoch, 0);
+}
+
+/* Called with the rcu lock held */
+static gint rcu_oldest_reader(void)
+{
+	struct rcu_reader *reader;
+	gint oldest = G_MAXINT, epoch;
+
+	for (reader = rcu_readers; reader != NULL; reader = reader->next) {
+		epoch = g_atomic_int_get(&reader->epoch);
+		if (epoch != 0 && epoch < oldest)
+			oldest = epoch;
+	}
+
+	return oldest;
+}
+
+static void rcu_free(GList *list)
+{
+	struct rcu_retired *retired;
+	GList *iter;
+
+	for (iter = list; iter != NULL; iter = iter->next) {
+		retired = iter->data;
+		retired->destroy(retired->data);
+		g_free(retired);
+	}
+
+	g_list_free(list);
+}
+
+/* Called with the rcu lock held, returns what can be freed */
+static GList *rcu_collect(void)
+{
+	struct rcu_retired *retired;
+	GList *list = NULL;
+	gint oldest;
+
+	oldest = rcu_oldest_reader();
+
+	while ((retired = g_queue_peek_head(&rcu_retired_queue)) &&
+					retired->epoch < oldest)
+		list = g_list_prepend(list,
+				g_queue_pop_head(&rcu_retired_queue));
+
+	return list;
+}
+
+/*
+ * Frees data with destroy once no reader can hold it any more. The data
+ * must already be unreachable for new readers.
+ */
+void dvpnlib_rcu_retire(gpointer data, GDestroyNotify destroy)
+{
+	struct rcu_retired *retired;
+	GList *list;
+
+	if (data == NULL)
+		return;
+
+	retired = g_new(struct rcu_retired, 1);
+	retired->data = data;
+	retired->destroy = destroy;
+
+	G_LOCK(rcu);
+	retired->epoch = g_atomic_int_add(&rcu_epoch, 1);
+	g_queue_push_tail(&rcu_retired_queue, retired);
+	list = rcu_collect();
+	G_UNLOCK(rcu);
+
+	rcu_free(list);
+}
+
+/*
+ * Waits for the read sections in progress and frees everything retired
+ * so far. Must not be called from inside a read section.
+ */
+void dvpnlib_rcu_synchronize(void)
+{
+	GList *list;
+	gint target;
+
+	target = g_atomic_int_add(&rcu_epoch, 1);
+
+	G_LOCK(rcu);
+	while (rcu_oldest_reader() <= target) {
+		G_UNLOCK(rcu);
+		g_usleep(1000);
+		G_LOCK(rcu);
+	}
+
+	list = rcu_collect();
+	G_UNLOCK(rcu);
+
+	rcu_free(list);
+}
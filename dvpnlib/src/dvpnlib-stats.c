@@ -0,0 +1,119 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn.h"
+
+/*
+ * Per-method D-Bus call statistics
+ *
+ * Every counter is a plain atomic integer, so recording a call costs a
+ * monotonic clock read and a handful of atomic adds, with no lock.
+ */
+
+struct method_stats {
+	gint calls;
+	gint errors;
+	gint in_flight;
+	gint latency[DVPNLIB_STATS_LATENCY_BUCKETS];
+};
+
+static struct method_stats method_stats[DVPNLIB_METHOD_MAX];
+
+static const char *method_names[DVPNLIB_METHOD_OTHER] = {
+	[DVPNLIB_METHOD_CREATE] = "Create",
+	[DVPNLIB_METHOD_REMOVE] = "Remove",
+	[DVPNLIB_METHOD_CONNECT] = "Connect",
+	[DVPNLIB_METHOD_DISCONNECT] = "Disconnect",
+	[DVPNLIB_METHOD_SET_PROPERTY] = "SetProperty",
+	[DVPNLIB_METHOD_CLEAR_PROPERTY] = "ClearProperty",
+	[DVPNLIB_METHOD_GET_CONNECTIONS] = "GetConnections",
+	[DVPNLIB_METHOD_REGISTER_AGENT] = "RegisterAgent",
+	[DVPNLIB_METHOD_UNREGISTER_AGENT] = "UnregisterAgent",
+};
+
+enum dvpnlib_method dvpnlib_stats_method(const char *method)
+{
+	int i;
+
+	for (i = 0; i < DVPNLIB_METHOD_OTHER; i++)
+		if (g_strcmp0(method_names[i], method) == 0)
+			return i;
+
+	return DVPNLIB_METHOD_OTHER;
+}
+
+const char *dvpnlib_stats_method_name(enum dvpnlib_method method)
+{
+	if (method < 0 || method >= DVPNLIB_METHOD_OTHER)
+		return "Other";
+
+	return method_names[method];
+}
+
+/* Returns the start time to be handed to dvpnlib_stats_call_end() */
+gint64 dvpnlib_stats_call_begin(enum dvpnlib_method method)
+{
+	struct method_stats *stats = &method_stats[method];
+
+	g_atomic_int_inc(&stats->calls);
+	g_atomic_int_inc(&stats->in_flight);
+
+	return g_get_monotonic_time();
+}
+
+void dvpnlib_stats_call_end(enum dvpnlib_method method, gint64 start,
+				enum dvpnlib_err result)
+{
+	struct method_stats *stats = &method_stats[method];
+	gint64 elapsed = g_get_monotonic_time() - start;
+	guint bucket = 0;
+
+	if (elapsed > 1)
+		bucket = g_bit_storage(elapsed) - 1;
+	if (bucket >= DVPNLIB_STATS_LATENCY_BUCKETS)
+		bucket = DVPNLIB_STATS_LATENCY_BUCKETS - 1;
+
+	g_atomic_int_inc(&stats->latency[bucket]);
+
+	if (result != DVPNLIB_ERR_NONE)
+		g_atomic_int_inc(&stats->errors);
+
+	g_atomic_int_add(&stats->in_flight, -1);
+}
+
+/*
+ * The counters are read one by one, so a snapshot taken while calls
+ * complete may be off by the calls completing meanwhile.
+ */
+enum dvpnlib_err dvpnlib_get_method_stats(enum dvpnlib_method method,
+				struct dvpnlib_method_stats *stats)
+{
+	struct method_stats *s;
+	int i;
+
+	if (method < 0 || method >= DVPNLIB_METHOD_MAX || stats == NULL)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	s = &method_stats[method];
+
+	stats->calls = g_atomic_int_get(&s->calls);
+	stats->errors = g_atomic_int_get(&s->errors);
+	stats->in_flight = g_atomic_int_get(&s->in_flight);
+	for (i = 0; i < DVPNLIB_STATS_LATENCY_BUCKETS; i++)
+		stats->latency[i] = g_atomic_int_get(&s->latency[i]);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+/* Clears the counters; the in-flight gauges are left alone */
+void dvpnlib_reset_stats(void)
+{
+	int method, i;
+
+	for (method = 0; method < DVPNLIB_METHOD_MAX; method++) {
+		struct method_stats *s = &method_stats[method];
+
+		g_atomic_int_set(&s->calls, 0);
+		g_atomic_int_set(&s->errors, 0);
+		for (i = 0; i < DVPNLIB_STATS_LATENCY_BUCKETS; i++)
+			g_atomic_int_set(&s->latency[i], 0);
+	}
+}
@@ -0,0 +1,647 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-agent.h"
+#include "dvpnlib-vpn-manager.h"
+
+#define VPN_AGENT_INTERFACE "net.connman.vpn.Agent"
+#define VPN_AGENT_ERROR_CANCELED "net.connman.vpn.Agent.Error.Canceled"
+
+static const gchar agent_introspection_xml[] =
+	"<node>"
+	"  <interface name='" VPN_AGENT_INTERFACE "'>"
+	"    <method name='Release'/>"
+	"    <method name='ReportError'>"
+	"      <arg type='o' name='connection' direction='in'/>"
+	"      <arg type='s' name='error' direction='in'/>"
+	"    </method>"
+	"    <method name='RequestInput'>"
+	"      <arg type='o' name='connection' direction='in'/>"
+	"      <arg type='a{sv}' name='fields' direction='in'/>"
+	"      <arg type='a{sv}' name='inputs' direction='out'/>"
+	"    </method>"
+	"    <method name='Cancel'/>"
+	"  </interface>"
+	"</node>";
+
+/*
+ * The object is exported in the context which dispatches the D-Bus
+ * traffic, while the secrets are set from the application's threads:
+ * everything below is guarded by the agent lock.
+ */
+struct agent_secrets {
+	GHashTable *values;	/* field -> value */
+	gint64 expiry;		/* monotonic, 0 if none */
+};
+
+struct agent_request {
+	GDBusMethodInvocation *invocation;
+	gchar *path;
+	GVariant *fields;
+};
+
+struct agent_input_event {
+	struct vpn_connection *connection;
+	gchar **fields;
+};
+
+G_LOCK_DEFINE_STATIC(agent);
+static GHashTable *agent_secrets;	/* path -> struct agent_secrets */
+static GList *agent_requests;		/* struct agent_request, pending */
+static dvpnlib_agent_input_cb agent_input_cb;
+static void *agent_input_cb_data;
+static GDBusConnection *agent_connection;
+static guint agent_registration_id;
+static gboolean agent_registered;	/* with the running connman-vpn */
+static gboolean agent_wanted;		/* by the application */
+
+static void wipe_secret(gpointer data)
+{
+	gchar *value = data;
+
+	memset(value, 0, strlen(value));
+	g_free(value);
+}
+
+static void free_agent_secrets(gpointer data)
+{
+	struct agent_secrets *secrets = data;
+
+	g_hash_table_destroy(secrets->values);
+	g_free(secrets);
+}
+
+static void free_agent_request(struct agent_request *request)
+{
+	g_object_unref(request->invocation);
+	g_free(request->path);
+	g_variant_unref(request->fields);
+	g_free(request);
+}
+
+static void agent_request_cancel(gpointer data)
+{
+	struct agent_request *request = data;
+
+	DBG("%s", request->path);
+
+	g_dbus_method_invocation_return_dbus_error(
+			g_object_ref(request->invocation),
+			VPN_AGENT_ERROR_CANCELED, "Canceled");
+	free_agent_request(request);
+}
+
+/* Called with the agent lock held */
+static struct agent_secrets *agent_secrets_get(const gchar *path)
+{
+	struct agent_secrets *secrets;
+
+	if (agent_secrets == NULL)
+		return NULL;
+
+	secrets = g_hash_table_lookup(agent_secrets, path);
+	if (secrets == NULL)
+		return NULL;
+
+	if (secrets->expiry != 0 &&
+			secrets->expiry <= g_get_monotonic_time()) {
+		DBG("secrets of %s expired", path);
+		g_hash_table_remove(agent_secrets, path);
+		return NULL;
+	}
+
+	return secrets;
+}
+
+/* Called with the agent lock held */
+static gboolean agent_has_alternate(struct agent_secrets *secrets,
+					GVariant *field)
+{
+	const gchar **alternates;
+	gboolean found = FALSE;
+	int i;
+
+	if (!g_variant_lookup(field, "Alternates", "^a&s", &alternates))
+		return FALSE;
+
+	for (i = 0; alternates[i] != NULL && !found; i++)
+		found = g_hash_table_contains(secrets->values, alternates[i]);
+
+	g_free(alternates);
+
+	return found;
+}
+
+/*
+ * Called with the agent lock held. Returns the inputs for the requested
+ * fields, or NULL and the mandatory fields which are missing.
+ */
+static GVariant *agent_answer(const gchar *path, GVariant *fields,
+				gchar ***missing)
+{
+	struct agent_secrets *secrets;
+	GVariantBuilder builder;
+	GPtrArray *absent;
+	GVariantIter iter;
+	const gchar *key, *requirement, *type, *value;
+	GVariant *field;
+
+	secrets = agent_secrets_get(path);
+	absent = g_ptr_array_new();
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+	g_variant_iter_init(&iter, fields);
+	while (g_variant_iter_next(&iter, "{&sv}", &key, &field)) {
+		if (!g_variant_lookup(field, "Requirement", "&s",
+							&requirement))
+			requirement = "optional";
+		if (!g_variant_lookup(field, "Type", "&s", &type))
+			type = "string";
+
+		if (!g_strcmp0(requirement, "informational") ||
+				!g_strcmp0(type, "informational")) {
+			g_variant_unref(field);
+			continue;
+		}
+
+		value = NULL;
+		if (secrets != NULL)
+			value = g_hash_table_lookup(secrets->values, key);
+
+		if (value != NULL && !g_strcmp0(type, "boolean"))
+			g_variant_builder_add(&builder, "{sv}", key,
+					g_variant_new_boolean(
+						!g_strcmp0(value, "true")));
+		else if (value != NULL)
+			g_variant_builder_add(&builder, "{sv}", key,
+					g_variant_new_string(value));
+		else if (!g_strcmp0(requirement, "mandatory") &&
+				(secrets == NULL ||
+				 !agent_has_alternate(secrets, field)))
+			g_ptr_array_add(absent, g_strdup(key));
+
+		g_variant_unref(field);
+	}
+
+	if (absent->len > 0) {
+		g_variant_builder_clear(&builder);
+		g_ptr_array_add(absent, NULL);
+		*missing = (gchar **)g_ptr_array_free(absent, FALSE);
+		return NULL;
+	}
+
+	g_ptr_array_free(absent, TRUE);
+	*missing = NULL;
+
+	return g_variant_builder_end(&builder);
+}
+
+static gboolean agent_input_dispatch(gpointer data)
+{
+	struct agent_input_event *event = data;
+	dvpnlib_agent_input_cb callback;
+	void *user_data;
+
+	G_LOCK(agent);
+	callback = agent_input_cb;
+	user_data = agent_input_cb_data;
+	G_UNLOCK(agent);
+
+	if (callback)
+		callback(event->connection, (const char **)event->fields,
+							user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_agent_input_event(gpointer data)
+{
+	struct agent_input_event *event = data;
+
+	vpn_connection_unref(event->connection);
+	g_strfreev(event->fields);
+	g_free(event);
+}
+
+static void agent_request_input(GDBusMethodInvocation *invocation,
+				GVariant *parameters)
+{
+	struct vpn_connection *connection;
+	struct agent_input_event *event;
+	struct agent_request *request;
+	const gchar *path;
+	GVariant *fields, *inputs;
+	gchar **missing = NULL;
+
+	g_variant_get(parameters, "(&o@a{sv})", &path, &fields);
+
+	connection = get_connection_by_path(path);
+
+	G_LOCK(agent);
+	inputs = agent_answer(path, fields, &missing);
+	if (inputs == NULL && connection != NULL && agent_input_cb != NULL) {
+		request = g_new0(struct agent_request, 1);
+		request->invocation = invocation;
+		request->path = g_strdup(path);
+		request->fields = g_variant_ref(fields);
+		agent_requests = g_list_append(agent_requests, request);
+		invocation = NULL;
+	}
+	G_UNLOCK(agent);
+
+	if (inputs != NULL) {
+		DBG("%s answered from the cache", path);
+		g_dbus_method_invocation_return_value(invocation,
+				g_variant_new("(@a{sv})", inputs));
+	} else if (invocation != NULL) {
+		DBG("%s has no cached secrets", path);
+		g_dbus_method_invocation_return_dbus_error(invocation,
+				VPN_AGENT_ERROR_CANCELED, "No cached secrets");
+	} else {
+		DBG("%s waits for %u fields", path, g_strv_length(missing));
+		event = g_new0(struct agent_input_event, 1);
+		event->connection = vpn_connection_ref(connection);
+		event->fields = missing;
+		missing = NULL;
+		dvpnlib_event_post(agent_input_dispatch, event,
+					free_agent_input_event, FALSE);
+	}
+
+	g_strfreev(missing);
+	g_variant_unref(fields);
+}
+
+/* Called with the agent lock held, returns the requests taken out */
+static GList *agent_take_requests(const gchar *path)
+{
+	GList *iter, *next, *taken = NULL;
+	struct agent_request *request;
+
+	for (iter = agent_requests; iter != NULL; iter = next) {
+		next = iter->next;
+		request = iter->data;
+
+		if (path != NULL && g_strcmp0(request->path, path))
+			continue;
+
+		agent_requests = g_list_remove_link(agent_requests, iter);
+		taken = g_list_concat(taken, iter);
+	}
+
+	return taken;
+}
+
+static void agent_forget_secrets(const gchar *path)
+{
+	GList *requests;
+
+	G_LOCK(agent);
+	if (agent_secrets != NULL)
+		g_hash_table_remove(agent_secrets, path);
+	requests = agent_take_requests(path);
+	G_UNLOCK(agent);
+
+	g_list_free_full(requests, agent_request_cancel);
+}
+
+static void agent_method_call(GDBusConnection *connection,
+				const gchar *sender,
+				const gchar *object_path,
+				const gchar *interface_name,
+				const gchar *method_name,
+				GVariant *parameters,
+				GDBusMethodInvocation *invocation,
+				gpointer user_data)
+{
+	const gchar *path, *error;
+	GList *requests;
+
+	DBG("method_name: %s", method_name);
+
+	if (!g_strcmp0(method_name, "RequestInput")) {
+		agent_request_input(invocation, parameters);
+		return;
+	}
+
+	if (!g_strcmp0(method_name, "ReportError")) {
+		/* The cached secrets may be what was rejected */
+		g_variant_get(parameters, "(&o&s)", &path, &error);
+		WARN("%s: %s", path, error);
+		agent_forget_secrets(path);
+	} else if (!g_strcmp0(method_name, "Release")) {
+		G_LOCK(agent);
+		agent_registered = FALSE;
+		requests = agent_take_requests(NULL);
+		G_UNLOCK(agent);
+
+		g_list_free_full(requests, agent_request_cancel);
+	} else if (!g_strcmp0(method_name, "Cancel")) {
+		G_LOCK(agent);
+		requests = agent_take_requests(NULL);
+		G_UNLOCK(agent);
+
+		g_list_free_full(requests, agent_request_cancel);
+	}
+
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static const GDBusInterfaceVTable agent_vtable = {
+	.method_call = agent_method_call,
+};
+
+/*
+ * Exports the agent object; runs in the context which dispatches the
+ * D-Bus traffic, where its methods are then called.
+ */
+void dvpnlib_agent_export(GDBusConnection *connection)
+{
+	GDBusNodeInfo *info;
+	GError *error = NULL;
+
+	DBG("");
+
+	info = g_dbus_node_info_new_for_xml(agent_introspection_xml, NULL);
+
+	agent_registration_id = g_dbus_connection_register_object(connection,
+					DVPNLIB_AGENT_PATH,
+					info->interfaces[0], &agent_vtable,
+					NULL, NULL, &error);
+	g_dbus_node_info_unref(info);
+
+	if (agent_registration_id == 0) {
+		ERROR("error info: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	agent_connection = g_object_ref(connection);
+
+	G_LOCK(agent);
+	agent_secrets = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, free_agent_secrets);
+	G_UNLOCK(agent);
+}
+
+/* Unregisters the agent if needed; the manager must still be there */
+void dvpnlib_agent_unexport(void)
+{
+	GHashTable *secrets;
+	GList *requests;
+	gboolean registered;
+
+	DBG("");
+
+	G_LOCK(agent);
+	registered = agent_registered;
+	agent_registered = FALSE;
+	agent_wanted = FALSE;
+	agent_input_cb = NULL;
+	agent_input_cb_data = NULL;
+	requests = agent_take_requests(NULL);
+	secrets = agent_secrets;
+	agent_secrets = NULL;
+	G_UNLOCK(agent);
+
+	if (registered)
+		dvpnlib_vpn_manager_unregister_agent(DVPNLIB_AGENT_PATH);
+
+	g_list_free_full(requests, agent_request_cancel);
+	if (secrets != NULL)
+		g_hash_table_destroy(secrets);
+
+	if (agent_connection == NULL)
+		return;
+
+	g_dbus_connection_unregister_object(agent_connection,
+						agent_registration_id);
+	g_object_unref(agent_connection);
+	agent_connection = NULL;
+	agent_registration_id = 0;
+}
+
+void connection_agent_forget(struct vpn_connection *connection)
+{
+	agent_forget_secrets(vpn_connection_get_path(connection));
+}
+
+/* Asynchronous, not to block the context dispatching the D-Bus traffic */
+static void agent_manager_call(const char *method,
+				common_call_reply_cb callback)
+{
+	GCancellable *cancellable;
+	GVariant *value;
+
+	value = g_variant_new("(o)", DVPNLIB_AGENT_PATH);
+	cancellable = get_vpn_manager_cancellable();
+	common_set_interface_call_method(get_vpn_manager_dbus_proxy(),
+					method, &value,
+					DVPNLIB_TIMEOUT_DEFAULT, cancellable,
+					callback, NULL);
+	g_object_unref(cancellable);
+}
+
+static void agent_reregister_reply(enum dvpnlib_err result,
+				GVariant *reply, gpointer user_data)
+{
+	gboolean wanted;
+
+	if (result != DVPNLIB_ERR_NONE) {
+		ERROR("RegisterAgent failed: %d", result);
+		return;
+	}
+
+	G_LOCK(agent);
+	wanted = agent_wanted;
+	agent_registered = wanted;
+	G_UNLOCK(agent);
+
+	/* Unregistered by the application meanwhile */
+	if (!wanted)
+		agent_manager_call("UnregisterAgent", NULL);
+}
+
+/*
+ * Follows the owner of connman-vpn: a new daemon knows no agent, so the
+ * agent the application registered is registered again with it. The
+ * requests of the old one can no longer be answered.
+ */
+void connection_agent_owner_changed(gboolean present)
+{
+	GList *requests;
+	gboolean wanted;
+
+	DBG("present %d", present);
+
+	G_LOCK(agent);
+	agent_registered = FALSE;
+	wanted = agent_wanted;
+	requests = agent_take_requests(NULL);
+	G_UNLOCK(agent);
+
+	g_list_free_full(requests, agent_request_cancel);
+
+	if (!present || !wanted || agent_connection == NULL)
+		return;
+
+	agent_manager_call("RegisterAgent", agent_reregister_reply);
+}
+
+/*
+ * Makes the built-in agent the one connman-vpn asks for input; callback
+ * is invoked in the application's context when cached secrets are not
+ * enough to answer a request.
+ */
+enum dvpnlib_err dvpnlib_agent_register(dvpnlib_agent_input_cb callback,
+					void *user_data)
+{
+	enum dvpnlib_err ret = DVPNLIB_ERR_NONE;
+	dvpnlib_agent_input_cb old_callback;
+	void *old_user_data;
+	gboolean registered;
+
+	DBG("");
+
+	assert(vpn_manager != NULL);
+
+	if (agent_connection == NULL)
+		return DVPNLIB_ERR_NOT_SUPPORTED;
+
+	G_LOCK(agent);
+	old_callback = agent_input_cb;
+	old_user_data = agent_input_cb_data;
+	agent_input_cb = callback;
+	agent_input_cb_data = user_data;
+	registered = agent_registered;
+	G_UNLOCK(agent);
+
+	if (!registered)
+		ret = dvpnlib_vpn_manager_register_agent(DVPNLIB_AGENT_PATH);
+
+	G_LOCK(agent);
+	if (ret == DVPNLIB_ERR_NONE) {
+		agent_registered = TRUE;
+		agent_wanted = TRUE;
+	} else {
+		/* A failed registration leaves the previous one in place */
+		agent_input_cb = old_callback;
+		agent_input_cb_data = old_user_data;
+	}
+	G_UNLOCK(agent);
+
+	return ret;
+}
+
+enum dvpnlib_err dvpnlib_agent_unregister(void)
+{
+	GList *requests;
+	gboolean registered;
+
+	DBG("");
+
+	assert(vpn_manager != NULL);
+
+	G_LOCK(agent);
+	registered = agent_registered;
+	agent_registered = FALSE;
+	agent_wanted = FALSE;
+	agent_input_cb = NULL;
+	agent_input_cb_data = NULL;
+	requests = agent_take_requests(NULL);
+	G_UNLOCK(agent);
+
+	g_list_free_full(requests, agent_request_cancel);
+
+	if (!registered)
+		return DVPNLIB_ERR_NOT_REGISTERED;
+
+	return dvpnlib_vpn_manager_unregister_agent(DVPNLIB_AGENT_PATH);
+}
+
+/*
+ * Caches value for field and restarts the ttl of all the secrets of the
+ * connection. Pending requests of the connection which can now be
+ * answered are.
+ */
+enum dvpnlib_err vpn_connection_set_secret(
+				struct vpn_connection *connection,
+				const char *field, const char *value,
+				unsigned int ttl)
+{
+	struct agent_secrets *secrets;
+	struct agent_request *request;
+	const gchar *path;
+	GList *iter, *next, *answered = NULL;
+	GVariant *inputs;
+	gchar **missing;
+
+	assert(connection != NULL);
+
+	if (field == NULL || value == NULL)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	if (vpn_connection_is_removed(connection))
+		return DVPNLIB_ERR_NOT_FOUND;
+
+	path = vpn_connection_get_path(connection);
+
+	DBG("%s: %s, ttl %u", path, field, ttl);
+
+	G_LOCK(agent);
+	if (agent_secrets == NULL) {
+		G_UNLOCK(agent);
+		return DVPNLIB_ERR_NOT_SUPPORTED;
+	}
+
+	secrets = agent_secrets_get(path);
+	if (secrets == NULL) {
+		secrets = g_new0(struct agent_secrets, 1);
+		secrets->values = g_hash_table_new_full(g_str_hash,
+					g_str_equal, g_free, wipe_secret);
+		g_hash_table_insert(agent_secrets, g_strdup(path), secrets);
+	}
+
+	g_hash_table_replace(secrets->values, g_strdup(field),
+							g_strdup(value));
+	secrets->expiry = ttl == 0 ? 0 :
+		g_get_monotonic_time() + (gint64)ttl * G_USEC_PER_SEC;
+
+	for (iter = agent_requests; iter != NULL; iter = next) {
+		next = iter->next;
+		request = iter->data;
+
+		if (g_strcmp0(request->path, path))
+			continue;
+
+		inputs = agent_answer(path, request->fields, &missing);
+		g_strfreev(missing);
+		if (inputs == NULL)
+			continue;
+
+		agent_requests = g_list_delete_link(agent_requests, iter);
+		g_variant_unref(request->fields);
+		request->fields = g_variant_ref_sink(inputs);
+		answered = g_list_prepend(answered, request);
+	}
+	G_UNLOCK(agent);
+
+	for (iter = answered; iter != NULL; iter = iter->next) {
+		request = iter->data;
+
+		DBG("%s answered", request->path);
+		g_dbus_method_invocation_return_value(
+				g_object_ref(request->invocation),
+				g_variant_new("(@a{sv})", request->fields));
+		free_agent_request(request);
+	}
+	g_list_free(answered);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+void vpn_connection_clear_secrets(struct vpn_connection *connection)
+{
+	assert(connection != NULL);
+
+	DBG("%s", vpn_connection_get_path(connection));
+
+	agent_forget_secrets(vpn_connection_get_path(connection));
+}
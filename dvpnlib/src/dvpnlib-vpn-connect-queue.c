@@ -0,0 +1,253 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connect-queue.h"
+
+/*
+ * Each priority holds a ring of the callers with connects queued, each
+ * caller its own FIFO. A free slot goes to the head caller of the
+ * highest priority, which then moves to the tail of the ring if it has
+ * more: O(1) per connect, whatever the number of callers. Everything is
+ * guarded by the connect queue lock; the connects themselves are started
+ * outside of it.
+ */
+struct connect_caller {
+	GMainContext *context;		/* identity only */
+	enum dvpnlib_connect_priority priority;
+	GQueue requests;
+};
+
+struct connect_request {
+	struct vpn_connection *connection;	/* reference */
+	connect_queue_func start;
+	gpointer data;
+	gint64 enqueued;
+};
+
+G_LOCK_DEFINE_STATIC(connect_queue);
+static unsigned int queue_concurrency;
+static unsigned int queue_in_flight;
+static unsigned int queue_length;
+static GQueue queue_callers[DVPNLIB_CONNECT_PRIORITY_MAX];
+static struct dvpnlib_connect_queue_stats queue_stats;
+
+static void free_connect_request(struct connect_request *request)
+{
+	vpn_connection_unref(request->connection);
+	g_free(request);
+}
+
+/* Called with the connect queue lock held */
+static struct connect_caller *connect_caller_get(
+				enum dvpnlib_connect_priority priority,
+				GMainContext *context)
+{
+	struct connect_caller *caller;
+	GList *iter;
+
+	for (iter = queue_callers[priority].head; iter; iter = iter->next) {
+		caller = iter->data;
+		if (caller->context == context)
+			return caller;
+	}
+
+	caller = g_new0(struct connect_caller, 1);
+	caller->context = context;
+	caller->priority = priority;
+	g_queue_init(&caller->requests);
+	g_queue_push_tail(&queue_callers[priority], caller);
+
+	return caller;
+}
+
+/* Called with the connect queue lock held, NULL without a free slot */
+static struct connect_request *connect_queue_next(void)
+{
+	struct connect_request *request;
+	struct connect_caller *caller;
+	gint64 wait;
+	guint bucket = 0;
+	int priority;
+
+	if (queue_length == 0 || (queue_concurrency != 0 &&
+				queue_in_flight >= queue_concurrency))
+		return NULL;
+
+	for (priority = 0; priority < DVPNLIB_CONNECT_PRIORITY_MAX;
+							priority++)
+		if (!g_queue_is_empty(&queue_callers[priority]))
+			break;
+
+	caller = g_queue_pop_head(&queue_callers[priority]);
+	request = g_queue_pop_head(&caller->requests);
+
+	/* Its turn is over */
+	if (g_queue_is_empty(&caller->requests))
+		g_free(caller);
+	else
+		g_queue_push_tail(&queue_callers[priority], caller);
+
+	queue_length--;
+	queue_in_flight++;
+
+	wait = g_get_monotonic_time() - request->enqueued;
+	if (wait > 1)
+		bucket = g_bit_storage(wait) - 1;
+	if (bucket >= DVPNLIB_STATS_LATENCY_BUCKETS)
+		bucket = DVPNLIB_STATS_LATENCY_BUCKETS - 1;
+
+	queue_stats.dispatched++;
+	queue_stats.wait[bucket]++;
+	queue_stats.wait_total_us += wait;
+	queue_stats.wait_max_us = MAX(queue_stats.wait_max_us, (guint64)wait);
+
+	return request;
+}
+
+/* Starts as many queued connects as there are free slots */
+static void connect_queue_run(void)
+{
+	struct connect_request *request;
+
+	for (;;) {
+		G_LOCK(connect_queue);
+		request = connect_queue_next();
+		G_UNLOCK(connect_queue);
+
+		if (request == NULL)
+			return;
+
+		request->start(request->data, DVPNLIB_ERR_NONE);
+		free_connect_request(request);
+	}
+}
+
+/*
+ * Runs start(data, DVPNLIB_ERR_NONE) once a slot is free, at once if
+ * one is; start() then issues the Connect and connect_queue_release()
+ * is due once it has completed. A connect aborted while queued runs
+ * start(data, DVPNLIB_ERR_OPERATION_ABORTED) instead, and holds no slot.
+ */
+void connect_queue_submit(struct vpn_connection *connection,
+				enum dvpnlib_connect_priority priority,
+				connect_queue_func start, gpointer data)
+{
+	struct connect_request *request;
+	struct connect_caller *caller;
+
+	request = g_new0(struct connect_request, 1);
+	request->connection = vpn_connection_ref(connection);
+	request->start = start;
+	request->data = data;
+	request->enqueued = g_get_monotonic_time();
+
+	G_LOCK(connect_queue);
+	caller = connect_caller_get(priority,
+				g_main_context_get_thread_default());
+	g_queue_push_tail(&caller->requests, request);
+	queue_length++;
+	G_UNLOCK(connect_queue);
+
+	connect_queue_run();
+}
+
+void connect_queue_release(void)
+{
+	G_LOCK(connect_queue);
+	if (queue_in_flight > 0)
+		queue_in_flight--;
+	G_UNLOCK(connect_queue);
+
+	connect_queue_run();
+}
+
+/* Called with the connect queue lock held, returns the requests taken */
+static GList *connect_queue_take(struct vpn_connection *connection)
+{
+	struct connect_request *request;
+	struct connect_caller *caller;
+	GList *taken = NULL, *iter, *next, *link, *next_link;
+	int priority;
+
+	for (priority = 0; priority < DVPNLIB_CONNECT_PRIORITY_MAX;
+							priority++) {
+		for (iter = queue_callers[priority].head; iter; iter = next) {
+			next = iter->next;
+			caller = iter->data;
+
+			for (link = caller->requests.head; link;
+							link = next_link) {
+				next_link = link->next;
+				request = link->data;
+
+				if (connection != NULL &&
+					request->connection != connection)
+					continue;
+
+				g_queue_delete_link(&caller->requests, link);
+				taken = g_list_prepend(taken, request);
+				queue_length--;
+			}
+
+			if (g_queue_is_empty(&caller->requests)) {
+				g_queue_delete_link(&queue_callers[priority],
+									iter);
+				g_free(caller);
+			}
+		}
+	}
+
+	return g_list_reverse(taken);
+}
+
+static void connect_queue_abort_list(GList *requests)
+{
+	struct connect_request *request;
+	GList *iter;
+
+	for (iter = requests; iter != NULL; iter = iter->next) {
+		request = iter->data;
+		request->start(request->data, DVPNLIB_ERR_OPERATION_ABORTED);
+		free_connect_request(request);
+	}
+
+	g_list_free(requests);
+}
+
+/* Aborts the queued connects of connection, all of them for NULL */
+void connect_queue_abort(struct vpn_connection *connection)
+{
+	GList *requests;
+
+	G_LOCK(connect_queue);
+	requests = connect_queue_take(connection);
+	G_UNLOCK(connect_queue);
+
+	connect_queue_abort_list(requests);
+}
+
+/*
+ * Raising the concurrency starts queued connects at once; lowering it
+ * lets the calls in flight complete.
+ */
+void dvpnlib_connect_queue_set_concurrency(unsigned int concurrency)
+{
+	DBG("concurrency: %u", concurrency);
+
+	G_LOCK(connect_queue);
+	queue_concurrency = concurrency;
+	G_UNLOCK(connect_queue);
+
+	connect_queue_run();
+}
+
+void dvpnlib_connect_queue_get_stats(
+				struct dvpnlib_connect_queue_stats *stats)
+{
+	assert(stats != NULL);
+
+	G_LOCK(connect_queue);
+	*stats = queue_stats;
+	stats->concurrency = queue_concurrency;
+	stats->in_flight = queue_in_flight;
+	stats->queued = queue_length;
+	G_UNLOCK(connect_queue);
+}
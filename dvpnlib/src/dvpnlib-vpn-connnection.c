@@ -1,35 +1,89 @@
 #include "dvpnlib-internal.h"
 #include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-trace.h"
+
+/*
+ * Readers never lock: the connection table and the properties of each
+ * connection are immutable records published with an atomic store.
+ * A change builds a new record, publishes it and retires the old one,
+ * which is freed once the read sections that may still see it are over
+ * (see dvpnlib-rcu.c). Only the Type is interned; the other strings are
+ * retired with the record they belong to.
+ *
+ * connection_write_lock serializes the writers, index_lock guards the
+ * secondary indexes of dvpnlib-vpn-index.c.
+ */
+struct connection_table {
+	GList *list;		/* in creation order */
+	GHashTable *by_path;
+	GHashTable *members;	/* set of connections */
+};
 
-static GList *vpn_connection_list;
-static GHashTable *vpn_connection_hash;
+static GMutex connection_write_lock;
+static GRWLock index_lock;
+static struct connection_table *connection_table;
 
 struct connection_property_changed_cb {
 	vpn_connection_property_changed_cb property_changed_cb;
 	void *user_data;
 };
 
+/* Outcomes kept for the percentiles of each connect latency */
+#define CONNECTION_TIMING_SAMPLES	64
+
+struct connection_latency {
+	gint64 last;
+	gint64 min;
+	gint64 max;
+	guint count;
+	gint64 samples[CONNECTION_TIMING_SAMPLES];	/* ring */
+};
+
+struct connection_timing {
+	guint attempts;
+	gint64 connect_start;	/* monotonic; 0 when no attempt was made */
+	gboolean finished;	/* ready or failure seen for this attempt */
+	gint64 connect_reply;
+	gint64 configuration;
+	gint64 ipv4;
+	gint64 nameservers;
+	struct connection_latency ready;
+	struct connection_latency failure;
+};
+
 struct vpn_connection {
+	gint ref_count;
+	gint removed;		/* no longer in the connection table */
+	GMutex lock;		/* cancellable, property_changed_cb_hash,
+				 * timing, connecting, disconnecting */
 	GDBusProxy *dbus_proxy;
-	gchar *type;
+	GCancellable *cancellable;
 	gchar *path;
-	gchar *name;
-	gchar *domain;
-	gchar *host;
-	gboolean immutable;
-	gint index;
-	enum vpn_connection_state state;
-	struct vpn_connection_ipv4 *ipv4;
-	struct vpn_connection_ipv6 *ipv6;
-	gchar **nameservers;
-	GSList *user_routes; /*struct vpn_connection_route */
-	GSList *server_routes; /* struct vpn_connection_route */
+	struct vpn_connection_snapshot *snapshot;	/* published */
 	GHashTable *property_changed_cb_hash;
+	struct connection_timing timing;
+	struct dvpnlib_journal journal;
+	struct connection_index_node index_node;	/* under index_lock */
+	struct connect_pending *connecting;	/* Connect in progress */
+	struct disconnect_call *disconnecting;	/* Disconnect in flight */
 };
 
 static void free_vpn_connection_ipv4(struct vpn_connection_ipv4 *ipv4_info);
 static void free_vpn_connection_ipv6(struct vpn_connection_ipv6 *ipv6_info);
 static void free_vpn_connection_route(gpointer data);
+static void release_vpn_connection(struct vpn_connection *connection);
+
+static GCancellable *connection_ref_cancellable(
+				struct vpn_connection *connection)
+{
+	GCancellable *cancellable;
+
+	g_mutex_lock(&connection->lock);
+	cancellable = g_object_ref(connection->cancellable);
+	g_mutex_unlock(&connection->lock);
+
+	return cancellable;
+}
 
 enum dvpnlib_err
 vpn_connection_set_user_routes(struct vpn_connection *connection,
@@ -83,8 +137,19 @@ vpn_connection_set_user_routes(struct vpn_connection *connection,
 
 	user_routes_v = g_variant_builder_end(&user_routes_b);
 
-	return common_set_property(connection->dbus_proxy, "UserRoutes",
-			user_routes_v);
+	GCancellable *cancellable = connection_ref_cancellable(connection);
+	enum dvpnlib_err ret;
+
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_CALL,
+			DVPNLIB_METHOD_SET_PROPERTY, DVPNLIB_TIMEOUT_DEFAULT, 0);
+	ret = common_set_property(connection->dbus_proxy, "UserRoutes",
+			user_routes_v, DVPNLIB_TIMEOUT_DEFAULT, cancellable);
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_REPLY,
+			DVPNLIB_METHOD_SET_PROPERTY, ret, 0);
+
+	g_object_unref(cancellable);
+
+	return ret;
 
 }
 
@@ -98,7 +163,7 @@ static struct connection_property_changed_cb
 }
 
 static void parse_connection_property_ipv4(
-				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
 				GVariant *ipv4)
 {
 	DBG("");
@@ -113,11 +178,9 @@ static void parse_connection_property_ipv4(
 		return;
 	}
 
-	if (connection->ipv4)
-		free_vpn_connection_ipv4(connection->ipv4);
-
-	connection->ipv4 = g_try_new0(struct vpn_connection_ipv4, 1);
-	if (connection->ipv4 == NULL) {
+	/* The previous value is retired when the record is published */
+	snapshot->ipv4 = g_try_new0(struct vpn_connection_ipv4, 1);
+	if (snapshot->ipv4 == NULL) {
 		ERROR("no memory");
 		g_variant_iter_free(iter);
 		return;
@@ -128,22 +191,22 @@ static void parse_connection_property_ipv4(
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Address is %s", property_value);
-			connection->ipv4->address = g_strdup(property_value);
+			snapshot->ipv4->address = g_strdup(property_value);
 		} else if (!g_strcmp0(key, "Netmask")) {
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Netmask is %s", property_value);
-			connection->ipv4->netmask = g_strdup(property_value);
+			snapshot->ipv4->netmask = g_strdup(property_value);
 		} else if (!g_strcmp0(key, "Gateway")) {
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Gateway is %s", property_value);
-			connection->ipv4->gateway = g_strdup(property_value);
+			snapshot->ipv4->gateway = g_strdup(property_value);
 		} else if (!g_strcmp0(key, "Peer")) {
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Peer is %s", property_value);
-			connection->ipv4->peer = g_strdup(property_value);
+			snapshot->ipv4->peer = g_strdup(property_value);
 		}
 	}
 
@@ -151,7 +214,7 @@ static void parse_connection_property_ipv4(
 }
 
 static void parse_connection_property_ipv6(
-				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
 				GVariant *ipv6)
 {
 	DBG("");
@@ -166,11 +229,8 @@ static void parse_connection_property_ipv6(
 		return;
 	}
 
-	if (connection->ipv6)
-		free_vpn_connection_ipv6(connection->ipv6);
-
-	connection->ipv6 = g_try_new0(struct vpn_connection_ipv6, 1);
-	if (connection->ipv6 == NULL) {
+	snapshot->ipv6 = g_try_new0(struct vpn_connection_ipv6, 1);
+	if (snapshot->ipv6 == NULL) {
 		ERROR("no memory");
 		g_variant_iter_free(iter);
 		return;
@@ -181,23 +241,23 @@ static void parse_connection_property_ipv6(
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Address is %s", property_value);
-			connection->ipv6->address = g_strdup(property_value);
+			snapshot->ipv6->address = g_strdup(property_value);
 		} else if (!g_strcmp0(key, "PrefixLength")) {
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("PrefixLength is %s", property_value);
-			connection->ipv6->prefix_length =
+			snapshot->ipv6->prefix_length =
 				g_strdup(property_value);
 		} else if (!g_strcmp0(key, "Gateway")) {
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Gateway is %s", property_value);
-			connection->ipv6->gateway = g_strdup(property_value);
+			snapshot->ipv6->gateway = g_strdup(property_value);
 		} else if (!g_strcmp0(key, "Peer")) {
 			const char *property_value =
 				g_variant_get_string(value, NULL);
 			DBG("Peer is %s", property_value);
-			connection->ipv6->peer = g_strdup(property_value);
+			snapshot->ipv6->peer = g_strdup(property_value);
 		}
 	}
 
@@ -205,7 +265,7 @@ static void parse_connection_property_ipv6(
 }
 
 static void parse_connection_property_nameservers(
-				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
 				GVariant *nameservers)
 {
 	DBG("");
@@ -220,10 +280,9 @@ static void parse_connection_property_nameservers(
 		return;
 	}
 
-	g_strfreev(connection->nameservers);
 	n = g_variant_iter_n_children(iter);
-	connection->nameservers = g_try_new0(char *, n+1);
-	if (connection->nameservers == NULL) {
+	snapshot->nameservers = g_try_new0(char *, n+1);
+	if (snapshot->nameservers == NULL) {
 		ERROR("no memory");
 		g_variant_iter_free(iter);
 		return;
@@ -231,23 +290,28 @@ static void parse_connection_property_nameservers(
 
 	while (g_variant_iter_loop(iter, "s", &value) && i < n) {
 		DBG("Nameserver Entry is %s", value);
-		connection->nameservers[i] = g_strdup(value);
+		snapshot->nameservers[i] = g_strdup(value);
 		i++;
 	}
-	connection->nameservers[n] = NULL;
+	snapshot->nameservers[n] = NULL;
 
 	g_variant_iter_free(iter);
 }
 
 static void print_variant(const gchar *s, GVariant *v)
 {
-	gchar *temp = g_variant_print(v, true);
+	gchar *temp;
+
+	if (!DBG_ENABLED())
+		return;
+
+	temp = g_variant_print(v, true);
 	DBG("%s => %s", s, temp);
 	g_free(temp);
 }
 
 static void parse_connection_property_user_routes(
-				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
 				GVariant *user_routes)
 {
 	DBG("");
@@ -257,16 +321,9 @@ static void parse_connection_property_user_routes(
 
 	print_variant("Incoming : ", user_routes);
 
-	g_variant_iter_init(&outer, user_routes);
-	if (g_variant_iter_n_children(&outer) == 0)
-		return;
+	snapshot->user_routes = NULL;
 
-	if (connection->user_routes == NULL) {
-		ERROR("connection->server_routes is NULL");
-		return;
-	} else
-		g_slist_free_full(connection->user_routes,
-				free_vpn_connection_route);
+	g_variant_iter_init(&outer, user_routes);
 
 	while (g_variant_iter_loop(&outer, "(a{sv})", &route_entry)) {
 		gchar *key;
@@ -306,14 +363,14 @@ static void parse_connection_property_user_routes(
 		}
 
 		/*TODO: See if g_slist_prepend works better*/
-		connection->user_routes =
-			g_slist_append(connection->user_routes, route);
+		snapshot->user_routes =
+			g_slist_append(snapshot->user_routes, route);
 
 	}
 }
 
 static void parse_connection_property_server_routes(
-				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
 				GVariant *server_routes)
 {
 	DBG("");
@@ -321,16 +378,9 @@ static void parse_connection_property_server_routes(
 	GVariantIter outer;
 	GVariantIter *route_entry;
 
-	g_variant_iter_init(&outer, server_routes);
-	if (g_variant_iter_n_children(&outer) == 0)
-		return;
+	snapshot->server_routes = NULL;
 
-	if (connection->server_routes == NULL) {
-		ERROR("connection->server_routes is NULL");
-		return;
-	} else
-		g_slist_free_full(connection->server_routes,
-				free_vpn_connection_route);
+	g_variant_iter_init(&outer, server_routes);
 
 	while (g_variant_iter_loop(&outer, "(a{sv})", &route_entry)) {
 		gchar *key;
@@ -370,63 +420,234 @@ static void parse_connection_property_server_routes(
 		}
 
 		/*TODO: See if g_slist_prepend works better*/
-		connection->server_routes =
-			g_slist_append(connection->server_routes, route);
+		snapshot->server_routes =
+			g_slist_append(snapshot->server_routes, route);
+	}
+}
+
+/*
+ * Connect timing
+ *
+ * Each phase of an attempt is stamped relative to its Connect call: the
+ * Connect reply, the "configuration" state, the arrival of IPv4 and of
+ * Nameservers, and the outcome ("ready", or "failure" / an error
+ * reply). Only the first occurrence of a phase in an attempt counts.
+ */
+enum connection_phase {
+	CONNECTION_PHASE_REPLY,
+	CONNECTION_PHASE_CONFIGURATION,
+	CONNECTION_PHASE_IPV4,
+	CONNECTION_PHASE_NAMESERVERS,
+	CONNECTION_PHASE_READY,
+	CONNECTION_PHASE_FAILURE,
+};
+
+static void connection_latency_add(struct connection_latency *latency,
+					gint64 elapsed)
+{
+	if (latency->count == 0 || elapsed < latency->min)
+		latency->min = elapsed;
+	if (latency->count == 0 || elapsed > latency->max)
+		latency->max = elapsed;
+
+	latency->last = elapsed;
+	latency->samples[latency->count % CONNECTION_TIMING_SAMPLES] = elapsed;
+	latency->count++;
+}
+
+static void connection_timing_start(struct vpn_connection *connection)
+{
+	struct connection_timing *timing = &connection->timing;
+
+	g_mutex_lock(&connection->lock);
+	timing->attempts++;
+	timing->connect_start = g_get_monotonic_time();
+	timing->finished = FALSE;
+	timing->connect_reply = -1;
+	timing->configuration = -1;
+	timing->ipv4 = -1;
+	timing->nameservers = -1;
+	g_mutex_unlock(&connection->lock);
+}
+
+static void connection_timing_mark(struct vpn_connection *connection,
+					enum connection_phase phase)
+{
+	struct connection_timing *timing = &connection->timing;
+	gint64 elapsed;
+
+	g_mutex_lock(&connection->lock);
+
+	if (timing->connect_start == 0)
+		goto out;
+
+	elapsed = g_get_monotonic_time() - timing->connect_start;
+
+	switch (phase) {
+	case CONNECTION_PHASE_REPLY:
+		if (timing->connect_reply < 0)
+			timing->connect_reply = elapsed;
+		break;
+	case CONNECTION_PHASE_CONFIGURATION:
+		if (timing->configuration < 0)
+			timing->configuration = elapsed;
+		break;
+	case CONNECTION_PHASE_IPV4:
+		if (timing->ipv4 < 0)
+			timing->ipv4 = elapsed;
+		break;
+	case CONNECTION_PHASE_NAMESERVERS:
+		if (timing->nameservers < 0)
+			timing->nameservers = elapsed;
+		break;
+	case CONNECTION_PHASE_READY:
+		if (!timing->finished)
+			connection_latency_add(&timing->ready, elapsed);
+		timing->finished = TRUE;
+		break;
+	case CONNECTION_PHASE_FAILURE:
+		if (!timing->finished)
+			connection_latency_add(&timing->failure, elapsed);
+		timing->finished = TRUE;
+		break;
+	}
+
+out:
+	g_mutex_unlock(&connection->lock);
+}
+
+static gint compare_gint64(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a;
+	gint64 y = *(const gint64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void connection_latency_summary(struct connection_latency *latency,
+				struct vpn_connection_latency *summary)
+{
+	gint64 sorted[CONNECTION_TIMING_SAMPLES];
+	guint n;
+
+	summary->samples = latency->count;
+	if (latency->count == 0) {
+		summary->last = summary->min = summary->max = -1;
+		summary->p50 = summary->p90 = summary->p99 = -1;
+		return;
+	}
+
+	summary->last = latency->last;
+	summary->min = latency->min;
+	summary->max = latency->max;
+
+	n = MIN(latency->count, CONNECTION_TIMING_SAMPLES);
+	memcpy(sorted, latency->samples, n * sizeof(gint64));
+	qsort(sorted, n, sizeof(gint64), compare_gint64);
+
+	summary->p50 = sorted[(n - 1) * 50 / 100];
+	summary->p90 = sorted[(n - 1) * 90 / 100];
+	summary->p99 = sorted[(n - 1) * 99 / 100];
+}
+
+void vpn_connection_get_timing(struct vpn_connection *connection,
+				struct vpn_connection_timing *timing)
+{
+	struct connection_timing *t;
+
+	assert(connection != NULL);
+	assert(timing != NULL);
+
+	t = &connection->timing;
+
+	g_mutex_lock(&connection->lock);
+
+	timing->attempts = t->attempts;
+	if (t->connect_start == 0) {
+		timing->connect_reply = -1;
+		timing->configuration = -1;
+		timing->ipv4 = -1;
+		timing->nameservers = -1;
+	} else {
+		timing->connect_reply = t->connect_reply;
+		timing->configuration = t->configuration;
+		timing->ipv4 = t->ipv4;
+		timing->nameservers = t->nameservers;
 	}
+	connection_latency_summary(&t->ready, &timing->time_to_ready);
+	connection_latency_summary(&t->failure, &timing->time_to_failure);
+
+	g_mutex_unlock(&connection->lock);
 }
 
+/* Stores the property in snapshot, the record being built */
 static enum vpn_connection_property_type parse_connection_property(
-					struct vpn_connection *connection,
-					gchar *key, GVariant *value)
+				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
+				gchar *key, GVariant *value)
 {
 	assert(connection != NULL);
 	enum vpn_connection_property_type property_type = VPN_CONN_PROP_NONE;
 
 	if (!g_strcmp0(key, "State")) {
 		const gchar *property_value;
+		enum vpn_connection_state state = VPN_CONN_STATE_UNKNOWN;
 		property_value = g_variant_get_string(value, NULL);
 		DBG("connection state is %s", property_value);
 		if (!g_strcmp0(property_value, "idle"))
-			connection->state = VPN_CONN_STATE_IDLE;
+			state = VPN_CONN_STATE_IDLE;
 		else if (!g_strcmp0(property_value, "failure"))
-			connection->state = VPN_CONN_STATE_FAILURE;
+			state = VPN_CONN_STATE_FAILURE;
 		else if (!g_strcmp0(property_value, "configuration"))
-			connection->state = VPN_CONN_STATE_CONFIGURATION;
+			state = VPN_CONN_STATE_CONFIGURATION;
 		else if (!g_strcmp0(property_value, "ready"))
-			connection->state = VPN_CONN_STATE_READY;
+			state = VPN_CONN_STATE_READY;
 		else if (!g_strcmp0(property_value, "disconnect"))
-			connection->state = VPN_CONN_STATE_DISCONNECT;
+			state = VPN_CONN_STATE_DISCONNECT;
+		if (state != VPN_CONN_STATE_UNKNOWN) {
+			TRACE_STATE(connection, connection->path,
+						snapshot->state, state);
+			dvpnlib_journal_record(&connection->journal,
+					DVPNLIB_JOURNAL_STATE, 0,
+					snapshot->state, state);
+			snapshot->state = state;
+		}
+		if (state == VPN_CONN_STATE_CONFIGURATION)
+			connection_timing_mark(connection,
+					CONNECTION_PHASE_CONFIGURATION);
+		else if (state == VPN_CONN_STATE_READY)
+			connection_timing_mark(connection,
+					CONNECTION_PHASE_READY);
+		else if (state == VPN_CONN_STATE_FAILURE)
+			connection_timing_mark(connection,
+					CONNECTION_PHASE_FAILURE);
 		property_type = VPN_CONN_PROP_STATE;
 	} else if (!g_strcmp0(key, "Type")) {
 		const gchar *property_value;
 		property_value = g_variant_get_string(value, NULL);
 		DBG("connection type is %s", property_value);
-		g_free(connection->type);
-		connection->type = g_strdup(property_value);
+		snapshot->type = g_intern_string(property_value);
 		property_type = VPN_CONN_PROP_TYPE;
 	} else if (!g_strcmp0(key, "Name")) {
 		const gchar *property_value;
 		property_value = g_variant_get_string(value, NULL);
-		g_free(connection->name);
-		connection->name = g_strdup(property_value);
+		snapshot->name = g_strdup(property_value);
 		property_type = VPN_CONN_PROP_NAME;
 	} else if (!g_strcmp0(key, "Domain")) {
 		const gchar *property_value;
 		property_value = g_variant_get_string(value, NULL);
-		g_free(connection->domain);
-		connection->domain = g_strdup(property_value);
+		snapshot->domain = g_strdup(property_value);
 		property_type = VPN_CONN_PROP_DOMAIN;
 	} else if (!g_strcmp0(key, "Host")) {
 		const gchar *property_value;
 		property_value = g_variant_get_string(value, NULL);
-		g_free(connection->host);
-		connection->host = g_strdup(property_value);
+		snapshot->host = g_strdup(property_value);
 		property_type = VPN_CONN_PROP_HOST;
 	} else if (!g_strcmp0(key, "Immutable")) {
-		connection->immutable = g_variant_get_boolean(value);
+		snapshot->immutable = g_variant_get_boolean(value);
 		property_type = VPN_CONN_PROP_IMMUTABLE;
 	} else if (!g_strcmp0(key, "Index")) {
-		connection->index = g_variant_get_int32(value);
+		snapshot->index = g_variant_get_int32(value);
 		property_type = VPN_CONN_PROP_INDEX;
 	}
 	/* TODO:
@@ -435,19 +656,22 @@ static enum vpn_connection_property_type parse_connection_property(
 	 * Parsing code */
 
 	else if (!g_strcmp0(key, "IPv4")) {
-		parse_connection_property_ipv4(connection, value);
+		parse_connection_property_ipv4(snapshot, value);
+		connection_timing_mark(connection, CONNECTION_PHASE_IPV4);
 		property_type = VPN_CONN_PROP_IPV4;
 	} else if (!g_strcmp0(key, "IPv6")) {
-		parse_connection_property_ipv6(connection, value);
+		parse_connection_property_ipv6(snapshot, value);
 		property_type = VPN_CONN_PROP_IPV6;
 	} else if (!g_strcmp0(key, "Nameservers")) {
-		parse_connection_property_nameservers(connection, value);
-		property_type = VPN_CONN_PROP_USERROUTES;
+		parse_connection_property_nameservers(snapshot, value);
+		connection_timing_mark(connection,
+					CONNECTION_PHASE_NAMESERVERS);
+		property_type = VPN_CONN_PROP_NAMESERVERS;
 	} else if (!g_strcmp0(key, "UserRoutes")) {
-		parse_connection_property_user_routes(connection, value);
+		parse_connection_property_user_routes(snapshot, value);
 		property_type = VPN_CONN_PROP_USERROUTES;
 	} else if (!g_strcmp0(key, "ServerRoutes")) {
-		parse_connection_property_server_routes(connection, value);
+		parse_connection_property_server_routes(snapshot, value);
 		property_type = VPN_CONN_PROP_SERVERROUTES;
 	}
 
@@ -456,47 +680,210 @@ static enum vpn_connection_property_type parse_connection_property(
 
 static void parse_connection_properties(
 				struct vpn_connection *connection,
+				struct vpn_connection_snapshot *snapshot,
 				GVariantIter *properties)
 {
 	gchar *key;
 	GVariant *value;
 
 	while (g_variant_iter_next(properties, "{sv}", &key, &value)) {
-		parse_connection_property(connection, key, value);
+		parse_connection_property(connection, snapshot, key, value);
 
 		g_free(key);
 		g_variant_unref(value);
 	}
 }
 
+static void free_route_list(gpointer data)
+{
+	g_slist_free_full(data, free_vpn_connection_route);
+}
+
+static void free_connection_snapshot(struct vpn_connection_snapshot *snapshot)
+{
+	if (snapshot->ipv4)
+		free_vpn_connection_ipv4(snapshot->ipv4);
+
+	if (snapshot->ipv6)
+		free_vpn_connection_ipv6(snapshot->ipv6);
+
+	g_strfreev(snapshot->nameservers);
+	free_route_list(snapshot->user_routes);
+	free_route_list(snapshot->server_routes);
+
+	g_free(snapshot->name);
+	g_free(snapshot->domain);
+	g_free(snapshot->host);
+	g_free(snapshot);
+}
+
+static struct vpn_connection_snapshot *connection_snapshot(
+				struct vpn_connection *connection)
+{
+	return g_atomic_pointer_get(&connection->snapshot);
+}
+
+/*
+ * Replaces the record of the connection with next, which started as a
+ * copy of it. Whatever next no longer shares with the old record is
+ * retired with it. Called with connection_write_lock held.
+ */
+static void connection_publish(struct vpn_connection *connection,
+				struct vpn_connection_snapshot *next)
+{
+	struct vpn_connection_snapshot *old = connection->snapshot;
+
+	next->version = old->version + 1;
+	g_atomic_pointer_set(&connection->snapshot, next);
+
+	if (old->ipv4 != next->ipv4)
+		dvpnlib_rcu_retire(old->ipv4,
+			(GDestroyNotify)free_vpn_connection_ipv4);
+	if (old->ipv6 != next->ipv6)
+		dvpnlib_rcu_retire(old->ipv6,
+			(GDestroyNotify)free_vpn_connection_ipv6);
+	if (old->nameservers != next->nameservers)
+		dvpnlib_rcu_retire(old->nameservers,
+			(GDestroyNotify)g_strfreev);
+	if (old->user_routes != next->user_routes)
+		dvpnlib_rcu_retire(old->user_routes, free_route_list);
+	if (old->server_routes != next->server_routes)
+		dvpnlib_rcu_retire(old->server_routes, free_route_list);
+	if (old->name != next->name)
+		dvpnlib_rcu_retire(old->name, g_free);
+	if (old->domain != next->domain)
+		dvpnlib_rcu_retire(old->domain, g_free);
+	if (old->host != next->host)
+		dvpnlib_rcu_retire(old->host, g_free);
+
+	dvpnlib_rcu_retire(old, g_free);
+}
+
+static void connection_reindex(struct vpn_connection *connection,
+				enum vpn_connection_property_type type)
+{
+	struct vpn_connection_snapshot *snapshot = connection->snapshot;
+
+	switch (type) {
+	case VPN_CONN_PROP_STATE:
+	case VPN_CONN_PROP_TYPE:
+	case VPN_CONN_PROP_DOMAIN:
+	case VPN_CONN_PROP_NAME:
+		g_rw_lock_writer_lock(&index_lock);
+		connection_index_update(&connection->index_node,
+				snapshot->state, snapshot->type,
+				snapshot->domain, snapshot->name);
+		g_rw_lock_writer_unlock(&index_lock);
+		break;
+	default:
+		break;
+	}
+}
+
+struct property_event {
+	struct vpn_connection *connection;
+	enum vpn_connection_property_type property_type;
+};
+
+static gboolean property_event_dispatch(gpointer data)
+{
+	struct property_event *event = data;
+	struct vpn_connection *connection = event->connection;
+	struct connection_property_changed_cb *property_changed_cb_t;
+	struct connection_property_changed_cb property_changed_cb = {0,};
+
+	DBG("Now check property changed callback");
+
+	g_mutex_lock(&connection->lock);
+	property_changed_cb_t = get_connection_property_changed_cb(
+						connection,
+						event->property_type);
+	if (property_changed_cb_t != NULL)
+		property_changed_cb = *property_changed_cb_t;
+	g_mutex_unlock(&connection->lock);
+
+	if (property_changed_cb.property_changed_cb != NULL) {
+		DBG("property changed callback has been set");
+		property_changed_cb.property_changed_cb(connection,
+				property_changed_cb.user_data);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_property_event(gpointer data)
+{
+	struct property_event *event = data;
+
+	vpn_connection_unref(event->connection);
+	g_free(event);
+}
+
+static void post_property_changed(struct vpn_connection *connection,
+				enum vpn_connection_property_type property_type)
+{
+	struct property_event *event;
+
+	/* State changes are journaled with their old and new value */
+	if (property_type != VPN_CONN_PROP_STATE)
+		dvpnlib_journal_record(&connection->journal,
+				DVPNLIB_JOURNAL_PROPERTY, property_type, 0, 0);
+
+	event = g_new0(struct property_event, 1);
+	event->connection = vpn_connection_ref(connection);
+	event->property_type = property_type;
+
+	/*
+	 * The new value is already stored, so a dropped notification
+	 * only loses the wakeup, never the state.
+	 */
+	dvpnlib_event_post(property_event_dispatch, event,
+				free_property_event, TRUE);
+}
+
 static void connection_property_changed(
 				struct vpn_connection *connection,
 				GVariant *parameters)
 {
 	gchar *key;
 	GVariant *value;
+	struct vpn_connection_snapshot *next;
 	enum vpn_connection_property_type property_type;
+	gint state = VPN_CONN_STATE_UNKNOWN;
 
 	DBG("");
 
 	g_variant_get(parameters, "(sv)", &key, &value);
-	property_type = parse_connection_property(connection, key, value);
 
+	g_mutex_lock(&connection_write_lock);
+
+	next = g_new(struct vpn_connection_snapshot, 1);
+	*next = *connection->snapshot;
+
+	property_type = parse_connection_property(connection, next,
+							key, value);
 	if (property_type != VPN_CONN_PROP_NONE) {
-		DBG("Now check property changed callback");
+		state = next->state;
+		connection_publish(connection, next);
+		connection_reindex(connection, property_type);
+	} else {
+		g_free(next);
+	}
 
-		struct connection_property_changed_cb *property_changed_cb_t;
+	g_mutex_unlock(&connection_write_lock);
 
-		property_changed_cb_t = get_connection_property_changed_cb(
-							connection,
-							property_type);
-		if (property_changed_cb_t != NULL) {
-			DBG("property changed callback has been set");
-			property_changed_cb_t->property_changed_cb(connection,
-					property_changed_cb_t->user_data);
-		}
+	if (property_type == VPN_CONN_PROP_STATE &&
+				state == VPN_CONN_STATE_READY)
+		connection_watchdog_disarm(connection);
+
+	if (property_type == VPN_CONN_PROP_STATE) {
+		connection_race_state_changed(connection, state);
+		connection_reconnect_state_changed(connection, state);
 	}
 
+	if (property_type != VPN_CONN_PROP_NONE)
+		post_property_changed(connection, property_type);
+
 	g_free(key);
 	g_variant_unref(value);
 }
@@ -511,6 +898,8 @@ static void connection_signal_handler(GDBusProxy *proxy,
 
 	struct vpn_connection *connection = user_data;
 
+	TRACE_SIGNAL(connection->path, signal_name);
+
 	if (!g_strcmp0(signal_name, "PropertyChanged"))
 		connection_property_changed(connection, parameters);
 }
@@ -523,16 +912,78 @@ static void free_connection_property_changed_cb(gpointer data)
 	g_free(property_changed_cb);
 }
 
-void destroy_vpn_connections(void)
+static void connection_table_free(gpointer data)
 {
-	if (vpn_connection_list != NULL) {
-		g_list_free(vpn_connection_list);
-		vpn_connection_list = NULL;
-	}
-	if (vpn_connection_hash != NULL) {
-		g_hash_table_destroy(vpn_connection_hash);
-		vpn_connection_hash = NULL;
+	struct connection_table *table = data;
+
+	g_list_free(table->list);
+	g_hash_table_destroy(table->by_path);
+	g_hash_table_destroy(table->members);
+	g_free(table);
+}
+
+/* The copy does not own the connections, the published table does */
+static struct connection_table *connection_table_copy(
+				const struct connection_table *old)
+{
+	struct connection_table *table;
+	GList *iter;
+
+	table = g_new0(struct connection_table, 1);
+	table->by_path = g_hash_table_new(g_str_hash, g_str_equal);
+	table->members = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	if (old == NULL)
+		return table;
+
+	table->list = g_list_copy(old->list);
+	for (iter = table->list; iter != NULL; iter = iter->next) {
+		struct vpn_connection *connection = iter->data;
+
+		g_hash_table_insert(table->by_path, connection->path,
+							connection);
+		g_hash_table_add(table->members, connection);
 	}
+
+	return table;
+}
+
+/* Called with connection_write_lock held */
+static void connection_table_publish(struct connection_table *table)
+{
+	struct connection_table *old = connection_table;
+
+	g_atomic_pointer_set(&connection_table, table);
+	dvpnlib_rcu_retire(old, connection_table_free);
+}
+
+/* Valid until the read section it was loaded in ends */
+static struct connection_table *connection_table_get(void)
+{
+	return g_atomic_pointer_get(&connection_table);
+}
+
+void destroy_vpn_connections(void)
+{
+	struct connection_table *table;
+	GList *iter;
+
+	g_mutex_lock(&connection_write_lock);
+	table = connection_table;
+	g_atomic_pointer_set(&connection_table, NULL);
+
+	g_rw_lock_writer_lock(&index_lock);
+	connection_index_clear();
+	g_rw_lock_writer_unlock(&index_lock);
+
+	for (iter = table ? table->list : NULL; iter; iter = iter->next)
+		release_vpn_connection(iter->data);
+
+	dvpnlib_rcu_retire(table, connection_table_free);
+	g_mutex_unlock(&connection_write_lock);
+
+	/* Nothing of the old table outlives the library */
+	dvpnlib_rcu_synchronize();
 }
 
 static struct vpn_connection *create_vpn_connection(
@@ -541,12 +992,13 @@ static struct vpn_connection *create_vpn_connection(
 {
 	GDBusProxy *connection_proxy;
 	struct vpn_connection *connection;
+	struct connection_table *table;
 	GError *error = NULL;
 
 	DBG("");
 
 	connection_proxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM,
-					G_DBUS_PROXY_FLAGS_NONE, NULL,
+				G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL,
 					VPN_NAME, object_path,
 					VPN_CONNECTION_INTERFACE, NULL, &error);
 	if (connection_proxy == NULL) {
@@ -562,25 +1014,38 @@ static struct vpn_connection *create_vpn_connection(
 		return NULL;
 	}
 
+	connection->ref_count = 1;
+	g_mutex_init(&connection->lock);
 	connection->dbus_proxy = connection_proxy;
+	connection->cancellable = g_cancellable_new();
 	connection->path = g_strdup(object_path);
-
-	parse_connection_properties(connection, properties);
-
-	g_hash_table_insert(vpn_connection_hash,
-				(gpointer)connection->path,
-				(gpointer)connection);
-
-	vpn_connection_list = g_list_append(vpn_connection_list,
-						connection);
-
 	connection->property_changed_cb_hash = g_hash_table_new_full(
 					g_direct_hash, g_direct_equal, NULL,
 					free_connection_property_changed_cb);
 
+	connection->snapshot = g_new0(struct vpn_connection_snapshot, 1);
+	parse_connection_properties(connection, connection->snapshot,
+							properties);
+
 	g_signal_connect(connection->dbus_proxy, "g-signal",
 			G_CALLBACK(connection_signal_handler), connection);
 
+	g_mutex_lock(&connection_write_lock);
+	table = connection_table_copy(connection_table);
+	table->list = g_list_append(table->list, connection);
+	g_hash_table_insert(table->by_path, connection->path, connection);
+	g_hash_table_add(table->members, connection);
+	connection_table_publish(table);
+
+	g_rw_lock_writer_lock(&index_lock);
+	connection_index_add(&connection->index_node, connection,
+				connection->snapshot->state,
+				connection->snapshot->type,
+				connection->snapshot->domain,
+				connection->snapshot->name);
+	g_rw_lock_writer_unlock(&index_lock);
+	g_mutex_unlock(&connection_write_lock);
+
 	return connection;
 }
 
@@ -624,14 +1089,14 @@ static void free_vpn_connection_route(gpointer data)
 	g_free(route);
 }
 
-static void free_vpn_connection(gpointer data)
+static void free_vpn_connection(struct vpn_connection *connection)
 {
 	DBG("");
 
-	struct vpn_connection *connection = data;
-
-	if (connection == NULL)
-		return;
+	if (connection->cancellable != NULL) {
+		g_cancellable_cancel(connection->cancellable);
+		g_object_unref(connection->cancellable);
+	}
 
 	if (connection->dbus_proxy != NULL)
 		g_object_unref(connection->dbus_proxy);
@@ -640,27 +1105,76 @@ static void free_vpn_connection(gpointer data)
 		g_hash_table_destroy(connection->property_changed_cb_hash);
 
 	g_free(connection->path);
-	g_free(connection->name);
-	g_free(connection->domain);
-	g_free(connection->host);
 
-	if (connection->ipv4)
-		free_vpn_connection_ipv4(connection->ipv4);
+	if (connection->snapshot != NULL)
+		free_connection_snapshot(connection->snapshot);
 
-	if (connection->ipv6)
-		free_vpn_connection_ipv6(connection->ipv6);
+	g_mutex_clear(&connection->lock);
+	g_free(connection);
+}
 
-	g_strfreev(connection->nameservers);
+struct vpn_connection *vpn_connection_ref(struct vpn_connection *connection)
+{
+	assert(connection != NULL);
 
-	if (connection->user_routes)
-		g_slist_free_full(connection->user_routes,
-				free_vpn_connection_route);
+	g_atomic_int_inc(&connection->ref_count);
 
-	if (connection->server_routes)
-		g_slist_free_full(connection->server_routes,
-				free_vpn_connection_route);
+	return connection;
+}
 
-	g_free(connection);
+void vpn_connection_unref(struct vpn_connection *connection)
+{
+	if (connection == NULL)
+		return;
+
+	if (g_atomic_int_dec_and_test(&connection->ref_count))
+		free_vpn_connection(connection);
+}
+
+/*
+ * Drops the table's reference once the readers that may still see the
+ * connection are done; the signal handler is disconnected right away so
+ * that no PropertyChanged is dispatched to a connection which another
+ * thread may be about to free. Holders of other references see the
+ * connection as removed from now on.
+ */
+static void release_vpn_connection(struct vpn_connection *connection)
+{
+	if (connection == NULL)
+		return;
+
+	g_atomic_int_set(&connection->removed, TRUE);
+	g_signal_handlers_disconnect_by_data(connection->dbus_proxy,
+						connection);
+	connection_reconnect_forget(connection);
+	connection_watchdog_forget(connection);
+	connection_agent_forget(connection);
+	dvpnlib_rcu_retire(connection, (GDestroyNotify)vpn_connection_unref);
+}
+
+/*
+ * Returns a new reference to the connection if it is still in the
+ * connection table, NULL otherwise. Used to validate the handles which
+ * hold no reference; a stale one whose memory went to a newer
+ * connection cannot be told apart.
+ */
+struct vpn_connection *vpn_connection_lookup_ref(
+				struct vpn_connection *connection)
+{
+	struct connection_table *table;
+	struct vpn_connection *found = NULL;
+
+	if (connection == NULL)
+		return NULL;
+
+	/* The handle is not dereferenced unless it is a member */
+	dvpnlib_rcu_read_lock();
+	table = connection_table_get();
+	if (table != NULL && g_hash_table_contains(table->members, connection))
+		found = vpn_connection_ref(connection);
+	dvpnlib_rcu_read_unlock();
+
+	return found;
 }
 
 static void create_vpn_connections(GVariant *connections)
@@ -681,11 +1195,310 @@ static void create_vpn_connections(GVariant *connections)
 	g_variant_iter_free(iter);
 }
 
+static gboolean ipv4_equal(const struct vpn_connection_ipv4 *a,
+				const struct vpn_connection_ipv4 *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	return !g_strcmp0(a->address, b->address) &&
+		!g_strcmp0(a->netmask, b->netmask) &&
+		!g_strcmp0(a->gateway, b->gateway) &&
+		!g_strcmp0(a->peer, b->peer);
+}
+
+static gboolean ipv6_equal(const struct vpn_connection_ipv6 *a,
+				const struct vpn_connection_ipv6 *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	return !g_strcmp0(a->address, b->address) &&
+		!g_strcmp0(a->prefix_length, b->prefix_length) &&
+		!g_strcmp0(a->gateway, b->gateway) &&
+		!g_strcmp0(a->peer, b->peer);
+}
+
+static gboolean strv_equal(gchar **a, gchar **b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	for (; *a && *b; a++, b++)
+		if (g_strcmp0(*a, *b))
+			return FALSE;
+
+	return *a == *b;
+}
+
+static gboolean routes_equal(GSList *a, GSList *b)
+{
+	struct vpn_connection_route *route_a, *route_b;
+
+	for (; a && b; a = a->next, b = b->next) {
+		route_a = a->data;
+		route_b = b->data;
+
+		if (route_a->protocol_family != route_b->protocol_family ||
+			g_strcmp0(route_a->network, route_b->network) ||
+			g_strcmp0(route_a->netmask, route_b->netmask) ||
+			g_strcmp0(route_a->gateway, route_b->gateway))
+			return FALSE;
+	}
+
+	return a == b;
+}
+
+/* Shares old's string instead of an equal copy in *next */
+static gboolean connection_string_keep(gchar *old, gchar **next)
+{
+	if (g_strcmp0(old, *next) != 0)
+		return FALSE;
+
+	if (*next != old) {
+		g_free(*next);
+		*next = old;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Returns TRUE if next holds the same value of the property as old. A
+ * compound value equal to the old one is freed and the old one shared
+ * instead, so that publishing next does not retire it.
+ */
+static gboolean connection_property_keep(
+				const struct vpn_connection_snapshot *old,
+				struct vpn_connection_snapshot *next,
+				enum vpn_connection_property_type type)
+{
+	switch (type) {
+	case VPN_CONN_PROP_STATE:
+		return old->state == next->state;
+	case VPN_CONN_PROP_NAME:
+		return connection_string_keep(old->name, &next->name);
+	case VPN_CONN_PROP_IMMUTABLE:
+		return old->immutable == next->immutable;
+	case VPN_CONN_PROP_DOMAIN:
+		return connection_string_keep(old->domain, &next->domain);
+	case VPN_CONN_PROP_HOST:
+		return connection_string_keep(old->host, &next->host);
+	case VPN_CONN_PROP_TYPE:
+		return old->type == next->type;
+	case VPN_CONN_PROP_INDEX:
+		return old->index == next->index;
+	case VPN_CONN_PROP_IPV4:
+		if (!ipv4_equal(old->ipv4, next->ipv4))
+			return FALSE;
+		if (next->ipv4 != old->ipv4)
+			free_vpn_connection_ipv4(next->ipv4);
+		next->ipv4 = old->ipv4;
+		return TRUE;
+	case VPN_CONN_PROP_IPV6:
+		if (!ipv6_equal(old->ipv6, next->ipv6))
+			return FALSE;
+		if (next->ipv6 != old->ipv6)
+			free_vpn_connection_ipv6(next->ipv6);
+		next->ipv6 = old->ipv6;
+		return TRUE;
+	case VPN_CONN_PROP_NAMESERVERS:
+		if (!strv_equal(old->nameservers, next->nameservers))
+			return FALSE;
+		if (next->nameservers != old->nameservers)
+			g_strfreev(next->nameservers);
+		next->nameservers = old->nameservers;
+		return TRUE;
+	case VPN_CONN_PROP_USERROUTES:
+		if (!routes_equal(old->user_routes, next->user_routes))
+			return FALSE;
+		if (next->user_routes != old->user_routes)
+			free_route_list(next->user_routes);
+		next->user_routes = old->user_routes;
+		return TRUE;
+	case VPN_CONN_PROP_SERVERROUTES:
+		if (!routes_equal(old->server_routes, next->server_routes))
+			return FALSE;
+		if (next->server_routes != old->server_routes)
+			free_route_list(next->server_routes);
+		next->server_routes = old->server_routes;
+		return TRUE;
+	default:
+		return TRUE;
+	}
+}
+
+/*
+ * Clears an optional property of next, freeing its value unless it is
+ * still shared with old. Returns whether old had one.
+ */
+static gboolean connection_property_clear(
+				struct vpn_connection_snapshot *old,
+				struct vpn_connection_snapshot *next,
+				enum vpn_connection_property_type type)
+{
+	switch (type) {
+	case VPN_CONN_PROP_IPV4:
+		if (next->ipv4 && next->ipv4 != old->ipv4)
+			free_vpn_connection_ipv4(next->ipv4);
+		next->ipv4 = NULL;
+		return old->ipv4 != NULL;
+	case VPN_CONN_PROP_IPV6:
+		if (next->ipv6 && next->ipv6 != old->ipv6)
+			free_vpn_connection_ipv6(next->ipv6);
+		next->ipv6 = NULL;
+		return old->ipv6 != NULL;
+	case VPN_CONN_PROP_NAMESERVERS:
+		if (next->nameservers != old->nameservers)
+			g_strfreev(next->nameservers);
+		next->nameservers = NULL;
+		return old->nameservers != NULL;
+	case VPN_CONN_PROP_USERROUTES:
+		if (next->user_routes != old->user_routes)
+			free_route_list(next->user_routes);
+		next->user_routes = NULL;
+		return old->user_routes != NULL;
+	case VPN_CONN_PROP_SERVERROUTES:
+		if (next->server_routes != old->server_routes)
+			free_route_list(next->server_routes);
+		next->server_routes = NULL;
+		return old->server_routes != NULL;
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Brings a known connection up to date with a full set of properties.
+ * Optional properties missing from the set are cleared. Only the
+ * properties that differ are published and notified.
+ */
+static void refresh_vpn_connection(struct vpn_connection *connection,
+					GVariantIter *properties)
+{
+	struct vpn_connection_snapshot *old, *next;
+	enum vpn_connection_property_type type;
+	guint seen = 0, changed = 0;
+	gint state;
+	gchar *key;
+	GVariant *value;
+
+	g_mutex_lock(&connection_write_lock);
+
+	old = connection->snapshot;
+	next = g_new(struct vpn_connection_snapshot, 1);
+	*next = *old;
+
+	while (g_variant_iter_next(properties, "{sv}", &key, &value)) {
+		type = parse_connection_property(connection, next, key, value);
+		if (type != VPN_CONN_PROP_NONE) {
+			seen |= 1 << type;
+			if (!connection_property_keep(old, next, type))
+				changed |= 1 << type;
+		}
+
+		g_free(key);
+		g_variant_unref(value);
+	}
+
+	for (type = VPN_CONN_PROP_IPV4;
+			type <= VPN_CONN_PROP_SERVERROUTES; type++)
+		if (!(seen & 1 << type) &&
+				connection_property_clear(old, next, type))
+			changed |= 1 << type;
+
+	state = next->state;
+	if (changed != 0) {
+		connection_publish(connection, next);
+		/* Updates every indexed property at once */
+		connection_reindex(connection, VPN_CONN_PROP_STATE);
+	} else {
+		g_free(next);
+	}
+
+	g_mutex_unlock(&connection_write_lock);
+
+	if (changed & 1 << VPN_CONN_PROP_STATE &&
+				state == VPN_CONN_STATE_READY)
+		connection_watchdog_disarm(connection);
+
+	if (changed & 1 << VPN_CONN_PROP_STATE) {
+		connection_race_state_changed(connection, state);
+		connection_reconnect_state_changed(connection, state);
+	}
+
+	for (type = VPN_CONN_PROP_STATE;
+			type <= VPN_CONN_PROP_SERVERROUTES; type++)
+		if (changed & 1 << type)
+			post_property_changed(connection, type);
+}
+
+/*
+ * Reconciles the table with the reply of a GetConnections issued after
+ * connman-vpn came back: the connections of the paths still listed are
+ * kept and refreshed. Returns new references to the connections which
+ * were added, and to the ones no longer listed, which the caller
+ * removes. Called in the context which dispatches the D-Bus traffic.
+ */
+void resync_vpn_connections(GVariant *connections, GList **added,
+				GList **stale)
+{
+	struct vpn_connection *connection;
+	GVariantIter *properties;
+	GVariantIter *iter;
+	GHashTable *listed;
+	GList *list;
+	gchar *path;
+
+	*added = NULL;
+	*stale = NULL;
+
+	listed = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	g_variant_get(connections, "(a(oa{sv}))", &iter);
+	while (g_variant_iter_loop(iter, "(oa{sv})", &path, &properties)) {
+		/* Only this context removes connections */
+		connection = get_connection_by_path(path);
+		if (connection != NULL) {
+			refresh_vpn_connection(connection, properties);
+		} else {
+			connection = create_vpn_connection(path, properties);
+			if (connection == NULL)
+				continue;
+			*added = g_list_prepend(*added,
+					vpn_connection_ref(connection));
+		}
+
+		g_hash_table_add(listed, connection);
+	}
+	g_variant_iter_free(iter);
+
+	dvpnlib_rcu_read_lock();
+	for (list = vpn_get_connections(); list != NULL; list = list->next)
+		if (!g_hash_table_contains(listed, list->data))
+			*stale = g_list_prepend(*stale,
+					vpn_connection_ref(list->data));
+	dvpnlib_rcu_read_unlock();
+
+	g_hash_table_destroy(listed);
+
+	*added = g_list_reverse(*added);
+}
+
 struct vpn_connection *get_connection_by_path(const gchar *path)
 {
+	struct connection_table *table;
+	struct vpn_connection *connection = NULL;
+
 	DBG("path: %s", path);
 
-	return g_hash_table_lookup(vpn_connection_hash, (gpointer)path);
+	dvpnlib_rcu_read_lock();
+	table = connection_table_get();
+	if (table != NULL)
+		connection = g_hash_table_lookup(table->by_path, path);
+	dvpnlib_rcu_read_unlock();
+
+	return connection;
 }
 
 gboolean add_vpn_connection(GVariant **parameters,
@@ -698,17 +1511,20 @@ gboolean add_vpn_connection(GVariant **parameters,
 
 	g_variant_get(*parameters, "(oa{sv})", &connection_path, &properties);
 
-	print_str = g_variant_print(*parameters, TRUE);
-	DBG("connection path: %s, parameters: %s", connection_path, print_str);
-	g_free(print_str);
+	if (DBG_ENABLED()) {
+		print_str = g_variant_print(*parameters, TRUE);
+		DBG("connection path: %s, parameters: %s",
+					connection_path, print_str);
+		g_free(print_str);
+	}
 
 	/*
 	 * Lookup if it has existed in the hash table
 	 */
-	*connection = g_hash_table_lookup(vpn_connection_hash,
-						(gpointer) connection_path);
+	*connection = get_connection_by_path(connection_path);
 	if (*connection != NULL) {
-		DBG("Repetitive connection %s", (*connection)->name);
+		DBG("Repetitive connection %s",
+				vpn_connection_get_name(*connection));
 
 		ret = FALSE;
 	} else {
@@ -726,15 +1542,45 @@ gboolean add_vpn_connection(GVariant **parameters,
 
 void remove_vpn_connection(struct vpn_connection *connection)
 {
+	struct connection_table *table;
+
 	DBG("");
 
 	assert(connection != NULL);
 
-	vpn_connection_list = g_list_remove(vpn_connection_list,
-						(gpointer)connection);
+	g_mutex_lock(&connection_write_lock);
+	if (connection_table == NULL ||
+		!g_hash_table_contains(connection_table->members, connection)) {
+		g_mutex_unlock(&connection_write_lock);
+		return;
+	}
+
+	table = connection_table_copy(connection_table);
+	table->list = g_list_remove(table->list, connection);
+	g_hash_table_remove(table->by_path, connection->path);
+	g_hash_table_remove(table->members, connection);
+	connection_table_publish(table);
+
+	g_rw_lock_writer_lock(&index_lock);
+	connection_index_remove(&connection->index_node);
+	g_rw_lock_writer_unlock(&index_lock);
+
+	release_vpn_connection(connection);
+	g_mutex_unlock(&connection_write_lock);
+}
+
+void cancel_vpn_connections(void)
+{
+	struct connection_table *table;
+	GList *iter;
+
+	DBG("");
 
-	g_hash_table_remove(vpn_connection_hash,
-			(gconstpointer)connection->path);
+	dvpnlib_rcu_read_lock();
+	table = connection_table_get();
+	for (iter = table ? table->list : NULL; iter; iter = iter->next)
+		vpn_connection_cancel(iter->data);
+	dvpnlib_rcu_read_unlock();
 }
 
 void sync_vpn_connections(void)
@@ -743,27 +1589,28 @@ void sync_vpn_connections(void)
 
 	gchar *print_str;
 	GVariant *connections;
-	GError *error = NULL;
 
-	connections = g_dbus_proxy_call_sync(get_vpn_manager_dbus_proxy(),
-						"GetConnections", NULL,
-						G_DBUS_CALL_FLAGS_NONE,
-						-1, NULL, &error);
-	if (connections == NULL) {
-		ERROR("error info: %s", error->message);
-		g_error_free(error);
+	GCancellable *cancellable = get_vpn_manager_cancellable();
+
+	connections = common_get_call_method_result(
+					get_vpn_manager_dbus_proxy(),
+					"GetConnections",
+					DVPNLIB_TIMEOUT_DEFAULT,
+					cancellable);
+	g_object_unref(cancellable);
+	if (connections == NULL)
 		return;
-	}
 
-	print_str = g_variant_print(connections, TRUE);
-	DBG("connections: %s", print_str);
-	g_free(print_str);
+	if (DBG_ENABLED()) {
+		print_str = g_variant_print(connections, TRUE);
+		DBG("connections: %s", print_str);
+		g_free(print_str);
+	}
 
-	if (!vpn_connection_hash)
-		vpn_connection_hash = g_hash_table_new_full(
-					g_str_hash, g_str_equal,
-					NULL, free_vpn_connection);
-	DBG("hash: %p", vpn_connection_hash);
+	g_mutex_lock(&connection_write_lock);
+	if (connection_table == NULL)
+		connection_table_publish(connection_table_copy(NULL));
+	g_mutex_unlock(&connection_write_lock);
 
 	create_vpn_connections(connections);
 
@@ -773,11 +1620,29 @@ void sync_vpn_connections(void)
 /**
  * VPN Connection Methods
  */
+/*
+ * The list is owned by the library and is never modified: a change
+ * publishes a new one. When other threads may add or remove connections,
+ * walk it inside vpn_connections_lock_read(), which keeps it and the
+ * records of its connections alive without blocking anybody.
+ */
 GList *vpn_get_connections(void)
 {
+	struct connection_table *table = connection_table_get();
+
 	DBG("");
 
-	return vpn_connection_list;
+	return table ? table->list : NULL;
+}
+
+void vpn_connections_lock_read(void)
+{
+	dvpnlib_rcu_read_lock();
+}
+
+void vpn_connections_unlock_read(void)
+{
+	dvpnlib_rcu_read_unlock();
 }
 
 struct vpn_connection *vpn_get_connection(
@@ -787,18 +1652,69 @@ struct vpn_connection *vpn_get_connection(
 		return NULL;
 
 	GList *iter;
+	struct vpn_connection *found = NULL;
 
-	for (iter = vpn_connection_list; iter != NULL;
+	dvpnlib_rcu_read_lock();
+	for (iter = vpn_get_connections(); iter != NULL;
 	     iter = iter->next) {
 		struct vpn_connection *connection =
 		    (struct vpn_connection *)(iter->data);
 
-		if (g_str_equal(connection->host, host) &&
-				g_str_equal(connection->domain, domain))
-			return connection;
+		if (!g_strcmp0(vpn_connection_get_host(connection), host) &&
+			!g_strcmp0(vpn_connection_get_domain(connection),
+								domain)) {
+			found = connection;
+			break;
+		}
 	}
+	dvpnlib_rcu_read_unlock();
+
+	return found;
+}
+
+/* Returns a new reference, NULL if no connection matches */
+struct vpn_connection *vpn_get_connection_ref(
+					const char *host, const char *domain)
+{
+	struct vpn_connection *found;
+
+	dvpnlib_rcu_read_lock();
+	found = vpn_get_connection(host, domain);
+	if (found != NULL)
+		vpn_connection_ref(found);
+	dvpnlib_rcu_read_unlock();
 
-	return NULL;
+	return found;
+}
+
+/*
+ * Returns a new list of references to the connections matching every
+ * filter that is set, to be freed with
+ * g_list_free_full(list, vpn_connection_unref); the strings need not be
+ * interned.
+ */
+GList *vpn_connections_query(const struct vpn_connection_query *query)
+{
+	const gchar *type = NULL;
+	GList *result;
+
+	assert(query != NULL);
+
+	/* A type nobody interned cannot match any connection */
+	if (query->type != NULL) {
+		type = g_quark_to_string(g_quark_try_string(query->type));
+		if (type == NULL)
+			return NULL;
+	}
+
+	/* A connection leaves the indexes before its table reference */
+	g_rw_lock_reader_lock(&index_lock);
+	result = connection_index_query(query->state, type, query->domain,
+						query->name_prefix);
+	g_list_foreach(result, (GFunc)vpn_connection_ref, NULL);
+	g_rw_lock_reader_unlock(&index_lock);
+
+	return result;
 }
 
 enum dvpnlib_err vpn_connection_clear_property(
@@ -813,19 +1729,121 @@ enum dvpnlib_err vpn_connection_clear_property(
 	 */
 	value = g_variant_new("(s)", "UserRoutes");
 
-	return common_set_interface_call_method_sync(connection->dbus_proxy,
-						"ClearProperty", &value);
+	GCancellable *cancellable = connection_ref_cancellable(connection);
+	enum dvpnlib_err ret;
+
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_CALL,
+			DVPNLIB_METHOD_CLEAR_PROPERTY, DVPNLIB_TIMEOUT_DEFAULT, 0);
+	ret = common_set_interface_call_method_sync(connection->dbus_proxy,
+						"ClearProperty", &value,
+						DVPNLIB_TIMEOUT_DEFAULT,
+						cancellable);
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_REPLY,
+			DVPNLIB_METHOD_CLEAR_PROPERTY, ret, 0);
+	g_object_unref(cancellable);
+
+	return ret;
+}
+
+/*
+ * The Connect in progress on a connection, queued or in flight. Every
+ * caller connecting meanwhile joins it as a waiter instead of issuing a
+ * Connect of its own, which connman-vpn would answer with InProgress,
+ * and they all get its single result. The queue, the reply and an armed
+ * watchdog each hold a reference.
+ */
+struct connect_waiter {
+	dvpnlib_reply_cb callback;
+	void *user_data;
+};
+
+struct connect_pending {
+	gint ref_count;
+	struct vpn_connection *connection;	/* reference */
+	int timeout;
+	GList *waiters;		/* under the connection lock, newest first */
+};
+
+static struct connect_pending *connect_pending_ref(
+				struct connect_pending *pending)
+{
+	g_atomic_int_inc(&pending->ref_count);
+
+	return pending;
+}
+
+static void connect_pending_unref(struct connect_pending *pending)
+{
+	if (!g_atomic_int_dec_and_test(&pending->ref_count))
+		return;
+
+	vpn_connection_unref(pending->connection);
+	g_free(pending);
+}
+
+/*
+ * Delivers result to the callers waiting, once: whoever comes later
+ * starts a new connect.
+ */
+static void connect_pending_finish(struct connect_pending *pending,
+					enum dvpnlib_err result)
+{
+	struct vpn_connection *connection = pending->connection;
+	struct connect_waiter *waiter;
+	GList *waiters, *iter;
+
+	g_mutex_lock(&connection->lock);
+	if (connection->connecting == pending)
+		connection->connecting = NULL;
+	waiters = g_list_reverse(pending->waiters);
+	pending->waiters = NULL;
+	g_mutex_unlock(&connection->lock);
+
+	DBG("%u callers, result %d", g_list_length(waiters), result);
+
+	for (iter = waiters; iter != NULL; iter = iter->next) {
+		waiter = iter->data;
+		common_reply_dispatch(waiter->callback, result,
+						waiter->user_data);
+	}
+
+	g_list_free_full(waiters, g_free);
+}
+
+/* Callback of the connect watchdog, once it has timed the call out */
+static void connect_pending_timeout(enum dvpnlib_err result,
+					void *user_data)
+{
+	struct connect_pending *pending = user_data;
+
+	connect_pending_finish(pending, result);
+	connect_pending_unref(pending);
+}
+
+/*
+ * Returns whether the reply is still to be delivered; the reference of
+ * the watchdog is dropped then, since it will not time the call out.
+ */
+static gboolean connect_settle(struct vpn_connection *connection,
+				struct common_reply_data *reply_data,
+				enum dvpnlib_err result)
+{
+	if (!connection_watchdog_settle(connection, reply_data->attempt,
+								result))
+		return FALSE;
+
+	if (reply_data->attempt != NULL)
+		connect_pending_unref(reply_data->data);
+
+	return TRUE;
 }
 
 /**
  * Asynchronous connect callback
  */
-static void connect_callback(GObject *source_object,
-			     GAsyncResult *res, gpointer user_data)
+static void connect_callback(enum dvpnlib_err result,
+				GVariant *reply, gpointer user_data)
 {
-	GError *error = NULL;
-	enum dvpnlib_err error_type = DVPNLIB_ERR_NONE;
-	GVariant *ret;
 	struct common_reply_data *reply_data;
 	struct vpn_connection *connection;
 
@@ -837,44 +1855,233 @@ static void connect_callback(GObject *source_object,
 	if (!connection)
 		goto done;
 
-	if (!connection->dbus_proxy)
-		goto done;
-
-	ret = g_dbus_proxy_call_finish(connection->dbus_proxy, res, &error);
-	if (!ret) {
-		DBG("%s", error->message);
-		error_type = get_error_type(error);
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_REPLY,
+				DVPNLIB_METHOD_CONNECT, result, 0);
+	connection_timing_mark(connection, CONNECTION_PHASE_REPLY);
+	if (result != DVPNLIB_ERR_NONE)
+		connection_timing_mark(connection, CONNECTION_PHASE_FAILURE);
 
-		g_error_free(error);
-	} else
-		g_variant_unref(ret);
+	/* Unless the watchdog has timed the call out already */
+	if (connect_settle(connection, reply_data, result))
+		connect_pending_finish(reply_data->data, result);
 
-	if (reply_data->cb) {
-		dvpnlib_reply_cb callback = reply_data->cb;
-		callback(error_type, reply_data->data);
-	}
+	connect_pending_unref(reply_data->data);
+	vpn_connection_unref(connection);
 
 done:
 	g_free(reply_data);
+
+	/* The slot of this call goes to the next connect queued */
+	connect_queue_release();
 }
 
 enum dvpnlib_err vpn_connection_connect(struct vpn_connection *connection,
 				 dvpnlib_reply_cb callback,
 				 void *user_data)
 {
-	DBG("");
+	return vpn_connection_connect_with_timeout(connection,
+					DVPNLIB_TIMEOUT_DEFAULT,
+					callback, user_data);
+}
 
-	struct common_reply_data *reply_data;
+enum dvpnlib_err vpn_connection_connect_with_timeout(
+				struct vpn_connection *connection,
+				int timeout,
+				dvpnlib_reply_cb callback,
+				void *user_data)
+{
+	return vpn_connection_connect_with_priority(connection, timeout,
+					DVPNLIB_CONNECT_PRIORITY_NORMAL,
+					callback, user_data);
+}
 
+enum dvpnlib_err vpn_connection_connect_with_priority(
+				struct vpn_connection *connection,
+				int timeout,
+				enum dvpnlib_connect_priority priority,
+				dvpnlib_reply_cb callback,
+				void *user_data)
+{
 	assert(connection != NULL);
 
-	reply_data =
-	    common_reply_data_new(callback, user_data, connection, TRUE);
+	if (priority < DVPNLIB_CONNECT_PRIORITY_HIGH ||
+			priority >= DVPNLIB_CONNECT_PRIORITY_MAX)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	connection_reconnect_reset(connection);
+
+	return connection_connect(connection, timeout, priority,
+						callback, user_data);
+}
+
+/* Issues a connect once the connect queue gives it a slot */
+static void connect_start(gpointer data, enum dvpnlib_err result)
+{
+	struct connect_pending *pending = data;
+	struct vpn_connection *connection = pending->connection;
+	struct common_reply_data *reply_data;
+	GCancellable *cancellable;
+
+	DBG("timeout: %d, result: %d", pending->timeout, result);
 
-	return common_set_interface_call_method(connection->dbus_proxy,
+	/* Aborted while queued, it never held a slot */
+	if (result != DVPNLIB_ERR_NONE) {
+		connect_pending_finish(pending, result);
+		goto done;
+	}
+
+	/* Removed while queued */
+	if (vpn_connection_is_removed(connection)) {
+		result = DVPNLIB_ERR_NOT_FOUND;
+		goto failed;
+	}
+
+	/* The reply holds a reference, it is stamped on the connection */
+	reply_data = common_reply_data_new(NULL, connect_pending_ref(pending),
+					vpn_connection_ref(connection), TRUE);
+	if (reply_data == NULL) {
+		ERROR("no memory");
+		vpn_connection_unref(connection);
+		connect_pending_unref(pending);
+		result = DVPNLIB_ERR_FAILED;
+		goto failed;
+	}
+
+	connection_timing_start(connection);
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_CALL,
+				DVPNLIB_METHOD_CONNECT, pending->timeout, 0);
+
+	/* The deadline counts from the call, not from the queueing */
+	reply_data->attempt = connection_watchdog_arm(connection,
+					connect_pending_timeout, pending);
+	if (reply_data->attempt != NULL)
+		connect_pending_ref(pending);
+
+	cancellable = connection_ref_cancellable(connection);
+	result = common_set_interface_call_method(connection->dbus_proxy,
 					 "Connect", NULL,
-					 (GAsyncReadyCallback)
+					 pending->timeout, cancellable,
 					 connect_callback, reply_data);
+	g_object_unref(cancellable);
+
+	if (result == DVPNLIB_ERR_NONE)
+		goto done;
+
+	connect_settle(connection, reply_data, result);
+	vpn_connection_unref(connection);
+	connect_pending_unref(pending);
+	g_free(reply_data);
+
+failed:
+	connect_pending_finish(pending, result);
+	connect_queue_release();
+
+done:
+	connect_pending_unref(pending);
+}
+
+/*
+ * Connect without overriding the reconnect engine, which uses it. The
+ * connect waits in the connect queue for a slot, so that even a failure
+ * to issue it is reported through the callback. A connect already in
+ * progress is joined, keeping its timeout and priority.
+ */
+enum dvpnlib_err connection_connect(struct vpn_connection *connection,
+				int timeout,
+				enum dvpnlib_connect_priority priority,
+				dvpnlib_reply_cb callback,
+				void *user_data)
+{
+	struct connect_pending *pending;
+	struct connect_waiter *waiter;
+
+	DBG("timeout: %d, priority: %d", timeout, priority);
+
+	assert(connection != NULL);
+
+	waiter = g_new0(struct connect_waiter, 1);
+	waiter->callback = callback;
+	waiter->user_data = user_data;
+
+	g_mutex_lock(&connection->lock);
+	pending = connection->connecting;
+	if (pending != NULL) {
+		pending->waiters = g_list_prepend(pending->waiters, waiter);
+		g_mutex_unlock(&connection->lock);
+
+		DBG("joins the connect in progress");
+		return DVPNLIB_ERR_NONE;
+	}
+
+	pending = g_new0(struct connect_pending, 1);
+	pending->ref_count = 1;
+	pending->connection = vpn_connection_ref(connection);
+	pending->timeout = timeout;
+	pending->waiters = g_list_prepend(NULL, waiter);
+	connection->connecting = pending;
+	g_mutex_unlock(&connection->lock);
+
+	/* The reference of the queue goes to connect_start() */
+	connect_queue_submit(connection, priority, connect_start, pending);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+static void abort_connect_callback(enum dvpnlib_err result,
+				GVariant *reply, gpointer user_data)
+{
+	struct vpn_connection *connection = user_data;
+
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_REPLY,
+				DVPNLIB_METHOD_DISCONNECT, result, 0);
+	vpn_connection_unref(connection);
+}
+
+/*
+ * Disconnect issued by the connect watchdog: asynchronous, since it runs
+ * in the dispatch context, and leaving the reconnect engine alone.
+ */
+void connection_abort_connect(struct vpn_connection *connection)
+{
+	GCancellable *cancellable;
+	enum dvpnlib_err ret;
+
+	DBG("%s", connection->path);
+
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_CALL,
+			DVPNLIB_METHOD_DISCONNECT, DVPNLIB_TIMEOUT_DEFAULT, 0);
+
+	cancellable = connection_ref_cancellable(connection);
+	ret = common_set_interface_call_method(connection->dbus_proxy,
+					"Disconnect", NULL,
+					DVPNLIB_TIMEOUT_DEFAULT, cancellable,
+					abort_connect_callback,
+					vpn_connection_ref(connection));
+	g_object_unref(cancellable);
+
+	if (ret != DVPNLIB_ERR_NONE)
+		abort_connect_callback(ret, NULL, connection);
+}
+
+/*
+ * The Disconnect in flight on a connection; the threads disconnecting
+ * meanwhile wait for its result instead of issuing their own.
+ */
+struct disconnect_call {
+	unsigned int ref_count;	/* under the connection lock */
+	gboolean done;
+	enum dvpnlib_err result;
+	GCond cond;
+};
+
+/* Called with the connection lock held */
+static void disconnect_call_unref(struct disconnect_call *call)
+{
+	if (--call->ref_count > 0)
+		return;
+
+	g_cond_clear(&call->cond);
+	g_free(call);
 }
 
 enum dvpnlib_err
@@ -882,19 +2089,111 @@ vpn_connection_disconnect(struct vpn_connection *connection)
 {
 	DBG("");
 
+	struct disconnect_call *call;
+	GCancellable *cancellable;
+	enum dvpnlib_err ret;
+
+	assert(connection != NULL);
+
+	/* The drop that follows is not to be undone */
+	connection_reconnect_reset(connection);
+	connection_watchdog_disarm(connection);
+
+	g_mutex_lock(&connection->lock);
+	call = connection->disconnecting;
+	if (call != NULL) {
+		DBG("joins the disconnect in flight");
+
+		call->ref_count++;
+		while (!call->done)
+			g_cond_wait(&call->cond, &connection->lock);
+		ret = call->result;
+		disconnect_call_unref(call);
+		g_mutex_unlock(&connection->lock);
+
+		return ret;
+	}
+
+	call = g_new0(struct disconnect_call, 1);
+	call->ref_count = 1;
+	g_cond_init(&call->cond);
+	connection->disconnecting = call;
+	g_mutex_unlock(&connection->lock);
+
+	cancellable = connection_ref_cancellable(connection);
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_CALL,
+			DVPNLIB_METHOD_DISCONNECT, DVPNLIB_TIMEOUT_DEFAULT, 0);
+	ret = common_set_interface_call_method_sync(connection->dbus_proxy,
+					 "Disconnect", NULL,
+					 DVPNLIB_TIMEOUT_DEFAULT,
+					 cancellable);
+	dvpnlib_journal_record(&connection->journal, DVPNLIB_JOURNAL_REPLY,
+			DVPNLIB_METHOD_DISCONNECT, ret, 0);
+	g_object_unref(cancellable);
+
+	g_mutex_lock(&connection->lock);
+	connection->disconnecting = NULL;
+	call->result = ret;
+	call->done = TRUE;
+	g_cond_broadcast(&call->cond);
+	disconnect_call_unref(call);
+	g_mutex_unlock(&connection->lock);
+
+	return ret;
+}
+
+/*
+ * Aborts the calls in flight on this connection (Connect, Disconnect,
+ * SetProperty, ClearProperty); their callers see
+ * DVPNLIB_ERR_OPERATION_ABORTED.
+ */
+void vpn_connection_cancel(struct vpn_connection *connection)
+{
+	GCancellable *cancellable;
+
+	DBG("");
+
 	assert(connection != NULL);
 
-	return common_set_interface_call_method_sync(connection->dbus_proxy,
-					 "Disconnect", NULL);
+	g_mutex_lock(&connection->lock);
+	cancellable = connection->cancellable;
+	connection->cancellable = g_cancellable_new();
+	g_mutex_unlock(&connection->lock);
+
+	connect_queue_abort(connection);
+
+	dvpnlib_journal_record(&connection->journal,
+				DVPNLIB_JOURNAL_CANCEL, 0, 0, 0);
+
+	g_cancellable_cancel(cancellable);
+	g_object_unref(cancellable);
+}
+
+/*
+ * Writes the recent events of the connection to fd; see
+ * dvpnlib-journal.c. Returns the number of events or -1.
+ */
+int vpn_connection_dump_journal(struct vpn_connection *connection, int fd)
+{
+	assert(connection != NULL);
 
+	return dvpnlib_journal_dump(&connection->journal,
+					connection->path, fd);
 }
 
+/* The type is interned, it outlives the read section */
 const char *vpn_connection_get_type(
 					struct vpn_connection *connection)
 {
+	const char *type;
+
 	assert(connection != NULL);
 
-	return connection->type;
+	dvpnlib_rcu_read_lock();
+	type = connection_snapshot(connection)->type;
+	dvpnlib_rcu_read_unlock();
+
+	return type;
 }
 
 const char *vpn_connection_get_name(
@@ -902,7 +2201,7 @@ const char *vpn_connection_get_name(
 {
 	assert(connection != NULL);
 
-	return connection->name;
+	return connection_snapshot(connection)->name;
 }
 
 const char *vpn_connection_get_path(
@@ -913,12 +2212,19 @@ const char *vpn_connection_get_path(
 	return connection->path;
 }
 
+gboolean vpn_connection_is_removed(struct vpn_connection *connection)
+{
+	assert(connection != NULL);
+
+	return g_atomic_int_get(&connection->removed);
+}
+
 const char *vpn_connection_get_domain(
 				struct vpn_connection *connection)
 {
 	assert(connection != NULL);
 
-	return connection->domain;
+	return connection_snapshot(connection)->domain;
 }
 
 const char *vpn_connection_get_host(
@@ -926,31 +2232,49 @@ const char *vpn_connection_get_host(
 {
 	assert(connection != NULL);
 
-	return connection->host;
+	return connection_snapshot(connection)->host;
 }
 
 bool vpn_connection_get_immutable(
 				struct vpn_connection *connection)
 {
+	bool immutable;
+
 	assert(connection != NULL);
 
-	return connection->immutable;
+	dvpnlib_rcu_read_lock();
+	immutable = connection_snapshot(connection)->immutable;
+	dvpnlib_rcu_read_unlock();
+
+	return immutable;
 }
 
 int vpn_connection_get_index(
 				struct vpn_connection *connection)
 {
+	int index;
+
 	assert(connection != NULL);
 
-	return connection->index;
+	dvpnlib_rcu_read_lock();
+	index = connection_snapshot(connection)->index;
+	dvpnlib_rcu_read_unlock();
+
+	return index;
 }
 
 enum vpn_connection_state vpn_connection_get_state(
 				struct vpn_connection *connection)
 {
+	enum vpn_connection_state state;
+
 	assert(connection != NULL);
 
-	return connection->state;
+	dvpnlib_rcu_read_lock();
+	state = connection_snapshot(connection)->state;
+	dvpnlib_rcu_read_unlock();
+
+	return state;
 }
 
 const struct vpn_connection_ipv4 *vpn_connection_get_ipv4(
@@ -958,7 +2282,7 @@ const struct vpn_connection_ipv4 *vpn_connection_get_ipv4(
 {
 	assert(connection != NULL);
 
-	return connection->ipv4;
+	return connection_snapshot(connection)->ipv4;
 }
 
 const struct vpn_connection_ipv6 *vpn_connection_get_ipv6(
@@ -966,7 +2290,7 @@ const struct vpn_connection_ipv6 *vpn_connection_get_ipv6(
 {
 	assert(connection != NULL);
 
-	return connection->ipv6;
+	return connection_snapshot(connection)->ipv6;
 }
 
 char **vpn_connection_get_nameservers(
@@ -974,7 +2298,7 @@ char **vpn_connection_get_nameservers(
 {
 	assert(connection != NULL);
 
-	return connection->nameservers;
+	return connection_snapshot(connection)->nameservers;
 }
 
 GSList *vpn_connection_get_user_routes(
@@ -982,7 +2306,7 @@ GSList *vpn_connection_get_user_routes(
 {
 	assert(connection != NULL);
 
-	return connection->user_routes;
+	return connection_snapshot(connection)->user_routes;
 }
 
 GSList *vpn_connection_get_server_routes(
@@ -990,7 +2314,15 @@ GSList *vpn_connection_get_server_routes(
 {
 	assert(connection != NULL);
 
-	return connection->server_routes;
+	return connection_snapshot(connection)->server_routes;
+}
+
+const struct vpn_connection_snapshot *vpn_connection_get_snapshot(
+				struct vpn_connection *connection)
+{
+	assert(connection != NULL);
+
+	return connection_snapshot(connection);
 }
 
 enum dvpnlib_err vpn_connection_set_property_changed_cb(
@@ -1013,9 +2345,11 @@ enum dvpnlib_err vpn_connection_set_property_changed_cb(
 	property_changed_cb_t->property_changed_cb = cb;
 	property_changed_cb_t->user_data = user_data;
 
+	g_mutex_lock(&connection->lock);
 	g_hash_table_insert(connection->property_changed_cb_hash,
 				GINT_TO_POINTER(type),
 				(gpointer)property_changed_cb_t);
+	g_mutex_unlock(&connection->lock);
 
 	return DVPNLIB_ERR_NONE;
 }
@@ -1029,16 +2363,17 @@ enum dvpnlib_err vpn_connection_unset_property_changed_cb(
 	if (connection == NULL)
 		return DVPNLIB_ERR_INVALID_PARAMETER;
 
-	struct connection_property_changed_cb *property_changed_cb_t =
-			get_connection_property_changed_cb(connection, type);
+	gboolean removed;
 
-	if (property_changed_cb_t == NULL) {
+	g_mutex_lock(&connection->lock);
+	removed = g_hash_table_remove(connection->property_changed_cb_hash,
+				GINT_TO_POINTER(type));
+	g_mutex_unlock(&connection->lock);
+
+	if (!removed) {
 		DBG("Can't find connection property changed callback");
 		return DVPNLIB_ERR_FAILED;
 	}
 
-	g_hash_table_remove(connection->property_changed_cb_hash,
-				GINT_TO_POINTER(type));
-
 	return DVPNLIB_ERR_NONE;
 }
@@ -0,0 +1,366 @@
+#include <errno.h>
+#include <unistd.h>
+
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-export.h"
+
+/*
+ * Records are formatted straight from the published snapshot of each
+ * connection into one output buffer, which is handed to the writer
+ * whenever it fills up.
+ */
+#define EXPORT_FLUSH_SIZE	4096
+
+struct export {
+	GByteArray *buf;
+	dvpnlib_export_write_cb write_cb;
+	void *user_data;
+	gboolean failed;
+};
+
+static void export_flush(struct export *export)
+{
+	if (export->buf->len == 0 || export->failed)
+		return;
+
+	if (!export->write_cb(export->buf->data, export->buf->len,
+						export->user_data))
+		export->failed = TRUE;
+
+	g_byte_array_set_size(export->buf, 0);
+}
+
+static void put_bytes(struct export *export, const void *data, size_t len)
+{
+	g_byte_array_append(export->buf, data, len);
+}
+
+static void put_str(struct export *export, const char *str)
+{
+	put_bytes(export, str, strlen(str));
+}
+
+static void put_int(struct export *export, int value)
+{
+	char number[16];
+
+	put_bytes(export, number, g_snprintf(number, sizeof(number),
+							"%d", value));
+}
+
+/*
+ * JSON lines
+ */
+static void json_put_string(struct export *export, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *start;
+	char escape[6] = { '\\', 'u', '0', '0' };
+
+	if (str == NULL) {
+		put_str(export, "null");
+		return;
+	}
+
+	put_str(export, "\"");
+
+	for (start = str; *str; str++) {
+		unsigned char c = *str;
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		put_bytes(export, start, str - start);
+		escape[4] = hex[c >> 4];
+		escape[5] = hex[c & 0xf];
+		put_bytes(export, escape, sizeof(escape));
+		start = str + 1;
+	}
+
+	put_bytes(export, start, str - start);
+	put_str(export, "\"");
+}
+
+static void json_put_member(struct export *export, const char *name,
+				const char *value)
+{
+	put_str(export, ",\"");
+	put_str(export, name);
+	put_str(export, "\":");
+	json_put_string(export, value);
+}
+
+static void json_put_int(struct export *export, const char *name, int value)
+{
+	put_str(export, ",\"");
+	put_str(export, name);
+	put_str(export, "\":");
+	put_int(export, value);
+}
+
+static void json_put_routes(struct export *export, const char *name,
+				GSList *routes)
+{
+	struct vpn_connection_route *route;
+	GSList *iter;
+
+	put_str(export, ",\"");
+	put_str(export, name);
+	put_str(export, "\":[");
+
+	for (iter = routes; iter != NULL; iter = iter->next) {
+		route = iter->data;
+
+		if (iter != routes)
+			put_str(export, ",");
+
+		put_str(export, "{\"family\":");
+		put_int(export, route->protocol_family);
+		json_put_member(export, "network", route->network);
+		json_put_member(export, "netmask", route->netmask);
+		json_put_member(export, "gateway", route->gateway);
+		put_str(export, "}");
+	}
+
+	put_str(export, "]");
+}
+
+static void json_put_connection(struct export *export,
+				struct vpn_connection *connection)
+{
+	const struct vpn_connection_snapshot *snapshot =
+			vpn_connection_get_snapshot(connection);
+	const struct vpn_connection_ipv4 *ipv4;
+	const struct vpn_connection_ipv6 *ipv6;
+	char **nameservers;
+	int i;
+
+	put_str(export, "{\"path\":");
+	json_put_string(export, vpn_connection_get_path(connection));
+	json_put_member(export, "name", snapshot->name);
+	json_put_member(export, "type", snapshot->type);
+	json_put_member(export, "host", snapshot->host);
+	json_put_member(export, "domain", snapshot->domain);
+	json_put_member(export, "state",
+			dvpnlib_state_name(snapshot->state));
+	json_put_int(export, "index", snapshot->index);
+	put_str(export, snapshot->immutable ?
+			",\"immutable\":true" : ",\"immutable\":false");
+
+	ipv4 = snapshot->ipv4;
+	if (ipv4) {
+		put_str(export, ",\"ipv4\":{\"address\":");
+		json_put_string(export, ipv4->address);
+		json_put_member(export, "netmask", ipv4->netmask);
+		json_put_member(export, "gateway", ipv4->gateway);
+		json_put_member(export, "peer", ipv4->peer);
+		put_str(export, "}");
+	}
+
+	ipv6 = snapshot->ipv6;
+	if (ipv6) {
+		put_str(export, ",\"ipv6\":{\"address\":");
+		json_put_string(export, ipv6->address);
+		json_put_member(export, "prefix_length", ipv6->prefix_length);
+		json_put_member(export, "gateway", ipv6->gateway);
+		json_put_member(export, "peer", ipv6->peer);
+		put_str(export, "}");
+	}
+
+	put_str(export, ",\"nameservers\":[");
+	nameservers = snapshot->nameservers;
+	for (i = 0; nameservers && nameservers[i]; i++) {
+		if (i > 0)
+			put_str(export, ",");
+		json_put_string(export, nameservers[i]);
+	}
+	put_str(export, "]");
+
+	json_put_routes(export, "user_routes", snapshot->user_routes);
+	json_put_routes(export, "server_routes", snapshot->server_routes);
+
+	put_str(export, "}\n");
+}
+
+/*
+ * Binary
+ */
+static void bin_put_u8(struct export *export, guint8 value)
+{
+	put_bytes(export, &value, sizeof(value));
+}
+
+static void bin_put_u16(struct export *export, guint16 value)
+{
+	value = GUINT16_TO_LE(value);
+	put_bytes(export, &value, sizeof(value));
+}
+
+static void bin_put_u32(struct export *export, guint32 value)
+{
+	value = GUINT32_TO_LE(value);
+	put_bytes(export, &value, sizeof(value));
+}
+
+static void bin_put_str(struct export *export, const char *str)
+{
+	size_t len;
+
+	if (str == NULL) {
+		bin_put_u16(export, G_MAXUINT16);
+		return;
+	}
+
+	len = MIN(strlen(str), G_MAXUINT16 - 1);
+	bin_put_u16(export, len);
+	put_bytes(export, str, len);
+}
+
+static void bin_put_routes(struct export *export, GSList *routes)
+{
+	struct vpn_connection_route *route;
+	guint count;
+	GSList *iter;
+
+	count = MIN(g_slist_length(routes), G_MAXUINT16);
+	bin_put_u16(export, count);
+
+	for (iter = routes; count > 0; iter = iter->next, count--) {
+		route = iter->data;
+
+		bin_put_u32(export, route->protocol_family);
+		bin_put_str(export, route->network);
+		bin_put_str(export, route->netmask);
+		bin_put_str(export, route->gateway);
+	}
+}
+
+static void bin_put_connection(struct export *export,
+				struct vpn_connection *connection)
+{
+	const struct vpn_connection_snapshot *snapshot =
+			vpn_connection_get_snapshot(connection);
+	const struct vpn_connection_ipv4 *ipv4;
+	const struct vpn_connection_ipv6 *ipv6;
+	char **nameservers;
+	guint start, count;
+	guint32 len;
+
+	/* The length is patched in once the record is complete */
+	start = export->buf->len;
+	bin_put_u32(export, 0);
+
+	bin_put_str(export, vpn_connection_get_path(connection));
+	bin_put_str(export, snapshot->name);
+	bin_put_str(export, snapshot->type);
+	bin_put_str(export, snapshot->host);
+	bin_put_str(export, snapshot->domain);
+	bin_put_u32(export, snapshot->state);
+	bin_put_u32(export, snapshot->index);
+	bin_put_u8(export, snapshot->immutable);
+
+	ipv4 = snapshot->ipv4;
+	bin_put_u8(export, ipv4 != NULL);
+	if (ipv4) {
+		bin_put_str(export, ipv4->address);
+		bin_put_str(export, ipv4->netmask);
+		bin_put_str(export, ipv4->gateway);
+		bin_put_str(export, ipv4->peer);
+	}
+
+	ipv6 = snapshot->ipv6;
+	bin_put_u8(export, ipv6 != NULL);
+	if (ipv6) {
+		bin_put_str(export, ipv6->address);
+		bin_put_str(export, ipv6->prefix_length);
+		bin_put_str(export, ipv6->gateway);
+		bin_put_str(export, ipv6->peer);
+	}
+
+	nameservers = snapshot->nameservers;
+	count = nameservers ? MIN(g_strv_length(nameservers), G_MAXUINT16) : 0;
+	bin_put_u16(export, count);
+	while (count--)
+		bin_put_str(export, *nameservers++);
+
+	bin_put_routes(export, snapshot->user_routes);
+	bin_put_routes(export, snapshot->server_routes);
+
+	len = GUINT32_TO_LE(export->buf->len - start - sizeof(len));
+	memcpy(export->buf->data + start, &len, sizeof(len));
+}
+
+enum dvpnlib_err vpn_connections_export(enum dvpnlib_export_format format,
+				dvpnlib_export_write_cb write_cb,
+				void *user_data)
+{
+	struct export export;
+	GList *iter;
+
+	if (write_cb == NULL || (format != DVPNLIB_EXPORT_JSON &&
+				format != DVPNLIB_EXPORT_BINARY))
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	export.buf = g_byte_array_sized_new(EXPORT_FLUSH_SIZE * 2);
+	export.write_cb = write_cb;
+	export.user_data = user_data;
+	export.failed = FALSE;
+
+	if (format == DVPNLIB_EXPORT_BINARY) {
+		put_bytes(&export, "DVPN", 4);
+		bin_put_u32(&export, DVPNLIB_EXPORT_BINARY_VERSION);
+	}
+
+	vpn_connections_lock_read();
+
+	for (iter = vpn_get_connections(); iter != NULL && !export.failed;
+						iter = iter->next) {
+		if (format == DVPNLIB_EXPORT_JSON)
+			json_put_connection(&export, iter->data);
+		else
+			bin_put_connection(&export, iter->data);
+
+		if (export.buf->len >= EXPORT_FLUSH_SIZE)
+			export_flush(&export);
+	}
+
+	export_flush(&export);
+
+	vpn_connections_unlock_read();
+
+	g_byte_array_unref(export.buf);
+
+	return export.failed ? DVPNLIB_ERR_FAILED : DVPNLIB_ERR_NONE;
+}
+
+static bool export_write_fd(const void *data, size_t len, void *user_data)
+{
+	int fd = GPOINTER_TO_INT(user_data);
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, data, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0) {
+			ERROR("export write: %s", g_strerror(errno));
+			return false;
+		}
+
+		data = (const char *)data + written;
+		len -= written;
+	}
+
+	return true;
+}
+
+enum dvpnlib_err vpn_connections_export_fd(
+				enum dvpnlib_export_format format, int fd)
+{
+	if (fd < 0)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	return vpn_connections_export(format, export_write_fd,
+					GINT_TO_POINTER(fd));
+}
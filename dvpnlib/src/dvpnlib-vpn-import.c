@@ -0,0 +1,360 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-manager.h"
+#include "dvpnlib-vpn-settings.h"
+#include "dvpnlib-vpn-import.h"
+
+/*
+ * The file is read one record at a time, only when a Create slot is
+ * free, so memory use does not depend on the size of the file.
+ *
+ * in_flight counts the records being created plus the callers of
+ * import_pump(): each caller owns one slot and gives it back under the
+ * lock, so whoever sees the end of the file with in_flight at zero is
+ * the last user of the import and may free it.
+ */
+struct import {
+	GMutex lock;
+	GDataInputStream *input;
+	unsigned int line;
+	unsigned int index;
+	gchar *next_group;	/* header that ended the previous record */
+	unsigned int next_line;
+	gboolean eof;
+	enum dvpnlib_err error;
+	unsigned int in_flight;
+	unsigned int max_in_flight;
+	unsigned int succeeded;
+	unsigned int failed;
+	dvpnlib_import_record_cb record_cb;
+	dvpnlib_import_done_cb done_cb;
+	void *user_data;
+};
+
+enum {
+	RECORD_HAS_TYPE = 1 << 0,
+	RECORD_HAS_NAME = 1 << 1,
+	RECORD_HAS_HOST = 1 << 2,
+	RECORD_HAS_ALL = (1 << 3) - 1,
+};
+
+struct import_record {
+	struct import *import;
+	struct dvpnlib_import_record info;
+	gchar *name;
+	unsigned int keys;	/* RECORD_HAS_* */
+	struct dvpnlib_settings *settings;
+};
+
+static void import_pump(struct import *import);
+
+static struct import_record *import_record_new(struct import *import,
+					gchar *name, unsigned int line)
+{
+	struct import_record *record;
+
+	record = g_new0(struct import_record, 1);
+	record->import = import;
+	record->info.index = import->index++;
+	record->info.line = line;
+	record->name = name;
+	record->settings = dvpnlib_settings_new();
+	if (record->settings == NULL)
+		record->info.result = DVPNLIB_ERR_FAILED;
+
+	return record;
+}
+
+static void import_record_free(struct import_record *record)
+{
+	dvpnlib_settings_unref(record->settings);
+	g_free(record->name);
+	g_free(record);
+}
+
+static void import_record_set(struct import_record *record,
+				const char *key, const char *value)
+{
+	if (record->info.result != DVPNLIB_ERR_NONE)
+		return;
+
+	record->info.result =
+		dvpnlib_settings_set(record->settings, key, value);
+
+	if (!g_strcmp0(key, "Type")) {
+		record->keys |= RECORD_HAS_TYPE;
+	} else if (!g_strcmp0(key, "Host")) {
+		record->keys |= RECORD_HAS_HOST;
+	} else if (!g_strcmp0(key, "Name")) {
+		record->keys |= RECORD_HAS_NAME;
+		g_free(record->name);
+		record->name = g_strdup(value);
+	}
+}
+
+static void import_record_parse_key(struct import_record *record,
+					gchar *text)
+{
+	gchar *value;
+
+	value = strchr(text, '=');
+	if (value == NULL) {
+		record->info.result = DVPNLIB_ERR_INVALID_PARAMETER;
+		return;
+	}
+
+	*value++ = '\0';
+	text = g_strstrip(text);
+	if (*text == '\0') {
+		record->info.result = DVPNLIB_ERR_INVALID_PARAMETER;
+		return;
+	}
+
+	import_record_set(record, text, g_strstrip(value));
+}
+
+/* A flat JSON object of strings is also the GVariant text of an a{ss} */
+static void import_record_parse_json(struct import_record *record,
+					const gchar *text)
+{
+	GVariant *object;
+	GVariantIter iter;
+	const gchar *key, *value;
+	GError *error = NULL;
+
+	object = g_variant_parse(G_VARIANT_TYPE("a{ss}"), text,
+					NULL, NULL, &error);
+	if (object == NULL) {
+		DBG("line %u: %s", record->info.line, error->message);
+		g_error_free(error);
+		record->info.result = DVPNLIB_ERR_INVALID_PARAMETER;
+		return;
+	}
+
+	g_variant_iter_init(&iter, object);
+	while (g_variant_iter_next(&iter, "{&s&s}", &key, &value))
+		import_record_set(record, key, value);
+
+	g_variant_unref(object);
+}
+
+static void import_record_validate(struct import_record *record)
+{
+	if (record->info.result != DVPNLIB_ERR_NONE)
+		return;
+
+	if (!(record->keys & RECORD_HAS_NAME) && record->name != NULL) {
+		gchar *name = g_strdup(record->name);
+
+		import_record_set(record, "Name", name);
+		g_free(name);
+	}
+
+	if (record->keys != RECORD_HAS_ALL) {
+		WARN("line %u: Type, Name and Host are required",
+						record->info.line);
+		record->info.result = DVPNLIB_ERR_INVALID_PARAMETER;
+	}
+}
+
+static gboolean parse_group(gchar *text)
+{
+	size_t len = strlen(text);
+
+	if (len < 3 || text[len - 1] != ']')
+		return FALSE;
+
+	text[len - 1] = '\0';
+
+	return TRUE;
+}
+
+/* Called with import->lock held, returns NULL at the end of the file */
+static struct import_record *import_read_record(struct import *import)
+{
+	struct import_record *record = NULL;
+	GError *error = NULL;
+	gboolean complete = FALSE;
+	gchar *line, *text;
+
+	if (import->next_group != NULL) {
+		record = import_record_new(import, import->next_group,
+							import->next_line);
+		import->next_group = NULL;
+	}
+
+	while (!complete && (line = g_data_input_stream_read_line(
+				import->input, NULL, NULL, &error))) {
+		import->line++;
+		text = g_strstrip(line);
+
+		if (*text == '\0' || *text == '#' || *text == ';') {
+			/* comment */
+		} else if (*text == '[' && parse_group(text)) {
+			if (record == NULL) {
+				record = import_record_new(import,
+					g_strdup(text + 1), import->line);
+			} else {
+				import->next_group = g_strdup(text + 1);
+				import->next_line = import->line;
+				complete = TRUE;
+			}
+		} else if (*text == '{' && record == NULL) {
+			record = import_record_new(import, NULL, import->line);
+			import_record_parse_json(record, text);
+			complete = TRUE;
+		} else {
+			if (record == NULL) {
+				/* Keys before the first group */
+				record = import_record_new(import, NULL,
+							import->line);
+				record->info.result =
+					DVPNLIB_ERR_INVALID_PARAMETER;
+			}
+			import_record_parse_key(record, text);
+		}
+
+		g_free(line);
+	}
+
+	if (!complete) {
+		if (error != NULL) {
+			ERROR("line %u: %s", import->line, error->message);
+			g_error_free(error);
+			import->error = DVPNLIB_ERR_FAILED;
+		}
+		import->eof = TRUE;
+	}
+
+	if (record != NULL) {
+		import_record_validate(record);
+		record->info.name = record->name;
+	}
+
+	return record;
+}
+
+static void import_report(struct import_record *record,
+				enum dvpnlib_err result)
+{
+	struct import *import = record->import;
+
+	g_mutex_lock(&import->lock);
+	if (result == DVPNLIB_ERR_NONE)
+		import->succeeded++;
+	else
+		import->failed++;
+	g_mutex_unlock(&import->lock);
+
+	record->info.result = result;
+	if (import->record_cb)
+		import->record_cb(&record->info, import->user_data);
+
+	import_record_free(record);
+}
+
+static void import_create_reply(enum dvpnlib_err result, void *user_data)
+{
+	struct import_record *record = user_data;
+	struct import *import = record->import;
+
+	import_report(record, result);
+
+	/* The record's slot is handed over to the pump */
+	import_pump(import);
+}
+
+static void import_free(struct import *import)
+{
+	g_object_unref(import->input);
+	g_free(import->next_group);
+	g_mutex_clear(&import->lock);
+	g_free(import);
+}
+
+/* The caller owns one in_flight slot, given back here */
+static void import_pump(struct import *import)
+{
+	struct import_record *record;
+	enum dvpnlib_err err;
+	gboolean done;
+
+	g_mutex_lock(&import->lock);
+	import->in_flight--;
+
+	while (!import->eof &&
+			import->in_flight < import->max_in_flight) {
+		record = import_read_record(import);
+		if (record == NULL)
+			break;
+
+		import->in_flight++;
+		g_mutex_unlock(&import->lock);
+
+		err = record->info.result;
+		if (err == DVPNLIB_ERR_NONE)
+			err = dvpnlib_vpn_manager_create(record->settings,
+					import_create_reply, record);
+		if (err != DVPNLIB_ERR_NONE)
+			import_report(record, err);
+
+		g_mutex_lock(&import->lock);
+		if (err != DVPNLIB_ERR_NONE)
+			import->in_flight--;
+	}
+
+	done = import->eof && import->in_flight == 0;
+	g_mutex_unlock(&import->lock);
+
+	if (!done)
+		return;
+
+	DBG("%u created, %u failed", import->succeeded, import->failed);
+
+	if (import->done_cb)
+		import->done_cb(import->error, import->succeeded,
+					import->failed, import->user_data);
+
+	import_free(import);
+}
+
+enum dvpnlib_err dvpnlib_vpn_manager_import(const char *path,
+				unsigned int max_in_flight,
+				dvpnlib_import_record_cb record_cb,
+				dvpnlib_import_done_cb done_cb,
+				void *user_data)
+{
+	struct import *import;
+	GFileInputStream *stream;
+	GError *error = NULL;
+	GFile *file;
+
+	assert(vpn_manager != NULL);
+
+	if (path == NULL || max_in_flight == 0)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	file = g_file_new_for_path(path);
+	stream = g_file_read(file, NULL, &error);
+	g_object_unref(file);
+
+	if (stream == NULL) {
+		ERROR("%s: %s", path, error->message);
+		g_error_free(error);
+		return DVPNLIB_ERR_NOT_FOUND;
+	}
+
+	import = g_new0(struct import, 1);
+	g_mutex_init(&import->lock);
+	import->input = g_data_input_stream_new(G_INPUT_STREAM(stream));
+	g_object_unref(stream);
+	import->max_in_flight = max_in_flight;
+	import->record_cb = record_cb;
+	import->done_cb = done_cb;
+	import->user_data = user_data;
+
+	/* The slot of this first pump */
+	import->in_flight = 1;
+	import_pump(import);
+
+	return DVPNLIB_ERR_NONE;
+}
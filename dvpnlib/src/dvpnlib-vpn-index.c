@@ -0,0 +1,314 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+
+/*
+ * Secondary indexes over the connection table, kept up to date as the
+ * State/Type/Domain/Name properties change so that a query only visits
+ * the connections of the smallest index that applies:
+ *
+ *  - one set per state,
+ *  - one set per type and per domain, keyed by the string,
+ *  - every connection sorted by name, for prefix ranges.
+ *
+ * The type is interned; the node keeps its own copies of the domain and
+ * name, as the records they come from may be retired before the update.
+ *
+ * The indexes are guarded by index_lock of dvpnlib-vpn-connnection.c:
+ * updates are made with it held for writing, queries for reading.
+ */
+static GHashTable *state_index[VPN_CONN_STATE_UNKNOWN + 1];
+static GHashTable *type_index;		/* type -> set of nodes */
+static GHashTable *domain_index;	/* domain -> set of nodes */
+static GSequence *name_index;
+
+/* The probe of a prefix search sorts before the names it prefixes */
+static gint name_compare(gconstpointer a, gconstpointer b, gpointer probe)
+{
+	const struct connection_index_node *node_a = a;
+	const struct connection_index_node *node_b = b;
+
+	if (a == probe)
+		return g_strcmp0(node_a->name, node_b->name) <= 0 ? -1 : 1;
+
+	if (b == probe)
+		return g_strcmp0(node_a->name, node_b->name) < 0 ? -1 : 1;
+
+	return g_strcmp0(node_a->name, node_b->name);
+}
+
+static GHashTable *key_set(GHashTable **index, const gchar *key,
+				gboolean create)
+{
+	GHashTable *set;
+
+	if (*index == NULL) {
+		if (!create)
+			return NULL;
+
+		*index = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify)g_hash_table_destroy);
+	}
+
+	set = g_hash_table_lookup(*index, key);
+	if (set == NULL && create) {
+		set = g_hash_table_new(g_direct_hash, g_direct_equal);
+		g_hash_table_insert(*index, g_strdup(key), set);
+	}
+
+	return set;
+}
+
+static void key_set_add(GHashTable **index, const gchar *key,
+				struct connection_index_node *node)
+{
+	if (key == NULL)
+		return;
+
+	g_hash_table_add(key_set(index, key, TRUE), node);
+}
+
+static void key_set_remove(GHashTable **index, const gchar *key,
+				struct connection_index_node *node)
+{
+	GHashTable *set;
+
+	if (key == NULL)
+		return;
+
+	set = key_set(index, key, FALSE);
+	if (set == NULL)
+		return;
+
+	g_hash_table_remove(set, node);
+	if (g_hash_table_size(set) == 0)
+		g_hash_table_remove(*index, key);
+}
+
+static GHashTable *state_set(gint state)
+{
+	if (state < 0 || state > VPN_CONN_STATE_UNKNOWN)
+		state = VPN_CONN_STATE_UNKNOWN;
+
+	if (state_index[state] == NULL)
+		state_index[state] = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+
+	return state_index[state];
+}
+
+void connection_index_add(struct connection_index_node *node,
+				gpointer connection, gint state,
+				const gchar *type, const gchar *domain,
+				const gchar *name)
+{
+	assert(!node->linked);
+
+	node->connection = connection;
+	node->state = state;
+	node->type = type;
+	node->domain = g_strdup(domain);
+	node->name = g_strdup(name);
+
+	g_hash_table_add(state_set(state), node);
+	key_set_add(&type_index, type, node);
+	key_set_add(&domain_index, domain, node);
+
+	if (name_index == NULL)
+		name_index = g_sequence_new(NULL);
+	node->name_iter = g_sequence_insert_sorted(name_index, node,
+						name_compare, NULL);
+
+	node->linked = TRUE;
+}
+
+void connection_index_update(struct connection_index_node *node,
+				gint state, const gchar *type,
+				const gchar *domain, const gchar *name)
+{
+	if (!node->linked)
+		return;
+
+	if (node->state != state) {
+		g_hash_table_remove(state_set(node->state), node);
+		node->state = state;
+		g_hash_table_add(state_set(state), node);
+	}
+
+	/* The type is interned, comparing pointers is enough */
+	if (node->type != type) {
+		key_set_remove(&type_index, node->type, node);
+		node->type = type;
+		key_set_add(&type_index, type, node);
+	}
+
+	if (g_strcmp0(node->domain, domain) != 0) {
+		key_set_remove(&domain_index, node->domain, node);
+		g_free(node->domain);
+		node->domain = g_strdup(domain);
+		key_set_add(&domain_index, domain, node);
+	}
+
+	if (g_strcmp0(node->name, name) != 0) {
+		g_free(node->name);
+		node->name = g_strdup(name);
+		g_sequence_sort_changed(node->name_iter, name_compare, NULL);
+	}
+}
+
+void connection_index_remove(struct connection_index_node *node)
+{
+	if (!node->linked)
+		return;
+
+	g_hash_table_remove(state_set(node->state), node);
+	key_set_remove(&type_index, node->type, node);
+	key_set_remove(&domain_index, node->domain, node);
+	g_sequence_remove(node->name_iter);
+
+	g_free(node->domain);
+	g_free(node->name);
+	node->domain = NULL;
+	node->name = NULL;
+	node->name_iter = NULL;
+	node->linked = FALSE;
+}
+
+static void unlink_node(gpointer data, gpointer user_data)
+{
+	struct connection_index_node *node = data;
+
+	g_free(node->domain);
+	g_free(node->name);
+	node->domain = NULL;
+	node->name = NULL;
+	node->name_iter = NULL;
+	node->linked = FALSE;
+}
+
+void connection_index_clear(void)
+{
+	int i;
+
+	if (name_index != NULL) {
+		g_sequence_foreach(name_index, unlink_node, NULL);
+		g_sequence_free(name_index);
+		name_index = NULL;
+	}
+
+	for (i = 0; i <= VPN_CONN_STATE_UNKNOWN; i++) {
+		if (state_index[i] != NULL) {
+			g_hash_table_destroy(state_index[i]);
+			state_index[i] = NULL;
+		}
+	}
+
+	if (type_index != NULL) {
+		g_hash_table_destroy(type_index);
+		type_index = NULL;
+	}
+
+	if (domain_index != NULL) {
+		g_hash_table_destroy(domain_index);
+		domain_index = NULL;
+	}
+}
+
+static gboolean node_matches(struct connection_index_node *node,
+				gint state, const gchar *type,
+				const gchar *domain, const gchar *name_prefix)
+{
+	if (state >= 0 && node->state != state)
+		return FALSE;
+
+	if (type != NULL && node->type != type)
+		return FALSE;
+
+	if (domain != NULL && g_strcmp0(node->domain, domain) != 0)
+		return FALSE;
+
+	if (name_prefix != NULL &&
+			(node->name == NULL ||
+			 !g_str_has_prefix(node->name, name_prefix)))
+		return FALSE;
+
+	return TRUE;
+}
+
+static void pick_smaller(GHashTable **smallest, GHashTable *set)
+{
+	if (*smallest == NULL ||
+			g_hash_table_size(set) < g_hash_table_size(*smallest))
+		*smallest = set;
+}
+
+/*
+ * type must be interned. Walks the smallest of the state,
+ * type and domain sets that apply, or the name range of the prefix when
+ * only the prefix is given. Returns a new list of connections.
+ */
+GList *connection_index_query(gint state, const gchar *type,
+				const gchar *domain, const gchar *name_prefix)
+{
+	struct connection_index_node probe = { .name = (gchar *)name_prefix };
+	struct connection_index_node *node;
+	GHashTable *smallest = NULL, *set;
+	GSequenceIter *iter;
+	GHashTableIter set_iter;
+	GList *result = NULL;
+
+	if (state >= 0) {
+		if (state > VPN_CONN_STATE_UNKNOWN ||
+				state_index[state] == NULL)
+			return NULL;
+		pick_smaller(&smallest, state_index[state]);
+	}
+
+	if (type != NULL) {
+		set = key_set(&type_index, type, FALSE);
+		if (set == NULL)
+			return NULL;
+		pick_smaller(&smallest, set);
+	}
+
+	if (domain != NULL) {
+		set = key_set(&domain_index, domain, FALSE);
+		if (set == NULL)
+			return NULL;
+		pick_smaller(&smallest, set);
+	}
+
+	if (smallest != NULL) {
+		g_hash_table_iter_init(&set_iter, smallest);
+		while (g_hash_table_iter_next(&set_iter,
+						(gpointer *)&node, NULL))
+			if (node_matches(node, state, type, domain,
+							name_prefix))
+				result = g_list_prepend(result,
+							node->connection);
+
+		return result;
+	}
+
+	if (name_index == NULL)
+		return NULL;
+
+	if (name_prefix != NULL)
+		iter = g_sequence_search(name_index, &probe,
+					name_compare, &probe);
+	else
+		iter = g_sequence_get_begin_iter(name_index);
+
+	/* In name order, stop at the first name past the prefix */
+	for (; !g_sequence_iter_is_end(iter);
+				iter = g_sequence_iter_next(iter)) {
+		node = g_sequence_get(iter);
+
+		if (name_prefix != NULL && (node->name == NULL ||
+				!g_str_has_prefix(node->name, name_prefix)))
+			break;
+
+		result = g_list_prepend(result, node->connection);
+	}
+
+	return g_list_reverse(result);
+}
@@ -0,0 +1,526 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-latency.h"
+
+/* Used for DVPNLIB_TIMEOUT_DEFAULT, a handshake is not a D-Bus call */
+#define LATENCY_PROBE_TIMEOUT	3000	/* ms */
+
+#define LATENCY_GROUP_PREFIX	"Endpoint "
+
+struct latency_port {
+	const char *type;
+	unsigned short port;
+};
+
+/* Where the server of each Type usually listens */
+static const struct latency_port latency_ports[] = {
+	{ "openvpn", 1194 },
+	{ "openconnect", 443 },
+	{ "pptp", 1723 },
+	{ "l2tp", 1701 },
+	{ "vpnc", 500 },
+	{ "wireguard", 51820 },
+};
+
+#define LATENCY_PORT_DEFAULT	443
+
+struct latency_entry {
+	gint64 latency;		/* microseconds or UNREACHABLE */
+	gint64 measured;	/* real time, microseconds */
+};
+
+/*
+ * The cache is shared by the rankings of every thread; the rankings
+ * themselves run in the context of the thread which started them.
+ */
+G_LOCK_DEFINE_STATIC(latency);
+static GHashTable *latency_cache;	/* endpoint -> struct latency_entry */
+static gchar *latency_cache_path;
+static guint latency_ttl = DVPNLIB_LATENCY_TTL_DEFAULT;
+
+struct rank_candidate {
+	struct vpn_connection *connection;	/* reference */
+	gchar *endpoint;	/* NULL without a Host */
+	gint64 latency;
+};
+
+struct rank {
+	gint ref_count;
+	struct rank_candidate *candidates;
+	unsigned int count;
+	unsigned int pending;
+	gboolean measured;	/* something to save */
+	GSocketClient *client;
+	dvpnlib_rank_cb callback;
+	void *user_data;
+};
+
+struct rank_probe {
+	struct rank *rank;
+	unsigned int index;
+	GCancellable *cancellable;
+	GSource *timer;
+	gint64 start;
+};
+
+static void free_latency_cache(void)
+{
+	if (latency_cache != NULL)
+		g_hash_table_destroy(latency_cache);
+	latency_cache = NULL;
+}
+
+/* Called with the latency lock held */
+static GHashTable *latency_cache_get(void)
+{
+	if (latency_cache == NULL)
+		latency_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, g_free);
+
+	return latency_cache;
+}
+
+/* Called with the latency lock held */
+static gboolean latency_entry_fresh(const struct latency_entry *entry,
+					gint64 now)
+{
+	return entry->measured + (gint64)latency_ttl * G_USEC_PER_SEC > now;
+}
+
+/* Called with the latency lock held */
+static gboolean latency_lookup(const gchar *endpoint, gint64 *latency)
+{
+	struct latency_entry *entry;
+
+	entry = g_hash_table_lookup(latency_cache_get(), endpoint);
+	if (entry == NULL || !latency_entry_fresh(entry, g_get_real_time()))
+		return FALSE;
+
+	*latency = entry->latency;
+
+	return TRUE;
+}
+
+/* Called with the latency lock held */
+static void latency_store(const gchar *endpoint, gint64 latency,
+				gint64 measured)
+{
+	struct latency_entry *entry;
+
+	entry = g_new(struct latency_entry, 1);
+	entry->latency = latency;
+	entry->measured = measured;
+
+	g_hash_table_replace(latency_cache_get(), g_strdup(endpoint), entry);
+}
+
+/*
+ * One group per endpoint, named after its digest since a Host may hold
+ * characters a group name cannot.
+ */
+static void latency_load(const gchar *path)
+{
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	gchar **groups, *endpoint;
+	gint64 latency, measured, now;
+	int i;
+
+	keyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE,
+								&error)) {
+		DBG("%s: %s", path, error->message);
+		g_error_free(error);
+		g_key_file_free(keyfile);
+		return;
+	}
+
+	now = g_get_real_time();
+	groups = g_key_file_get_groups(keyfile, NULL);
+
+	G_LOCK(latency);
+	for (i = 0; groups[i] != NULL; i++) {
+		if (!g_str_has_prefix(groups[i], LATENCY_GROUP_PREFIX))
+			continue;
+
+		endpoint = g_key_file_get_string(keyfile, groups[i],
+							"Endpoint", NULL);
+		latency = g_key_file_get_int64(keyfile, groups[i],
+							"Latency", NULL);
+		measured = g_key_file_get_int64(keyfile, groups[i],
+							"Measured", NULL);
+
+		if (endpoint != NULL && measured <= now)
+			latency_store(endpoint, latency, measured);
+
+		g_free(endpoint);
+	}
+	G_UNLOCK(latency);
+
+	g_strfreev(groups);
+	g_key_file_free(keyfile);
+}
+
+static void latency_save(void)
+{
+	struct latency_entry *entry;
+	GHashTableIter iter;
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	gpointer key, value;
+	gchar *path, *group, *digest;
+	gint64 now;
+
+	keyfile = g_key_file_new();
+	now = g_get_real_time();
+
+	G_LOCK(latency);
+	path = g_strdup(latency_cache_path);
+
+	g_hash_table_iter_init(&iter, latency_cache_get());
+	while (path != NULL && g_hash_table_iter_next(&iter, &key, &value)) {
+		entry = value;
+		if (!latency_entry_fresh(entry, now))
+			continue;
+
+		digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1,
+								key, -1);
+		group = g_strconcat(LATENCY_GROUP_PREFIX, digest, NULL);
+		g_key_file_set_string(keyfile, group, "Endpoint", key);
+		g_key_file_set_int64(keyfile, group, "Latency",
+							entry->latency);
+		g_key_file_set_int64(keyfile, group, "Measured",
+							entry->measured);
+		g_free(group);
+		g_free(digest);
+	}
+	G_UNLOCK(latency);
+
+	if (path != NULL && !g_key_file_save_to_file(keyfile, path, &error)) {
+		WARN("%s: %s", path, error->message);
+		g_error_free(error);
+	}
+
+	g_free(path);
+	g_key_file_free(keyfile);
+}
+
+/* Host is read under the read lock, as it may change meanwhile */
+static gchar *latency_endpoint(struct vpn_connection *connection,
+				unsigned short port)
+{
+	const char *host, *type;
+	gchar *endpoint = NULL;
+	unsigned int i;
+
+	type = vpn_connection_get_type(connection);
+	for (i = 0; port == 0 && i < G_N_ELEMENTS(latency_ports); i++)
+		if (!g_strcmp0(type, latency_ports[i].type))
+			port = latency_ports[i].port;
+
+	if (port == 0)
+		port = LATENCY_PORT_DEFAULT;
+
+	vpn_connections_lock_read();
+	host = vpn_connection_get_host(connection);
+	/* A port in Host wins over the default one */
+	if (host != NULL && *host != '\0')
+		endpoint = g_strdup_printf("%s %u", host, port);
+	vpn_connections_unlock_read();
+
+	return endpoint;
+}
+
+static struct rank *rank_ref(struct rank *rank)
+{
+	g_atomic_int_inc(&rank->ref_count);
+
+	return rank;
+}
+
+static void rank_unref(struct rank *rank)
+{
+	unsigned int i;
+
+	if (!g_atomic_int_dec_and_test(&rank->ref_count))
+		return;
+
+	for (i = 0; i < rank->count; i++) {
+		vpn_connection_unref(rank->candidates[i].connection);
+		g_free(rank->candidates[i].endpoint);
+	}
+
+	g_object_unref(rank->client);
+	g_free(rank->candidates);
+	g_free(rank);
+}
+
+static gint rank_compare(gconstpointer a, gconstpointer b)
+{
+	const struct rank_candidate *ca = a, *cb = b;
+
+	if (ca->latency == cb->latency)
+		return 0;
+	if (ca->latency == DVPNLIB_LATENCY_UNREACHABLE)
+		return 1;
+	if (cb->latency == DVPNLIB_LATENCY_UNREACHABLE)
+		return -1;
+
+	return ca->latency < cb->latency ? -1 : 1;
+}
+
+static void rank_finish(struct rank *rank)
+{
+	GList *sorted = NULL, *connections = NULL, *iter;
+	struct rank_candidate *candidate;
+	unsigned int i;
+
+	if (rank->measured)
+		latency_save();
+
+	for (i = 0; i < rank->count; i++)
+		sorted = g_list_prepend(sorted, &rank->candidates[i]);
+
+	/* Stable, so equal latencies keep the order given */
+	sorted = g_list_sort(g_list_reverse(sorted), rank_compare);
+
+	for (iter = sorted; iter != NULL; iter = iter->next) {
+		candidate = iter->data;
+
+		DBG("%s: %" G_GINT64_FORMAT " us", candidate->endpoint,
+						candidate->latency);
+		connections = g_list_prepend(connections,
+						candidate->connection);
+	}
+	connections = g_list_reverse(connections);
+
+	if (rank->callback)
+		rank->callback(connections, rank->user_data);
+
+	g_list_free(connections);
+	g_list_free(sorted);
+}
+
+static void free_rank_probe(struct rank_probe *probe)
+{
+	if (probe->timer != NULL) {
+		g_source_destroy(probe->timer);
+		g_source_unref(probe->timer);
+	}
+
+	g_object_unref(probe->cancellable);
+	rank_unref(probe->rank);
+	g_free(probe);
+}
+
+static void rank_probe_done(struct rank_probe *probe, gint64 latency)
+{
+	struct rank *rank = probe->rank;
+	struct rank_candidate *candidate = &rank->candidates[probe->index];
+
+	candidate->latency = latency;
+	rank->measured = TRUE;
+
+	G_LOCK(latency);
+	latency_store(candidate->endpoint, latency, g_get_real_time());
+	G_UNLOCK(latency);
+
+	if (--rank->pending == 0)
+		rank_finish(rank);
+
+	free_rank_probe(probe);
+}
+
+static void rank_probe_reply(GObject *source, GAsyncResult *result,
+				gpointer user_data)
+{
+	struct rank_probe *probe = user_data;
+	GSocketConnection *connection;
+	GError *error = NULL;
+	gint64 latency;
+
+	latency = g_get_monotonic_time() - probe->start;
+
+	connection = g_socket_client_connect_finish(G_SOCKET_CLIENT(source),
+							result, &error);
+	if (connection != NULL) {
+		g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+		g_object_unref(connection);
+	} else if (g_error_matches(error, G_IO_ERROR,
+					G_IO_ERROR_CONNECTION_REFUSED)) {
+		/* The host answered, with a reset */
+		g_error_free(error);
+	} else {
+		DBG("%s: %s", probe->rank->candidates[probe->index].endpoint,
+							error->message);
+		g_error_free(error);
+		latency = DVPNLIB_LATENCY_UNREACHABLE;
+	}
+
+	rank_probe_done(probe, latency);
+}
+
+static gboolean rank_probe_timeout(gpointer data)
+{
+	struct rank_probe *probe = data;
+
+	g_source_unref(probe->timer);
+	probe->timer = NULL;
+
+	/* The reply follows with G_IO_ERROR_CANCELLED */
+	g_cancellable_cancel(probe->cancellable);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void rank_probe_start(struct rank *rank, unsigned int index,
+				int timeout)
+{
+	struct rank_candidate *candidate = &rank->candidates[index];
+	GSocketConnectable *address;
+	struct rank_probe *probe;
+	gchar **parts;
+	GError *error = NULL;
+
+	/* endpoint is "<host> <default port>" */
+	parts = g_strsplit(candidate->endpoint, " ", 2);
+	address = g_network_address_parse(parts[0],
+				(guint16)g_ascii_strtoull(parts[1], NULL, 10),
+				&error);
+	g_strfreev(parts);
+
+	probe = g_new0(struct rank_probe, 1);
+	probe->rank = rank_ref(rank);
+	probe->index = index;
+	probe->cancellable = g_cancellable_new();
+
+	if (address == NULL) {
+		DBG("%s: %s", candidate->endpoint, error->message);
+		g_error_free(error);
+		rank_probe_done(probe, DVPNLIB_LATENCY_UNREACHABLE);
+		return;
+	}
+
+	probe->timer = g_timeout_source_new(timeout);
+	g_source_set_callback(probe->timer, rank_probe_timeout, probe, NULL);
+	g_source_attach(probe->timer, g_main_context_get_thread_default());
+
+	probe->start = g_get_monotonic_time();
+	g_socket_client_connect_async(rank->client, address,
+				probe->cancellable, rank_probe_reply, probe);
+	g_object_unref(address);
+}
+
+/*
+ * Measures the connections which have no fresh result, all at once,
+ * and calls callback in the thread-default main context of the caller
+ * once they are known. Without anything to measure, callback is called
+ * before this returns.
+ */
+enum dvpnlib_err vpn_connections_rank_by_latency(
+				struct vpn_connection **connections,
+				unsigned int count,
+				unsigned short port,
+				int timeout,
+				dvpnlib_rank_cb callback,
+				void *user_data)
+{
+	struct rank_candidate *candidate;
+	struct rank *rank;
+	unsigned int i;
+	gboolean *probe;
+
+	DBG("count %u, port %u", count, port);
+
+	if (connections == NULL || count == 0)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	if (timeout == DVPNLIB_TIMEOUT_DEFAULT || timeout <= 0)
+		timeout = LATENCY_PROBE_TIMEOUT;
+
+	rank = g_new0(struct rank, 1);
+	rank->ref_count = 1;
+	rank->candidates = g_new0(struct rank_candidate, count);
+	rank->count = count;
+	rank->client = g_socket_client_new();
+	rank->callback = callback;
+	rank->user_data = user_data;
+
+	probe = g_new0(gboolean, count);
+
+	G_LOCK(latency);
+	for (i = 0; i < count; i++) {
+		assert(connections[i] != NULL);
+
+		candidate = &rank->candidates[i];
+		candidate->connection = vpn_connection_ref(connections[i]);
+		candidate->endpoint = latency_endpoint(connections[i], port);
+		candidate->latency = DVPNLIB_LATENCY_UNREACHABLE;
+
+		if (candidate->endpoint != NULL &&
+				!latency_lookup(candidate->endpoint,
+						&candidate->latency)) {
+			probe[i] = TRUE;
+			rank->pending++;
+		}
+	}
+	G_UNLOCK(latency);
+
+	if (rank->pending == 0)
+		rank_finish(rank);
+
+	/* Each probe holds the ranking until it is done */
+	for (i = 0; i < count; i++)
+		if (probe[i])
+			rank_probe_start(rank, i, timeout);
+
+	g_free(probe);
+	rank_unref(rank);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+enum dvpnlib_err vpn_connection_get_latency(
+				struct vpn_connection *connection,
+				unsigned short port,
+				gint64 *latency)
+{
+	enum dvpnlib_err ret = DVPNLIB_ERR_NONE;
+	gchar *endpoint;
+
+	assert(connection != NULL);
+
+	endpoint = latency_endpoint(connection, port);
+	if (endpoint == NULL)
+		return DVPNLIB_ERR_NOT_FOUND;
+
+	G_LOCK(latency);
+	if (!latency_lookup(endpoint, latency))
+		ret = DVPNLIB_ERR_NOT_FOUND;
+	G_UNLOCK(latency);
+
+	g_free(endpoint);
+
+	return ret;
+}
+
+enum dvpnlib_err dvpnlib_latency_set_cache(const char *path,
+				unsigned int ttl)
+{
+	DBG("path %s, ttl %u", path, ttl);
+
+	if (ttl == 0)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	G_LOCK(latency);
+	g_free(latency_cache_path);
+	latency_cache_path = g_strdup(path);
+	latency_ttl = ttl;
+	free_latency_cache();
+	G_UNLOCK(latency);
+
+	if (path != NULL)
+		latency_load(path);
+
+	return DVPNLIB_ERR_NONE;
+}
@@ -1,26 +1,80 @@
 #include "dvpnlib-internal.h"
 #include "dvpnlib-vpn-manager.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-settings.h"
+#include "dvpnlib-trace.h"
 
 struct vpn_manager {
 	GDBusProxy *dbus_proxy;
+	GCancellable *cancellable;
 	void *connection_added_cb_data;
 	void *connection_removed_cb_data;
 	vpn_connection_added_cb connection_added_cb;
 	vpn_connection_removed_cb connection_removed_cb;
 };
 
+/* Guards the callbacks above and the cancellable */
+G_LOCK_DEFINE_STATIC(manager);
+
+struct connection_event {
+	struct vpn_connection *connection;
+	gboolean added;
+};
+
+static gboolean connection_event_dispatch(gpointer data)
+{
+	struct connection_event *event = data;
+	vpn_connection_added_cb added_cb = NULL;
+	vpn_connection_removed_cb removed_cb = NULL;
+	void *user_data = NULL;
+
+	G_LOCK(manager);
+	if (vpn_manager != NULL && event->added) {
+		added_cb = vpn_manager->connection_added_cb;
+		user_data = vpn_manager->connection_added_cb_data;
+	} else if (vpn_manager != NULL) {
+		removed_cb = vpn_manager->connection_removed_cb;
+		user_data = vpn_manager->connection_removed_cb_data;
+	}
+	G_UNLOCK(manager);
+
+	if (added_cb)
+		added_cb(event->connection, user_data);
+	else if (removed_cb)
+		removed_cb(event->connection, user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_connection_event(gpointer data)
+{
+	struct connection_event *event = data;
+
+	vpn_connection_unref(event->connection);
+	g_free(event);
+}
+
+static void post_connection_event(struct vpn_connection *connection,
+					gboolean added)
+{
+	struct connection_event *event;
+
+	event = g_new0(struct connection_event, 1);
+	event->connection = vpn_connection_ref(connection);
+	event->added = added;
+
+	dvpnlib_event_post(connection_event_dispatch, event,
+				free_connection_event, FALSE);
+}
+
 static void connection_added(GVariant *parameters)
 {
 	struct vpn_connection *connection;
 
 	DBG("");
 
-	if (add_vpn_connection(&parameters, &connection)) {
-		if (vpn_manager->connection_added_cb) {
-			vpn_manager->connection_added_cb(connection,
-				vpn_manager->connection_added_cb_data);
-		}
-	}
+	if (add_vpn_connection(&parameters, &connection))
+		post_connection_event(connection, TRUE);
 }
 
 static void connection_removed(GVariant *parameters)
@@ -30,26 +84,83 @@ static void connection_removed(GVariant *parameters)
 	const gchar *connection_path;
 	struct vpn_connection *connection;
 
-	g_variant_get(parameters, "(o)", &connection_path);
+	g_variant_get(parameters, "(&o)", &connection_path);
 
 	connection = get_connection_by_path(connection_path);
 	if (connection == NULL)
 		return;
 
-	if (vpn_manager->connection_removed_cb) {
-		void *user_data = vpn_manager->connection_removed_cb_data;
-		vpn_manager->connection_removed_cb(connection, user_data);
-	}
+	/* The event holds a reference until it has been delivered */
+	post_connection_event(connection, FALSE);
 
 	remove_vpn_connection(connection);
 }
 
+static void resync_reply(enum dvpnlib_err result, GVariant *reply,
+				gpointer user_data)
+{
+	GList *added, *stale, *iter;
+
+	if (result != DVPNLIB_ERR_NONE) {
+		ERROR("GetConnections failed: %d", result);
+		return;
+	}
+
+	resync_vpn_connections(reply, &added, &stale);
+
+	DBG("%u added, %u removed", g_list_length(added),
+					g_list_length(stale));
+
+	for (iter = stale; iter != NULL; iter = iter->next) {
+		post_connection_event(iter->data, FALSE);
+		remove_vpn_connection(iter->data);
+	}
+
+	for (iter = added; iter != NULL; iter = iter->next)
+		post_connection_event(iter->data, TRUE);
+
+	g_list_free_full(stale, (GDestroyNotify)vpn_connection_unref);
+	g_list_free_full(added, (GDestroyNotify)vpn_connection_unref);
+}
+
+/*
+ * The proxy follows the owner of VPN_NAME. When connman-vpn comes back
+ * after a restart the table is reconciled with its profiles instead of
+ * being rebuilt, so the handles of the paths that survive stay valid,
+ * and the agent is registered again.
+ */
+static void manager_name_owner_changed(GObject *object, GParamSpec *pspec,
+					gpointer user_data)
+{
+	GDBusProxy *proxy = G_DBUS_PROXY(object);
+	GCancellable *cancellable;
+	gchar *owner;
+
+	owner = g_dbus_proxy_get_name_owner(proxy);
+	connection_agent_owner_changed(owner != NULL);
+	if (owner == NULL) {
+		WARN("%s has vanished", VPN_NAME);
+		return;
+	}
+
+	DBG("%s is now owned by %s", VPN_NAME, owner);
+	g_free(owner);
+
+	cancellable = get_vpn_manager_cancellable();
+	common_set_interface_call_method(proxy, "GetConnections", NULL,
+					DVPNLIB_TIMEOUT_DEFAULT, cancellable,
+					resync_reply, NULL);
+	g_object_unref(cancellable);
+}
+
 static void manager_signal_handler(GDBusProxy *proxy, gchar *sender_name,
 				gchar *signal_name, GVariant *parameters,
 				gpointer user_data)
 {
 	DBG("signal_name: %s", signal_name);
 
+	TRACE_SIGNAL(g_dbus_proxy_get_object_path(proxy), signal_name);
+
 	if (!g_strcmp0(signal_name, "ConnectionAdded"))
 		connection_added(parameters);
 	else if (!g_strcmp0(signal_name, "ConnectionRemoved"))
@@ -63,6 +174,11 @@ void free_vpn_manager(struct vpn_manager *manager)
 	if (manager == NULL)
 		return;
 
+	if (manager->cancellable != NULL) {
+		g_cancellable_cancel(manager->cancellable);
+		g_object_unref(manager->cancellable);
+	}
+
 	if (manager->dbus_proxy != NULL)
 		g_object_unref(manager->dbus_proxy);
 
@@ -83,7 +199,8 @@ struct vpn_manager *create_vpn_manager(void)
 
 	manager->dbus_proxy = g_dbus_proxy_new_for_bus_sync(
 					G_BUS_TYPE_SYSTEM,
-					G_DBUS_PROXY_FLAGS_NONE, NULL,
+					G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+					NULL,
 					VPN_NAME, VPN_MANAGER_PATH,
 					VPN_MANAGER_INTERFACE, NULL, &error);
 
@@ -94,8 +211,12 @@ struct vpn_manager *create_vpn_manager(void)
 		return NULL;
 	}
 
+	manager->cancellable = g_cancellable_new();
+
 	g_signal_connect(manager->dbus_proxy, "g-signal",
 			G_CALLBACK(manager_signal_handler), NULL);
+	g_signal_connect(manager->dbus_proxy, "notify::g-name-owner",
+			G_CALLBACK(manager_name_owner_changed), NULL);
 
 	return manager;
 }
@@ -105,42 +226,32 @@ GDBusProxy *get_vpn_manager_dbus_proxy(void)
 	return vpn_manager->dbus_proxy;
 }
 
+/* Returns a new reference */
+GCancellable *get_vpn_manager_cancellable(void)
+{
+	GCancellable *cancellable;
+
+	G_LOCK(manager);
+	cancellable = g_object_ref(vpn_manager->cancellable);
+	G_UNLOCK(manager);
+
+	return cancellable;
+}
+
 /**
  * Asynchronous Methods Create/Remove callback
  */
-static void create_remove_callback(GObject *source_object,
-			     GAsyncResult *res, gpointer user_data)
+static void create_remove_callback(enum dvpnlib_err result,
+				GVariant *reply, gpointer user_data)
 {
-	GError *error = NULL;
-	enum dvpnlib_err error_type = DVPNLIB_ERR_NONE;
-	GVariant *ret;
 	struct common_reply_data *reply_data;
 
 	reply_data = user_data;
 	if (!reply_data)
 		return;
 
-	if (!vpn_manager)
-		goto done;
-
-	if (!vpn_manager->dbus_proxy)
-		goto done;
-
-	ret = g_dbus_proxy_call_finish(vpn_manager->dbus_proxy, res, &error);
-	if (!ret) {
-		DBG("%s", error->message);
-		error_type = get_error_type(error);
-
-		g_error_free(error);
-	} else
-		g_variant_unref(ret);
+	common_reply_dispatch(reply_data->cb, result, reply_data->data);
 
-	if (reply_data->cb) {
-		dvpnlib_reply_cb callback = reply_data->cb;
-		callback(error_type, reply_data->data);
-	}
-
-done:
 	g_free(reply_data);
 }
 
@@ -148,35 +259,18 @@ done:
 
 static void print_variant(const gchar *s, GVariant *v)
 {
-	gchar *temp = g_variant_print(v, true);
-	DBG("%s => %s", s, temp);
-	g_free(temp);
-}
+	gchar *temp;
 
-static GVariant *
-settings_from_hash_table(GHashTable *hash_table)
-{
-	GVariantBuilder builder;
-
-	g_variant_builder_init(&builder, G_VARIANT_TYPE("(a{sv})"));
-	g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
-
-	GHashTableIter iter;
-	gpointer key, value;
-
-	g_hash_table_iter_init(&iter, hash_table);
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		g_variant_builder_add(&builder, "{sv}",
-				key,
-				g_variant_new_string(value));
-	}
-
-	g_variant_builder_close(&builder);
+	if (!DBG_ENABLED())
+		return;
 
-	return g_variant_builder_end(&builder);
+	temp = g_variant_print(v, true);
+	DBG("%s => %s", s, temp);
+	g_free(temp);
 }
 
-enum dvpnlib_err dvpnlib_vpn_manager_create(GHashTable *settings,
+enum dvpnlib_err dvpnlib_vpn_manager_create(
+				 struct dvpnlib_settings *settings,
 				 dvpnlib_reply_cb callback,
 				 void *user_data)
 {
@@ -185,9 +279,6 @@ enum dvpnlib_err dvpnlib_vpn_manager_create(GHashTable *settings,
 	assert(vpn_manager != NULL);
 	assert(settings != NULL);
 
-	settings_v = settings_from_hash_table(settings);
-	print_variant("Settings", settings_v);
-
 	struct common_reply_data *reply_data;
 
 	reply_data =
@@ -198,12 +289,27 @@ enum dvpnlib_err dvpnlib_vpn_manager_create(GHashTable *settings,
 		return DVPNLIB_ERR_FAILED;
 	}
 
-	return common_set_interface_call_method(
+	settings_v = dvpnlib_settings_get_parameters(settings);
+	print_variant("Settings", settings_v);
+
+	GCancellable *cancellable = get_vpn_manager_cancellable();
+	enum dvpnlib_err ret;
+
+	ret = common_set_interface_call_method(
 			vpn_manager->dbus_proxy,
 			"Create",
 			&settings_v,
-			(GAsyncReadyCallback)create_remove_callback,
+			DVPNLIB_TIMEOUT_DEFAULT,
+			cancellable,
+			create_remove_callback,
 			reply_data);
+	g_object_unref(cancellable);
+	g_variant_unref(settings_v);
+
+	if (ret != DVPNLIB_ERR_NONE)
+		g_free(reply_data);
+
+	return ret;
 }
 
 enum dvpnlib_err dvpnlib_vpn_manager_remove(const char *path,
@@ -231,12 +337,17 @@ enum dvpnlib_err dvpnlib_vpn_manager_remove(const char *path,
 
 	}
 
+	GCancellable *cancellable = get_vpn_manager_cancellable();
+
 	ret = common_set_interface_call_method(
 			vpn_manager->dbus_proxy,
 			"Remove",
 			&value,
-			(GAsyncReadyCallback)create_remove_callback,
+			DVPNLIB_TIMEOUT_DEFAULT,
+			cancellable,
+			create_remove_callback,
 			reply_data);
+	g_object_unref(cancellable);
 
 	return ret;
 }
@@ -252,10 +363,18 @@ enum dvpnlib_err dvpnlib_vpn_manager_register_agent(const char *path)
 
 	value = g_variant_new("(o)", path);
 
-	return common_set_interface_call_method_sync(
+	GCancellable *cancellable = get_vpn_manager_cancellable();
+	enum dvpnlib_err ret;
+
+	ret = common_set_interface_call_method_sync(
 			vpn_manager->dbus_proxy,
 			"RegisterAgent",
-			&value);
+			&value,
+			DVPNLIB_TIMEOUT_DEFAULT,
+			cancellable);
+	g_object_unref(cancellable);
+
+	return ret;
 }
 
 enum dvpnlib_err dvpnlib_vpn_manager_unregister_agent(const char *path)
@@ -269,10 +388,40 @@ enum dvpnlib_err dvpnlib_vpn_manager_unregister_agent(const char *path)
 
 	value = g_variant_new("(o)", path);
 
-	return common_set_interface_call_method_sync(
+	GCancellable *cancellable = get_vpn_manager_cancellable();
+	enum dvpnlib_err ret;
+
+	ret = common_set_interface_call_method_sync(
 			vpn_manager->dbus_proxy,
 			"UnregisterAgent",
-			&value);
+			&value,
+			DVPNLIB_TIMEOUT_DEFAULT,
+			cancellable);
+	g_object_unref(cancellable);
+
+	return ret;
+}
+
+/*
+ * Aborts every Create/Remove/RegisterAgent call currently in flight;
+ * they complete with DVPNLIB_ERR_OPERATION_ABORTED. Later calls get a
+ * fresh GCancellable and are not affected.
+ */
+void dvpnlib_vpn_manager_cancel(void)
+{
+	DBG("");
+
+	GCancellable *cancellable;
+
+	assert(vpn_manager != NULL);
+
+	G_LOCK(manager);
+	cancellable = vpn_manager->cancellable;
+	vpn_manager->cancellable = g_cancellable_new();
+	G_UNLOCK(manager);
+
+	g_cancellable_cancel(cancellable);
+	g_object_unref(cancellable);
 }
 
 void dvpnlib_vpn_manager_set_connection_added_cb(
@@ -283,8 +432,10 @@ void dvpnlib_vpn_manager_set_connection_added_cb(
 
 	assert(vpn_manager != NULL);
 
+	G_LOCK(manager);
 	vpn_manager->connection_added_cb = cb;
 	vpn_manager->connection_added_cb_data = user_data;
+	G_UNLOCK(manager);
 }
 
 void dvpnlib_vpn_manager_unset_connection_added_cb()
@@ -293,8 +444,10 @@ void dvpnlib_vpn_manager_unset_connection_added_cb()
 
 	assert(vpn_manager != NULL);
 
+	G_LOCK(manager);
 	vpn_manager->connection_added_cb = NULL;
 	vpn_manager->connection_added_cb_data = NULL;
+	G_UNLOCK(manager);
 }
 
 void dvpnlib_vpn_manager_set_connection_removed_cb(
@@ -305,8 +458,10 @@ void dvpnlib_vpn_manager_set_connection_removed_cb(
 
 	assert(vpn_manager != NULL);
 
+	G_LOCK(manager);
 	vpn_manager->connection_removed_cb = cb;
 	vpn_manager->connection_removed_cb_data = user_data;
+	G_UNLOCK(manager);
 }
 
 void dvpnlib_vpn_manager_unset_connection_removed_cb()
@@ -315,7 +470,9 @@ void dvpnlib_vpn_manager_unset_connection_removed_cb()
 
 	assert(vpn_manager != NULL);
 
+	G_LOCK(manager);
 	vpn_manager->connection_removed_cb = NULL;
 	vpn_manager->connection_removed_cb_data = NULL;
+	G_UNLOCK(manager);
 }
 
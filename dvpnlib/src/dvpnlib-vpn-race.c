@@ -0,0 +1,345 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-race.h"
+
+/*
+ * A race runs in the main context of the thread which started it: the
+ * Connect replies and State changes of its connections are marshalled
+ * there, and the stagger timer is attached to it, so the race itself
+ * needs no lock. Only the table of the connections racing is shared with
+ * the dispatch context, under the race lock.
+ */
+struct race_candidate {
+	struct vpn_connection *connection;	/* reference */
+	gboolean started;
+	gboolean failed;
+};
+
+struct race {
+	gint ref_count;
+	GMainContext *context;
+	struct race_candidate *candidates;
+	unsigned int count;
+	unsigned int next;	/* first candidate not started */
+	unsigned int failed;
+	unsigned int stagger_ms;
+	int timeout;
+	GSource *timer;
+	gboolean finished;
+	dvpnlib_connect_any_cb callback;
+	void *user_data;
+};
+
+struct race_event {
+	struct race *race;
+	unsigned int index;
+	gboolean reply;
+	gint state;
+	enum dvpnlib_err result;
+};
+
+G_LOCK_DEFINE_STATIC(race);
+static GHashTable *races;	/* connection -> struct race */
+
+static struct race *race_ref(struct race *race)
+{
+	g_atomic_int_inc(&race->ref_count);
+
+	return race;
+}
+
+static void race_unref(gpointer data)
+{
+	struct race *race = data;
+	unsigned int i;
+
+	if (!g_atomic_int_dec_and_test(&race->ref_count))
+		return;
+
+	for (i = 0; i < race->count; i++)
+		vpn_connection_unref(race->candidates[i].connection);
+
+	g_free(race->candidates);
+	g_main_context_unref(race->context);
+	g_free(race);
+}
+
+static void race_stop_timer(struct race *race)
+{
+	if (race->timer == NULL)
+		return;
+
+	g_source_destroy(race->timer);
+	g_source_unref(race->timer);
+	race->timer = NULL;
+}
+
+/* Stops the connect of a loser, without letting it reconnect */
+static void race_abort(struct vpn_connection *connection)
+{
+	DBG("%s", vpn_connection_get_path(connection));
+
+	connection_reconnect_reset(connection);
+	connection_watchdog_disarm(connection);
+	connection_abort_connect(connection);
+}
+
+static void race_finish(struct race *race, int winner,
+				enum dvpnlib_err result)
+{
+	struct race_candidate *candidate;
+	unsigned int i;
+
+	race->finished = TRUE;
+	race_stop_timer(race);
+
+	G_LOCK(race);
+	for (i = 0; i < race->count; i++)
+		g_hash_table_remove(races, race->candidates[i].connection);
+	G_UNLOCK(race);
+
+	for (i = 0; i < race->count; i++) {
+		candidate = &race->candidates[i];
+
+		if ((int)i != winner && candidate->started &&
+							!candidate->failed)
+			race_abort(candidate->connection);
+	}
+
+	DBG("winner %d of %u, result %d", winner, race->count, result);
+
+	if (race->callback)
+		race->callback(winner < 0 ? NULL :
+				race->candidates[winner].connection,
+				result, race->user_data);
+
+	race_unref(race);
+}
+
+static void race_post(struct race *race, unsigned int index,
+			gboolean reply, gint state, enum dvpnlib_err result);
+
+static void race_connect_reply(enum dvpnlib_err result, void *user_data)
+{
+	struct race_event *event = user_data;
+
+	race_post(event->race, event->index, TRUE, 0, result);
+	race_unref(event->race);
+	g_free(event);
+}
+
+static void race_failed(struct race *race, unsigned int index,
+				enum dvpnlib_err result);
+static void race_start_next(struct race *race);
+
+static gboolean race_stagger_timeout(gpointer data)
+{
+	struct race *race = data;
+
+	if (race->timer != g_main_current_source())
+		return G_SOURCE_REMOVE;
+
+	g_source_unref(race->timer);
+	race->timer = NULL;
+
+	race_start_next(race);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void race_start_next(struct race *race)
+{
+	struct race_candidate *candidate;
+	struct race_event *event;
+	unsigned int index;
+	enum dvpnlib_err err;
+
+	if (race->finished || race->next >= race->count)
+		return;
+
+	index = race->next++;
+	candidate = &race->candidates[index];
+	candidate->started = TRUE;
+
+	DBG("%u: %s", index, vpn_connection_get_path(candidate->connection));
+
+	/* The next one gets its head start before this one may fail */
+	race_stop_timer(race);
+	if (race->next < race->count) {
+		race->timer = g_timeout_source_new(race->stagger_ms);
+		g_source_set_callback(race->timer, race_stagger_timeout,
+					race_ref(race), race_unref);
+		g_source_attach(race->timer, race->context);
+	}
+
+	event = g_new0(struct race_event, 1);
+	event->race = race_ref(race);
+	event->index = index;
+
+	err = vpn_connection_connect_with_timeout(candidate->connection,
+					race->timeout, race_connect_reply,
+					event);
+	if (err != DVPNLIB_ERR_NONE) {
+		race_unref(event->race);
+		g_free(event);
+		race_failed(race, index, err);
+	}
+}
+
+static void race_failed(struct race *race, unsigned int index,
+				enum dvpnlib_err result)
+{
+	struct race_candidate *candidate = &race->candidates[index];
+
+	if (race->finished || candidate->failed)
+		return;
+
+	DBG("%u failed: %d", index, result);
+
+	candidate->failed = TRUE;
+	if (++race->failed == race->count) {
+		race_finish(race, -1, result);
+		return;
+	}
+
+	/* No need to wait for the stagger delay */
+	race_start_next(race);
+}
+
+static gboolean race_event_dispatch(gpointer data)
+{
+	struct race_event *event = data;
+	struct race *race = event->race;
+
+	if (race->finished)
+		return G_SOURCE_REMOVE;
+
+	if (event->reply) {
+		if (event->result == DVPNLIB_ERR_NONE ||
+			event->result == DVPNLIB_ERR_ALREADY_CONNECTED)
+			race_finish(race, event->index, DVPNLIB_ERR_NONE);
+		else if (event->result != DVPNLIB_ERR_IN_PROGRESS)
+			race_failed(race, event->index, event->result);
+	} else if (event->state == VPN_CONN_STATE_READY &&
+			race->candidates[event->index].started) {
+		race_finish(race, event->index, DVPNLIB_ERR_NONE);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_race_event(gpointer data)
+{
+	struct race_event *event = data;
+
+	race_unref(event->race);
+	g_free(event);
+}
+
+static void race_post(struct race *race, unsigned int index,
+			gboolean reply, gint state, enum dvpnlib_err result)
+{
+	struct race_event *event;
+
+	event = g_new0(struct race_event, 1);
+	event->race = race_ref(race);
+	event->index = index;
+	event->reply = reply;
+	event->state = state;
+	event->result = result;
+
+	g_main_context_invoke_full(race->context, G_PRIORITY_DEFAULT,
+				race_event_dispatch, event, free_race_event);
+}
+
+/* Hook of dvpnlib-vpn-connnection.c */
+void connection_race_state_changed(struct vpn_connection *connection,
+					gint state)
+{
+	struct race *race = NULL;
+	unsigned int index = 0;
+
+	if (state != VPN_CONN_STATE_READY)
+		return;
+
+	G_LOCK(race);
+	if (races != NULL)
+		race = g_hash_table_lookup(races, connection);
+	if (race != NULL) {
+		race_ref(race);
+		while (race->candidates[index].connection != connection)
+			index++;
+	}
+	G_UNLOCK(race);
+
+	if (race == NULL)
+		return;
+
+	race_post(race, index, FALSE, state, DVPNLIB_ERR_NONE);
+	race_unref(race);
+}
+
+enum dvpnlib_err vpn_connections_connect_any(
+				struct vpn_connection **connections,
+				unsigned int count,
+				unsigned int stagger_ms,
+				int timeout,
+				dvpnlib_connect_any_cb callback,
+				void *user_data)
+{
+	struct race *race;
+	unsigned int i;
+
+	DBG("count %u, stagger %u ms", count, stagger_ms);
+
+	if (connections == NULL || count == 0)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	for (i = 0; i < count; i++) {
+		assert(connections[i] != NULL);
+
+		if (vpn_connection_is_removed(connections[i]))
+			return DVPNLIB_ERR_NOT_FOUND;
+	}
+
+	race = g_new0(struct race, 1);
+	race->ref_count = 1;
+	race->context = g_main_context_ref_thread_default();
+	race->candidates = g_new0(struct race_candidate, count);
+	race->count = count;
+	race->stagger_ms = stagger_ms;
+	race->timeout = timeout;
+	race->callback = callback;
+	race->user_data = user_data;
+
+	for (i = 0; i < count; i++)
+		race->candidates[i].connection =
+					vpn_connection_ref(connections[i]);
+
+	G_LOCK(race);
+	if (races == NULL)
+		races = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* Also catches a connection given twice */
+	for (i = 0; i < count; i++) {
+		if (g_hash_table_contains(races, connections[i]))
+			break;
+
+		g_hash_table_insert(races, connections[i], race);
+	}
+
+	if (i < count) {
+		while (i-- > 0)
+			g_hash_table_remove(races, connections[i]);
+		G_UNLOCK(race);
+
+		race_unref(race);
+		return DVPNLIB_ERR_IN_PROGRESS;
+	}
+	G_UNLOCK(race);
+
+	/* The reference of the table, dropped when the race is over */
+	race_start_next(race);
+
+	return DVPNLIB_ERR_NONE;
+}
@@ -0,0 +1,466 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-reconnect.h"
+
+/*
+ * The engine of each connection runs in the main context of the thread
+ * which set its policy: State changes and Connect replies are marshalled
+ * there, and the backoff timer is attached to it. The fields below are
+ * also reset from explicit connect and disconnect calls, from any
+ * thread, so they are guarded by the reconnect lock.
+ */
+struct reconnect {
+	gint ref_count;
+	struct vpn_connection *connection;	/* reference */
+	struct dvpnlib_reconnect_policy policy;
+	dvpnlib_reconnect_cb callback;
+	void *user_data;
+	GDestroyNotify destroy;
+	GMainContext *context;
+	gboolean active;	/* still the policy of the connection */
+	gboolean armed;		/* ready since the last explicit request */
+	gboolean in_progress;	/* an attempt awaits its outcome */
+	unsigned int attempt;
+	GSource *timer;
+};
+
+struct reconnect_event {
+	struct reconnect *reconnect;
+	gboolean reply;
+	gint state;
+	enum dvpnlib_err result;
+};
+
+G_LOCK_DEFINE_STATIC(reconnect);
+static GHashTable *reconnects;	/* connection -> struct reconnect */
+
+static struct reconnect *reconnect_ref(struct reconnect *reconnect)
+{
+	g_atomic_int_inc(&reconnect->ref_count);
+
+	return reconnect;
+}
+
+static void reconnect_unref(gpointer data)
+{
+	struct reconnect *reconnect = data;
+
+	if (!g_atomic_int_dec_and_test(&reconnect->ref_count))
+		return;
+
+	if (reconnect->destroy)
+		reconnect->destroy(reconnect->user_data);
+
+	vpn_connection_unref(reconnect->connection);
+	g_main_context_unref(reconnect->context);
+	g_free(reconnect);
+}
+
+/* Called with the reconnect lock held */
+static void reconnect_stop_timer(struct reconnect *reconnect)
+{
+	if (reconnect->timer == NULL)
+		return;
+
+	g_source_destroy(reconnect->timer);
+	g_source_unref(reconnect->timer);
+	reconnect->timer = NULL;
+}
+
+/* Called with the reconnect lock held */
+static void reconnect_reset(struct reconnect *reconnect)
+{
+	reconnect_stop_timer(reconnect);
+	reconnect->armed = FALSE;
+	reconnect->in_progress = FALSE;
+	reconnect->attempt = 0;
+}
+
+/*
+ * Called with the reconnect lock held. Takes it out of the table, the
+ * caller drops the table's reference once the lock is released.
+ */
+static void reconnect_deactivate(struct reconnect *reconnect)
+{
+	reconnect_reset(reconnect);
+	reconnect->active = FALSE;
+	g_hash_table_steal(reconnects, reconnect->connection);
+}
+
+static void reconnect_report(struct reconnect *reconnect,
+				enum dvpnlib_reconnect_event event,
+				unsigned int attempt, unsigned int delay_ms,
+				enum dvpnlib_err result)
+{
+	struct dvpnlib_reconnect_info info = {
+		.event = event,
+		.attempt = attempt,
+		.delay_ms = delay_ms,
+		.result = result,
+	};
+
+	DBG("%s: event %d attempt %u delay %u result %d",
+			vpn_connection_get_path(reconnect->connection),
+			event, attempt, delay_ms, result);
+
+	if (reconnect->callback)
+		reconnect->callback(reconnect->connection, &info,
+						reconnect->user_data);
+}
+
+static unsigned int reconnect_delay(
+				const struct dvpnlib_reconnect_policy *policy,
+				unsigned int attempt)
+{
+	guint64 delay = policy->initial_delay_ms;
+	gint64 spread;
+
+	while (--attempt > 0 && delay < policy->max_delay_ms)
+		delay *= 2;
+
+	delay = MIN(delay, policy->max_delay_ms);
+
+	spread = delay * policy->jitter_percent / 100;
+	if (spread > 0)
+		delay += g_random_int_range(-spread, spread + 1);
+
+	return delay;
+}
+
+static gboolean reconnect_timeout(gpointer data);
+
+/*
+ * Called with the reconnect lock held, releases it. Schedules the next
+ * attempt, or gives up once the attempts are exhausted.
+ */
+static void reconnect_schedule(struct reconnect *reconnect)
+{
+	unsigned int attempt, delay;
+
+	if (reconnect->policy.max_attempts != 0 &&
+			reconnect->attempt >= reconnect->policy.max_attempts) {
+		attempt = reconnect->attempt;
+		reconnect->armed = FALSE;
+		reconnect->attempt = 0;
+		G_UNLOCK(reconnect);
+
+		reconnect_report(reconnect, DVPNLIB_RECONNECT_GAVE_UP,
+					attempt, 0, DVPNLIB_ERR_NONE);
+		return;
+	}
+
+	attempt = ++reconnect->attempt;
+	delay = reconnect_delay(&reconnect->policy, attempt);
+
+	reconnect->timer = g_timeout_source_new(delay);
+	g_source_set_callback(reconnect->timer, reconnect_timeout,
+				reconnect_ref(reconnect), reconnect_unref);
+	g_source_attach(reconnect->timer, reconnect->context);
+	G_UNLOCK(reconnect);
+
+	reconnect_report(reconnect, DVPNLIB_RECONNECT_SCHEDULED,
+				attempt, delay, DVPNLIB_ERR_NONE);
+}
+
+/* Called with the reconnect lock held, releases it */
+static void reconnect_attempt_failed(struct reconnect *reconnect,
+					enum dvpnlib_err result)
+{
+	unsigned int attempt = reconnect->attempt;
+
+	reconnect->in_progress = FALSE;
+	G_UNLOCK(reconnect);
+
+	reconnect_report(reconnect, DVPNLIB_RECONNECT_FAILED,
+				attempt, 0, result);
+
+	G_LOCK(reconnect);
+	if (reconnect->active && reconnect->armed && reconnect->timer == NULL)
+		reconnect_schedule(reconnect);
+	else
+		G_UNLOCK(reconnect);
+}
+
+static void reconnect_post(struct reconnect *reconnect, gboolean reply,
+				gint state, enum dvpnlib_err result);
+
+static void reconnect_connect_reply(enum dvpnlib_err result, void *user_data)
+{
+	struct reconnect *reconnect = user_data;
+
+	reconnect_post(reconnect, TRUE, 0, result);
+	reconnect_unref(reconnect);
+}
+
+static gboolean reconnect_timeout(gpointer data)
+{
+	struct reconnect *reconnect = data;
+	unsigned int attempt;
+	enum dvpnlib_err err;
+
+	G_LOCK(reconnect);
+	if (reconnect->timer != g_main_current_source()) {
+		/* Stopped meanwhile */
+		G_UNLOCK(reconnect);
+		return G_SOURCE_REMOVE;
+	}
+
+	g_source_unref(reconnect->timer);
+	reconnect->timer = NULL;
+
+	if (!reconnect->active || !reconnect->armed) {
+		G_UNLOCK(reconnect);
+		return G_SOURCE_REMOVE;
+	}
+
+	reconnect->in_progress = TRUE;
+	attempt = reconnect->attempt;
+	G_UNLOCK(reconnect);
+
+	reconnect_report(reconnect, DVPNLIB_RECONNECT_STARTED,
+				attempt, 0, DVPNLIB_ERR_NONE);
+
+	err = connection_connect(reconnect->connection,
+				reconnect->policy.connect_timeout,
+				DVPNLIB_CONNECT_PRIORITY_NORMAL,
+				reconnect_connect_reply,
+				reconnect_ref(reconnect));
+	if (err != DVPNLIB_ERR_NONE)
+		reconnect_connect_reply(err, reconnect);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void reconnect_state_changed(struct reconnect *reconnect, gint state)
+{
+	unsigned int attempt;
+
+	G_LOCK(reconnect);
+	if (!reconnect->active) {
+		G_UNLOCK(reconnect);
+		return;
+	}
+
+	switch (state) {
+	case VPN_CONN_STATE_READY:
+		attempt = reconnect->in_progress ? reconnect->attempt : 0;
+		reconnect_stop_timer(reconnect);
+		reconnect->armed = TRUE;
+		reconnect->in_progress = FALSE;
+		reconnect->attempt = 0;
+		G_UNLOCK(reconnect);
+
+		if (attempt > 0)
+			reconnect_report(reconnect,
+					DVPNLIB_RECONNECT_SUCCEEDED,
+					attempt, 0, DVPNLIB_ERR_NONE);
+		return;
+	case VPN_CONN_STATE_FAILURE:
+	case VPN_CONN_STATE_IDLE:
+	case VPN_CONN_STATE_DISCONNECT:
+		/* A drop goes through several states, act on the first */
+		if (!reconnect->armed || reconnect->timer != NULL)
+			break;
+
+		if (reconnect->in_progress) {
+			reconnect_attempt_failed(reconnect,
+						DVPNLIB_ERR_NOT_CONNECTED);
+			return;
+		}
+
+		reconnect_schedule(reconnect);
+		return;
+	default:
+		break;
+	}
+
+	G_UNLOCK(reconnect);
+}
+
+static void reconnect_reply(struct reconnect *reconnect,
+				enum dvpnlib_err result)
+{
+	/* Success is only known once State reaches ready */
+	if (result == DVPNLIB_ERR_NONE ||
+			result == DVPNLIB_ERR_ALREADY_CONNECTED ||
+			result == DVPNLIB_ERR_IN_PROGRESS)
+		return;
+
+	G_LOCK(reconnect);
+	if (reconnect->active && reconnect->in_progress &&
+						reconnect->timer == NULL)
+		reconnect_attempt_failed(reconnect, result);
+	else
+		G_UNLOCK(reconnect);
+}
+
+static gboolean reconnect_event_dispatch(gpointer data)
+{
+	struct reconnect_event *event = data;
+
+	if (event->reply)
+		reconnect_reply(event->reconnect, event->result);
+	else
+		reconnect_state_changed(event->reconnect, event->state);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_reconnect_event(gpointer data)
+{
+	struct reconnect_event *event = data;
+
+	reconnect_unref(event->reconnect);
+	g_free(event);
+}
+
+static void reconnect_post(struct reconnect *reconnect, gboolean reply,
+				gint state, enum dvpnlib_err result)
+{
+	struct reconnect_event *event;
+
+	event = g_new0(struct reconnect_event, 1);
+	event->reconnect = reconnect_ref(reconnect);
+	event->reply = reply;
+	event->state = state;
+	event->result = result;
+
+	g_main_context_invoke_full(reconnect->context, G_PRIORITY_DEFAULT,
+				reconnect_event_dispatch, event,
+				free_reconnect_event);
+}
+
+/*
+ * Hooks of dvpnlib-vpn-connnection.c
+ */
+void connection_reconnect_state_changed(struct vpn_connection *connection,
+					gint state)
+{
+	struct reconnect *reconnect = NULL;
+
+	G_LOCK(reconnect);
+	if (reconnects != NULL)
+		reconnect = g_hash_table_lookup(reconnects, connection);
+	if (reconnect != NULL)
+		reconnect_ref(reconnect);
+	G_UNLOCK(reconnect);
+
+	if (reconnect == NULL)
+		return;
+
+	reconnect_post(reconnect, FALSE, state, DVPNLIB_ERR_NONE);
+	reconnect_unref(reconnect);
+}
+
+/* An explicit Connect or Disconnect overrides the engine */
+void connection_reconnect_reset(struct vpn_connection *connection)
+{
+	struct reconnect *reconnect;
+
+	G_LOCK(reconnect);
+	if (reconnects != NULL) {
+		reconnect = g_hash_table_lookup(reconnects, connection);
+		if (reconnect != NULL)
+			reconnect_reset(reconnect);
+	}
+	G_UNLOCK(reconnect);
+}
+
+/*
+ * A connect the watchdog gave up on: the engine takes over as after a
+ * drop, unless the attempt was its own and is retried already.
+ */
+void connection_reconnect_handoff(struct vpn_connection *connection)
+{
+	struct reconnect *reconnect = NULL;
+
+	G_LOCK(reconnect);
+	if (reconnects != NULL)
+		reconnect = g_hash_table_lookup(reconnects, connection);
+	if (reconnect != NULL && !reconnect->in_progress &&
+						reconnect->timer == NULL) {
+		reconnect->armed = TRUE;
+		reconnect_ref(reconnect);
+	} else {
+		reconnect = NULL;
+	}
+	G_UNLOCK(reconnect);
+
+	if (reconnect == NULL)
+		return;
+
+	reconnect_post(reconnect, FALSE, VPN_CONN_STATE_FAILURE,
+						DVPNLIB_ERR_NONE);
+	reconnect_unref(reconnect);
+}
+
+void connection_reconnect_forget(struct vpn_connection *connection)
+{
+	struct reconnect *reconnect = NULL;
+
+	G_LOCK(reconnect);
+	if (reconnects != NULL)
+		reconnect = g_hash_table_lookup(reconnects, connection);
+	if (reconnect != NULL)
+		reconnect_deactivate(reconnect);
+	G_UNLOCK(reconnect);
+
+	if (reconnect != NULL)
+		reconnect_unref(reconnect);
+}
+
+enum dvpnlib_err vpn_connection_set_reconnect_policy(
+				struct vpn_connection *connection,
+				const struct dvpnlib_reconnect_policy *policy,
+				dvpnlib_reconnect_cb callback,
+				void *user_data, GDestroyNotify destroy)
+{
+	struct reconnect *reconnect, *old;
+
+	assert(connection != NULL);
+
+	if (policy == NULL || policy->initial_delay_ms == 0 ||
+			policy->max_delay_ms < policy->initial_delay_ms ||
+			policy->jitter_percent > 100)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	if (vpn_connection_is_removed(connection))
+		return DVPNLIB_ERR_NOT_FOUND;
+
+	reconnect = g_new0(struct reconnect, 1);
+	reconnect->ref_count = 1;
+	reconnect->connection = vpn_connection_ref(connection);
+	reconnect->policy = *policy;
+	reconnect->callback = callback;
+	reconnect->user_data = user_data;
+	reconnect->destroy = destroy;
+	reconnect->context = g_main_context_ref_thread_default();
+	reconnect->active = TRUE;
+
+	/* A profile which is up already is protected right away */
+	reconnect->armed = vpn_connection_get_state(connection) ==
+						VPN_CONN_STATE_READY;
+
+	G_LOCK(reconnect);
+	if (reconnects == NULL)
+		reconnects = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	old = g_hash_table_lookup(reconnects, connection);
+	if (old != NULL)
+		reconnect_deactivate(old);
+
+	g_hash_table_insert(reconnects, connection, reconnect);
+	G_UNLOCK(reconnect);
+
+	if (old != NULL)
+		reconnect_unref(old);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+void vpn_connection_unset_reconnect_policy(struct vpn_connection *connection)
+{
+	assert(connection != NULL);
+
+	connection_reconnect_forget(connection);
+}
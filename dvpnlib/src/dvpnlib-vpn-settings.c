@@ -0,0 +1,347 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-settings.h"
+
+/*
+ * The keys every profile has live in fixed slots, any other key goes to
+ * a side table created on first use. The Manager.Create parameters are
+ * built once and kept until the settings are modified.
+ *
+ * Cloning freezes the side table into a template shared by the source
+ * and all of its clones. A clone records only the keys it overrides or
+ * removes (as a NULL value) on top of the template, and the template's
+ * entries are serialized once and copied as-is into each Create payload.
+ */
+enum settings_slot {
+	SETTINGS_SLOT_TYPE,
+	SETTINGS_SLOT_NAME,
+	SETTINGS_SLOT_HOST,
+	SETTINGS_SLOT_DOMAIN,
+	SETTINGS_SLOT_MAX,
+};
+
+static const char *slot_keys[SETTINGS_SLOT_MAX] = {
+	[SETTINGS_SLOT_TYPE] = "Type",
+	[SETTINGS_SLOT_NAME] = "Name",
+	[SETTINGS_SLOT_HOST] = "Host",
+	[SETTINGS_SLOT_DOMAIN] = "VPN.Domain",
+};
+
+struct settings_template {
+	gint ref_count;
+	GHashTable *table;	/* immutable */
+	GVariant *entries;	/* the table as a{sv} */
+};
+
+struct dvpnlib_settings {
+	gint ref_count;
+	GMutex lock;
+	gchar *slots[SETTINGS_SLOT_MAX];
+	struct settings_template *base;
+	GHashTable *extras;	/* overrides of base, NULL value removes */
+	GVariant *parameters;	/* cache, NULL when stale */
+};
+
+static struct settings_template *template_ref(
+				struct settings_template *template)
+{
+	if (template)
+		g_atomic_int_inc(&template->ref_count);
+
+	return template;
+}
+
+static void template_unref(struct settings_template *template)
+{
+	if (template == NULL)
+		return;
+
+	if (!g_atomic_int_dec_and_test(&template->ref_count))
+		return;
+
+	g_hash_table_destroy(template->table);
+	g_variant_unref(template->entries);
+	g_free(template);
+}
+
+/* Called with settings->lock held */
+static struct settings_template *template_freeze(
+				struct dvpnlib_settings *settings)
+{
+	struct settings_template *template;
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (settings->extras == NULL ||
+			g_hash_table_size(settings->extras) == 0)
+		return template_ref(settings->base);
+
+	template = g_new0(struct settings_template, 1);
+	template->ref_count = 1;
+	template->table = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, g_free);
+
+	if (settings->base) {
+		g_hash_table_iter_init(&iter, settings->base->table);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			g_hash_table_insert(template->table,
+					g_strdup(key), g_strdup(value));
+	}
+
+	g_hash_table_iter_init(&iter, settings->extras);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (value)
+			g_hash_table_replace(template->table,
+					g_strdup(key), g_strdup(value));
+		else
+			g_hash_table_remove(template->table, key);
+	}
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+	g_hash_table_iter_init(&iter, template->table);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		g_variant_builder_add(&builder, "{sv}", key,
+				g_variant_new_string(value));
+	template->entries = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+	/* From now on the source shares the template with its clones */
+	template_unref(settings->base);
+	settings->base = template_ref(template);
+	g_hash_table_destroy(settings->extras);
+	settings->extras = NULL;
+
+	return template;
+}
+
+static int settings_slot(const char *key)
+{
+	int i;
+
+	for (i = 0; i < SETTINGS_SLOT_MAX; i++)
+		if (!g_strcmp0(key, slot_keys[i]))
+			return i;
+
+	/* connman-vpn reads the domain from either key */
+	if (!g_strcmp0(key, "Domain"))
+		return SETTINGS_SLOT_DOMAIN;
+
+	return -1;
+}
+
+struct dvpnlib_settings *dvpnlib_settings_new(void)
+{
+	struct dvpnlib_settings *settings;
+
+	settings = g_try_new0(struct dvpnlib_settings, 1);
+	if (settings == NULL) {
+		ERROR("no memory");
+		return NULL;
+	}
+
+	settings->ref_count = 1;
+	g_mutex_init(&settings->lock);
+
+	return settings;
+}
+
+struct dvpnlib_settings *dvpnlib_settings_ref(
+				struct dvpnlib_settings *settings)
+{
+	assert(settings != NULL);
+
+	g_atomic_int_inc(&settings->ref_count);
+
+	return settings;
+}
+
+void dvpnlib_settings_unref(struct dvpnlib_settings *settings)
+{
+	int i;
+
+	if (settings == NULL)
+		return;
+
+	if (!g_atomic_int_dec_and_test(&settings->ref_count))
+		return;
+
+	for (i = 0; i < SETTINGS_SLOT_MAX; i++)
+		g_free(settings->slots[i]);
+
+	if (settings->extras)
+		g_hash_table_destroy(settings->extras);
+
+	template_unref(settings->base);
+
+	if (settings->parameters)
+		g_variant_unref(settings->parameters);
+
+	g_mutex_clear(&settings->lock);
+	g_free(settings);
+}
+
+struct dvpnlib_settings *dvpnlib_settings_clone(
+				struct dvpnlib_settings *settings)
+{
+	struct dvpnlib_settings *clone;
+	int i;
+
+	assert(settings != NULL);
+
+	clone = dvpnlib_settings_new();
+	if (clone == NULL)
+		return NULL;
+
+	g_mutex_lock(&settings->lock);
+
+	for (i = 0; i < SETTINGS_SLOT_MAX; i++)
+		clone->slots[i] = g_strdup(settings->slots[i]);
+
+	clone->base = template_freeze(settings);
+
+	/* Same content, so the same payload */
+	if (settings->parameters)
+		clone->parameters = g_variant_ref(settings->parameters);
+
+	g_mutex_unlock(&settings->lock);
+
+	return clone;
+}
+
+static void settings_invalidate(struct dvpnlib_settings *settings)
+{
+	if (settings->parameters) {
+		g_variant_unref(settings->parameters);
+		settings->parameters = NULL;
+	}
+}
+
+/* Called with settings->lock held */
+static void settings_set_extra(struct dvpnlib_settings *settings,
+				const char *key, const char *value)
+{
+	const char *base_value = NULL;
+	gpointer current;
+
+	if (settings->base)
+		base_value = g_hash_table_lookup(settings->base->table, key);
+
+	if (settings->extras == NULL ||
+			!g_hash_table_lookup_extended(settings->extras, key,
+							NULL, &current))
+		current = (gpointer)base_value;
+
+	if (g_strcmp0(current, value) == 0)
+		return;
+
+	if (g_strcmp0(base_value, value) == 0) {
+		/* Back to the template's value, drop the override */
+		g_hash_table_remove(settings->extras, key);
+	} else {
+		if (settings->extras == NULL)
+			settings->extras = g_hash_table_new_full(g_str_hash,
+						g_str_equal, g_free, g_free);
+
+		g_hash_table_replace(settings->extras, g_strdup(key),
+							g_strdup(value));
+	}
+
+	settings_invalidate(settings);
+}
+
+enum dvpnlib_err dvpnlib_settings_set(struct dvpnlib_settings *settings,
+				const char *key, const char *value)
+{
+	int slot;
+
+	assert(settings != NULL);
+
+	if (key == NULL || *key == '\0')
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	slot = settings_slot(key);
+
+	g_mutex_lock(&settings->lock);
+
+	if (slot >= 0) {
+		if (g_strcmp0(settings->slots[slot], value) != 0) {
+			g_free(settings->slots[slot]);
+			settings->slots[slot] = g_strdup(value);
+			settings_invalidate(settings);
+		}
+	} else {
+		settings_set_extra(settings, key, value);
+	}
+
+	g_mutex_unlock(&settings->lock);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+static GVariant *settings_build_parameters(struct dvpnlib_settings *settings)
+{
+	GVariantBuilder builder;
+	GHashTableIter iter;
+	gpointer key, value;
+	GVariantIter entries;
+	GVariant *entry;
+	const char *entry_key;
+	int i;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("(a{sv})"));
+	g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
+
+	for (i = 0; i < SETTINGS_SLOT_MAX; i++) {
+		if (settings->slots[i] == NULL)
+			continue;
+
+		g_variant_builder_add(&builder, "{sv}", slot_keys[i],
+				g_variant_new_string(settings->slots[i]));
+	}
+
+	if (settings->base) {
+		g_variant_iter_init(&entries, settings->base->entries);
+		while ((entry = g_variant_iter_next_value(&entries))) {
+			g_variant_get_child(entry, 0, "&s", &entry_key);
+
+			if (settings->extras == NULL ||
+					!g_hash_table_contains(settings->extras,
+								entry_key))
+				g_variant_builder_add_value(&builder, entry);
+
+			g_variant_unref(entry);
+		}
+	}
+
+	if (settings->extras) {
+		g_hash_table_iter_init(&iter, settings->extras);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			if (value == NULL)
+				continue;
+
+			g_variant_builder_add(&builder, "{sv}", key,
+					g_variant_new_string(value));
+		}
+	}
+
+	g_variant_builder_close(&builder);
+
+	return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+GVariant *dvpnlib_settings_get_parameters(struct dvpnlib_settings *settings)
+{
+	GVariant *parameters;
+
+	assert(settings != NULL);
+
+	g_mutex_lock(&settings->lock);
+
+	if (settings->parameters == NULL)
+		settings->parameters = settings_build_parameters(settings);
+
+	parameters = g_variant_ref(settings->parameters);
+
+	g_mutex_unlock(&settings->lock);
+
+	return parameters;
+}
@@ -0,0 +1,378 @@
+#include <errno.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-traffic.h"
+
+#define TRAFFIC_RECV_SIZE	32768
+
+struct traffic_counters {
+	guint64 rx_bytes;
+	guint64 tx_bytes;
+	guint64 rx_packets;
+	guint64 tx_packets;
+	guint64 rx_errors;
+	guint64 tx_errors;
+};
+
+struct traffic_entry {
+	struct traffic_counters counters;
+	struct traffic_counters sample;	/* at the previous rate tick */
+	gint64 sample_time;		/* 0 before the first tick */
+	struct traffic_counters rate;
+	gboolean seen;			/* in the last dump */
+};
+
+/* Guards everything below */
+G_LOCK_DEFINE_STATIC(traffic);
+static GHashTable *traffic_entries;	/* ifindex -> struct traffic_entry */
+static gint64 traffic_dump_time;
+static GSource *traffic_rate_timer;
+
+static struct traffic_entry *traffic_entry_get(int ifindex)
+{
+	struct traffic_entry *entry;
+
+	if (traffic_entries == NULL)
+		traffic_entries = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, g_free);
+
+	entry = g_hash_table_lookup(traffic_entries, GINT_TO_POINTER(ifindex));
+	if (entry == NULL) {
+		entry = g_new0(struct traffic_entry, 1);
+		g_hash_table_insert(traffic_entries,
+					GINT_TO_POINTER(ifindex), entry);
+	}
+
+	return entry;
+}
+
+static void traffic_store(int ifindex, const struct traffic_counters *counters)
+{
+	struct traffic_entry *entry = traffic_entry_get(ifindex);
+
+	entry->counters = *counters;
+	entry->seen = TRUE;
+}
+
+static void traffic_parse_link(struct nlmsghdr *hdr)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(hdr);
+	struct traffic_counters counters;
+	struct rtattr *rta;
+	int len;
+
+	len = IFLA_PAYLOAD(hdr);
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_STATS64 &&
+			RTA_PAYLOAD(rta) >= sizeof(struct rtnl_link_stats64)) {
+			struct rtnl_link_stats64 stats;
+
+			/* The attribute is only 4 byte aligned */
+			memcpy(&stats, RTA_DATA(rta), sizeof(stats));
+			counters.rx_bytes = stats.rx_bytes;
+			counters.tx_bytes = stats.tx_bytes;
+			counters.rx_packets = stats.rx_packets;
+			counters.tx_packets = stats.tx_packets;
+			counters.rx_errors = stats.rx_errors;
+			counters.tx_errors = stats.tx_errors;
+			traffic_store(ifi->ifi_index, &counters);
+			return;
+		}
+	}
+}
+
+/* Called with the traffic lock held */
+static enum dvpnlib_err traffic_dump_netlink(void)
+{
+	struct {
+		struct nlmsghdr hdr;
+		struct ifinfomsg ifi;
+	} request = {
+		.hdr = {
+			.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+			.nlmsg_type = RTM_GETLINK,
+			.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+			.nlmsg_seq = 1,
+		},
+		.ifi = { .ifi_family = AF_UNSPEC },
+	};
+	enum dvpnlib_err err = DVPNLIB_ERR_FAILED;
+	struct nlmsghdr *hdr;
+	gboolean done = FALSE;
+	gchar *buf;
+	ssize_t len;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		DBG("netlink: %s", g_strerror(errno));
+		return DVPNLIB_ERR_NOT_SUPPORTED;
+	}
+
+	if (send(fd, &request, request.hdr.nlmsg_len, 0) < 0) {
+		DBG("netlink send: %s", g_strerror(errno));
+		close(fd);
+		return DVPNLIB_ERR_NOT_SUPPORTED;
+	}
+
+	buf = g_malloc(TRAFFIC_RECV_SIZE);
+
+	while (!done) {
+		len = recv(fd, buf, TRAFFIC_RECV_SIZE, 0);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0) {
+			ERROR("netlink recv: %s", g_strerror(errno));
+			break;
+		}
+
+		for (hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, len);
+					hdr = NLMSG_NEXT(hdr, len)) {
+			if (hdr->nlmsg_type == NLMSG_DONE) {
+				err = DVPNLIB_ERR_NONE;
+				done = TRUE;
+				break;
+			}
+
+			if (hdr->nlmsg_type == NLMSG_ERROR) {
+				ERROR("netlink: link dump failed");
+				done = TRUE;
+				break;
+			}
+
+			if (hdr->nlmsg_type == RTM_NEWLINK)
+				traffic_parse_link(hdr);
+		}
+	}
+
+	g_free(buf);
+	close(fd);
+
+	return err;
+}
+
+static gboolean traffic_read_counter(const char *ifname, const char *name,
+					guint64 *value)
+{
+	gchar *path, *contents = NULL;
+	gboolean ok;
+
+	path = g_strdup_printf("/sys/class/net/%s/statistics/%s",
+							ifname, name);
+	ok = g_file_get_contents(path, &contents, NULL, NULL);
+	if (ok)
+		*value = g_ascii_strtoull(contents, NULL, 10);
+
+	g_free(contents);
+	g_free(path);
+
+	return ok;
+}
+
+/* Called with the traffic lock held */
+static enum dvpnlib_err traffic_read_sysfs(int ifindex)
+{
+	struct traffic_counters counters;
+	char ifname[IF_NAMESIZE];
+
+	if (if_indextoname(ifindex, ifname) == NULL)
+		return DVPNLIB_ERR_NOT_FOUND;
+
+	if (!traffic_read_counter(ifname, "rx_bytes", &counters.rx_bytes) ||
+		!traffic_read_counter(ifname, "tx_bytes", &counters.tx_bytes) ||
+		!traffic_read_counter(ifname, "rx_packets",
+						&counters.rx_packets) ||
+		!traffic_read_counter(ifname, "tx_packets",
+						&counters.tx_packets) ||
+		!traffic_read_counter(ifname, "rx_errors",
+						&counters.rx_errors) ||
+		!traffic_read_counter(ifname, "tx_errors", &counters.tx_errors))
+		return DVPNLIB_ERR_FAILED;
+
+	traffic_store(ifindex, &counters);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+/*
+ * Called with the traffic lock held. Refreshes every interface unless
+ * the last dump is recent enough; interfaces gone since are forgotten.
+ */
+static enum dvpnlib_err traffic_refresh(gboolean force)
+{
+	GHashTableIter iter;
+	struct traffic_entry *entry;
+	enum dvpnlib_err err;
+	gint64 now = g_get_monotonic_time();
+
+	if (!force && traffic_dump_time != 0 &&
+			now - traffic_dump_time < DVPNLIB_TRAFFIC_CACHE_USEC)
+		return DVPNLIB_ERR_NONE;
+
+	if (traffic_entries != NULL) {
+		g_hash_table_iter_init(&iter, traffic_entries);
+		while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry))
+			entry->seen = FALSE;
+	}
+
+	err = traffic_dump_netlink();
+	if (err != DVPNLIB_ERR_NONE)
+		return err;
+
+	traffic_dump_time = now;
+
+	if (traffic_entries == NULL)
+		return DVPNLIB_ERR_NONE;
+
+	g_hash_table_iter_init(&iter, traffic_entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry))
+		if (!entry->seen)
+			g_hash_table_iter_remove(&iter);
+
+	return DVPNLIB_ERR_NONE;
+}
+
+static guint64 traffic_rate(guint64 now, guint64 then, gint64 elapsed)
+{
+	/* A counter going back means the interface was recreated */
+	if (now < then || elapsed <= 0)
+		return 0;
+
+	return (now - then) * G_USEC_PER_SEC / elapsed;
+}
+
+static gboolean traffic_rate_tick(gpointer user_data)
+{
+	GHashTableIter iter;
+	struct traffic_entry *entry;
+	gint64 now;
+
+	G_LOCK(traffic);
+	if (traffic_refresh(TRUE) != DVPNLIB_ERR_NONE ||
+					traffic_entries == NULL) {
+		G_UNLOCK(traffic);
+		return G_SOURCE_CONTINUE;
+	}
+
+	now = traffic_dump_time;
+
+	g_hash_table_iter_init(&iter, traffic_entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+		gint64 elapsed = now - entry->sample_time;
+
+		if (entry->sample_time != 0) {
+			entry->rate.rx_bytes = traffic_rate(
+					entry->counters.rx_bytes,
+					entry->sample.rx_bytes, elapsed);
+			entry->rate.tx_bytes = traffic_rate(
+					entry->counters.tx_bytes,
+					entry->sample.tx_bytes, elapsed);
+			entry->rate.rx_packets = traffic_rate(
+					entry->counters.rx_packets,
+					entry->sample.rx_packets, elapsed);
+			entry->rate.tx_packets = traffic_rate(
+					entry->counters.tx_packets,
+					entry->sample.tx_packets, elapsed);
+		}
+
+		entry->sample = entry->counters;
+		entry->sample_time = now;
+	}
+	G_UNLOCK(traffic);
+
+	return G_SOURCE_CONTINUE;
+}
+
+enum dvpnlib_err dvpnlib_traffic_get_stats(int ifindex,
+				struct dvpnlib_traffic_stats *stats)
+{
+	struct traffic_entry *entry = NULL;
+	enum dvpnlib_err err;
+
+	if (ifindex <= 0 || stats == NULL)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	G_LOCK(traffic);
+	err = traffic_refresh(FALSE);
+	if (err == DVPNLIB_ERR_NOT_SUPPORTED)
+		err = traffic_read_sysfs(ifindex);
+
+	if (err == DVPNLIB_ERR_NONE && traffic_entries != NULL)
+		entry = g_hash_table_lookup(traffic_entries,
+						GINT_TO_POINTER(ifindex));
+
+	if (entry != NULL) {
+		stats->rx_bytes = entry->counters.rx_bytes;
+		stats->tx_bytes = entry->counters.tx_bytes;
+		stats->rx_packets = entry->counters.rx_packets;
+		stats->tx_packets = entry->counters.tx_packets;
+		stats->rx_errors = entry->counters.rx_errors;
+		stats->tx_errors = entry->counters.tx_errors;
+		stats->rx_bytes_rate = entry->rate.rx_bytes;
+		stats->tx_bytes_rate = entry->rate.tx_bytes;
+		stats->rx_packets_rate = entry->rate.rx_packets;
+		stats->tx_packets_rate = entry->rate.tx_packets;
+	} else if (err == DVPNLIB_ERR_NONE) {
+		err = DVPNLIB_ERR_NOT_FOUND;
+	}
+	G_UNLOCK(traffic);
+
+	return err;
+}
+
+enum dvpnlib_err vpn_connection_get_traffic_stats(
+				struct vpn_connection *connection,
+				struct dvpnlib_traffic_stats *stats)
+{
+	assert(connection != NULL);
+
+	if (vpn_connection_get_state(connection) != VPN_CONN_STATE_READY)
+		return DVPNLIB_ERR_NOT_CONNECTED;
+
+	return dvpnlib_traffic_get_stats(
+			vpn_connection_get_index(connection), stats);
+}
+
+void dvpnlib_traffic_set_rate_interval(unsigned int interval_ms)
+{
+	GMainContext *context;
+	GHashTableIter iter;
+	struct traffic_entry *entry;
+
+	G_LOCK(traffic);
+	if (traffic_rate_timer != NULL) {
+		g_source_destroy(traffic_rate_timer);
+		g_source_unref(traffic_rate_timer);
+		traffic_rate_timer = NULL;
+	}
+
+	/* Rates from the previous interval no longer apply */
+	if (traffic_entries != NULL) {
+		g_hash_table_iter_init(&iter, traffic_entries);
+		while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&entry)) {
+			memset(&entry->rate, 0, sizeof(entry->rate));
+			entry->sample_time = 0;
+		}
+	}
+
+	if (interval_ms > 0) {
+		context = g_main_context_ref_thread_default();
+		traffic_rate_timer = g_timeout_source_new(interval_ms);
+		g_source_set_callback(traffic_rate_timer, traffic_rate_tick,
+							NULL, NULL);
+		g_source_attach(traffic_rate_timer, context);
+		g_main_context_unref(context);
+	}
+	G_UNLOCK(traffic);
+
+	/* The first sample, so that rates are known after one interval */
+	if (interval_ms > 0)
+		traffic_rate_tick(NULL);
+}
@@ -0,0 +1,441 @@
+#include "dvpnlib-internal.h"
+#include "dvpnlib-vpn-connection.h"
+#include "dvpnlib-vpn-watchdog.h"
+
+/*
+ * The connections with a deadline running sit in a binary min-heap
+ * ordered by expiry, and a single GSource is kept ready at the earliest
+ * one: arming, disarming and expiring cost O(log n), and no timer exists
+ * per connection however many deadlines are set. Connect calls arm the
+ * deadlines from any thread, so everything below is guarded by the
+ * watchdog lock.
+ */
+#define WATCHDOG_UNQUEUED	G_MAXUINT
+
+/*
+ * A connect call under watch. Both its reply and the watchdog try to
+ * claim it; only the first one completes the callback.
+ */
+struct watchdog_attempt {
+	gint ref_count;
+	gint claimed;
+	dvpnlib_reply_cb callback;
+	void *user_data;
+};
+
+struct watchdog {
+	struct vpn_connection *connection;	/* reference */
+	unsigned int deadline_ms;
+	gboolean reconnect;
+	gint64 expiry;		/* monotonic, while queued */
+	guint heap_index;	/* WATCHDOG_UNQUEUED if not queued */
+	GList *attempts;	/* struct watchdog_attempt, references */
+};
+
+struct watchdog_expired {
+	struct vpn_connection *connection;	/* reference */
+	gboolean reconnect;
+	GList *attempts;
+};
+
+G_LOCK_DEFINE_STATIC(watchdog);
+static GHashTable *watchdogs;	/* connection -> struct watchdog */
+static GPtrArray *watchdog_heap;
+static GSource *watchdog_source;
+
+static void watchdog_attempt_unref(gpointer data)
+{
+	struct watchdog_attempt *attempt = data;
+
+	if (g_atomic_int_dec_and_test(&attempt->ref_count))
+		g_free(attempt);
+}
+
+static gboolean watchdog_attempt_claim(struct watchdog_attempt *attempt)
+{
+	return g_atomic_int_compare_and_exchange(&attempt->claimed, 0, 1);
+}
+
+/*
+ * Min-heap, called with the watchdog lock held
+ */
+static void heap_set(guint index, struct watchdog *watchdog)
+{
+	watchdog_heap->pdata[index] = watchdog;
+	watchdog->heap_index = index;
+}
+
+static gboolean heap_before(guint a, guint b)
+{
+	struct watchdog *wa = g_ptr_array_index(watchdog_heap, a);
+	struct watchdog *wb = g_ptr_array_index(watchdog_heap, b);
+
+	return wa->expiry < wb->expiry;
+}
+
+static void heap_swap(guint a, guint b)
+{
+	struct watchdog *wa = g_ptr_array_index(watchdog_heap, a);
+	struct watchdog *wb = g_ptr_array_index(watchdog_heap, b);
+
+	heap_set(a, wb);
+	heap_set(b, wa);
+}
+
+static void heap_sift_up(guint index)
+{
+	while (index > 0 && heap_before(index, (index - 1) / 2)) {
+		heap_swap(index, (index - 1) / 2);
+		index = (index - 1) / 2;
+	}
+}
+
+static void heap_sift_down(guint index)
+{
+	guint child, len = watchdog_heap->len;
+
+	while ((child = 2 * index + 1) < len) {
+		if (child + 1 < len && heap_before(child + 1, child))
+			child++;
+
+		if (!heap_before(child, index))
+			break;
+
+		heap_swap(index, child);
+		index = child;
+	}
+}
+
+static void heap_push(struct watchdog *watchdog)
+{
+	g_ptr_array_add(watchdog_heap, watchdog);
+	watchdog->heap_index = watchdog_heap->len - 1;
+	heap_sift_up(watchdog->heap_index);
+}
+
+static void heap_remove(struct watchdog *watchdog)
+{
+	guint index = watchdog->heap_index, last;
+	struct watchdog *moved;
+
+	if (index == WATCHDOG_UNQUEUED)
+		return;
+
+	/* The last one takes its place and moves whichever way it must */
+	last = watchdog_heap->len - 1;
+	if (index != last) {
+		moved = g_ptr_array_index(watchdog_heap, last);
+		heap_set(index, moved);
+		g_ptr_array_set_size(watchdog_heap, last);
+		heap_sift_up(index);
+		heap_sift_down(moved->heap_index);
+	} else {
+		g_ptr_array_set_size(watchdog_heap, last);
+	}
+
+	watchdog->heap_index = WATCHDOG_UNQUEUED;
+}
+
+/* Called with the watchdog lock held */
+static void watchdog_reschedule(void)
+{
+	struct watchdog *top;
+
+	if (watchdog_source == NULL)
+		return;
+
+	if (watchdog_heap->len == 0) {
+		g_source_set_ready_time(watchdog_source, -1);
+		return;
+	}
+
+	top = g_ptr_array_index(watchdog_heap, 0);
+	g_source_set_ready_time(watchdog_source, top->expiry);
+}
+
+static void free_watchdog(gpointer data)
+{
+	struct watchdog *watchdog = data;
+
+	g_list_free_full(watchdog->attempts, watchdog_attempt_unref);
+	vpn_connection_unref(watchdog->connection);
+	g_free(watchdog);
+}
+
+static void watchdog_expire(struct watchdog_expired *expired)
+{
+	struct watchdog_attempt *attempt;
+	GList *iter;
+
+	WARN("%s not ready in time",
+			vpn_connection_get_path(expired->connection));
+
+	for (iter = expired->attempts; iter != NULL; iter = iter->next) {
+		attempt = iter->data;
+
+		if (watchdog_attempt_claim(attempt))
+			common_reply_dispatch(attempt->callback,
+					DVPNLIB_ERR_OPERATION_TIMEOUT,
+					attempt->user_data);
+	}
+
+	connection_abort_connect(expired->connection);
+
+	if (expired->reconnect)
+		connection_reconnect_handoff(expired->connection);
+
+	g_list_free_full(expired->attempts, watchdog_attempt_unref);
+	vpn_connection_unref(expired->connection);
+	g_free(expired);
+}
+
+static gboolean watchdog_dispatch(GSource *source, GSourceFunc callback,
+				gpointer user_data)
+{
+	struct watchdog_expired *expired;
+	struct watchdog *watchdog;
+	GList *list = NULL, *iter;
+	gint64 now;
+
+	now = g_source_get_time(source);
+
+	G_LOCK(watchdog);
+	while (watchdog_heap->len > 0) {
+		watchdog = g_ptr_array_index(watchdog_heap, 0);
+		if (watchdog->expiry > now)
+			break;
+
+		heap_remove(watchdog);
+
+		expired = g_new0(struct watchdog_expired, 1);
+		expired->connection = vpn_connection_ref(watchdog->connection);
+		expired->reconnect = watchdog->reconnect;
+		expired->attempts = watchdog->attempts;
+		watchdog->attempts = NULL;
+		list = g_list_prepend(list, expired);
+	}
+	watchdog_reschedule();
+	G_UNLOCK(watchdog);
+
+	list = g_list_reverse(list);
+	for (iter = list; iter != NULL; iter = iter->next)
+		watchdog_expire(iter->data);
+	g_list_free(list);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs watchdog_source_funcs = {
+	.dispatch = watchdog_dispatch,
+};
+
+/*
+ * Runs in the context which dispatches the D-Bus traffic, where the
+ * deadlines then expire.
+ */
+void dvpnlib_watchdog_start(void)
+{
+	DBG("");
+
+	G_LOCK(watchdog);
+	watchdogs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, free_watchdog);
+	watchdog_heap = g_ptr_array_new();
+	watchdog_source = g_source_new(&watchdog_source_funcs,
+						sizeof(GSource));
+	g_source_attach(watchdog_source,
+			g_main_context_get_thread_default());
+	G_UNLOCK(watchdog);
+}
+
+void dvpnlib_watchdog_stop(void)
+{
+	GHashTable *table;
+	GPtrArray *heap;
+	GSource *source;
+
+	DBG("");
+
+	G_LOCK(watchdog);
+	table = watchdogs;
+	heap = watchdog_heap;
+	source = watchdog_source;
+	watchdogs = NULL;
+	watchdog_heap = NULL;
+	watchdog_source = NULL;
+	G_UNLOCK(watchdog);
+
+	if (source != NULL) {
+		g_source_destroy(source);
+		g_source_unref(source);
+	}
+
+	/* The replies still due complete the attempts themselves */
+	if (table != NULL)
+		g_hash_table_destroy(table);
+	if (heap != NULL)
+		g_ptr_array_free(heap, TRUE);
+}
+
+/*
+ * Hooks of dvpnlib-vpn-connnection.c
+ */
+
+/*
+ * Puts a Connect under watch. Returns NULL when the connection has no
+ * deadline, the attempt to pass to connection_watchdog_settle()
+ * otherwise.
+ */
+struct watchdog_attempt *connection_watchdog_arm(
+				struct vpn_connection *connection,
+				dvpnlib_reply_cb callback, void *user_data)
+{
+	struct watchdog_attempt *attempt;
+	struct watchdog *watchdog = NULL;
+
+	G_LOCK(watchdog);
+	if (watchdogs != NULL)
+		watchdog = g_hash_table_lookup(watchdogs, connection);
+	if (watchdog == NULL) {
+		G_UNLOCK(watchdog);
+		return NULL;
+	}
+
+	attempt = g_new0(struct watchdog_attempt, 1);
+	attempt->ref_count = 2;
+	attempt->callback = callback;
+	attempt->user_data = user_data;
+	watchdog->attempts = g_list_prepend(watchdog->attempts, attempt);
+
+	if (watchdog->heap_index == WATCHDOG_UNQUEUED) {
+		DBG("%s: %u ms", vpn_connection_get_path(connection),
+						watchdog->deadline_ms);
+		watchdog->expiry = g_get_monotonic_time() +
+				(gint64)watchdog->deadline_ms * 1000;
+		heap_push(watchdog);
+		watchdog_reschedule();
+	}
+	G_UNLOCK(watchdog);
+
+	return attempt;
+}
+
+/*
+ * Called with the Connect reply. Returns whether the reply is still to
+ * be delivered, FALSE once the watchdog has completed the call.
+ */
+gboolean connection_watchdog_settle(struct vpn_connection *connection,
+				struct watchdog_attempt *attempt,
+				enum dvpnlib_err result)
+{
+	struct watchdog *watchdog = NULL;
+	gboolean claimed;
+
+	if (attempt == NULL)
+		return TRUE;
+
+	claimed = watchdog_attempt_claim(attempt);
+
+	G_LOCK(watchdog);
+	if (watchdogs != NULL)
+		watchdog = g_hash_table_lookup(watchdogs, connection);
+	if (watchdog != NULL &&
+			g_list_find(watchdog->attempts, attempt) != NULL) {
+		watchdog->attempts = g_list_remove(watchdog->attempts,
+								attempt);
+		watchdog_attempt_unref(attempt);
+
+		/* A failed attempt is over, not stuck */
+		if (watchdog->attempts == NULL &&
+				result != DVPNLIB_ERR_NONE &&
+				result != DVPNLIB_ERR_IN_PROGRESS &&
+				result != DVPNLIB_ERR_ALREADY_CONNECTED) {
+			heap_remove(watchdog);
+			watchdog_reschedule();
+		}
+	}
+	G_UNLOCK(watchdog);
+
+	watchdog_attempt_unref(attempt);
+
+	return claimed;
+}
+
+/* Ready in time, or disconnected on purpose */
+void connection_watchdog_disarm(struct vpn_connection *connection)
+{
+	struct watchdog *watchdog = NULL;
+
+	G_LOCK(watchdog);
+	if (watchdogs != NULL)
+		watchdog = g_hash_table_lookup(watchdogs, connection);
+	if (watchdog != NULL && watchdog->heap_index != WATCHDOG_UNQUEUED) {
+		DBG("%s", vpn_connection_get_path(connection));
+		heap_remove(watchdog);
+		watchdog_reschedule();
+	}
+	G_UNLOCK(watchdog);
+}
+
+void connection_watchdog_forget(struct vpn_connection *connection)
+{
+	struct watchdog *watchdog = NULL;
+
+	G_LOCK(watchdog);
+	if (watchdogs != NULL)
+		watchdog = g_hash_table_lookup(watchdogs, connection);
+	if (watchdog != NULL) {
+		heap_remove(watchdog);
+		watchdog_reschedule();
+		g_hash_table_steal(watchdogs, connection);
+	}
+	G_UNLOCK(watchdog);
+
+	if (watchdog != NULL)
+		free_watchdog(watchdog);
+}
+
+/*
+ * Sets the connect deadline of the connection, 0 removes it. A deadline
+ * already running keeps its expiry.
+ */
+enum dvpnlib_err vpn_connection_set_connect_deadline(
+				struct vpn_connection *connection,
+				unsigned int deadline_ms,
+				gboolean reconnect)
+{
+	struct watchdog *watchdog;
+
+	assert(connection != NULL);
+
+	DBG("%s: %u ms, reconnect %d", vpn_connection_get_path(connection),
+						deadline_ms, reconnect);
+
+	if (deadline_ms == 0) {
+		connection_watchdog_forget(connection);
+		return DVPNLIB_ERR_NONE;
+	}
+
+	if (vpn_connection_is_removed(connection))
+		return DVPNLIB_ERR_NOT_FOUND;
+
+	G_LOCK(watchdog);
+	if (watchdogs == NULL) {
+		G_UNLOCK(watchdog);
+		return DVPNLIB_ERR_NOT_SUPPORTED;
+	}
+
+	watchdog = g_hash_table_lookup(watchdogs, connection);
+	if (watchdog == NULL) {
+		watchdog = g_new0(struct watchdog, 1);
+		watchdog->connection = vpn_connection_ref(connection);
+		watchdog->heap_index = WATCHDOG_UNQUEUED;
+		g_hash_table_insert(watchdogs, connection, watchdog);
+	}
+
+	watchdog->deadline_ms = deadline_ms;
+	watchdog->reconnect = reconnect;
+	G_UNLOCK(watchdog);
+
+	return DVPNLIB_ERR_NONE;
+}
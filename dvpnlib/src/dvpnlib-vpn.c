@@ -1,15 +1,16 @@
 #include "dvpnlib-internal.h"
 #include "dvpnlib-vpn.h"
+#include "dvpnlib-vpn-manager.h"
+#include "dvpnlib-vpn-traffic.h"
 
 struct vpn_manager *vpn_manager;
 
-int dvpnlib_vpn_init(void)
+/*
+ * Runs in the context which dispatches the D-Bus traffic: the caller's
+ * one, or the worker's in DVPNLIB_THREAD_MODE_WORKER.
+ */
+static int vpn_init_in_context(void)
 {
-	DBG("");
-
-	if (vpn_manager != NULL)
-		return 0;
-
 	vpn_manager = create_vpn_manager();
 
 	if (vpn_manager == NULL) {
@@ -19,15 +20,68 @@ int dvpnlib_vpn_init(void)
 
 	sync_vpn_connections();
 
+	dvpnlib_watchdog_start();
+
+	dvpnlib_agent_export(g_dbus_proxy_get_connection(
+					get_vpn_manager_dbus_proxy()));
+
 	return 0;
 }
 
-void dvpnlib_vpn_deinit(void)
+static void vpn_deinit_in_context(void)
 {
-	DBG("");
+	dvpnlib_traffic_set_rate_interval(0);
+	dvpnlib_agent_unexport();
 
 	free_vpn_manager(vpn_manager);
 	vpn_manager = NULL;
 
 	destroy_vpn_connections();
+	connect_queue_abort(NULL);
+
+	dvpnlib_watchdog_stop();
+}
+
+int dvpnlib_vpn_init(void)
+{
+	return dvpnlib_vpn_init_with_mode(DVPNLIB_THREAD_MODE_DEFAULT, 0);
+}
+
+int dvpnlib_vpn_init_with_mode(enum dvpnlib_thread_mode mode,
+				unsigned int event_queue_size)
+{
+	DBG("mode: %d", mode);
+
+	if (vpn_manager != NULL)
+		return 0;
+
+	if (mode == DVPNLIB_THREAD_MODE_WORKER)
+		return dvpnlib_worker_start(vpn_init_in_context,
+					vpn_deinit_in_context,
+					event_queue_size);
+
+	return vpn_init_in_context();
+}
+
+void dvpnlib_vpn_deinit(void)
+{
+	DBG("");
+
+	if (dvpnlib_worker_is_enabled()) {
+		dvpnlib_worker_stop();
+		return;
+	}
+
+	vpn_deinit_in_context();
+}
+
+void dvpnlib_cancel_all(void)
+{
+	DBG("");
+
+	if (vpn_manager == NULL)
+		return;
+
+	dvpnlib_vpn_manager_cancel();
+	cancel_vpn_connections();
 }
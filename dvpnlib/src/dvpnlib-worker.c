@@ -0,0 +1,314 @@
+#include "dvpnlib-internal.h"
+
+/*
+ * Worker thread mode
+ *
+ * The library runs a GMainContext of its own in a dedicated thread. All
+ * the D-Bus proxies are created there, so signals and asynchronous
+ * replies are dispatched and parsed by the worker no matter how busy
+ * the application's main loop is. Finished events are then handed to
+ * the application's context through a queue. Only the droppable events
+ * (property change notifications) are bounded by its size: completion,
+ * added/removed and agent input events are never dropped, so the queue
+ * may grow past it while the application does not dispatch them.
+ *
+ * The worker pointer is published with atomic stores, since it is read
+ * by every thread posting or invoking.
+ */
+
+#define WORKER_DEFAULT_QUEUE_SIZE	256
+#define WORKER_EVENTS_PER_DISPATCH	32
+
+struct worker_event {
+	GSourceFunc func;
+	gpointer data;
+	GDestroyNotify notify;
+};
+
+struct worker_source {
+	GSource source;
+	GAsyncQueue *queue;
+};
+
+struct worker {
+	GThread *thread;
+	GMainContext *context;
+	GMainLoop *loop;
+	GMainContext *app_context;
+	GSource *event_source;
+	GAsyncQueue *event_queue;
+	guint event_queue_size;
+	guint dropped_events;	/* atomic */
+	GMutex lock;
+	GCond cond;
+	gboolean started;
+	int result;
+	int (*init_func)(void);
+	void (*deinit_func)(void);
+};
+
+static struct worker *worker;
+
+static void free_worker_event(struct worker_event *event)
+{
+	if (event->notify)
+		event->notify(event->data);
+
+	g_free(event);
+}
+
+static gboolean event_source_prepare(GSource *source, gint *timeout)
+{
+	struct worker_source *event_source = (struct worker_source *)source;
+
+	*timeout = -1;
+
+	return g_async_queue_length(event_source->queue) > 0;
+}
+
+static gboolean event_source_check(GSource *source)
+{
+	struct worker_source *event_source = (struct worker_source *)source;
+
+	return g_async_queue_length(event_source->queue) > 0;
+}
+
+static gboolean event_source_dispatch(GSource *source,
+					GSourceFunc callback,
+					gpointer user_data)
+{
+	struct worker_source *event_source = (struct worker_source *)source;
+	struct worker_event *event;
+	int i;
+
+	/* Bounded batches keep the application's main loop responsive */
+	for (i = 0; i < WORKER_EVENTS_PER_DISPATCH; i++) {
+		event = g_async_queue_try_pop(event_source->queue);
+		if (event == NULL)
+			break;
+
+		event->func(event->data);
+		free_worker_event(event);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs event_source_funcs = {
+	event_source_prepare,
+	event_source_check,
+	event_source_dispatch,
+	NULL,
+};
+
+static gpointer worker_thread(gpointer data)
+{
+	struct worker *w = data;
+	int result;
+
+	DBG("");
+
+	g_main_context_push_thread_default(w->context);
+
+	result = w->init_func();
+
+	g_mutex_lock(&w->lock);
+	w->result = result;
+	w->started = TRUE;
+	g_cond_signal(&w->cond);
+	g_mutex_unlock(&w->lock);
+
+	if (result == 0)
+		g_main_loop_run(w->loop);
+
+	g_main_context_pop_thread_default(w->context);
+
+	DBG("worker thread exits");
+
+	return NULL;
+}
+
+static gboolean worker_quit(gpointer data)
+{
+	struct worker *w = data;
+
+	w->deinit_func();
+	g_main_loop_quit(w->loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_worker(struct worker *w)
+{
+	struct worker_event *event;
+
+	if (w->event_source) {
+		g_source_destroy(w->event_source);
+		g_source_unref(w->event_source);
+	}
+
+	if (w->event_queue) {
+		while ((event = g_async_queue_try_pop(w->event_queue)))
+			free_worker_event(event);
+		g_async_queue_unref(w->event_queue);
+	}
+
+	if (w->loop)
+		g_main_loop_unref(w->loop);
+	if (w->context)
+		g_main_context_unref(w->context);
+	if (w->app_context)
+		g_main_context_unref(w->app_context);
+
+	g_mutex_clear(&w->lock);
+	g_cond_clear(&w->cond);
+	g_free(w);
+}
+
+/*
+ * Starts the worker and runs init_func() in it; blocks until init_func()
+ * has returned and returns its result. Events are delivered to the
+ * thread-default context of the calling thread.
+ */
+int dvpnlib_worker_start(int (*init_func)(void), void (*deinit_func)(void),
+				guint queue_size)
+{
+	struct worker *w;
+	struct worker_source *event_source;
+	int result;
+
+	DBG("queue size: %u", queue_size);
+
+	if (g_atomic_pointer_get(&worker) != NULL)
+		return -1;
+
+	w = g_try_new0(struct worker, 1);
+	if (w == NULL) {
+		ERROR("no memory");
+		return -1;
+	}
+
+	g_mutex_init(&w->lock);
+	g_cond_init(&w->cond);
+	w->init_func = init_func;
+	w->deinit_func = deinit_func;
+	w->event_queue_size = queue_size ? queue_size :
+					WORKER_DEFAULT_QUEUE_SIZE;
+	w->context = g_main_context_new();
+	w->loop = g_main_loop_new(w->context, FALSE);
+	w->app_context = g_main_context_ref_thread_default();
+	w->event_queue = g_async_queue_new();
+
+	w->event_source = g_source_new(&event_source_funcs,
+					sizeof(struct worker_source));
+	event_source = (struct worker_source *)w->event_source;
+	event_source->queue = w->event_queue;
+	g_source_attach(w->event_source, w->app_context);
+
+	/* Published before the thread starts posting events */
+	g_atomic_pointer_set(&worker, w);
+
+	w->thread = g_thread_new("dvpnlib-worker", worker_thread, w);
+
+	g_mutex_lock(&w->lock);
+	while (!w->started)
+		g_cond_wait(&w->cond, &w->lock);
+	result = w->result;
+	g_mutex_unlock(&w->lock);
+
+	if (result != 0) {
+		g_thread_join(w->thread);
+		g_atomic_pointer_set(&worker, NULL);
+		free_worker(w);
+	}
+
+	return result;
+}
+
+/*
+ * Runs deinit_func() in the worker, stops it and drops the events which
+ * have not been delivered yet.
+ */
+void dvpnlib_worker_stop(void)
+{
+	struct worker *w = g_atomic_pointer_get(&worker);
+
+	DBG("");
+
+	if (w == NULL)
+		return;
+
+	g_main_context_invoke(w->context, worker_quit, w);
+	g_thread_join(w->thread);
+
+	g_atomic_pointer_set(&worker, NULL);
+
+	if (g_atomic_int_get(&w->dropped_events))
+		DBG("%u events were dropped",
+				g_atomic_int_get(&w->dropped_events));
+
+	free_worker(w);
+}
+
+gboolean dvpnlib_worker_is_enabled(void)
+{
+	return g_atomic_pointer_get(&worker) != NULL;
+}
+
+/*
+ * Runs func in the worker thread, immediately if called from it; runs
+ * it in place when the worker mode is not enabled.
+ */
+void dvpnlib_worker_invoke(GSourceFunc func, gpointer data,
+				GDestroyNotify notify)
+{
+	struct worker *w = g_atomic_pointer_get(&worker);
+
+	if (w == NULL) {
+		func(data);
+		if (notify)
+			notify(data);
+		return;
+	}
+
+	g_main_context_invoke_full(w->context, G_PRIORITY_DEFAULT,
+					func, data, notify);
+}
+
+/*
+ * Delivers an event to the application. Without the worker the event
+ * runs in place. With it, the event is queued for the application's
+ * context; once the queue holds event_queue_size events, droppable
+ * events (property change notifications, whose new value can still be
+ * read through the getters) are discarded instead of queued. The other
+ * events are always queued, whatever the length of the queue.
+ */
+void dvpnlib_event_post(GSourceFunc func, gpointer data,
+				GDestroyNotify notify, gboolean droppable)
+{
+	struct worker *w = g_atomic_pointer_get(&worker);
+	struct worker_event *event;
+
+	if (w == NULL) {
+		func(data);
+		if (notify)
+			notify(data);
+		return;
+	}
+
+	if (droppable && (guint)g_async_queue_length(w->event_queue) >=
+						w->event_queue_size) {
+		g_atomic_int_inc(&w->dropped_events);
+		if (notify)
+			notify(data);
+		return;
+	}
+
+	event = g_new0(struct worker_event, 1);
+	event->func = func;
+	event->data = data;
+	event->notify = notify;
+
+	g_async_queue_push(w->event_queue, event);
+	g_main_context_wakeup(w->app_context);
+}
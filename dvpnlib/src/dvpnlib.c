@@ -1,62 +1,146 @@
 #include "dvpnlib-internal.h"
+#include "dvpnlib-vpn.h"
+#include "dvpnlib-trace.h"
+
+static gint default_timeout = DVPNLIB_DEFAULT_CALL_TIMEOUT;
+
+gint dvpnlib_log_level = DVPNLIB_LOG_DEFAULT_LEVEL;
+
+/*
+ * Log
+ */
+void dvpnlib_set_log_level(enum dvpnlib_log_level level)
+{
+	g_atomic_int_set(&dvpnlib_log_level, level);
+}
+
+/*
+ * Timeout
+ */
+enum dvpnlib_err dvpnlib_set_default_timeout(int timeout)
+{
+	DBG("timeout: %d", timeout);
+
+	if (timeout == DVPNLIB_TIMEOUT_DEFAULT)
+		timeout = DVPNLIB_DEFAULT_CALL_TIMEOUT;
+	else if (timeout <= 0)
+		return DVPNLIB_ERR_INVALID_PARAMETER;
+
+	default_timeout = timeout;
+
+	return DVPNLIB_ERR_NONE;
+}
+
+int dvpnlib_get_default_timeout(void)
+{
+	return default_timeout;
+}
+
+/*
+ * Resolves a per-call timeout into the value handed to GDBus, so that
+ * no call ever falls back to the D-Bus default or blocks forever unless
+ * DVPNLIB_TIMEOUT_INFINITE is asked for explicitly.
+ */
+static gint common_get_timeout(gint timeout)
+{
+	if (timeout == DVPNLIB_TIMEOUT_DEFAULT || timeout <= 0)
+		return default_timeout;
+
+	return timeout;
+}
 
 /*
  * D-Bus
  */
 enum dvpnlib_err common_set_property(GDBusProxy *dbus_proxy,
 				const char *property,
-				GVariant *value)
+				GVariant *value,
+				gint timeout,
+				GCancellable *cancellable)
 {
 	gchar *print_str;
 	GError *error = NULL;
+	GVariant *result;
 	enum dvpnlib_err ret = DVPNLIB_ERR_NONE;
+	gint64 start;
 
-	print_str = g_variant_print(value, TRUE);
-	DBG("set object %s property %s to %s",
-		g_dbus_proxy_get_object_path(dbus_proxy),
-		property, print_str);
-	g_free(print_str);
+	if (DBG_ENABLED()) {
+		print_str = g_variant_print(value, TRUE);
+		DBG("set object %s property %s to %s",
+			g_dbus_proxy_get_object_path(dbus_proxy),
+			property, print_str);
+		g_free(print_str);
+	}
 
-	g_dbus_proxy_call_sync(dbus_proxy, "SetProperty",
+	TRACE_DBUS_CALL(g_dbus_proxy_get_object_path(dbus_proxy),
+							"SetProperty");
+	start = dvpnlib_stats_call_begin(DVPNLIB_METHOD_SET_PROPERTY);
+	result = g_dbus_proxy_call_sync(dbus_proxy, "SetProperty",
 				g_variant_new("(sv)", property, value),
-				G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+				G_DBUS_CALL_FLAGS_NONE,
+				common_get_timeout(timeout),
+				cancellable, &error);
 	if (error) {
 		ERROR("%s", error->message);
 		ret = get_error_type(error);
 		g_error_free(error);
-	}
+	} else
+		g_variant_unref(result);
+
+	dvpnlib_stats_call_end(DVPNLIB_METHOD_SET_PROPERTY, start, ret);
+	TRACE_DBUS_REPLY(g_dbus_proxy_get_object_path(dbus_proxy),
+			"SetProperty", ret, g_get_monotonic_time() - start);
 
 	return ret;
 }
 
 GVariant *common_get_call_method_result(GDBusProxy *dbus_proxy,
-					  const char *method)
+					  const char *method,
+					  gint timeout,
+					  GCancellable *cancellable)
 {
 	if ((!dbus_proxy) || (!method))
 		return NULL;
 
 	GError *error = NULL;
 	GVariant *result;
+	enum dvpnlib_method method_id = dvpnlib_stats_method(method);
+	gint64 start;
 
 	DBG("get object %s method %s",
 		g_dbus_proxy_get_object_path(dbus_proxy), method);
 
+	TRACE_DBUS_CALL(g_dbus_proxy_get_object_path(dbus_proxy), method);
+	start = dvpnlib_stats_call_begin(method_id);
 	result = g_dbus_proxy_call_sync(dbus_proxy, method, NULL,
-					    G_DBUS_CALL_FLAGS_NONE, -1,
-					    NULL, &error);
+					    G_DBUS_CALL_FLAGS_NONE,
+					    common_get_timeout(timeout),
+					    cancellable, &error);
 	if (!result) {
+		enum dvpnlib_err ret = get_error_type(error);
+
 		ERROR("%s", error->message);
+		dvpnlib_stats_call_end(method_id, start, ret);
+		TRACE_DBUS_REPLY(g_dbus_proxy_get_object_path(dbus_proxy),
+				method, ret, g_get_monotonic_time() - start);
 		g_error_free(error);
 		return NULL;
 	}
 
+	dvpnlib_stats_call_end(method_id, start, DVPNLIB_ERR_NONE);
+	TRACE_DBUS_REPLY(g_dbus_proxy_get_object_path(dbus_proxy),
+			method, DVPNLIB_ERR_NONE,
+			g_get_monotonic_time() - start);
+
 	return result;
 }
 
 enum dvpnlib_err common_set_interface_call_method_sync(
 						GDBusProxy *dbus_proxy,
 						const char *method,
-						GVariant **parameters)
+						GVariant **parameters,
+						gint timeout,
+						GCancellable *cancellable)
 {
 	if ((!dbus_proxy) || (!method))
 		return DVPNLIB_ERR_FAILED;
@@ -64,57 +148,224 @@ enum dvpnlib_err common_set_interface_call_method_sync(
 	GVariant *result;
 	GError *error = NULL;
 	enum dvpnlib_err ret = DVPNLIB_ERR_NONE;
+	enum dvpnlib_method method_id = dvpnlib_stats_method(method);
+	gint64 start;
 
 	DBG("get object %s property %s",
 		g_dbus_proxy_get_object_path(dbus_proxy), method);
 
+	TRACE_DBUS_CALL(g_dbus_proxy_get_object_path(dbus_proxy), method);
+	start = dvpnlib_stats_call_begin(method_id);
 	if (parameters)
 		result = g_dbus_proxy_call_sync(dbus_proxy, method, *parameters,
-			       G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+			       G_DBUS_CALL_FLAGS_NONE,
+			       common_get_timeout(timeout), cancellable, &error);
 	else
 		result = g_dbus_proxy_call_sync(dbus_proxy, method, NULL,
-			       G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+			       G_DBUS_CALL_FLAGS_NONE,
+			       common_get_timeout(timeout), cancellable, &error);
 	if (error) {
 		ERROR("%s", error->message);
 		ret = get_error_type(error);
 		g_error_free(error);
+		dvpnlib_stats_call_end(method_id, start, ret);
+		TRACE_DBUS_REPLY(g_dbus_proxy_get_object_path(dbus_proxy),
+				method, ret, g_get_monotonic_time() - start);
 		return ret;
 	}
 
 	g_variant_unref(result);
 
+	dvpnlib_stats_call_end(method_id, start, ret);
+	TRACE_DBUS_REPLY(g_dbus_proxy_get_object_path(dbus_proxy),
+			method, ret, g_get_monotonic_time() - start);
+
 	return ret;
 }
 
+/*
+ * An asynchronous call in flight: the reply is finished here, so that
+ * it is accounted for before the caller sees its result.
+ */
+struct common_pending_call {
+	const char *method;	/* method names are string literals */
+	enum dvpnlib_method method_id;
+	gint64 start;
+	common_call_reply_cb callback;
+	gpointer user_data;
+};
+
+/*
+ * In the worker thread mode asynchronous calls are issued from the
+ * worker, so that their replies are dispatched there as well.
+ */
+struct common_call_data {
+	GDBusProxy *dbus_proxy;
+	gchar *method;
+	GVariant *parameters;
+	gint timeout;
+	GCancellable *cancellable;
+	struct common_pending_call *pending;
+};
+
+struct common_reply_event {
+	dvpnlib_reply_cb callback;
+	enum dvpnlib_err result;
+	void *user_data;
+};
+
+static void common_call_reply(GObject *source_object,
+				GAsyncResult *res, gpointer user_data)
+{
+	struct common_pending_call *pending = user_data;
+	enum dvpnlib_err ret = DVPNLIB_ERR_NONE;
+	GError *error = NULL;
+	GVariant *reply;
+
+	/*
+	 * Finish on the source proxy: a cancelled call may complete after
+	 * the object it was issued for has gone away.
+	 */
+	reply = g_dbus_proxy_call_finish(G_DBUS_PROXY(source_object),
+					res, &error);
+	if (!reply) {
+		DBG("%s", error->message);
+		ret = get_error_type(error);
+		g_error_free(error);
+	}
+
+	dvpnlib_stats_call_end(pending->method_id, pending->start, ret);
+	TRACE_DBUS_REPLY(g_dbus_proxy_get_object_path(
+				G_DBUS_PROXY(source_object)),
+			pending->method, ret,
+			g_get_monotonic_time() - pending->start);
+
+	if (pending->callback)
+		pending->callback(ret, reply, pending->user_data);
+
+	if (reply)
+		g_variant_unref(reply);
+
+	g_free(pending);
+}
+
+static gboolean common_call_in_worker(gpointer data)
+{
+	struct common_call_data *call = data;
+
+	g_dbus_proxy_call(call->dbus_proxy, call->method, call->parameters,
+				G_DBUS_CALL_FLAGS_NONE, call->timeout,
+				call->cancellable, common_call_reply,
+				call->pending);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void free_common_call_data(gpointer data)
+{
+	struct common_call_data *call = data;
+
+	g_object_unref(call->dbus_proxy);
+	g_free(call->method);
+	if (call->parameters)
+		g_variant_unref(call->parameters);
+	if (call->cancellable)
+		g_object_unref(call->cancellable);
+	g_free(call);
+}
+
 enum dvpnlib_err common_set_interface_call_method(GDBusProxy *dbus_proxy,
 						const char *method,
 						GVariant **parameters,
-						GAsyncReadyCallback callback,
+						gint timeout,
+						GCancellable *cancellable,
+						common_call_reply_cb callback,
 						gpointer user_data)
 {
+	struct common_pending_call *pending;
+
 	if ((!dbus_proxy) || (!method))
 		return DVPNLIB_ERR_FAILED;
 
 	DBG("get object %s property %s",
 		g_dbus_proxy_get_object_path(dbus_proxy), method);
 
-	if (parameters) {
-		g_dbus_proxy_call(dbus_proxy,
-				method,
-				*parameters,
-				G_DBUS_CALL_FLAGS_NONE,
-				-1, NULL, callback, user_data);
-	} else {
-		g_dbus_proxy_call(dbus_proxy,
-				method,
-				NULL,
-				G_DBUS_CALL_FLAGS_NONE,
-				-1, NULL, callback, user_data);
+	pending = g_try_new0(struct common_pending_call, 1);
+	if (pending == NULL) {
+		ERROR("no memory");
+		return DVPNLIB_ERR_FAILED;
 	}
 
+	pending->method = method;
+	pending->method_id = dvpnlib_stats_method(method);
+	pending->callback = callback;
+	pending->user_data = user_data;
+	TRACE_DBUS_CALL(g_dbus_proxy_get_object_path(dbus_proxy), method);
+	pending->start = dvpnlib_stats_call_begin(pending->method_id);
+
+	if (dvpnlib_worker_is_enabled()) {
+		struct common_call_data *call = g_new0(struct common_call_data, 1);
+
+		call->dbus_proxy = g_object_ref(dbus_proxy);
+		call->method = g_strdup(method);
+		if (parameters)
+			call->parameters = g_variant_ref_sink(*parameters);
+		call->timeout = common_get_timeout(timeout);
+		if (cancellable)
+			call->cancellable = g_object_ref(cancellable);
+		call->pending = pending;
+
+		dvpnlib_worker_invoke(common_call_in_worker, call,
+					free_common_call_data);
+
+		return DVPNLIB_ERR_NONE;
+	}
+
+	g_dbus_proxy_call(dbus_proxy,
+			method,
+			parameters ? *parameters : NULL,
+			G_DBUS_CALL_FLAGS_NONE,
+			common_get_timeout(timeout), cancellable,
+			common_call_reply, pending);
+
 	return DVPNLIB_ERR_NONE;
 }
 
+static gboolean reply_event_dispatch(gpointer data)
+{
+	struct common_reply_event *event = data;
+
+	event->callback(event->result, event->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Hands the result of an asynchronous call to its caller; in the worker
+ * thread mode this is queued for the application's context.
+ */
+void common_reply_dispatch(dvpnlib_reply_cb callback,
+				enum dvpnlib_err result,
+				void *user_data)
+{
+	struct common_reply_event *event;
+
+	if (callback == NULL)
+		return;
+
+	if (!dvpnlib_worker_is_enabled()) {
+		callback(result, user_data);
+		return;
+	}
+
+	event = g_new0(struct common_reply_event, 1);
+	event->callback = callback;
+	event->result = result;
+	event->user_data = user_data;
+
+	dvpnlib_event_post(reply_event_dispatch, event, g_free, FALSE);
+}
+
 struct common_reply_data *common_reply_data_new(void *cb, void *data,
 						void *user, bool flag)
 {
@@ -134,8 +385,17 @@ struct common_reply_data *common_reply_data_new(void *cb, void *data,
 
 /*
  * Error
+ *
+ * ConnMan reports its errors under both of these D-Bus error name
+ * prefixes, the table below lists their common suffixes.
  */
-struct error_map_t error_map[] = {
+static const gchar *error_prefix[] = {
+	"net.connman.vpn.",
+	"net.connman.",
+	NULL,
+};
+
+static struct error_map_t error_map[] = {
 	{"Error.Failed", DVPNLIB_ERR_OPERATION_FAILED},
 	{"Error.InvalidArguments", DVPNLIB_ERR_INVALID_PARAMETER},
 	{"Error.PermissionDenied", DVPNLIB_ERR_PERMISSION_DENIED},
@@ -145,6 +405,7 @@ struct error_map_t error_map[] = {
 	{"Error.NotSupported", DVPNLIB_ERR_NOT_SUPPORTED},
 	{"Error.NotImplemented", DVPNLIB_ERR_NOT_IMPLEMENTED},
 	{"Error.NotFound", DVPNLIB_ERR_NOT_FOUND},
+	{"Error.NoCarrier", DVPNLIB_ERR_NOT_CARRIER},
 	{"Error.InProgress", DVPNLIB_ERR_IN_PROGRESS},
 	{"Error.AlreadyExists", DVPNLIB_ERR_ALREADY_EXISTS},
 	{"Error.AlreadyEnabled", DVPNLIB_ERR_ALREADY_ENABLED},
@@ -155,26 +416,81 @@ struct error_map_t error_map[] = {
 	{"Error.OperationTimeout", DVPNLIB_ERR_OPERATION_TIMEOUT},
 	{"Error.InvalidService", DVPNLIB_ERR_INVALID_SERVICE},
 	{"Error.InvalidProperty", DVPNLIB_ERR_INVALID_PROPERTY},
+	{NULL, DVPNLIB_ERR_NONE},
+};
 
-	{"Error.Timeout", DVPNLIB_ERR_TIMEOUT},
-	{"Error.Timedout", DVPNLIB_ERR_TIMEOUT},
-	{"Error.UnknownProperty", DVPNLIB_ERR_UNKNOWN_PROPERTY},
-	{"Error.PropertyReadOnly", DVPNLIB_ERR_PROPERTY_READONLY},
-	{"Error.UnknownMethod", DVPNLIB_ERR_UNKNOWN_METHOD},
+/* Errors raised by the bus or by GDBus rather than by ConnMan */
+static struct error_map_t dbus_error_map[] = {
+	{"org.freedesktop.DBus.Error.NoReply", DVPNLIB_ERR_TIMEOUT},
+	{"org.freedesktop.DBus.Error.Timeout", DVPNLIB_ERR_TIMEOUT},
+	{"org.freedesktop.DBus.Error.TimedOut", DVPNLIB_ERR_TIMEOUT},
+	{"org.freedesktop.DBus.Error.AccessDenied",
+					DVPNLIB_ERR_PERMISSION_DENIED},
+	{"org.freedesktop.DBus.Error.InvalidArgs",
+					DVPNLIB_ERR_INVALID_PARAMETER},
+	{"org.freedesktop.DBus.Error.UnknownMethod",
+					DVPNLIB_ERR_UNKNOWN_METHOD},
+	{"org.freedesktop.DBus.Error.UnknownProperty",
+					DVPNLIB_ERR_UNKNOWN_PROPERTY},
+	{"org.freedesktop.DBus.Error.PropertyReadOnly",
+					DVPNLIB_ERR_PROPERTY_READONLY},
+	{NULL, DVPNLIB_ERR_NONE},
 };
 
+/* D-Bus error name -> enum dvpnlib_err, built once and never freed */
+static gpointer create_error_hash(gpointer data)
+{
+	GHashTable *error_hash;
+	int i, j;
+
+	error_hash = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (i = 0; error_prefix[i] != NULL; i++)
+		for (j = 0; error_map[j].error_key_str != NULL; j++)
+			g_hash_table_insert(error_hash,
+				g_strconcat(error_prefix[i],
+					error_map[j].error_key_str, NULL),
+				GINT_TO_POINTER(error_map[j].type));
+
+	for (j = 0; dbus_error_map[j].error_key_str != NULL; j++)
+		g_hash_table_insert(error_hash,
+			(gpointer)dbus_error_map[j].error_key_str,
+			GINT_TO_POINTER(dbus_error_map[j].type));
+
+	return error_hash;
+}
+
 enum dvpnlib_err get_error_type(GError *error)
 {
-	int i = 0;
+	static GOnce error_hash_once = G_ONCE_INIT;
+	GHashTable *error_hash;
+	gchar *error_name;
+	gpointer type;
+
+	/*
+	 * Locally generated errors: the call was cancelled through its
+	 * GCancellable or did not get a reply within its timeout.
+	 */
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		return DVPNLIB_ERR_OPERATION_ABORTED;
+
+	if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+		return DVPNLIB_ERR_TIMEOUT;
 
-	while (error_map[i].error_key_str != NULL) {
-		const gchar *error_info = error_map[i].error_key_str;
+	error_name = g_dbus_error_get_remote_error(error);
+	if (error_name == NULL)
+		return DVPNLIB_ERR_FAILED;
 
-		if (g_strrstr(error->message, error_info))
-			return error_map[i].type;
+	error_hash = g_once(&error_hash_once, create_error_hash, NULL);
 
-		i++;
+	if (!g_hash_table_lookup_extended(error_hash, error_name,
+							NULL, &type)) {
+		DBG("unknown D-Bus error %s", error_name);
+		g_free(error_name);
+		return DVPNLIB_ERR_FAILED;
 	}
 
-	return DVPNLIB_ERR_FAILED;
+	g_free(error_name);
+
+	return GPOINTER_TO_INT(type);
 }
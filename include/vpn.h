@@ -17,6 +17,8 @@
 #ifndef __TIZEN_NETWORK_VPN_H__
 #define __TIZEN_NETWORK_VPN_H__
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <tizen.h>
 
 #ifdef __cplusplus
@@ -30,10 +32,39 @@ extern "C" {
 
 /**
  * @brief The handle for vpn.
+ * @details A plain handle, as given by vpn_get_vpn_handle(),
+ *   vpn_get_vpn_handle_list() and the callbacks, holds no reference: it
+ *   is only guaranteed to be valid until its profile is removed, and is
+ *   looked up among the profiles on every call. A referenced handle, as
+ *   given by vpn_handle_ref(), vpn_get_vpn_handle_ref(),
+ *   vpn_get_vpn_handle_list_ref() and vpn_query(), stays valid until it
+ *   is released with vpn_handle_unref(), e.g. across an asynchronous call
+ *   or in another thread, and is used without a lookup. Once its profile
+ *   is removed, calls on it fail with #VPN_ERROR_NO_CONNECTION and the
+ *   detail #VPN_ERROR_DETAIL_NOT_FOUND.
+ * @remarks A referenced handle does not compare equal to the plain
+ *   handle of the same profile.
  */
 typedef void *vpn_h;
 typedef void *vpn_settings_h;
 
+/**
+ * @brief Use the library-wide default timeout for a D-Bus call.
+ * @see vpn_set_default_timeout()
+ */
+#define VPN_TIMEOUT_DEFAULT	(-1)
+
+/**
+ * @brief Wait for a D-Bus reply without any timeout.
+ */
+#define VPN_TIMEOUT_INFINITE	0x7fffffff
+
+/**
+ * @brief The latency of a server which did not answer.
+ * @see vpn_get_latency()
+ */
+#define VPN_LATENCY_UNREACHABLE	(-1)
+
 /**
 * @brief The VPN error type
 */
@@ -54,6 +85,239 @@ typedef enum {
 	VPN_ERROR_SECURITY_RESTRICTED = TIZEN_ERROR_NETWORK_CLASS|0x0309, /**< Restricted by security system policy */
 } vpn_error_e;
 
+/**
+* @brief The detailed cause of the last VPN error
+* @details Several causes are reported as the same #vpn_error_e; this
+*   tells them apart.
+* @see vpn_get_last_error_detail()
+*/
+typedef enum {
+	VPN_ERROR_DETAIL_NONE = 0, /**< Successful */
+	VPN_ERROR_DETAIL_FAILED, /**< Unknown or local failure */
+	VPN_ERROR_DETAIL_OPERATION_FAILED, /**< The service reported a failure */
+	VPN_ERROR_DETAIL_INVALID_PARAMETER, /**< Invalid arguments */
+	VPN_ERROR_DETAIL_PERMISSION_DENIED, /**< Permission denied */
+	VPN_ERROR_DETAIL_PASSPHRASE_REQUIRED, /**< Passphrase required */
+	VPN_ERROR_DETAIL_NOT_REGISTERED, /**< Not registered */
+	VPN_ERROR_DETAIL_NOT_UNIQUE, /**< Not unique */
+	VPN_ERROR_DETAIL_NOT_SUPPORTED, /**< Not supported */
+	VPN_ERROR_DETAIL_NOT_IMPLEMENTED, /**< Not implemented */
+	VPN_ERROR_DETAIL_NOT_FOUND, /**< Not found */
+	VPN_ERROR_DETAIL_NO_CARRIER, /**< No carrier */
+	VPN_ERROR_DETAIL_IN_PROGRESS, /**< Already in progress */
+	VPN_ERROR_DETAIL_ALREADY_EXISTS, /**< Already exists */
+	VPN_ERROR_DETAIL_ALREADY_ENABLED, /**< Already enabled */
+	VPN_ERROR_DETAIL_ALREADY_DISABLED, /**< Already disabled */
+	VPN_ERROR_DETAIL_ALREADY_CONNECTED, /**< Already connected */
+	VPN_ERROR_DETAIL_NOT_CONNECTED, /**< Not connected */
+	VPN_ERROR_DETAIL_OPERATION_ABORTED, /**< Aborted, e.g. by vpn_cancel() */
+	VPN_ERROR_DETAIL_OPERATION_TIMEOUT, /**< The service timed out */
+	VPN_ERROR_DETAIL_INVALID_SERVICE, /**< Invalid service */
+	VPN_ERROR_DETAIL_INVALID_PROPERTY, /**< Invalid property */
+	VPN_ERROR_DETAIL_TIMEOUT, /**< No D-Bus reply within the call timeout */
+	VPN_ERROR_DETAIL_UNKNOWN_PROPERTY, /**< Unknown property */
+	VPN_ERROR_DETAIL_PROPERTY_READONLY, /**< Read-only property */
+	VPN_ERROR_DETAIL_UNKNOWN_METHOD, /**< Unknown method */
+} vpn_error_detail_e;
+
+/**
+* @brief The threading model used by the library.
+* @see vpn_initialize_with_mode()
+*/
+typedef enum {
+	VPN_THREAD_MODE_DEFAULT = 0, /**< D-Bus traffic is dispatched by the application's main context */
+	VPN_THREAD_MODE_WORKER, /**< D-Bus traffic is dispatched by a library-owned thread */
+} vpn_thread_mode_e;
+
+/**
+* @brief The verbosity of the library's log output.
+* @see vpn_set_log_level()
+*/
+typedef enum {
+	VPN_LOG_LEVEL_NONE = 0, /**< No logging */
+	VPN_LOG_LEVEL_ERROR, /**< Errors only */
+	VPN_LOG_LEVEL_WARN, /**< Errors and warnings (default) */
+	VPN_LOG_LEVEL_INFO, /**< Also API calls and their arguments */
+	VPN_LOG_LEVEL_DEBUG, /**< Also D-Bus traffic, including payloads */
+} vpn_log_level_e;
+
+/**
+* @brief The D-Bus methods for which call statistics are kept.
+* @see vpn_get_stats()
+*/
+typedef enum {
+	VPN_METHOD_CREATE = 0, /**< Manager.Create */
+	VPN_METHOD_REMOVE, /**< Manager.Remove */
+	VPN_METHOD_CONNECT, /**< Connection.Connect */
+	VPN_METHOD_DISCONNECT, /**< Connection.Disconnect */
+	VPN_METHOD_SET_PROPERTY, /**< Connection.SetProperty */
+	VPN_METHOD_CLEAR_PROPERTY, /**< Connection.ClearProperty */
+	VPN_METHOD_GET_CONNECTIONS, /**< Manager.GetConnections */
+	VPN_METHOD_REGISTER_AGENT, /**< Manager.RegisterAgent */
+	VPN_METHOD_UNREGISTER_AGENT, /**< Manager.UnregisterAgent */
+	VPN_METHOD_OTHER, /**< Any other method */
+	VPN_METHOD_MAX,
+} vpn_method_e;
+
+/**
+* @brief The number of latency buckets in #vpn_method_stats_s.
+*/
+#define VPN_STATS_LATENCY_BUCKETS	26
+
+/**
+* @brief D-Bus call statistics of one method.
+*/
+typedef struct {
+	unsigned int calls; /**< Calls issued */
+	unsigned int errors; /**< Calls which failed, timed out or were cancelled */
+	int in_flight; /**< Calls waiting for their reply */
+	unsigned int latency[VPN_STATS_LATENCY_BUCKETS]; /**< latency[i] counts round trips of 2^i to 2^(i+1) microseconds; the last bucket also counts longer ones */
+} vpn_method_stats_s;
+
+/**
+* @brief The connection states of a VPN Profile.
+*/
+typedef enum {
+	VPN_STATE_ANY = -1, /**< Matches every state in #vpn_query_s */
+	VPN_STATE_IDLE = 0, /**< Not connected */
+	VPN_STATE_READY, /**< Connected */
+	VPN_STATE_CONFIGURATION, /**< Connecting */
+	VPN_STATE_DISCONNECT, /**< Disconnecting */
+	VPN_STATE_FAILURE, /**< The last attempt failed */
+	VPN_STATE_UNKNOWN, /**< Not reported yet */
+} vpn_state_e;
+
+/**
+* @brief Filters of vpn_query(); a profile must match all that are set.
+*/
+typedef struct {
+	vpn_state_e state; /**< The state, or #VPN_STATE_ANY */
+	const char *type; /**< The VPN type, e.g. "openvpn", or NULL */
+	const char *domain; /**< The domain, or NULL */
+	const char *name_prefix; /**< The start of the name, or NULL */
+} vpn_query_s;
+
+/**
+* @brief The formats of vpn_export().
+*/
+typedef enum {
+	VPN_EXPORT_FORMAT_JSON = 0, /**< One JSON object per line */
+	VPN_EXPORT_FORMAT_BINARY, /**< Versioned binary records, see vpn_export() */
+} vpn_export_format_e;
+
+/**
+* @brief The version of #VPN_EXPORT_FORMAT_BINARY written by this library.
+*/
+#define VPN_EXPORT_BINARY_VERSION	1
+
+/**
+* @brief Called with the next chunk of vpn_export_with_callback() output.
+* @param[in] data  The bytes to write
+* @param[in] len  The number of bytes
+* @param[in] user_data The user data passed from vpn_export_with_callback()
+* @return true to go on, false to stop the export
+*/
+typedef bool(*vpn_export_write_cb)(const void *data, size_t len,
+		void *user_data);
+
+/**
+* @brief Latency summary of one connect outcome, in microseconds.
+* @details Values are -1 while there are no samples. The percentiles
+*   cover the most recent 64 samples.
+*/
+typedef struct {
+	long long last; /**< Last sample */
+	long long min; /**< Smallest sample */
+	long long max; /**< Largest sample */
+	long long p50; /**< Median */
+	long long p90; /**< 90th percentile */
+	long long p99; /**< 99th percentile */
+	unsigned int samples; /**< Number of samples */
+} vpn_latency_s;
+
+/**
+* @brief Connect timing of a VPN profile.
+* @details Phases are measured in microseconds from the vpn_connect()
+*   call of the last attempt and are -1 if the attempt did not reach them.
+*/
+typedef struct {
+	unsigned int attempts; /**< vpn_connect() calls */
+	long long connect_reply; /**< Reply to the D-Bus Connect call */
+	long long configuration; /**< State "configuration" */
+	long long ipv4; /**< IPv4 settings received */
+	long long nameservers; /**< Nameservers received */
+	vpn_latency_s time_to_ready; /**< Until State "ready" */
+	vpn_latency_s time_to_failure; /**< Until State "failure" or a failed Connect reply */
+} vpn_connect_timing_s;
+
+/**
+* @brief Traffic counters of the tunnel interface of a VPN profile.
+* @details The rates are per second over the last sampling interval set
+*   with vpn_set_traffic_rate_interval(), 0 while sampling is off.
+*/
+typedef struct {
+	unsigned long long rx_bytes; /**< Bytes received */
+	unsigned long long tx_bytes; /**< Bytes sent */
+	unsigned long long rx_packets; /**< Packets received */
+	unsigned long long tx_packets; /**< Packets sent */
+	unsigned long long rx_errors; /**< Receive errors */
+	unsigned long long tx_errors; /**< Transmit errors */
+	unsigned long long rx_bytes_rate; /**< Bytes received per second */
+	unsigned long long tx_bytes_rate; /**< Bytes sent per second */
+	unsigned long long rx_packets_rate; /**< Packets received per second */
+	unsigned long long tx_packets_rate; /**< Packets sent per second */
+} vpn_traffic_stats_s;
+
+/**
+* @brief The priorities of a queued connect.
+* @see vpn_connect_with_priority()
+*/
+typedef enum {
+	VPN_CONNECT_PRIORITY_HIGH = 0, /**< Goes before all the others */
+	VPN_CONNECT_PRIORITY_NORMAL, /**< Used by vpn_connect() */
+	VPN_CONNECT_PRIORITY_LOW, /**< Goes after all the others */
+} vpn_connect_priority_e;
+
+/**
+* @brief Statistics of the connect queue.
+* @see vpn_get_connect_queue_stats()
+*/
+typedef struct {
+	unsigned int concurrency; /**< The limit set, 0 for none */
+	unsigned int in_flight; /**< Connect calls waiting for their reply */
+	unsigned int queued; /**< Connects waiting for a free slot */
+	unsigned int dispatched; /**< Connects which left the queue */
+	unsigned long long wait_total_us; /**< Time they spent queued, in microseconds */
+	unsigned long long wait_max_us; /**< Longest time one spent queued */
+	unsigned int wait[VPN_STATS_LATENCY_BUCKETS]; /**< wait[i] counts connects queued for 2^i to 2^(i+1) microseconds; the last bucket also counts longer ones */
+} vpn_connect_queue_stats_s;
+
+/**
+* @brief Automatic reconnect policy of a VPN profile.
+* @details The delay before attempt n is initial_delay_ms * 2^(n-1),
+*   capped at max_delay_ms, then moved by a random amount of up to
+*   jitter_percent of itself.
+* @see vpn_set_reconnect_policy()
+*/
+typedef struct {
+	unsigned int max_attempts; /**< Attempts in a row, 0 for no limit */
+	unsigned int initial_delay_ms; /**< Delay before the first attempt */
+	unsigned int max_delay_ms; /**< Largest delay */
+	unsigned int jitter_percent; /**< 0 to 100 */
+	int connect_timeout_ms; /**< Of each attempt, or #VPN_TIMEOUT_DEFAULT */
+} vpn_reconnect_policy_s;
+
+/**
+* @brief The events of automatic reconnect.
+*/
+typedef enum {
+	VPN_RECONNECT_SCHEDULED = 0, /**< An attempt will start after delay_ms */
+	VPN_RECONNECT_STARTED, /**< Connect was issued */
+	VPN_RECONNECT_FAILED, /**< The attempt failed with result */
+	VPN_RECONNECT_SUCCEEDED, /**< The profile is ready again */
+	VPN_RECONNECT_GAVE_UP, /**< max_attempts attempts failed */
+} vpn_reconnect_event_e;
+
 /**
 * @}
 */
@@ -80,6 +344,29 @@ typedef void(*vpn_created_cb)(vpn_error_e result, void *user_data);
 * @see vpn_remove()
 */
 typedef void(*vpn_removed_cb)(vpn_error_e result, void *user_data);
+
+/**
+* @brief Called for each profile of vpn_import_profiles().
+* @param[in] index  The position of the profile in the file, from 0
+* @param[in] line  The line the profile starts at
+* @param[in] name  The profile Name, or NULL if it has none
+* @param[in] result  The result of creating the profile
+* @param[in] user_data The user data passed from vpn_import_profiles()
+* @see vpn_import_profiles()
+*/
+typedef void(*vpn_import_record_cb)(int index, int line, const char *name,
+		vpn_error_e result, void *user_data);
+
+/**
+* @brief Called once vpn_import_profiles() has handled the whole file.
+* @param[in] result  #VPN_ERROR_NONE unless the file could not be read
+* @param[in] succeeded  The number of profiles created
+* @param[in] failed  The number of profiles rejected or not created
+* @param[in] user_data The user data passed from vpn_import_profiles()
+* @see vpn_import_profiles()
+*/
+typedef void(*vpn_import_done_cb)(vpn_error_e result, int succeeded,
+		int failed, void *user_data);
 /**
 * @}
 */
@@ -93,6 +380,25 @@ typedef void(*vpn_removed_cb)(vpn_error_e result, void *user_data);
 */
 typedef void(*vpn_connect_cb)(vpn_error_e result, void *user_data);
 
+/**
+* @brief Called after vpn_connect_any() is completed.
+* @param[in] winner  The profile which came up, NULL if none did
+* @param[in] result  The result, that of the last failure if none did
+* @param[in] user_data The user data passed from vpn_connect_any()
+* @see vpn_connect_any()
+*/
+typedef void(*vpn_connect_any_cb)(vpn_h winner, vpn_error_e result,
+		void *user_data);
+
+/**
+* @brief Called after vpn_rank_by_latency() is completed.
+* @param[in] handles  The VPN Connection Identifiers, fastest first and
+*   unreachable last. The list is freed after the callback returns.
+* @param[in] user_data The user data passed from vpn_rank_by_latency()
+* @see vpn_rank_by_latency()
+*/
+typedef void(*vpn_rank_cb)(GList *handles, void *user_data);
+
 /**
 * @brief Called after vpn_disconnect() is completed.
 * @param[in] result  The result
@@ -101,6 +407,34 @@ typedef void(*vpn_connect_cb)(vpn_error_e result, void *user_data);
 * @see vpn_disconnect()
 */
 typedef void(*vpn_disconnect_cb)(vpn_error_e result, void *user_data);
+
+/**
+* @brief Called for each step of the automatic reconnect of a profile.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] event  What happened
+* @param[in] attempt  The attempt it concerns, from 1 after each drop
+* @param[in] delay_ms  The delay before the attempt, for
+*   #VPN_RECONNECT_SCHEDULED
+* @param[in] result  The result of the attempt, for #VPN_RECONNECT_FAILED
+* @param[in] user_data The user data passed from vpn_set_reconnect_policy()
+* @see vpn_set_reconnect_policy()
+*/
+/**
+* @brief Called when the cached secrets of a profile cannot answer a
+*   request for input of connman-vpn.
+* @details The request is answered as soon as the missing fields have
+*   been set with vpn_set_secret(), unless connman-vpn cancels it first.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] fields  The missing fields, NULL terminated
+* @param[in] user_data The user data passed from vpn_agent_register()
+* @see vpn_agent_register()
+*/
+typedef void(*vpn_agent_input_cb)(vpn_h handle, const char **fields,
+		void *user_data);
+
+typedef void(*vpn_reconnect_cb)(vpn_h handle, vpn_reconnect_event_e event,
+		int attempt, int delay_ms, vpn_error_e result,
+		void *user_data);
 /**
 * @}
 */
@@ -113,6 +447,9 @@ typedef void(*vpn_disconnect_cb)(vpn_error_e result, void *user_data);
 
 /**
 * @brief Initializes VPN
+* @remarks The VPN API can be called from any thread once initialized.
+*   Result callbacks are invoked on the thread-default GMainContext of
+*   the thread that made the request, as it was at call time.
 * @return 0 on success, otherwise negative error value.
 * @retval #VPN_ERROR_NONE  Successful
 * @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
@@ -120,6 +457,28 @@ typedef void(*vpn_disconnect_cb)(vpn_error_e result, void *user_data);
 */
 int vpn_initialize(void);
 
+/**
+* @brief Initializes VPN with the given threading model
+* @remarks With #VPN_THREAD_MODE_WORKER the library runs its own event
+*   loop thread, so D-Bus traffic does not depend on the application
+*   servicing its main loop. Callbacks are still delivered on the
+*   thread-default GMainContext of the thread calling this function.
+*   Once @a event_queue_size notifications are pending, further property
+*   change notifications are dropped. Completion callbacks, profile
+*   added/removed and agent input notifications are never dropped and
+*   are queued past that size. Pass 0 to use the default size.
+* @param[in] mode  The threading model
+* @param[in] event_queue_size  The number of pending notifications beyond
+*   which property change notifications are dropped
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_OPERATION_FAILED  Operation failed
+* @see vpn_initialize()
+*/
+int vpn_initialize_with_mode(vpn_thread_mode_e mode, int event_queue_size);
+
 /**
 * @brief Deinitializes VPN
 * @return 0 on success, otherwise negative error value.
@@ -129,6 +488,87 @@ int vpn_initialize(void);
 */
 int vpn_deinitialize(void);
 
+/**
+* @brief Sets the default timeout of the D-Bus calls issued by the library
+* @details The timeout applies to every call that is not given its own
+*   timeout, e.g. by vpn_connect_with_timeout(). Until this is called
+*   the default is 25 seconds.
+* @param[in] timeout_ms  The timeout in milliseconds,
+*   #VPN_TIMEOUT_INFINITE to wait forever or
+*   #VPN_TIMEOUT_DEFAULT to restore the built-in default.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+*/
+int vpn_set_default_timeout(int timeout_ms);
+
+/**
+* @brief Cancels all the VPN operations in flight
+* @details Pending vpn_create(), vpn_remove() and vpn_connect() requests
+*   are aborted and their callbacks are invoked with
+*   #VPN_ERROR_OPERATION_ABORTED. vpn_disconnect() is synchronous and
+*   never invokes its callback.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @see vpn_cancel()
+*/
+int vpn_cancel_all(void);
+
+/**
+* @brief Gets the detailed cause of the last VPN operation
+* @details The detail is kept per thread. It is updated when
+*   vpn_disconnect() returns, when vpn_create(), vpn_remove() or
+*   vpn_connect() fail to issue their request, and right before a result
+*   callback is invoked, so inside a callback it describes the result
+*   being delivered. A successful operation resets it to
+*   #VPN_ERROR_DETAIL_NONE.
+* @param[out] detail  The detailed cause
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+*/
+int vpn_get_last_error_detail(vpn_error_detail_e *detail);
+
+/**
+* @brief Sets the verbosity of the library's log output
+* @remarks This can be called at any time, also before vpn_initialize().
+*   Messages below the level are neither formatted nor sent to dlog.
+*   Release builds carry no logging code and ignore the level.
+* @param[in] level  The log level
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+*/
+int vpn_set_log_level(vpn_log_level_e level);
+
+/**
+* @brief Gets the D-Bus call statistics of a method
+* @details The round trip is measured from the moment the library issues
+*   the call until its reply has been decoded, so it includes the time
+*   spent in connman-vpn and on the bus but not in the application.
+* @param[in] method  The D-Bus method
+* @param[out] stats  The statistics
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_reset_stats()
+*/
+int vpn_get_stats(vpn_method_e method, vpn_method_stats_s *stats);
+
+/**
+* @brief Clears the D-Bus call statistics of all the methods
+* @remarks The in-flight gauges are not affected.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @see vpn_get_stats()
+*/
+int vpn_reset_stats(void);
+
 /**
 * @}
 */
@@ -220,6 +660,65 @@ int vpn_settings_set_host(const char *host);
 */
 int vpn_settings_set_domain(const char *domain);
 
+/**
+* @brief Creates a VPN Settings handle.
+* @details Unlike vpn_settings_init(), any number of handles may be
+*   built concurrently; each one is passed to vpn_create_with_settings().
+* @param[out] settings  The new VPN Settings handle
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OUT_OF_MEMORY  Out of memory
+* @see vpn_settings_destroy()
+*/
+int vpn_settings_create(vpn_settings_h *settings);
+
+/**
+* @brief Destroys a VPN Settings handle.
+* @details A vpn_create_with_settings() still in flight keeps its own
+*   copy, so the handle may be destroyed right after that call.
+* @param[in] settings  The VPN Settings handle
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_settings_create()
+*/
+int vpn_settings_destroy(vpn_settings_h settings);
+
+/**
+* @brief Clones a VPN Settings handle to use it as a template.
+* @details The clone shares the type specific keys of @a settings
+*   copy-on-write, so provisioning many profiles that differ in a few
+*   keys only costs the keys that are overridden with vpn_settings_set().
+* @param[in] settings  The VPN Settings handle to clone
+* @param[out] clone  The new VPN Settings handle
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OUT_OF_MEMORY  Out of memory
+* @see vpn_settings_create()
+* @see vpn_settings_destroy()
+*/
+int vpn_settings_clone(vpn_settings_h settings, vpn_settings_h *clone);
+
+/**
+* @brief Sets a value in a VPN Settings handle.
+* @param[in] settings  The VPN Settings handle
+* @param[in] key  The Key for the Settings, e.g. "Type", "Name", "Host",
+*   "VPN.Domain" or a VPN type specific key
+* @param[in] value The Value for the Settings, or NULL to remove the key
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_settings_create()
+*/
+int vpn_settings_set(vpn_settings_h settings,
+		const char *key, const char *value);
+
 /**
 * @}
 */
@@ -248,6 +747,62 @@ int vpn_settings_set_domain(const char *domain);
 */
 int vpn_create(vpn_created_cb callback, void *user_data);
 
+/**
+* @brief Create VPN Profile from a VPN Settings handle, asynchronously.
+* @param[in] settings  The VPN Settings handle, This can't be NULL.
+* @param[in] callback  The callback function to be called.
+*   This can be NULL if you don't want to get the notification.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  Operation failed
+* @retval #VPN_ERROR_SECURITY_RESTRICTED  Restricted by security system policy
+* @post vpn_created_cb() will be invoked
+* @see vpn_settings_create()
+* @see vpn_create()
+*/
+int vpn_create_with_settings(vpn_settings_h settings,
+		vpn_created_cb callback, void *user_data);
+
+/**
+* @brief Create the VPN Profiles listed in a file, asynchronously.
+* @details The file is read one profile at a time while up to
+*   @a max_in_flight profiles are being created. A profile is either a
+*   key file group:
+* @code
+* [name]
+* Type=openvpn
+* Host=vpn.example.com
+* OpenVPN.CACert=/etc/openvpn/ca.crt
+* @endcode
+*   or one line holding a flat JSON object of strings:
+* @code
+* {"Type": "openvpn", "Name": "name", "Host": "vpn.example.com"}
+* @endcode
+*   A file uses one of the two forms. Lines starting with '#' or ';' are
+*   comments. The group name is used as Name unless the group sets one.
+*   Profiles without Type, Name or Host are reported with
+*   #VPN_ERROR_INVALID_PARAMETER and skipped.
+* @param[in] path  The file to import
+* @param[in] max_in_flight  The number of creations kept in flight
+* @param[in] record_cb  Called for each profile, This can be NULL.
+* @param[in] done_cb  Called at the end of the file, This can be NULL.
+* @param[in] user_data The user data passed to the callback functions
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  The file could not be opened
+* @post vpn_import_record_cb() and vpn_import_done_cb() will be invoked,
+*   maybe before this function returns.
+* @see vpn_create_with_settings()
+*/
+int vpn_import_profiles(const char *path, int max_in_flight,
+		vpn_import_record_cb record_cb, vpn_import_done_cb done_cb,
+		void *user_data);
+
 /**
 * @brief Remove VPN Profile, asynchronously.
 * @param[in] handle  The VPN Connection Identifier.
@@ -276,6 +831,9 @@ int vpn_remove(vpn_h handle, vpn_removed_cb callback, void *user_data);
 
 /**
 * @brief Connect to a VPN Profile, asynchronously.
+* @details A connect issued while another one of the profile is still in
+*   progress joins it: one Connect call is made and every callback gets
+*   its result.
 * @param[in] settings  The VPN related Settings Handler, This can't be NULL.
 * @param[in] callback  The callback function to be called.
 *   This can be NULL if you don't want to get the notification.
@@ -290,8 +848,354 @@ int vpn_remove(vpn_h handle, vpn_removed_cb callback, void *user_data);
 */
 int vpn_connect(vpn_h handle, vpn_connect_cb callback, void *user_data);
 
+/**
+* @brief Connect to a VPN Profile with a deadline, asynchronously.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] timeout_ms  How long to wait for the reply in milliseconds,
+*   or #VPN_TIMEOUT_DEFAULT.
+* @param[in] callback  The callback function to be called.
+*   This can be NULL if you don't want to get the notification.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  Operation failed
+* @retval #VPN_ERROR_ALREADY_EXISTS  Already connected
+* @post vpn_connect_cb() will be invoked, with #VPN_ERROR_NO_REPLY
+*   if the deadline expires.
+* @see vpn_connect()
+* @see vpn_cancel()
+*/
+int vpn_connect_with_timeout(vpn_h handle, int timeout_ms,
+		vpn_connect_cb callback, void *user_data);
+
+/**
+* @brief Connects the first of several equivalent VPN Profiles to come up.
+* @details The profiles are started in order, @a stagger_ms apart, and
+*   the next one is started at once when one fails. The first to reach
+*   ready wins; the others that were started are disconnected and those
+*   left are not started.
+* @remarks @a callback is invoked in the thread-default main context of
+*   the calling thread. A profile takes part in one such call at a time.
+* @param[in] handles  The VPN Connection Identifiers, by preference
+* @param[in] count  The number of handles
+* @param[in] stagger_ms  The head start of each profile on the next one
+* @param[in] callback  The callback function to be called.
+*   This can be NULL if you don't want to get the notification.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_NOW_IN_PROGRESS  A profile is in another such call
+* @see vpn_connect_any_cb()
+*/
+int vpn_connect_any(vpn_h *handles, int count, int stagger_ms,
+		vpn_connect_any_cb callback, void *user_data);
+
+/**
+* @brief Connect to a VPN Profile with a priority, asynchronously.
+* @details Once vpn_set_connect_concurrency() bounds the Connect calls
+*   in flight, the connects beyond wait for a free slot. A connect of a
+*   higher priority goes first; within a priority, the threads connecting
+*   take turns, each one's connects in order.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] timeout_ms  How long to wait for the reply in milliseconds,
+*   or #VPN_TIMEOUT_DEFAULT. The wait for a slot does not count.
+* @param[in] priority  The priority
+* @param[in] callback  The callback function to be called.
+*   This can be NULL if you don't want to get the notification.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_ALREADY_EXISTS  Already connected
+* @post vpn_connect_cb() will be invoked, with
+*   #VPN_ERROR_OPERATION_ABORTED if vpn_cancel() is called while the
+*   connect is queued.
+* @see vpn_set_connect_concurrency()
+*/
+int vpn_connect_with_priority(vpn_h handle, int timeout_ms,
+		vpn_connect_priority_e priority,
+		vpn_connect_cb callback, void *user_data);
+
+/**
+* @brief Bounds the number of Connect calls in flight.
+* @details Lowering the limit lets the calls in flight complete; raising
+*   it starts queued connects at once.
+* @param[in] concurrency  The limit, or 0 for none (the default)
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_connect_with_priority()
+*/
+int vpn_set_connect_concurrency(int concurrency);
+
+/**
+* @brief Gets the statistics of the connect queue.
+* @param[out] stats  The statistics
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_set_connect_concurrency()
+*/
+int vpn_get_connect_queue_stats(vpn_connect_queue_stats_s *stats);
+
+/**
+* @brief Cancels the operations in flight on a VPN Profile.
+* @param[in] handle  The VPN Connection Identifier.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @post The callback of a pending vpn_connect() is invoked with
+*   #VPN_ERROR_OPERATION_ABORTED.
+* @see vpn_cancel_all()
+*/
+int vpn_cancel(vpn_h handle);
+
+/**
+* @brief Gets the connect timing of a VPN Profile
+* @param[in] handle  The VPN Connection Identifier.
+* @param[out] timing  The connect timing
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_connect()
+*/
+int vpn_get_connect_timing(vpn_h handle, vpn_connect_timing_s *timing);
+
+/**
+* @brief Writes the recent events of a VPN Profile to a file descriptor
+* @details Each profile keeps its last 64 events: state transitions,
+*   property changes, D-Bus calls with their results, and cancellations.
+*   They are written oldest first, one line per event, as
+*   "<monotonic usec> <object path> <event> <details>".
+* @remarks Recording the events takes no lock and allocates nothing.
+*   Writing them allocates nothing either.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] fd  The file descriptor to write to
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  Operation failed
+*/
+int vpn_dump_journal(vpn_h handle, int fd);
+
+/**
+* @brief Gets the traffic counters of the tunnel of a VPN Profile.
+* @details The counters are those of the network interface given by the
+*   Index of the profile. They are read for every interface at once and
+*   the result is reused for 100 ms, so calling this for each ready
+*   profile in turn costs a single read.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[out] stats  The counters
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_NO_CONNECTION  The profile is not ready
+* @retval #VPN_ERROR_OPERATION_FAILED  The counters could not be read
+* @see vpn_set_traffic_rate_interval()
+*/
+int vpn_get_traffic_stats(vpn_h handle, vpn_traffic_stats_s *stats);
+
+/**
+* @brief Sets how often the traffic rates are computed.
+* @details The counters of every interface are sampled each
+*   @a interval_ms in the thread-default main context of the calling
+*   thread. 0, the default, stops sampling and clears the rates.
+* @param[in] interval_ms  The sampling interval
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_get_traffic_stats()
+*/
+int vpn_set_traffic_rate_interval(int interval_ms);
+
+/**
+* @brief Reconnects a VPN Profile automatically when it drops.
+* @details Once the profile has been ready, losing the tunnel schedules
+*   Connect attempts with exponential backoff and jitter, until it is
+*   ready again or @a policy max_attempts attempts in a row have failed.
+*   A drop which follows vpn_disconnect() is not undone, and
+*   vpn_connect() or vpn_disconnect() cancel a pending attempt.
+* @remarks The attempts are made and @a callback is invoked in the
+*   thread-default main context of the calling thread. Setting a policy
+*   replaces the previous one.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] policy  The policy
+* @param[in] callback  Reports the attempts, This can be NULL.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_unset_reconnect_policy()
+*/
+int vpn_set_reconnect_policy(vpn_h handle,
+		const vpn_reconnect_policy_s *policy,
+		vpn_reconnect_cb callback, void *user_data);
+
+/**
+* @brief Stops reconnecting a VPN Profile automatically.
+* @details A pending attempt is cancelled.
+* @param[in] handle  The VPN Connection Identifier.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_set_reconnect_policy()
+*/
+int vpn_unset_reconnect_policy(vpn_h handle);
+
+/**
+* @brief Orders VPN Profiles by the latency of their server.
+* @details The latency is the time a TCP handshake with the Host of the
+*   profile takes, on @a port or, for 0, on the usual port of its Type.
+*   A refused handshake counts as an answer. Profiles measured within
+*   the cache TTL are not measured again, the others all at once.
+* @remarks @a callback is invoked in the thread-default main context of
+*   the calling thread, before this returns when nothing is measured.
+* @param[in] handles  The VPN Connection Identifiers
+* @param[in] count  The number of handles
+* @param[in] port  The port, or 0
+* @param[in] callback  The callback function to be called.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_get_latency()
+* @see vpn_set_latency_cache()
+*/
+int vpn_rank_by_latency(vpn_h *handles, int count, int port,
+		vpn_rank_cb callback, void *user_data);
+
+/**
+* @brief Gets the last measured latency of the server of a VPN Profile.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] port  The port given to vpn_rank_by_latency()
+* @param[out] latency_us  The latency in microseconds, or
+*   #VPN_LATENCY_UNREACHABLE
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  Not measured within the TTL, or the
+*   profile has no Host; vpn_get_last_error_detail() then reports
+*   #VPN_ERROR_DETAIL_NOT_FOUND
+* @see vpn_rank_by_latency()
+*/
+int vpn_get_latency(vpn_h handle, int port, long long *latency_us);
+
+/**
+* @brief Sets where the measured latencies are kept across restarts.
+* @details The results in @a path are loaded, and the file is rewritten
+*   after each measurement. A result is used for @a ttl_sec seconds.
+* @param[in] path  The cache file, or NULL to keep them in memory only
+* @param[in] ttl_sec  The lifetime of a result
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_rank_by_latency()
+*/
+int vpn_set_latency_cache(const char *path, int ttl_sec);
+
+/**
+* @brief Sets how long a VPN Profile may take to connect.
+* @details Each vpn_connect() must bring the profile to ready within
+*   @a deadline_ms. Otherwise the profile is disconnected and the connect
+*   callback gets #VPN_ERROR_NO_REPLY; its late result is not reported.
+*   With @a reconnect, the profile is then handed to the policy set with
+*   vpn_set_reconnect_policy(), if any. 0 removes the deadline.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] deadline_ms  The deadline
+* @param[in] reconnect  Whether to reconnect after a timeout
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_connect()
+*/
+int vpn_set_connect_deadline(vpn_h handle, int deadline_ms, bool reconnect);
+
+/**
+* @brief Registers the built-in agent of the library with connman-vpn.
+* @details The agent answers the requests for credentials from the
+*   secrets cached with vpn_set_secret(), so that a reconnect does not
+*   wait for the user. It replaces any agent registered before. The
+*   agent is registered again when connman-vpn restarts. On failure,
+*   the callback registered before, if any, is kept.
+* @remarks @a callback is invoked in the thread-default main context of
+*   the thread which called vpn_initialize().
+* @param[in] callback  Asks for the fields the cache cannot provide.
+*   This can be NULL, requests are then refused right away.
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_OPERATION_FAILED  Operation failed
+* @see vpn_agent_unregister()
+*/
+int vpn_agent_register(vpn_agent_input_cb callback, void *user_data);
+
+/**
+* @brief Unregisters the built-in agent of the library.
+* @details The requests still pending are canceled. The cached secrets
+*   are kept.
+* @remarks Can be called from any thread; once it returns, the callback
+*   is neither running nor invoked again.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  The agent is not registered
+* @see vpn_agent_register()
+*/
+int vpn_agent_unregister(void);
+
+/**
+* @brief Caches a secret of a VPN Profile for the built-in agent.
+* @details @a field is the name connman-vpn asks for, e.g. "Username",
+*   "Password" or "OpenConnect.Cookie". The secrets of a profile expire
+*   together @a ttl_sec seconds after the last one was set, 0 for never.
+*   They are wiped from memory once expired, when connman-vpn reports an
+*   error for the profile, or when the profile is removed.
+* @param[in] handle  The VPN Connection Identifier.
+* @param[in] field  The field name
+* @param[in] value  The value
+* @param[in] ttl_sec  The lifetime of the secrets of the profile
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_clear_secrets()
+*/
+int vpn_set_secret(vpn_h handle, const char *field, const char *value,
+		int ttl_sec);
+
+/**
+* @brief Wipes the cached secrets of a VPN Profile.
+* @param[in] handle  The VPN Connection Identifier.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_set_secret()
+*/
+int vpn_clear_secrets(vpn_h handle);
+
 /**
 * @brief Disconnect from VPN Profile, asynchronously.
+* @details A disconnect issued while another one of the profile is in
+*   flight waits for it and returns its result, without a call of its own.
 * @param[in] handle  The VPN Connection Identifier.
 * @param[in] callback  The callback function to be called.
 *   This can be NULL if you don't want to get the notification.
@@ -306,13 +1210,66 @@ int vpn_connect(vpn_h handle, vpn_connect_cb callback, void *user_data);
 */
 int vpn_disconnect(vpn_h handle, vpn_disconnect_cb callback, void *user_data);
 
+/**
+* @brief Takes a reference to a VPN Handle.
+* @details The referenced handle stays valid until the matching
+*   vpn_handle_unref(), even if the profile is removed.
+* @remarks Can be called from any thread. A handle whose profile has
+*   already been removed, or any handle once vpn_deinitialize() has
+*   been called, cannot be referenced anymore.
+* @param[in] handle  The VPN Connection Identifier, plain or referenced.
+* @return The referenced handle, NULL if @a handle is NULL or not a
+*   known profile.
+* @see vpn_handle_unref()
+*/
+vpn_h vpn_handle_ref(vpn_h handle);
+
+/**
+* @brief Releases a referenced handle.
+* @param[in] handle  The referenced VPN Connection Identifier.
+* @see vpn_handle_ref()
+*/
+void vpn_handle_unref(vpn_h handle);
+
 /**
 * @brief Gets the VPN Handle List.
+* @remarks The list is owned and updated by the library; do not walk it
+*   from another thread while the main loop dispatches VPN signals.
+*   Use vpn_get_vpn_handle() from other threads.
 * @return Valid GList Pointer on success, otherwise NULL.
 * @see vpn_get_vpn_handle()
+* @see vpn_get_vpn_handle_list_ref()
 */
 GList *vpn_get_vpn_handle_list(void);
 
+/**
+* @brief Gets a referenced handle of every VPN Profile.
+* @remarks Can be called from any thread. The list must be freed with
+*   g_list_free_full(list, (GDestroyNotify)vpn_handle_unref).
+* @return The handles, NULL if there is none.
+* @see vpn_get_vpn_handle_list()
+*/
+GList *vpn_get_vpn_handle_list_ref(void);
+
+/**
+* @brief Gets the VPN Handles matching a set of filters.
+* @details The library keeps the profiles indexed by state, type, domain
+*   and name as their properties change, so the cost of a query follows
+*   the size of the smallest index it can use rather than the number of
+*   profiles. A query on @a name_prefix alone returns the handles sorted
+*   by name, other queries in no particular order.
+* @remarks The handles are referenced: the list must be freed with
+*   g_list_free_full(handles, (GDestroyNotify)vpn_handle_unref).
+* @param[in] query  The filters
+* @param[out] handles  The matching handles, NULL if there is none
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @see vpn_get_vpn_handle_list()
+*/
+int vpn_query(const vpn_query_s *query, GList **handles);
+
 /**
 * @brief Get Specific VPN Handle based on host & domain.
 * @param[in] host  The VPN Host Identifier.
@@ -323,11 +1280,32 @@ GList *vpn_get_vpn_handle_list(void);
 * @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
 * @retval #VPN_ERROR_INVALID_PARAMETER  Operation failed
 * @see vpn_get_vpn_handle_list()
+* @see vpn_get_vpn_handle_ref()
 */
 int vpn_get_vpn_handle(const char *host, const char *domain, vpn_h *handle);
 
+/**
+* @brief Gets a referenced VPN Handle based on host & domain.
+* @remarks Can be called from any thread. The handle must be released
+*   with vpn_handle_unref().
+* @param[in] host  The VPN Host Identifier.
+* @param[in] domain  The VPN Domain Identifier.
+* @param[out] handle The referenced VPN handle that matches host & domain.
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Operation failed
+* @see vpn_get_vpn_handle()
+*/
+int vpn_get_vpn_handle_ref(const char *host, const char *domain,
+			vpn_h *handle);
+
 /**
 * @brief Get VPN Info (Name)
+* @remarks @a name is owned by the library and freed when the Name
+*   changes. Only use it on the thread that called vpn_initialize(),
+*   before returning to its main loop, and not with
+*   #VPN_THREAD_MODE_WORKER. Use vpn_get_vpn_info_name_copy() otherwise.
 * @param[in] handle The VPN handle for the Request
 * @param[out] name  Name of the VPN
 * @return 0 on success, otherwise negative error value.
@@ -350,6 +1328,8 @@ int vpn_get_vpn_info_type(const vpn_h handle, const char **type);
 
 /**
 * @brief Get VPN Info (Host)
+* @remarks @a host is owned by the library, as for
+*   vpn_get_vpn_info_name(). Use vpn_get_vpn_info_host_copy() otherwise.
 * @param[in] handle The VPN handle for the Request
 * @param[out] host  Host of the VPN
 * @return 0 on success, otherwise negative error value.
@@ -361,6 +1341,8 @@ int vpn_get_vpn_info_host(const vpn_h handle, const char **host);
 
 /**
 * @brief Get VPN Info (Domain)
+* @remarks @a domain is owned by the library, as for
+*   vpn_get_vpn_info_name(). Use vpn_get_vpn_info_domain_copy() otherwise.
 * @param[in] handle The VPN handle for the Request
 * @param[out] domain  Domain of the VPN
 * @return 0 on success, otherwise negative error value.
@@ -370,6 +1352,89 @@ int vpn_get_vpn_info_host(const vpn_h handle, const char **host);
 */
 int vpn_get_vpn_info_domain(const vpn_h handle, const char **domain);
 
+/**
+* @brief Get a copy of VPN Info (Name)
+* @remarks Can be called from any thread. @a name belongs to the caller
+*   and must be freed with g_free().
+* @param[in] handle The VPN handle for the Request
+* @param[out] name  Name of the VPN, NULL if it has none
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Operation failed
+* @see vpn_get_vpn_info_name()
+*/
+int vpn_get_vpn_info_name_copy(const vpn_h handle, char **name);
+
+/**
+* @brief Get a copy of VPN Info (Host)
+* @remarks Can be called from any thread. @a host belongs to the caller
+*   and must be freed with g_free().
+* @param[in] handle The VPN handle for the Request
+* @param[out] host  Host of the VPN, NULL if it has none
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Operation failed
+* @see vpn_get_vpn_info_host()
+*/
+int vpn_get_vpn_info_host_copy(const vpn_h handle, char **host);
+
+/**
+* @brief Get a copy of VPN Info (Domain)
+* @remarks Can be called from any thread. @a domain belongs to the caller
+*   and must be freed with g_free().
+* @param[in] handle The VPN handle for the Request
+* @param[out] domain  Domain of the VPN, NULL if it has none
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Operation failed
+* @see vpn_get_vpn_info_domain()
+*/
+int vpn_get_vpn_info_domain_copy(const vpn_h handle, char **domain);
+
+/**
+* @brief Writes every VPN Profile with its state, addresses, nameservers
+*   and routes to a file descriptor.
+* @details The records are formatted straight from the library's own
+*   connection table. #VPN_EXPORT_FORMAT_JSON writes one object per
+*   profile and line, with the members path, name, type, host, domain,
+*   state, index, immutable, ipv4, ipv6, nameservers, user_routes and
+*   server_routes.
+*   #VPN_EXPORT_FORMAT_BINARY starts with "DVPN" and a 32-bit version,
+*   followed by one record per profile: a 32-bit length, then the same
+*   fields in the same order. Integers are little endian, a string is a
+*   16-bit length (0xffff for none) and its bytes. Newer versions only
+*   append fields to a record.
+* @param[in] format  The output format
+* @param[in] fd  The file descriptor to write to
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  Writing failed
+* @see vpn_export_with_callback()
+*/
+int vpn_export(vpn_export_format_e format, int fd);
+
+/**
+* @brief Same as vpn_export(), but hands the output to a callback.
+* @remarks The callback runs with the connection table locked and must
+*   not call any other VPN API.
+* @param[in] format  The output format
+* @param[in] callback  The callback receiving the output
+* @param[in] user_data The user data passed to the callback function
+* @return 0 on success, otherwise negative error value.
+* @retval #VPN_ERROR_NONE  Successful
+* @retval #VPN_ERROR_INVALID_OPERATION  Invalid operation
+* @retval #VPN_ERROR_INVALID_PARAMETER  Invalid parameter
+* @retval #VPN_ERROR_OPERATION_FAILED  The callback stopped the export
+* @see vpn_export()
+*/
+int vpn_export_with_callback(vpn_export_format_e format,
+		vpn_export_write_cb callback, void *user_data);
+
 /**
 * @}
 */
@@ -6,11 +6,17 @@ Group:      System/Network
 License:    Apache-2.0
 Source0:    %{name}-%{version}.tar.gz
 Source1001: 	capi-network-vpn-setting.manifest
+
+# rpmbuild --with usdt: SystemTap static tracepoints
+%bcond_with usdt
 BuildRequires:  cmake
 BuildRequires:  pkgconfig(dlog)
 BuildRequires:  pkgconfig(glib-2.0)
 BuildRequires:  pkgconfig(vconf)
 BuildRequires:  pkgconfig(capi-base-common)
+%if %{with usdt}
+BuildRequires:  systemtap-sdt-devel
+%endif
 
 %description
 Library code for CAPI's to interact with the Default VPN functionality on TIZEN platform.
@@ -37,7 +43,8 @@ cp %{SOURCE1001} .
 
 %build
 MAJORVER=`echo %{version} | awk 'BEGIN {FS="."}{print $1}'`
-%cmake . -DFULLVER=%{version} -DMAJORVER=${MAJORVER}
+%cmake . -DFULLVER=%{version} -DMAJORVER=${MAJORVER} \
+	-DENABLE_USDT=%{?with_usdt:ON}%{!?with_usdt:OFF}
 
 make %{?_smp_mflags}
 
@@ -20,18 +20,13 @@
 #ifndef __VPN_CONNECTION_PRIVATE_H__
 #define __VPN_CONNECTION_PRIVATE_H__
 
+#include <dlog.h>
 #include <dvpnlib-common.h>
+#include <debug.h>
 
 #include "vpn.h"
 #include "common.h"
 
-#define LOGI(fmt, arg...) printf("%s:%d %s() " fmt "\n",  \
-				__FILE__, __LINE__, __func__, ## arg)
-#define LOGW(fmt, arg...) printf("warning %s:%d %s() " fmt "\n", \
-				__FILE__, __LINE__, __func__, ## arg)
-#define LOGE(fmt, arg...) printf("error %s:%d %s() " fmt "\n", \
-				__FILE__, __LINE__, __func__, ## arg)
-
 #undef LOG_TAG
 #define LOG_TAG "CAPI_NETWORK_VPN"
 
@@ -39,8 +34,21 @@
 #define VPN_ERROR	2
 #define VPN_WARN	3
 
+/* Maps a VPN_LOG level onto the shared dvpnlib log level */
+#define VPN_LOG_LEVEL(log_level) \
+	((log_level) == VPN_ERROR ? DVPNLIB_LOG_ERROR : \
+	 (log_level) == VPN_WARN ? DVPNLIB_LOG_WARN : DVPNLIB_LOG_INFO)
+
+#define VPN_LOG_ENABLED(log_level) LOG_ENABLED(VPN_LOG_LEVEL(log_level))
+
+/*
+ * The level is checked before the arguments are evaluated; release
+ * builds compile the calls out.
+ */
 #define VPN_LOG(log_level, format, args...) \
 	do { \
+		if (!VPN_LOG_ENABLED(log_level)) \
+			break; \
 		switch (log_level) { \
 		case VPN_ERROR: \
 			LOGE(format, ## args); \
@@ -58,24 +66,78 @@ extern "C" {
 #endif /* __cplusplus */
 
 bool _vpn_init(void);
+bool _vpn_init_with_mode(vpn_thread_mode_e mode, int event_queue_size);
 bool _vpn_deinit(void);
+int _vpn_set_default_timeout(int timeout_ms);
 
 int _vpn_settings_init();
 int _vpn_settings_deinit();
 int _vpn_settings_set_specific(const char *key, const char *value);
+int _vpn_settings_create(vpn_settings_h *settings);
+int _vpn_settings_destroy(vpn_settings_h settings);
+int _vpn_settings_clone(vpn_settings_h settings, vpn_settings_h *clone);
+int _vpn_settings_set(vpn_settings_h settings,
+			const char *key, const char *value);
 
 int _vpn_create(vpn_created_cb callback, void *user_data);
+int _vpn_create_with_settings(vpn_settings_h settings,
+			vpn_created_cb callback, void *user_data);
+int _vpn_import_profiles(const char *path, int max_in_flight,
+			vpn_import_record_cb record_cb,
+			vpn_import_done_cb done_cb, void *user_data);
 int _vpn_remove(vpn_h handle, vpn_removed_cb callback, void *user_data);
 
-int _vpn_connect(vpn_h handle, vpn_removed_cb callback, void *user_data);
+int _vpn_connect(vpn_h handle, int timeout_ms,
+		vpn_connect_priority_e priority,
+		vpn_connect_cb callback, void *user_data);
 int _vpn_disconnect(vpn_h handle);
+int _vpn_cancel(vpn_h handle);
+int _vpn_cancel_all(void);
+int _vpn_get_connect_timing(vpn_h handle, vpn_connect_timing_s *timing);
+int _vpn_dump_journal(vpn_h handle, int fd);
+int _vpn_get_traffic_stats(vpn_h handle, vpn_traffic_stats_s *stats);
+void _vpn_set_traffic_rate_interval(int interval_ms);
+int _vpn_connect_any(vpn_h *handles, int count, int stagger_ms,
+		vpn_connect_any_cb callback, void *user_data);
+void _vpn_set_connect_concurrency(int concurrency);
+void _vpn_get_connect_queue_stats(vpn_connect_queue_stats_s *stats);
+int _vpn_rank_by_latency(vpn_h *handles, int count, int port,
+		vpn_rank_cb callback, void *user_data);
+int _vpn_get_latency(vpn_h handle, int port, long long *latency_us);
+int _vpn_set_latency_cache(const char *path, int ttl_sec);
+int _vpn_set_connect_deadline(vpn_h handle, int deadline_ms, bool reconnect);
+int _vpn_agent_register(vpn_agent_input_cb callback, void *user_data);
+int _vpn_agent_unregister(void);
+int _vpn_set_secret(vpn_h handle, const char *field, const char *value,
+		int ttl_sec);
+int _vpn_clear_secrets(vpn_h handle);
+int _vpn_set_reconnect_policy(vpn_h handle,
+		const vpn_reconnect_policy_s *policy,
+		vpn_reconnect_cb callback, void *user_data);
+int _vpn_unset_reconnect_policy(vpn_h handle);
+vpn_error_detail_e _vpn_get_last_error_detail(void);
+void _vpn_set_log_level(vpn_log_level_e level);
+int _vpn_get_stats(vpn_method_e method, vpn_method_stats_s *stats);
+void _vpn_reset_stats(void);
 
+vpn_h _vpn_handle_ref(vpn_h handle);
+void _vpn_handle_unref(vpn_h handle);
 GList *_vpn_get_vpn_handle_list(void);
+GList *_vpn_get_vpn_handle_list_ref(void);
+int _vpn_query(const vpn_query_s *query, GList **handles);
 int _vpn_get_vpn_handle(const char *host, const char *domain, vpn_h *handle);
+int _vpn_get_vpn_handle_ref(const char *host, const char *domain,
+			vpn_h *handle);
 int _vpn_get_vpn_info_name(vpn_h handle, const char **name);
 int _vpn_get_vpn_info_type(vpn_h handle, const char **type);
 int _vpn_get_vpn_info_host(vpn_h handle, const char **host);
 int _vpn_get_vpn_info_domain(vpn_h handle, const char **domain);
+int _vpn_get_vpn_info_name_copy(vpn_h handle, char **name);
+int _vpn_get_vpn_info_host_copy(vpn_h handle, char **host);
+int _vpn_get_vpn_info_domain_copy(vpn_h handle, char **domain);
+int _vpn_export(vpn_export_format_e format, int fd);
+int _vpn_export_with_callback(vpn_export_format_e format,
+			vpn_export_write_cb callback, void *user_data);
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -25,43 +25,84 @@
 #include <dvpnlib-vpn.h>
 #include <dvpnlib-vpn-manager.h>
 #include <dvpnlib-vpn-connection.h>
+#include <dvpnlib-vpn-settings.h>
+#include <dvpnlib-vpn-import.h>
+#include <dvpnlib-vpn-export.h>
+#include <dvpnlib-vpn-reconnect.h>
+#include <dvpnlib-vpn-traffic.h>
+#include <dvpnlib-vpn-agent.h>
+#include <dvpnlib-vpn-watchdog.h>
+#include <dvpnlib-vpn-race.h>
+#include <dvpnlib-vpn-latency.h>
+#include <dvpnlib-vpn-connect-queue.h>
 
 #include "vpn-internal.h"
 
-struct _vpn_cb_s {
-	vpn_created_cb create_cb;
-	void *create_user_data;
-	vpn_removed_cb remove_cb;
-	void *remove_user_data;
-	vpn_connect_cb connect_cb;
-	void *connect_user_data;
-	vpn_disconnect_cb disconnect_cb;
-	void *disconnect_user_data;
+/*
+ * A pending asynchronous request. The callback is delivered on the
+ * thread-default GMainContext of the thread that issued the request, so
+ * the API can be used from any thread running its own main loop.
+ */
+struct _vpn_request_s {
+	GMainContext *context;
+	void (*callback)(vpn_error_e result, void *user_data);
+	void *user_data;
+	enum dvpnlib_err result;
 };
 
-static struct _vpn_cb_s vpn_callbacks = {0,};
-static GHashTable *settings_hash;
+G_LOCK_DEFINE_STATIC(settings);
+static struct dvpnlib_settings *default_settings;
+
+/* Per-thread enum dvpnlib_err of the last operation */
+static GPrivate last_error_detail;
+
+/* vpn_error_detail_e mirrors enum dvpnlib_err value for value */
+G_STATIC_ASSERT((int)VPN_ERROR_DETAIL_UNKNOWN_METHOD ==
+		(int)DVPNLIB_ERR_UNKNOWN_METHOD);
+
+/* ... and so do the connection states */
+G_STATIC_ASSERT((int)VPN_STATE_UNKNOWN == (int)VPN_CONN_STATE_UNKNOWN);
+
+/* ... and the export formats */
+G_STATIC_ASSERT((int)VPN_EXPORT_FORMAT_BINARY == (int)DVPNLIB_EXPORT_BINARY);
+G_STATIC_ASSERT(VPN_EXPORT_BINARY_VERSION == DVPNLIB_EXPORT_BINARY_VERSION);
+
+/* ... and the reconnect events */
+G_STATIC_ASSERT((int)VPN_RECONNECT_GAVE_UP == (int)DVPNLIB_RECONNECT_GAVE_UP);
+
+/* ... and the latency of an unreachable server */
+G_STATIC_ASSERT(VPN_LATENCY_UNREACHABLE == DVPNLIB_LATENCY_UNREACHABLE);
+
+/* ... and the statistics types */
+G_STATIC_ASSERT((int)VPN_METHOD_MAX == (int)DVPNLIB_METHOD_MAX);
+G_STATIC_ASSERT(VPN_STATS_LATENCY_BUCKETS == DVPNLIB_STATS_LATENCY_BUCKETS);
+G_STATIC_ASSERT(sizeof(vpn_method_stats_s) ==
+		sizeof(struct dvpnlib_method_stats));
+
+/* ... and the traffic counters, field for field */
+G_STATIC_ASSERT(sizeof(vpn_traffic_stats_s) ==
+		sizeof(struct dvpnlib_traffic_stats));
+
+/* ... and the connect queue */
+G_STATIC_ASSERT((int)VPN_CONNECT_PRIORITY_LOW ==
+		(int)DVPNLIB_CONNECT_PRIORITY_LOW);
+G_STATIC_ASSERT(sizeof(vpn_connect_queue_stats_s) ==
+		sizeof(struct dvpnlib_connect_queue_stats));
 
 /*
  * Utility Functions
  */
 
-static void print_key_value_string(gpointer key,
-				gpointer value, gpointer user_data)
-{
-	if (user_data) {
-		VPN_LOG(VPN_INFO, " %s[%s]=%s",
-			(gchar *)user_data, (gchar *)key, (gchar *)value);
-		return;
-	}
-	VPN_LOG(VPN_INFO, " %s=%s", (gchar *)key, (gchar *)value);
-}
 
 vpn_error_e _dvpnlib_error2vpn_error(enum dvpnlib_err err_type)
 {
 	switch (err_type) {
 	case DVPNLIB_ERR_NONE:
 		return VPN_ERROR_NONE;
+	case DVPNLIB_ERR_INVALID_PARAMETER:
+		return VPN_ERROR_INVALID_PARAMETER;
+	case DVPNLIB_ERR_PERMISSION_DENIED:
+		return VPN_ERROR_SECURITY_RESTRICTED;
 	case DVPNLIB_ERR_ALREADY_EXISTS:
 		return VPN_ERROR_INVALID_OPERATION;
 	case DVPNLIB_ERR_NOT_REGISTERED:
@@ -82,15 +123,205 @@ vpn_error_e _dvpnlib_error2vpn_error(enum dvpnlib_err err_type)
 	}
 }
 
+/*
+ * Records the full dvpnlib result for vpn_get_last_error_detail() in the
+ * calling thread and returns its vpn_error_e.
+ */
+static vpn_error_e __vpn_set_last_error(enum dvpnlib_err err)
+{
+	g_private_set(&last_error_detail, GINT_TO_POINTER(err));
+
+	return _dvpnlib_error2vpn_error(err);
+}
+
+vpn_error_detail_e _vpn_get_last_error_detail(void)
+{
+	return GPOINTER_TO_INT(g_private_get(&last_error_detail));
+}
+
+int _vpn_get_stats(vpn_method_e method, vpn_method_stats_s *stats)
+{
+	struct dvpnlib_method_stats dvpnlib_stats;
+	enum dvpnlib_err err;
+
+	err = dvpnlib_get_method_stats((enum dvpnlib_method)method,
+					&dvpnlib_stats);
+	if (err != DVPNLIB_ERR_NONE)
+		return _dvpnlib_error2vpn_error(err);
+
+	stats->calls = dvpnlib_stats.calls;
+	stats->errors = dvpnlib_stats.errors;
+	stats->in_flight = dvpnlib_stats.in_flight;
+	memcpy(stats->latency, dvpnlib_stats.latency, sizeof(stats->latency));
+
+	return VPN_ERROR_NONE;
+}
+
+void _vpn_reset_stats(void)
+{
+	dvpnlib_reset_stats();
+}
+
+void _vpn_set_log_level(vpn_log_level_e level)
+{
+	switch (level) {
+	case VPN_LOG_LEVEL_NONE:
+		dvpnlib_set_log_level(DVPNLIB_LOG_NONE);
+		break;
+	case VPN_LOG_LEVEL_ERROR:
+		dvpnlib_set_log_level(DVPNLIB_LOG_ERROR);
+		break;
+	case VPN_LOG_LEVEL_WARN:
+		dvpnlib_set_log_level(DVPNLIB_LOG_WARN);
+		break;
+	case VPN_LOG_LEVEL_INFO:
+		dvpnlib_set_log_level(DVPNLIB_LOG_INFO);
+		break;
+	case VPN_LOG_LEVEL_DEBUG:
+		dvpnlib_set_log_level(DVPNLIB_LOG_DEBUG);
+		break;
+	}
+}
+
+/*
+ * A handle which holds a reference is the connection pointer with its
+ * lowest bit set. Its connection cannot be freed, nor its memory reused
+ * for another profile, so it is used as is and only checked for removal.
+ * The plain handles of the legacy lookups hold no reference: they are
+ * not dereferenced before they are found in the connection table.
+ */
+#define VPN_HANDLE_REFERENCED	((gsize)1)
+
+static bool __vpn_handle_is_referenced(vpn_h handle)
+{
+	return (GPOINTER_TO_SIZE(handle) & VPN_HANDLE_REFERENCED) != 0;
+}
+
+/* Hands a reference of the caller over to the application */
+static vpn_h __vpn_handle_from(struct vpn_connection *connection)
+{
+	return GSIZE_TO_POINTER(GPOINTER_TO_SIZE(connection) |
+					VPN_HANDLE_REFERENCED);
+}
+
+static struct vpn_connection *__vpn_handle_connection(vpn_h handle)
+{
+	return GSIZE_TO_POINTER(GPOINTER_TO_SIZE(handle) &
+					~VPN_HANDLE_REFERENCED);
+}
+
+/*
+ * Handles come from the application and may be used from any thread;
+ * this returns a reference that keeps the connection alive for the
+ * duration of the call, or NULL if the handle is not a known connection
+ * or its profile has been removed.
+ */
+static struct vpn_connection *__vpn_handle_ref(vpn_h handle)
+{
+	struct vpn_connection *connection;
+
+	if (__vpn_handle_is_referenced(handle)) {
+		connection = __vpn_handle_connection(handle);
+		if (!vpn_connection_is_removed(connection))
+			return vpn_connection_ref(connection);
+
+		VPN_LOG(VPN_ERROR, "The profile of the %p Handle is removed",
+								handle);
+		return NULL;
+	}
+
+	connection = vpn_connection_lookup_ref(handle);
+	if (connection == NULL)
+		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
+
+	return connection;
+}
+
+/* The error of a handle __vpn_handle_ref() has refused */
+static vpn_error_e __vpn_handle_error(vpn_h handle)
+{
+	if (!__vpn_handle_is_referenced(handle))
+		return VPN_ERROR_INVALID_PARAMETER;
+
+	g_private_set(&last_error_detail,
+			GINT_TO_POINTER(DVPNLIB_ERR_NOT_FOUND));
+
+	return VPN_ERROR_NO_CONNECTION;
+}
+
+static struct _vpn_request_s *__vpn_request_new(void *callback,
+						void *user_data)
+{
+	struct _vpn_request_s *request;
+
+	request = g_try_new0(struct _vpn_request_s, 1);
+	if (request == NULL)
+		return NULL;
+
+	request->context = g_main_context_ref_thread_default();
+	request->callback = callback;
+	request->user_data = user_data;
+
+	return request;
+}
+
+static void __vpn_request_free(gpointer data)
+{
+	struct _vpn_request_s *request = data;
+
+	g_main_context_unref(request->context);
+	g_free(request);
+}
+
+static gboolean __vpn_request_dispatch(gpointer data)
+{
+	struct _vpn_request_s *request = data;
+	vpn_error_e result;
+
+	result = __vpn_set_last_error(request->result);
+
+	if (request->callback)
+		request->callback(result, request->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * dvpnlib reply callback shared by Create/Remove/Connect: hands the
+ * result over to the context captured when the request was made.
+ */
+static void __vpn_request_reply_cb(enum dvpnlib_err result, void *user_data)
+{
+	struct _vpn_request_s *request = user_data;
+
+	VPN_LOG(VPN_INFO, "callback: %d Request: %p\n", result, user_data);
+
+	request->result = result;
+
+	g_main_context_invoke_full(request->context, G_PRIORITY_DEFAULT,
+				__vpn_request_dispatch, request,
+				__vpn_request_free);
+}
+
 /*
  *Functions Actually use Default VPN Library
  */
 
 bool _vpn_init(void)
+{
+	return _vpn_init_with_mode(VPN_THREAD_MODE_DEFAULT, 0);
+}
+
+bool _vpn_init_with_mode(vpn_thread_mode_e mode, int event_queue_size)
 {
 	int rv;
 
-	rv = dvpnlib_vpn_init();
+	if (mode == VPN_THREAD_MODE_WORKER)
+		rv = dvpnlib_vpn_init_with_mode(DVPNLIB_THREAD_MODE_WORKER,
+						event_queue_size);
+	else
+		rv = dvpnlib_vpn_init_with_mode(DVPNLIB_THREAD_MODE_DEFAULT,
+						0);
 
 	if (rv != 0)
 		return false;
@@ -104,224 +335,876 @@ bool _vpn_deinit(void)
 	return true;
 }
 
+int _vpn_set_default_timeout(int timeout_ms)
+{
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "timeout: %d", timeout_ms);
+
+	err = dvpnlib_set_default_timeout(timeout_ms);
+	if (err != DVPNLIB_ERR_NONE)
+		return VPN_ERROR_INVALID_PARAMETER;
+
+	return VPN_ERROR_NONE;
+}
+
 int _vpn_settings_init()
 {
-	if (settings_hash != NULL) {
+	G_LOCK(settings);
+
+	if (default_settings != NULL) {
 		VPN_LOG(VPN_INFO,
-			"Settings Hash: %p Already present!", settings_hash);
+			"Settings: %p Already present!", default_settings);
+		G_UNLOCK(settings);
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	settings_hash = g_hash_table_new_full(
-				g_str_hash, g_str_equal,
-				g_free, g_free);
-	VPN_LOG(VPN_INFO, "Settings Hash: %p", settings_hash);
+	default_settings = dvpnlib_settings_new();
+	VPN_LOG(VPN_INFO, "Settings: %p", default_settings);
+
+	G_UNLOCK(settings);
+
+	if (default_settings == NULL)
+		return VPN_ERROR_OUT_OF_MEMORY;
 
 	return VPN_ERROR_NONE;
 }
 
 int _vpn_settings_deinit()
 {
-	if (settings_hash == NULL)
+	G_LOCK(settings);
+
+	if (default_settings == NULL) {
+		G_UNLOCK(settings);
 		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	VPN_LOG(VPN_INFO, "Settings: %p Destroyed", default_settings);
+	dvpnlib_settings_unref(default_settings);
+	default_settings = NULL;
 
-	VPN_LOG(VPN_INFO, "Settings Hash: %p Destroyed", settings_hash);
-	g_hash_table_destroy(settings_hash);
-	settings_hash = NULL;
+	G_UNLOCK(settings);
 
 	return VPN_ERROR_NONE;
 }
 
-int _vpn_settings_set_specific(const char *key, const char *value)
+/* Returns a reference to the settings of vpn_settings_init() */
+static struct dvpnlib_settings *__vpn_default_settings_ref(void)
 {
-	VPN_LOG(VPN_INFO,
-		"Settings Hash: %p {%s=%s}", settings_hash, key, value);
+	struct dvpnlib_settings *settings = NULL;
 
-	if (key == NULL)
-		return VPN_ERROR_INVALID_PARAMETER;
+	G_LOCK(settings);
+	if (default_settings != NULL)
+		settings = dvpnlib_settings_ref(default_settings);
+	G_UNLOCK(settings);
 
-	if (g_hash_table_contains(settings_hash, key)) {
-		if (value == NULL) {
-			VPN_LOG(VPN_INFO, "Settings Hash: %p {%s=%s} (Removed)",
-				settings_hash, key,
-				(gchar *)g_hash_table_lookup(
-					settings_hash, key));
-			g_hash_table_remove(settings_hash, key);
-			return VPN_ERROR_NONE;
-		}
-	}
+	return settings;
+}
+
+int _vpn_settings_set_specific(const char *key, const char *value)
+{
+	struct dvpnlib_settings *settings;
+	int rv;
+
+	settings = __vpn_default_settings_ref();
+	if (settings == NULL)
+		return VPN_ERROR_INVALID_OPERATION;
 
-	g_hash_table_replace(settings_hash,
-			(gpointer)g_strdup(key),
-			(gpointer)g_strdup(value));
+	rv = _vpn_settings_set(settings, key, value);
+	dvpnlib_settings_unref(settings);
 
-	return VPN_ERROR_NONE;
+	return rv;
 }
 
-/*
- *Callbacks
- */
-static void __vpn_create_cb(vpn_error_e result)
+int _vpn_settings_create(vpn_settings_h *settings)
 {
-	if (vpn_callbacks.create_cb)
-		vpn_callbacks.create_cb(result,
-				vpn_callbacks.create_user_data);
+	struct dvpnlib_settings *new_settings;
+
+	new_settings = dvpnlib_settings_new();
+	if (new_settings == NULL)
+		return VPN_ERROR_OUT_OF_MEMORY;
+
+	VPN_LOG(VPN_INFO, "Settings: %p", new_settings);
 
-	vpn_callbacks.create_cb = NULL;
-	vpn_callbacks.create_user_data = NULL;
+	*settings = new_settings;
+
+	return VPN_ERROR_NONE;
 }
 
-static void vpn_manager_create_cb(enum dvpnlib_err result,
-							void *user_data)
+int _vpn_settings_destroy(vpn_settings_h settings)
 {
-	VPN_LOG(VPN_INFO, "callback: %d Settings: %p\n", result, user_data);
+	VPN_LOG(VPN_INFO, "Settings: %p Destroyed", settings);
+
+	dvpnlib_settings_unref(settings);
 
-	__vpn_create_cb(_dvpnlib_error2vpn_error(result));
+	return VPN_ERROR_NONE;
 }
 
-static void __vpn_remove_cb(vpn_error_e result)
+int _vpn_settings_clone(vpn_settings_h settings, vpn_settings_h *clone)
 {
-	if (vpn_callbacks.create_cb)
-		vpn_callbacks.create_cb(result,
-				vpn_callbacks.create_user_data);
+	struct dvpnlib_settings *new_settings;
+
+	new_settings = dvpnlib_settings_clone(settings);
+	if (new_settings == NULL)
+		return VPN_ERROR_OUT_OF_MEMORY;
+
+	VPN_LOG(VPN_INFO, "Settings: %p Cloned from %p",
+		new_settings, settings);
+
+	*clone = new_settings;
 
-	vpn_callbacks.remove_cb = NULL;
-	vpn_callbacks.remove_user_data = NULL;
+	return VPN_ERROR_NONE;
 }
 
-static void vpn_manager_remove_cb(enum dvpnlib_err result,
-							void *user_data)
+int _vpn_settings_set(vpn_settings_h settings,
+			const char *key, const char *value)
 {
-	VPN_LOG(VPN_INFO, "callback: %d Settings: %p\n", result, user_data);
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "Settings: %p {%s=%s}", settings, key, value);
+
+	err = dvpnlib_settings_set(settings, key, value);
+	if (err != DVPNLIB_ERR_NONE)
+		return _dvpnlib_error2vpn_error(err);
 
-	__vpn_remove_cb(_dvpnlib_error2vpn_error(result));
+	return VPN_ERROR_NONE;
 }
 
 int _vpn_create(vpn_created_cb callback, void *user_data)
 {
-	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
-	if (!settings_hash)
+	struct dvpnlib_settings *settings;
+	int rv;
+
+	settings = __vpn_default_settings_ref();
+	if (settings == NULL)
 		return VPN_ERROR_INVALID_OPERATION;
 
-	VPN_LOG(VPN_INFO, "");
+	rv = _vpn_create_with_settings(settings, callback, user_data);
+	dvpnlib_settings_unref(settings);
 
-	vpn_callbacks.create_cb = callback;
-	vpn_callbacks.create_user_data = user_data;
+	return rv;
+}
 
-	g_hash_table_foreach(settings_hash,
-		print_key_value_string, "VPNSettings");
+int _vpn_create_with_settings(vpn_settings_h settings,
+			vpn_created_cb callback, void *user_data)
+{
+	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	struct _vpn_request_s *request;
 
-	err = dvpnlib_vpn_manager_create(settings_hash,
-		vpn_manager_create_cb, NULL);
-	if (err != DVPNLIB_ERR_NONE)
-		return _dvpnlib_error2vpn_error(err);
+	VPN_LOG(VPN_INFO, "Settings: %p", settings);
+
+	request = __vpn_request_new(callback, user_data);
+	if (request == NULL)
+		return VPN_ERROR_OUT_OF_MEMORY;
+
+	err = dvpnlib_vpn_manager_create(settings,
+		__vpn_request_reply_cb, request);
+	if (err != DVPNLIB_ERR_NONE) {
+		__vpn_request_free(request);
+		return __vpn_set_last_error(err);
+	}
 
 	return VPN_ERROR_NONE;
+}
+
+struct _vpn_import_s {
+	GMainContext *context;
+	vpn_import_record_cb record_cb;
+	vpn_import_done_cb done_cb;
+	void *user_data;
+};
+
+struct _vpn_import_event_s {
+	struct _vpn_import_s *import;
+	bool done;
+	int index;
+	int line;
+	gchar *name;
+	enum dvpnlib_err result;
+	int succeeded;
+	int failed;
+};
+
+static gboolean __vpn_import_dispatch(gpointer data)
+{
+	struct _vpn_import_event_s *event = data;
+	struct _vpn_import_s *import = event->import;
+	vpn_error_e result;
 
+	result = __vpn_set_last_error(event->result);
+
+	if (event->done && import->done_cb)
+		import->done_cb(result, event->succeeded, event->failed,
+				import->user_data);
+	else if (!event->done && import->record_cb)
+		import->record_cb(event->index, event->line, event->name,
+				result, import->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void __vpn_import_event_free(gpointer data)
+{
+	struct _vpn_import_event_s *event = data;
+
+	/* The done event is the last one of the import */
+	if (event->done) {
+		g_main_context_unref(event->import->context);
+		g_free(event->import);
+	}
+
+	g_free(event->name);
+	g_free(event);
+}
+
+static void __vpn_import_post(struct _vpn_import_event_s *event)
+{
+	g_main_context_invoke_full(event->import->context, G_PRIORITY_DEFAULT,
+				__vpn_import_dispatch, event,
+				__vpn_import_event_free);
+}
+
+static void __vpn_import_record_cb(const struct dvpnlib_import_record *record,
+				void *user_data)
+{
+	struct _vpn_import_event_s *event;
+
+	event = g_new0(struct _vpn_import_event_s, 1);
+	event->import = user_data;
+	event->index = record->index;
+	event->line = record->line;
+	event->name = g_strdup(record->name);
+	event->result = record->result;
+
+	__vpn_import_post(event);
+}
+
+static void __vpn_import_done_cb(enum dvpnlib_err result,
+				unsigned int succeeded, unsigned int failed,
+				void *user_data)
+{
+	struct _vpn_import_event_s *event;
+
+	VPN_LOG(VPN_INFO, "Import: %u created, %u failed\n",
+		succeeded, failed);
+
+	event = g_new0(struct _vpn_import_event_s, 1);
+	event->import = user_data;
+	event->done = true;
+	event->result = result;
+	event->succeeded = succeeded;
+	event->failed = failed;
+
+	__vpn_import_post(event);
+}
+
+int _vpn_import_profiles(const char *path, int max_in_flight,
+			vpn_import_record_cb record_cb,
+			vpn_import_done_cb done_cb, void *user_data)
+{
+	struct _vpn_import_s *import;
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "Import: %s, %d in flight", path, max_in_flight);
+
+	import = g_try_new0(struct _vpn_import_s, 1);
+	if (import == NULL)
+		return VPN_ERROR_OUT_OF_MEMORY;
+
+	import->context = g_main_context_ref_thread_default();
+	import->record_cb = record_cb;
+	import->done_cb = done_cb;
+	import->user_data = user_data;
+
+	err = dvpnlib_vpn_manager_import(path, max_in_flight,
+			__vpn_import_record_cb, __vpn_import_done_cb, import);
+	if (err != DVPNLIB_ERR_NONE) {
+		g_main_context_unref(import->context);
+		g_free(import);
+		return __vpn_set_last_error(err);
+	}
+
+	return VPN_ERROR_NONE;
 }
 
 int _vpn_remove(vpn_h handle, vpn_removed_cb callback, void *user_data)
 {
 	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	struct vpn_connection *connection;
+	struct _vpn_request_s *request;
 
 	VPN_LOG(VPN_INFO, "");
 
-	vpn_callbacks.remove_cb = callback;
-	vpn_callbacks.remove_user_data = user_data;
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
+	request = __vpn_request_new(callback, user_data);
+	if (request == NULL) {
+		vpn_connection_unref(connection);
+		return VPN_ERROR_OUT_OF_MEMORY;
 	}
 
-	const char *path = vpn_connection_get_path(handle);
-	err = dvpnlib_vpn_manager_remove(path, vpn_manager_remove_cb, NULL);
-	if (err != DVPNLIB_ERR_NONE)
-		return _dvpnlib_error2vpn_error(err);
+	const char *path = vpn_connection_get_path(connection);
+	err = dvpnlib_vpn_manager_remove(path, __vpn_request_reply_cb, request);
+	vpn_connection_unref(connection);
+	if (err != DVPNLIB_ERR_NONE) {
+		__vpn_request_free(request);
+		return __vpn_set_last_error(err);
+	}
 
 	return VPN_ERROR_NONE;
 }
 
 /*
- *Connect Disconnect Callbacks
+ *Connect to VPN Profile
  */
 
-static void __vpn_connect_cb(vpn_error_e result)
+int _vpn_connect(vpn_h handle, int timeout_ms,
+		vpn_connect_priority_e priority,
+		vpn_connect_cb callback, void *user_data)
 {
-	if (vpn_callbacks.connect_cb)
-		vpn_callbacks.connect_cb(result,
-				vpn_callbacks.connect_user_data);
+	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	struct vpn_connection *connection;
+	struct _vpn_request_s *request;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	enum vpn_connection_state state = vpn_connection_get_state(connection);
+	if (state == VPN_CONN_STATE_READY) {
+		vpn_connection_unref(connection);
+		return VPN_ERROR_ALREADY_EXISTS;
+	}
+
+	request = __vpn_request_new(callback, user_data);
+	if (request == NULL) {
+		vpn_connection_unref(connection);
+		return VPN_ERROR_OUT_OF_MEMORY;
+	}
 
-	vpn_callbacks.connect_cb = NULL;
-	vpn_callbacks.connect_user_data = NULL;
+	err = vpn_connection_connect_with_priority(connection, timeout_ms,
+					(enum dvpnlib_connect_priority)priority,
+					__vpn_request_reply_cb, request);
+	vpn_connection_unref(connection);
+	if (err != DVPNLIB_ERR_NONE) {
+		__vpn_request_free(request);
+		return __vpn_set_last_error(err);
+	}
+
+	return VPN_ERROR_NONE;
 }
 
-static void vpn_manager_connect_cb(enum dvpnlib_err result,
-							void *user_data)
+/*
+ *Disconnect from VPN Profile
+ */
+
+int _vpn_disconnect(vpn_h handle)
 {
-	VPN_LOG(VPN_INFO, "callback: %d Settings: %p\n", result, user_data);
+	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	struct vpn_connection *connection;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	/* Disconnecting, maybe by another caller whose result is shared */
+	enum vpn_connection_state state = vpn_connection_get_state(connection);
+	if (state != VPN_CONN_STATE_READY &&
+			state != VPN_CONN_STATE_DISCONNECT) {
+		vpn_connection_unref(connection);
+		return VPN_ERROR_NO_CONNECTION;
+	}
+
+	err = vpn_connection_disconnect(connection);
+	vpn_connection_unref(connection);
 
-	__vpn_connect_cb(_dvpnlib_error2vpn_error(result));
+	return __vpn_set_last_error(err);
 }
 
 /*
- *Connect to VPN Profile
+ *Cancel the operations in flight
  */
 
-int _vpn_connect(vpn_h handle, vpn_removed_cb callback, void *user_data)
+int _vpn_cancel(vpn_h handle)
 {
-	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	struct vpn_connection *connection;
 
 	VPN_LOG(VPN_INFO, "");
 
-	vpn_callbacks.connect_cb = callback;
-	vpn_callbacks.connect_user_data = user_data;
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
+	vpn_connection_cancel(connection);
+	vpn_connection_unref(connection);
+
+	return VPN_ERROR_NONE;
+}
+
+static void __vpn_latency_copy(vpn_latency_s *dst,
+				const struct vpn_connection_latency *src)
+{
+	dst->last = src->last;
+	dst->min = src->min;
+	dst->max = src->max;
+	dst->p50 = src->p50;
+	dst->p90 = src->p90;
+	dst->p99 = src->p99;
+	dst->samples = src->samples;
+}
+
+int _vpn_get_connect_timing(vpn_h handle, vpn_connect_timing_s *timing)
+{
+	struct vpn_connection_timing connection_timing;
+	struct vpn_connection *connection;
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	vpn_connection_get_timing(connection, &connection_timing);
+	vpn_connection_unref(connection);
+
+	timing->attempts = connection_timing.attempts;
+	timing->connect_reply = connection_timing.connect_reply;
+	timing->configuration = connection_timing.configuration;
+	timing->ipv4 = connection_timing.ipv4;
+	timing->nameservers = connection_timing.nameservers;
+	__vpn_latency_copy(&timing->time_to_ready,
+				&connection_timing.time_to_ready);
+	__vpn_latency_copy(&timing->time_to_failure,
+				&connection_timing.time_to_failure);
+
+	return VPN_ERROR_NONE;
+}
+
+int _vpn_dump_journal(vpn_h handle, int fd)
+{
+	struct vpn_connection *connection;
+	int rv;
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	rv = vpn_connection_dump_journal(connection, fd);
+	vpn_connection_unref(connection);
+
+	if (rv < 0)
+		return VPN_ERROR_OPERATION_FAILED;
+
+	return VPN_ERROR_NONE;
+}
+
+int _vpn_get_traffic_stats(vpn_h handle, vpn_traffic_stats_s *stats)
+{
+	struct dvpnlib_traffic_stats traffic_stats;
+	struct vpn_connection *connection;
+	enum dvpnlib_err err;
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	err = vpn_connection_get_traffic_stats(connection, &traffic_stats);
+	vpn_connection_unref(connection);
+	if (err != DVPNLIB_ERR_NONE)
+		return __vpn_set_last_error(err);
+
+	memcpy(stats, &traffic_stats, sizeof(*stats));
+
+	return VPN_ERROR_NONE;
+}
+
+void _vpn_set_traffic_rate_interval(int interval_ms)
+{
+	VPN_LOG(VPN_INFO, "%d ms", interval_ms);
+
+	dvpnlib_traffic_set_rate_interval(interval_ms);
+}
+
+struct _vpn_connect_any_s {
+	vpn_connect_any_cb callback;
+	void *user_data;
+};
+
+/* Already invoked in the context of the thread which started the race */
+static void __vpn_connect_any_cb(struct vpn_connection *winner,
+				enum dvpnlib_err result, void *user_data)
+{
+	struct _vpn_connect_any_s *request = user_data;
+
+	if (request->callback)
+		request->callback(winner, _dvpnlib_error2vpn_error(result),
+				request->user_data);
+
+	g_free(request);
+}
+
+int _vpn_connect_any(vpn_h *handles, int count, int stagger_ms,
+		vpn_connect_any_cb callback, void *user_data)
+{
+	struct _vpn_connect_any_s *request;
+	struct vpn_connection **connections;
+	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	int i, n;
+
+	VPN_LOG(VPN_INFO, "%d profiles, %d ms apart", count, stagger_ms);
+
+	connections = g_new0(struct vpn_connection *, count);
+	for (n = 0; n < count; n++) {
+		connections[n] = __vpn_handle_ref(handles[n]);
+		if (connections[n] == NULL)
+			break;
 	}
 
-	enum vpn_connection_state state = vpn_connection_get_state(handle);
-	if (state == VPN_CONN_STATE_READY)
-		return VPN_ERROR_ALREADY_EXISTS;
+	if (n == count) {
+		request = g_new0(struct _vpn_connect_any_s, 1);
+		request->callback = callback;
+		request->user_data = user_data;
+
+		err = vpn_connections_connect_any(connections, count,
+				stagger_ms, VPN_TIMEOUT_DEFAULT,
+				__vpn_connect_any_cb, request);
+		if (err != DVPNLIB_ERR_NONE)
+			g_free(request);
+	}
+
+	for (i = 0; i < n; i++)
+		vpn_connection_unref(connections[i]);
+	g_free(connections);
+
+	if (n < count)
+		return __vpn_handle_error(handles[n]);
+
+	return __vpn_set_last_error(err);
+}
+
+void _vpn_set_connect_concurrency(int concurrency)
+{
+	VPN_LOG(VPN_INFO, "%d", concurrency);
+
+	dvpnlib_connect_queue_set_concurrency(concurrency);
+}
+
+void _vpn_get_connect_queue_stats(vpn_connect_queue_stats_s *stats)
+{
+	struct dvpnlib_connect_queue_stats queue_stats;
+
+	dvpnlib_connect_queue_get_stats(&queue_stats);
+	memcpy(stats, &queue_stats, sizeof(*stats));
+}
+
+struct _vpn_rank_s {
+	vpn_rank_cb callback;
+	void *user_data;
+};
+
+/* Already invoked in the context of the thread which asked */
+static void __vpn_rank_cb(GList *connections, void *user_data)
+{
+	struct _vpn_rank_s *rank = user_data;
+
+	if (rank->callback)
+		rank->callback(connections, rank->user_data);
 
-	err = vpn_connection_connect(handle, vpn_manager_connect_cb, NULL);
+	g_free(rank);
+}
+
+int _vpn_rank_by_latency(vpn_h *handles, int count, int port,
+		vpn_rank_cb callback, void *user_data)
+{
+	struct vpn_connection **connections;
+	struct _vpn_rank_s *rank;
+	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	int i, n;
+
+	VPN_LOG(VPN_INFO, "%d profiles, port %d", count, port);
+
+	connections = g_new0(struct vpn_connection *, count);
+	for (n = 0; n < count; n++) {
+		connections[n] = __vpn_handle_ref(handles[n]);
+		if (connections[n] == NULL)
+			break;
+	}
+
+	if (n == count) {
+		rank = g_new0(struct _vpn_rank_s, 1);
+		rank->callback = callback;
+		rank->user_data = user_data;
+
+		err = vpn_connections_rank_by_latency(connections, count,
+				port, VPN_TIMEOUT_DEFAULT, __vpn_rank_cb, rank);
+		if (err != DVPNLIB_ERR_NONE)
+			g_free(rank);
+	}
+
+	for (i = 0; i < n; i++)
+		vpn_connection_unref(connections[i]);
+	g_free(connections);
+
+	if (n < count)
+		return __vpn_handle_error(handles[n]);
+
+	return __vpn_set_last_error(err);
+}
+
+int _vpn_get_latency(vpn_h handle, int port, long long *latency_us)
+{
+	struct vpn_connection *connection;
+	enum dvpnlib_err err;
+	gint64 latency;
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	err = vpn_connection_get_latency(connection, port, &latency);
+	vpn_connection_unref(connection);
 	if (err != DVPNLIB_ERR_NONE)
-		return _dvpnlib_error2vpn_error(err);
+		return __vpn_set_last_error(err);
+
+	*latency_us = latency;
 
 	return VPN_ERROR_NONE;
 }
 
+int _vpn_set_latency_cache(const char *path, int ttl_sec)
+{
+	VPN_LOG(VPN_INFO, "%s, ttl %d", path, ttl_sec);
+
+	return __vpn_set_last_error(dvpnlib_latency_set_cache(path, ttl_sec));
+}
+
+int _vpn_set_connect_deadline(vpn_h handle, int deadline_ms, bool reconnect)
+{
+	struct vpn_connection *connection;
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "%d ms, reconnect %d", deadline_ms, reconnect);
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	err = vpn_connection_set_connect_deadline(connection, deadline_ms,
+							reconnect);
+	vpn_connection_unref(connection);
+
+	return __vpn_set_last_error(err);
+}
+
 /*
- *Disconnect from VPN Profile
+ * The application's agent callback, registered from any thread. The lock
+ * is held while the callback runs, so that once vpn_agent_unregister()
+ * has returned it is neither running nor called again; it is recursive
+ * for the callback to register or unregister itself.
  */
+static GRecMutex __vpn_agent_lock;
+static struct {
+	vpn_agent_input_cb callback;
+	void *user_data;
+} __vpn_agent;
+
+/* Already invoked in the context of the application */
+static void __vpn_agent_input_cb(struct vpn_connection *connection,
+				const char **fields, void *user_data)
+{
+	g_rec_mutex_lock(&__vpn_agent_lock);
+	if (__vpn_agent.callback)
+		__vpn_agent.callback(connection, fields,
+				__vpn_agent.user_data);
+	g_rec_mutex_unlock(&__vpn_agent_lock);
+}
 
-int _vpn_disconnect(vpn_h handle)
+int _vpn_agent_register(vpn_agent_input_cb callback, void *user_data)
 {
-	enum dvpnlib_err err = DVPNLIB_ERR_NONE;
+	enum dvpnlib_err err;
+	vpn_agent_input_cb old_callback;
+	void *old_user_data;
 
 	VPN_LOG(VPN_INFO, "");
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
+	g_rec_mutex_lock(&__vpn_agent_lock);
+	old_callback = __vpn_agent.callback;
+	old_user_data = __vpn_agent.user_data;
+	__vpn_agent.callback = callback;
+	__vpn_agent.user_data = user_data;
+	g_rec_mutex_unlock(&__vpn_agent_lock);
+
+	err = dvpnlib_agent_register(
+			callback ? __vpn_agent_input_cb : NULL, NULL);
+
+	/* A failed registration leaves the previous one in place */
+	if (err != DVPNLIB_ERR_NONE) {
+		g_rec_mutex_lock(&__vpn_agent_lock);
+		__vpn_agent.callback = old_callback;
+		__vpn_agent.user_data = old_user_data;
+		g_rec_mutex_unlock(&__vpn_agent_lock);
 	}
 
-	enum vpn_connection_state state = vpn_connection_get_state(handle);
-	if (state != VPN_CONN_STATE_READY)
-		return VPN_ERROR_NO_CONNECTION;
+	return __vpn_set_last_error(err);
+}
 
-	err = vpn_connection_disconnect(handle);
-	if (err != DVPNLIB_ERR_NONE)
-		return _dvpnlib_error2vpn_error(err);
+int _vpn_agent_unregister(void)
+{
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "");
+
+	err = dvpnlib_agent_unregister();
+
+	g_rec_mutex_lock(&__vpn_agent_lock);
+	__vpn_agent.callback = NULL;
+	__vpn_agent.user_data = NULL;
+	g_rec_mutex_unlock(&__vpn_agent_lock);
+
+	return __vpn_set_last_error(err);
+}
+
+int _vpn_set_secret(vpn_h handle, const char *field, const char *value,
+		int ttl_sec)
+{
+	struct vpn_connection *connection;
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "%s, ttl %d", field, ttl_sec);
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	err = vpn_connection_set_secret(connection, field, value, ttl_sec);
+	vpn_connection_unref(connection);
+
+	return __vpn_set_last_error(err);
+}
+
+int _vpn_clear_secrets(vpn_h handle)
+{
+	struct vpn_connection *connection;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	vpn_connection_clear_secrets(connection);
+	vpn_connection_unref(connection);
+
+	return VPN_ERROR_NONE;
+}
+
+struct _vpn_reconnect_s {
+	vpn_reconnect_cb callback;
+	void *user_data;
+};
+
+/* Already invoked in the context of the thread which set the policy */
+static void __vpn_reconnect_cb(struct vpn_connection *connection,
+				const struct dvpnlib_reconnect_info *info,
+				void *user_data)
+{
+	struct _vpn_reconnect_s *reconnect = user_data;
+
+	if (reconnect->callback)
+		reconnect->callback(connection,
+				(vpn_reconnect_event_e)info->event,
+				info->attempt, info->delay_ms,
+				_dvpnlib_error2vpn_error(info->result),
+				reconnect->user_data);
+}
+
+int _vpn_set_reconnect_policy(vpn_h handle,
+		const vpn_reconnect_policy_s *policy,
+		vpn_reconnect_cb callback, void *user_data)
+{
+	struct dvpnlib_reconnect_policy reconnect_policy = {
+		.max_attempts = policy->max_attempts,
+		.initial_delay_ms = policy->initial_delay_ms,
+		.max_delay_ms = policy->max_delay_ms,
+		.jitter_percent = policy->jitter_percent,
+		.connect_timeout = policy->connect_timeout_ms,
+	};
+	struct _vpn_reconnect_s *reconnect;
+	struct vpn_connection *connection;
+	enum dvpnlib_err err;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	reconnect = g_new0(struct _vpn_reconnect_s, 1);
+	reconnect->callback = callback;
+	reconnect->user_data = user_data;
+
+	err = vpn_connection_set_reconnect_policy(connection,
+			&reconnect_policy, __vpn_reconnect_cb,
+			reconnect, g_free);
+	vpn_connection_unref(connection);
+	if (err != DVPNLIB_ERR_NONE) {
+		g_free(reconnect);
+		return __vpn_set_last_error(err);
+	}
+
+	return VPN_ERROR_NONE;
+}
+
+int _vpn_unset_reconnect_policy(vpn_h handle)
+{
+	struct vpn_connection *connection;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	vpn_connection_unset_reconnect_policy(connection);
+	vpn_connection_unref(connection);
+
+	return VPN_ERROR_NONE;
+}
+
+int _vpn_cancel_all(void)
+{
+	VPN_LOG(VPN_INFO, "");
+
+	dvpnlib_cancel_all();
 
 	return VPN_ERROR_NONE;
 }
 
+vpn_h _vpn_handle_ref(vpn_h handle)
+{
+	struct vpn_connection *connection;
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return NULL;
+
+	return __vpn_handle_from(connection);
+}
+
+void _vpn_handle_unref(vpn_h handle)
+{
+	if (!__vpn_handle_is_referenced(handle)) {
+		VPN_LOG(VPN_ERROR, "The %p Handle holds no reference", handle);
+		return;
+	}
+
+	vpn_connection_unref(__vpn_handle_connection(handle));
+}
+
 /*
  *Gets the VPN Handles List from VPN Profile
  */
@@ -330,6 +1213,41 @@ GList *_vpn_get_vpn_handle_list(void)
 	return vpn_get_connections();
 }
 
+GList *_vpn_get_vpn_handle_list_ref(void)
+{
+	GList *iter, *handles = NULL;
+
+	/* The connections of the table are alive in the read section */
+	vpn_connections_lock_read();
+	for (iter = vpn_get_connections(); iter != NULL; iter = iter->next)
+		handles = g_list_prepend(handles, __vpn_handle_from(
+					vpn_connection_ref(iter->data)));
+	vpn_connections_unlock_read();
+
+	return g_list_reverse(handles);
+}
+
+int _vpn_query(const vpn_query_s *query, GList **handles)
+{
+	struct vpn_connection_query connection_query = {
+		.state = query->state,
+		.type = query->type,
+		.domain = query->domain,
+		.name_prefix = query->name_prefix,
+	};
+	GList *iter;
+
+	VPN_LOG(VPN_INFO, "state=%d type=%s domain=%s name=%s*",
+		query->state, query->type, query->domain, query->name_prefix);
+
+	/* The references of the query are handed over to the handles */
+	*handles = vpn_connections_query(&connection_query);
+	for (iter = *handles; iter != NULL; iter = iter->next)
+		iter->data = __vpn_handle_from(iter->data);
+
+	return VPN_ERROR_NONE;
+}
+
 /*
  * Get a specific VPN Handle based on host & domain parameters
  */
@@ -348,20 +1266,45 @@ int _vpn_get_vpn_handle(const char *host, const char *domain, vpn_h *handle)
 	return VPN_ERROR_NONE;
 }
 
+int _vpn_get_vpn_handle_ref(const char *host, const char *domain,
+			vpn_h *handle)
+{
+	struct vpn_connection *connection;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = vpn_get_connection_ref(host, domain);
+	if (connection == NULL) {
+		VPN_LOG(VPN_ERROR, "host=%s domain=%s", host, domain);
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	*handle = __vpn_handle_from(connection);
+	return VPN_ERROR_NONE;
+}
+
+/*
+ * The string getters below never block. The Type is interned; the other
+ * strings are freed by the thread dispatching the VPN signals once their
+ * property changes, so only that thread may use them. The copying
+ * getters duplicate them inside a read section for the other threads.
+ */
+
 /*
  * Get VPN Info (Name) from VPN Handle
  */
 int _vpn_get_vpn_info_name(vpn_h handle, const char **name)
 {
+	struct vpn_connection *connection;
+
 	VPN_LOG(VPN_INFO, "");
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
-	}
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
 
-	*name = vpn_connection_get_name(handle);
+	*name = vpn_connection_get_name(connection);
+	vpn_connection_unref(connection);
 	return VPN_ERROR_NONE;
 }
 
@@ -370,15 +1313,16 @@ int _vpn_get_vpn_info_name(vpn_h handle, const char **name)
  */
 int _vpn_get_vpn_info_type(vpn_h handle, const char **type)
 {
+	struct vpn_connection *connection;
+
 	VPN_LOG(VPN_INFO, "");
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
-	}
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
 
-	*type = vpn_connection_get_type(handle);
+	*type = vpn_connection_get_type(connection);
+	vpn_connection_unref(connection);
 	return VPN_ERROR_NONE;
 }
 
@@ -387,15 +1331,16 @@ int _vpn_get_vpn_info_type(vpn_h handle, const char **type)
  */
 int _vpn_get_vpn_info_host(vpn_h handle, const char **host)
 {
+	struct vpn_connection *connection;
+
 	VPN_LOG(VPN_INFO, "");
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
-	}
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
 
-	*host = vpn_connection_get_host(handle);
+	*host = vpn_connection_get_host(connection);
+	vpn_connection_unref(connection);
 	return VPN_ERROR_NONE;
 }
 
@@ -404,14 +1349,72 @@ int _vpn_get_vpn_info_host(vpn_h handle, const char **host)
  */
 int _vpn_get_vpn_info_domain(vpn_h handle, const char **domain)
 {
+	struct vpn_connection *connection;
+
 	VPN_LOG(VPN_INFO, "");
 
-	GList *connections = vpn_get_connections();
-	if (NULL == g_list_find(connections, handle)) {
-		VPN_LOG(VPN_ERROR, "No Connections with the %p Handle", handle);
-		return VPN_ERROR_INVALID_PARAMETER;
-	}
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
 
-	*domain = vpn_connection_get_domain(handle);
+	*domain = vpn_connection_get_domain(connection);
+	vpn_connection_unref(connection);
 	return VPN_ERROR_NONE;
 }
+
+static int __vpn_get_vpn_info_copy(vpn_h handle,
+			const char *(*get)(struct vpn_connection *),
+			char **value)
+{
+	struct vpn_connection *connection;
+
+	VPN_LOG(VPN_INFO, "");
+
+	connection = __vpn_handle_ref(handle);
+	if (connection == NULL)
+		return __vpn_handle_error(handle);
+
+	vpn_connections_lock_read();
+	*value = g_strdup(get(connection));
+	vpn_connections_unlock_read();
+
+	vpn_connection_unref(connection);
+	return VPN_ERROR_NONE;
+}
+
+int _vpn_get_vpn_info_name_copy(vpn_h handle, char **name)
+{
+	return __vpn_get_vpn_info_copy(handle, vpn_connection_get_name, name);
+}
+
+int _vpn_get_vpn_info_host_copy(vpn_h handle, char **host)
+{
+	return __vpn_get_vpn_info_copy(handle, vpn_connection_get_host, host);
+}
+
+int _vpn_get_vpn_info_domain_copy(vpn_h handle, char **domain)
+{
+	return __vpn_get_vpn_info_copy(handle, vpn_connection_get_domain,
+					domain);
+}
+
+int _vpn_export(vpn_export_format_e format, int fd)
+{
+	enum dvpnlib_err err;
+
+	err = vpn_connections_export_fd((enum dvpnlib_export_format)format,
+					fd);
+
+	return __vpn_set_last_error(err);
+}
+
+int _vpn_export_with_callback(vpn_export_format_e format,
+			vpn_export_write_cb callback, void *user_data)
+{
+	enum dvpnlib_err err;
+
+	err = vpn_connections_export((enum dvpnlib_export_format)format,
+					callback, user_data);
+
+	return __vpn_set_last_error(err);
+}
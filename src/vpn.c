@@ -22,23 +22,58 @@
 #include <glib.h>
 #include <vconf/vconf.h>
 
+#include <dvpnlib-trace.h>
+
 #include "vpn-internal.h"
 
-static bool is_init = false;
+/*
+ * is_init is read without locking by every API call; initialize and
+ * deinitialize are serialized by the init lock.
+ */
+G_LOCK_DEFINE_STATIC(init);
+static gint is_init = false;
+
+#define IS_INIT() (g_atomic_int_get(&is_init) != false)
+
+/* Leaves an API function through the api__exit tracepoint */
+#define VPN_RETURN(handle, rv) \
+	do { \
+		int __rv = (rv); \
+		TRACE_API_EXIT(handle, __rv); \
+		return __rv; \
+	} while (0)
 
 EXPORT_API int vpn_initialize(void)
 {
-	if (is_init) {
+	return vpn_initialize_with_mode(VPN_THREAD_MODE_DEFAULT, 0);
+}
+
+EXPORT_API int vpn_initialize_with_mode(vpn_thread_mode_e mode,
+					int event_queue_size)
+{
+	if ((mode != VPN_THREAD_MODE_DEFAULT &&
+	     mode != VPN_THREAD_MODE_WORKER) || event_queue_size < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	G_LOCK(init);
+
+	if (IS_INIT()) {
+		G_UNLOCK(init);
 		VPN_LOG(VPN_ERROR, "Already initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	if (_vpn_init() == false) {
+	if (_vpn_init_with_mode(mode, event_queue_size) == false) {
+		G_UNLOCK(init);
 		VPN_LOG(VPN_ERROR, "Init failed!\n");
 		return VPN_ERROR_OPERATION_FAILED;
 	}
 
-	is_init = true;
+	g_atomic_int_set(&is_init, true);
+
+	G_UNLOCK(init);
 
 	VPN_LOG(VPN_INFO, "VPN successfully initialized!\n");
 
@@ -47,28 +82,120 @@ EXPORT_API int vpn_initialize(void)
 
 EXPORT_API int vpn_deinitialize(void)
 {
-	if (is_init == false) {
+	G_LOCK(init);
+
+	if (IS_INIT() == false) {
+		G_UNLOCK(init);
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
+	g_atomic_int_set(&is_init, false);
+
 	if (_vpn_deinit() == false) {
+		g_atomic_int_set(&is_init, true);
+		G_UNLOCK(init);
 		VPN_LOG(VPN_ERROR, "Deinit failed!\n");
 		return VPN_ERROR_OPERATION_FAILED;
 	}
 
-	is_init = false;
+	G_UNLOCK(init);
+
 	VPN_LOG(VPN_INFO, "VPN successfully de-initialized!\n");
 
 	return VPN_ERROR_NONE;
 }
 
+EXPORT_API int vpn_set_default_timeout(int timeout_ms)
+{
+	int rv;
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	rv = _vpn_set_default_timeout(timeout_ms);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Set Default Timeout failed.\n");
+
+	return rv;
+}
+
+EXPORT_API int vpn_cancel_all(void)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	return _vpn_cancel_all();
+}
+
+EXPORT_API int vpn_set_log_level(vpn_log_level_e level)
+{
+	if (level < VPN_LOG_LEVEL_NONE || level > VPN_LOG_LEVEL_DEBUG) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	_vpn_set_log_level(level);
+
+	return VPN_ERROR_NONE;
+}
+
+EXPORT_API int vpn_get_stats(vpn_method_e method, vpn_method_stats_s *stats)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (method < VPN_METHOD_CREATE || method >= VPN_METHOD_MAX ||
+	    stats == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_get_stats(method, stats);
+}
+
+EXPORT_API int vpn_reset_stats(void)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	_vpn_reset_stats();
+
+	return VPN_ERROR_NONE;
+}
+
+EXPORT_API int vpn_get_last_error_detail(vpn_error_detail_e *detail)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (detail == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	*detail = _vpn_get_last_error_detail();
+
+	return VPN_ERROR_NONE;
+}
+
 /* Settings API's */
 EXPORT_API int vpn_settings_init()
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
@@ -85,7 +212,7 @@ EXPORT_API int vpn_settings_deinit()
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
@@ -102,7 +229,7 @@ EXPORT_API int vpn_settings_set_specific(const char *key, const char *value)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
@@ -120,7 +247,7 @@ EXPORT_API int vpn_settings_set_type(const char *type)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
@@ -137,7 +264,7 @@ EXPORT_API int vpn_settings_set_name(const char *name)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
@@ -154,7 +281,7 @@ EXPORT_API int vpn_settings_set_host(const char *host)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
@@ -171,12 +298,12 @@ EXPORT_API int vpn_settings_set_domain(const char *domain)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	rv = _vpn_settings_set_specific("Domain", domain);
+	rv = _vpn_settings_set_specific("VPN.Domain", domain);
 
 	if (rv != VPN_ERROR_NONE)
 		VPN_LOG(VPN_ERROR, "Error!! VPN Settings Deinit failed.\n");
@@ -184,205 +311,934 @@ EXPORT_API int vpn_settings_set_domain(const char *domain)
 	return rv;
 }
 
-EXPORT_API int vpn_create(vpn_created_cb callback, void *user_data)
+EXPORT_API int vpn_settings_create(vpn_settings_h *settings)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	rv = _vpn_create(callback, user_data);
+	if (settings == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	rv = _vpn_settings_create(settings);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Create failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Settings Create failed.\n");
 
 	return rv;
 }
 
-EXPORT_API
-int vpn_remove(vpn_h handle, vpn_removed_cb callback, void *user_data)
+EXPORT_API int vpn_settings_destroy(vpn_settings_h settings)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	if (handle == NULL) {
-		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+	if (settings == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
 		return VPN_ERROR_INVALID_PARAMETER;
 	}
 
-	rv = _vpn_remove(handle, callback, user_data);
+	rv = _vpn_settings_destroy(settings);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Remove failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Settings Destroy failed.\n");
 
 	return rv;
 }
 
-EXPORT_API
-int vpn_connect(vpn_h handle, vpn_connect_cb callback, void *user_data)
+EXPORT_API int vpn_settings_clone(vpn_settings_h settings,
+		vpn_settings_h *clone)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	if (handle == NULL) {
-		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+	if (settings == NULL || clone == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
 		return VPN_ERROR_INVALID_PARAMETER;
 	}
 
-	rv = _vpn_connect(handle, callback, user_data);
+	rv = _vpn_settings_clone(settings, clone);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Remove failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Settings Clone failed.\n");
 
 	return rv;
 }
 
-EXPORT_API
-int vpn_disconnect(vpn_h handle, vpn_disconnect_cb callback, void *user_data)
+EXPORT_API int vpn_settings_set(vpn_settings_h settings,
+		const char *key, const char *value)
 {
 	int rv;
 
-	if (is_init == false) {
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	if (handle == NULL) {
-		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+	if (settings == NULL || key == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
 		return VPN_ERROR_INVALID_PARAMETER;
 	}
 
-	rv = _vpn_disconnect(handle);
+	rv = _vpn_settings_set(settings, key, value);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Remove failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Settings Set failed.\n");
 
 	return rv;
 }
 
+EXPORT_API int vpn_create(vpn_created_cb callback, void *user_data)
+{
+	int rv;
+
+	TRACE_API_ENTRY(NULL);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	rv = _vpn_create(callback, user_data);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Create failed.\n");
+
+	VPN_RETURN(NULL, rv);
+}
+
+EXPORT_API int vpn_create_with_settings(vpn_settings_h settings,
+		vpn_created_cb callback, void *user_data)
+{
+	int rv;
+
+	TRACE_API_ENTRY(NULL);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (settings == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_PARAMETER);
+	}
+
+	rv = _vpn_create_with_settings(settings, callback, user_data);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Create failed.\n");
+
+	VPN_RETURN(NULL, rv);
+}
+
+EXPORT_API int vpn_import_profiles(const char *path, int max_in_flight,
+		vpn_import_record_cb record_cb, vpn_import_done_cb done_cb,
+		void *user_data)
+{
+	int rv;
+
+	TRACE_API_ENTRY(NULL);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (path == NULL || max_in_flight <= 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_PARAMETER);
+	}
+
+	rv = _vpn_import_profiles(path, max_in_flight,
+			record_cb, done_cb, user_data);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Import failed.\n");
+
+	VPN_RETURN(NULL, rv);
+}
+
 EXPORT_API
-GList *vpn_get_vpn_handle_list(void)
+int vpn_remove(vpn_h handle, vpn_removed_cb callback, void *user_data)
 {
-	if (is_init == false) {
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
-		return NULL;
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
 	}
 
-	return _vpn_get_vpn_handle_list();
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
+
+	rv = _vpn_remove(handle, callback, user_data);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Remove failed.\n");
+
+	VPN_RETURN(handle, rv);
 }
 
 EXPORT_API
-int vpn_get_vpn_handle(const char *host, const char *domain, vpn_h *handle)
+int vpn_connect(vpn_h handle, vpn_connect_cb callback, void *user_data)
 {
 	int rv;
 
-	if (is_init == false) {
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
-		return VPN_ERROR_INVALID_OPERATION;
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
 	}
 
-	if (host == NULL || domain == NULL || handle == NULL)
-		return VPN_ERROR_INVALID_PARAMETER;
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
 
-	rv = _vpn_get_vpn_handle(host, domain, handle);
+	rv = _vpn_connect(handle, VPN_TIMEOUT_DEFAULT,
+			VPN_CONNECT_PRIORITY_NORMAL, callback, user_data);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Get Handle failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Remove failed.\n");
 
-	return rv;
+	VPN_RETURN(handle, rv);
 }
 
 EXPORT_API
-int vpn_get_vpn_info_name(const vpn_h handle, const char **name)
+int vpn_connect_with_timeout(vpn_h handle, int timeout_ms,
+		vpn_connect_cb callback, void *user_data)
 {
 	int rv;
 
-	if (is_init == false) {
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
-		return VPN_ERROR_INVALID_OPERATION;
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
 	}
 
-	if (handle == NULL || name == NULL)
-		return VPN_ERROR_INVALID_PARAMETER;
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
 
-	rv = _vpn_get_vpn_info_name(handle, name);
+	if (timeout_ms <= 0 && timeout_ms != VPN_TIMEOUT_DEFAULT)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_connect(handle, timeout_ms, VPN_CONNECT_PRIORITY_NORMAL,
+						callback, user_data);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Name) failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Connect failed.\n");
 
-	return rv;
+	VPN_RETURN(handle, rv);
 }
 
 EXPORT_API
-int vpn_get_vpn_info_type(const vpn_h handle, const char **type)
+int vpn_connect_with_priority(vpn_h handle, int timeout_ms,
+		vpn_connect_priority_e priority,
+		vpn_connect_cb callback, void *user_data)
 {
 	int rv;
 
-	if (is_init == false) {
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
-		return VPN_ERROR_INVALID_OPERATION;
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
 	}
 
-	if (handle == NULL || type == NULL)
-		return VPN_ERROR_INVALID_PARAMETER;
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
 
-	rv = _vpn_get_vpn_info_type(handle, type);
+	if ((timeout_ms <= 0 && timeout_ms != VPN_TIMEOUT_DEFAULT) ||
+			priority < VPN_CONNECT_PRIORITY_HIGH ||
+			priority > VPN_CONNECT_PRIORITY_LOW) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
+
+	rv = _vpn_connect(handle, timeout_ms, priority, callback, user_data);
 
 	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Type) failed.\n");
+		VPN_LOG(VPN_ERROR, "Error!! VPN Connect failed.\n");
 
-	return rv;
+	VPN_RETURN(handle, rv);
 }
 
 EXPORT_API
-int vpn_get_vpn_info_host(const vpn_h handle, const char **host)
+int vpn_cancel(vpn_h handle)
 {
 	int rv;
 
-	if (is_init == false) {
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
+
+	rv = _vpn_cancel(handle);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Cancel failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_connect_timing(vpn_h handle, vpn_connect_timing_s *timing)
+{
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	if (handle == NULL || host == NULL)
+	if (handle == NULL || timing == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
 		return VPN_ERROR_INVALID_PARAMETER;
+	}
 
-	rv = _vpn_get_vpn_info_host(handle, host);
+	return _vpn_get_connect_timing(handle, timing);
+}
 
-	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Host) failed.\n");
+EXPORT_API
+int vpn_dump_journal(vpn_h handle, int fd)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
 
-	return rv;
+	if (handle == NULL || fd < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_dump_journal(handle, fd);
 }
 
 EXPORT_API
-int vpn_get_vpn_info_domain(const vpn_h handle, const char **domain)
+int vpn_get_traffic_stats(vpn_h handle, vpn_traffic_stats_s *stats)
 {
-	int rv;
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL || stats == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
 
-	if (is_init == false) {
+	return _vpn_get_traffic_stats(handle, stats);
+}
+
+EXPORT_API
+int vpn_set_traffic_rate_interval(int interval_ms)
+{
+	if (IS_INIT() == false) {
 		VPN_LOG(VPN_ERROR, "Not initialized\n");
 		return VPN_ERROR_INVALID_OPERATION;
 	}
 
-	if (handle == NULL || domain == NULL)
+	if (interval_ms < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
 		return VPN_ERROR_INVALID_PARAMETER;
+	}
 
-	rv = _vpn_get_vpn_info_domain(handle, domain);
+	_vpn_set_traffic_rate_interval(interval_ms);
 
-	if (rv != VPN_ERROR_NONE)
-		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Domain) failed.\n");
+	return VPN_ERROR_NONE;
+}
 
-	return rv;
+EXPORT_API
+int vpn_connect_any(vpn_h *handles, int count, int stagger_ms,
+		vpn_connect_any_cb callback, void *user_data)
+{
+	int i;
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handles == NULL || count <= 0 || stagger_ms < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (handles[i] == NULL) {
+			VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+			return VPN_ERROR_INVALID_PARAMETER;
+		}
+	}
+
+	return _vpn_connect_any(handles, count, stagger_ms, callback,
+								user_data);
 }
 
+EXPORT_API
+int vpn_set_connect_concurrency(int concurrency)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (concurrency < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	_vpn_set_connect_concurrency(concurrency);
+
+	return VPN_ERROR_NONE;
+}
+
+EXPORT_API
+int vpn_get_connect_queue_stats(vpn_connect_queue_stats_s *stats)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (stats == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	_vpn_get_connect_queue_stats(stats);
+
+	return VPN_ERROR_NONE;
+}
+
+EXPORT_API
+int vpn_rank_by_latency(vpn_h *handles, int count, int port,
+		vpn_rank_cb callback, void *user_data)
+{
+	int i;
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handles == NULL || count <= 0 || port < 0 || port > 65535) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (handles[i] == NULL) {
+			VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+			return VPN_ERROR_INVALID_PARAMETER;
+		}
+	}
+
+	return _vpn_rank_by_latency(handles, count, port, callback,
+								user_data);
+}
+
+EXPORT_API
+int vpn_get_latency(vpn_h handle, int port, long long *latency_us)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL || latency_us == NULL || port < 0 ||
+							port > 65535) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_get_latency(handle, port, latency_us);
+}
+
+EXPORT_API
+int vpn_set_latency_cache(const char *path, int ttl_sec)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (ttl_sec <= 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_set_latency_cache(path, ttl_sec);
+}
+
+EXPORT_API
+int vpn_set_connect_deadline(vpn_h handle, int deadline_ms, bool reconnect)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL || deadline_ms < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_set_connect_deadline(handle, deadline_ms, reconnect);
+}
+
+EXPORT_API
+int vpn_agent_register(vpn_agent_input_cb callback, void *user_data)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	return _vpn_agent_register(callback, user_data);
+}
+
+EXPORT_API
+int vpn_agent_unregister(void)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	return _vpn_agent_unregister();
+}
+
+EXPORT_API
+int vpn_set_secret(vpn_h handle, const char *field, const char *value,
+		int ttl_sec)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL || field == NULL || value == NULL || ttl_sec < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_set_secret(handle, field, value, ttl_sec);
+}
+
+EXPORT_API
+int vpn_clear_secrets(vpn_h handle)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_clear_secrets(handle);
+}
+
+EXPORT_API
+int vpn_set_reconnect_policy(vpn_h handle,
+		const vpn_reconnect_policy_s *policy,
+		vpn_reconnect_cb callback, void *user_data)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL || policy == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_set_reconnect_policy(handle, policy, callback, user_data);
+}
+
+EXPORT_API
+int vpn_unset_reconnect_policy(vpn_h handle)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_unset_reconnect_policy(handle);
+}
+
+EXPORT_API
+int vpn_disconnect(vpn_h handle, vpn_disconnect_cb callback, void *user_data)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+	}
+
+	rv = _vpn_disconnect(handle);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Remove failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+vpn_h vpn_handle_ref(vpn_h handle)
+{
+	if (handle == NULL) {
+		VPN_LOG(VPN_ERROR, "VPN Handle is NULL\n");
+		return NULL;
+	}
+
+	return _vpn_handle_ref(handle);
+}
+
+EXPORT_API
+void vpn_handle_unref(vpn_h handle)
+{
+	if (handle == NULL)
+		return;
+
+	_vpn_handle_unref(handle);
+}
+
+EXPORT_API
+GList *vpn_get_vpn_handle_list(void)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return NULL;
+	}
+
+	return _vpn_get_vpn_handle_list();
+}
+
+EXPORT_API
+GList *vpn_get_vpn_handle_list_ref(void)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return NULL;
+	}
+
+	return _vpn_get_vpn_handle_list_ref();
+}
+
+EXPORT_API
+int vpn_get_vpn_handle(const char *host, const char *domain, vpn_h *handle)
+{
+	int rv;
+
+	TRACE_API_ENTRY(NULL);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (host == NULL || domain == NULL || handle == NULL)
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_handle(host, domain, handle);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Handle failed.\n");
+
+	VPN_RETURN(NULL, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_handle_ref(const char *host, const char *domain,
+			vpn_h *handle)
+{
+	int rv;
+
+	TRACE_API_ENTRY(NULL);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (host == NULL || domain == NULL || handle == NULL)
+		VPN_RETURN(NULL, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_handle_ref(host, domain, handle);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Handle failed.\n");
+
+	VPN_RETURN(NULL, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_name(const vpn_h handle, const char **name)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || name == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_name(handle, name);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Name) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_type(const vpn_h handle, const char **type)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || type == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_type(handle, type);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Type) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_host(const vpn_h handle, const char **host)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || host == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_host(handle, host);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Host) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_domain(const vpn_h handle, const char **domain)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || domain == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_domain(handle, domain);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Domain) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_name_copy(const vpn_h handle, char **name)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || name == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_name_copy(handle, name);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Name) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_host_copy(const vpn_h handle, char **host)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || host == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_host_copy(handle, host);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Host) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API
+int vpn_get_vpn_info_domain_copy(const vpn_h handle, char **domain)
+{
+	int rv;
+
+	TRACE_API_ENTRY(handle);
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		VPN_RETURN(handle, VPN_ERROR_INVALID_OPERATION);
+	}
+
+	if (handle == NULL || domain == NULL)
+		VPN_RETURN(handle, VPN_ERROR_INVALID_PARAMETER);
+
+	rv = _vpn_get_vpn_info_domain_copy(handle, domain);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Get Info (Domain) failed.\n");
+
+	VPN_RETURN(handle, rv);
+}
+
+EXPORT_API int vpn_query(const vpn_query_s *query, GList **handles)
+{
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (query == NULL || handles == NULL ||
+			query->state < VPN_STATE_ANY ||
+			query->state > VPN_STATE_UNKNOWN) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	return _vpn_query(query, handles);
+}
+
+EXPORT_API int vpn_export(vpn_export_format_e format, int fd)
+{
+	int rv;
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (fd < 0) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	rv = _vpn_export(format, fd);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Export failed.\n");
+
+	return rv;
+}
+
+EXPORT_API int vpn_export_with_callback(vpn_export_format_e format,
+		vpn_export_write_cb callback, void *user_data)
+{
+	int rv;
+
+	if (IS_INIT() == false) {
+		VPN_LOG(VPN_ERROR, "Not initialized\n");
+		return VPN_ERROR_INVALID_OPERATION;
+	}
+
+	if (callback == NULL) {
+		VPN_LOG(VPN_ERROR, "Invalid parameter\n");
+		return VPN_ERROR_INVALID_PARAMETER;
+	}
+
+	rv = _vpn_export_with_callback(format, callback, user_data);
+
+	if (rv != VPN_ERROR_NONE)
+		VPN_LOG(VPN_ERROR, "Error!! VPN Export failed.\n");
+
+	return rv;
+}
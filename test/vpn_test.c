@@ -93,11 +93,16 @@ static void __test_removed_callback(vpn_error_e result,
 static void __test_connect_callback(vpn_error_e result,
 				void *user_data)
 {
-	if (result == VPN_ERROR_NONE)
+	vpn_error_detail_e detail = VPN_ERROR_DETAIL_NONE;
+
+	if (result == VPN_ERROR_NONE) {
 		printf("VPN Connect Succeeded\n");
-	else
-		printf("VPN Connect Failed! error : %s",
-				__test_convert_error_to_string(result));
+		return;
+	}
+
+	vpn_get_last_error_detail(&detail);
+	printf("VPN Connect Failed! error : %s (detail %d)\n",
+			__test_convert_error_to_string(result), detail);
 }
 
 static void __test_disconnect_callback(vpn_error_e result,
@@ -357,6 +362,617 @@ int test_vpn_disconnect(void)
 	return 1;
 }
 
+int test_vpn_cancel(void)
+{
+	int rv = 0;
+	vpn_h handle = NULL;
+
+	_test_get_vpn_handle(&handle);
+
+	rv = vpn_cancel(handle);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to Cancel VPN Profile operations [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	printf("Success to Cancel VPN Profile operations\n");
+
+	return 1;
+}
+
+int test_vpn_stats(void)
+{
+	static const char *methods[VPN_METHOD_MAX] = {
+		"Create", "Remove", "Connect", "Disconnect", "SetProperty",
+		"ClearProperty", "GetConnections", "RegisterAgent",
+		"UnregisterAgent", "Other",
+	};
+	vpn_method_stats_s stats;
+	int method, i;
+	int rv;
+
+	for (method = 0; method < VPN_METHOD_MAX; method++) {
+		rv = vpn_get_stats(method, &stats);
+		if (rv != VPN_ERROR_NONE) {
+			printf("Fail to get VPN stats [%s]\n",
+					__test_convert_error_to_string(rv));
+			return -1;
+		}
+
+		if (stats.calls == 0)
+			continue;
+
+		printf("%-16s calls %u errors %u in flight %d\n",
+				methods[method], stats.calls,
+				stats.errors, stats.in_flight);
+		for (i = 0; i < VPN_STATS_LATENCY_BUCKETS; i++)
+			if (stats.latency[i])
+				printf("\t>= %8u us: %u\n",
+						1u << i, stats.latency[i]);
+	}
+
+	return 1;
+}
+
+int test_vpn_dump_journal(void)
+{
+	int rv = 0;
+	vpn_h handle = NULL;
+
+	_test_get_vpn_handle(&handle);
+
+	fflush(stdout);
+	rv = vpn_dump_journal(handle, STDOUT_FILENO);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to dump VPN Profile journal [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	return 1;
+}
+
+int test_vpn_export(void)
+{
+	int rv = 0;
+
+	fflush(stdout);
+	rv = vpn_export(VPN_EXPORT_FORMAT_JSON, STDOUT_FILENO);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to Export VPN Profiles [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	return 1;
+}
+
+int test_vpn_query(void)
+{
+	int rv = 0;
+	char type[100];
+	char prefix[100];
+	const char *name;
+	vpn_query_s query = { .state = VPN_STATE_ANY };
+	GList *handles = NULL;
+	GList *iter;
+
+	_test_get_user_input(&type[0], "Type (- for any)");
+	_test_get_user_input(&prefix[0], "Name prefix (- for any)");
+
+	if (strcmp(type, "-"))
+		query.type = type;
+	if (strcmp(prefix, "-"))
+		query.name_prefix = prefix;
+
+	rv = vpn_query(&query, &handles);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to Query VPN Profiles [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	for (iter = handles; iter != NULL; iter = iter->next) {
+		name = NULL;
+		vpn_get_vpn_info_name(iter->data, &name);
+		printf("%p %s\n", iter->data, name);
+	}
+
+	printf("%u VPN Profiles found\n", g_list_length(handles));
+	g_list_free_full(handles, (GDestroyNotify)vpn_handle_unref);
+
+	return 1;
+}
+
+static void __test_reconnect_callback(vpn_h handle,
+		vpn_reconnect_event_e event, int attempt, int delay_ms,
+		vpn_error_e result, void *user_data)
+{
+	static const char *events[] = {
+		"scheduled", "started", "failed", "succeeded", "gave up",
+	};
+
+	printf("Reconnect attempt %d %s, delay %d ms [%s]\n", attempt,
+			events[event], delay_ms,
+			__test_convert_error_to_string(result));
+}
+
+int test_vpn_reconnect(void)
+{
+	vpn_reconnect_policy_s policy = {
+		.max_attempts = 5,
+		.initial_delay_ms = 1000,
+		.max_delay_ms = 30000,
+		.jitter_percent = 20,
+		.connect_timeout_ms = VPN_TIMEOUT_DEFAULT,
+	};
+	vpn_h handle = NULL;
+	int rv = 0;
+
+	_test_get_vpn_handle(&handle);
+
+	rv = vpn_set_reconnect_policy(handle, &policy,
+				__test_reconnect_callback, NULL);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to set VPN reconnect policy [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	printf("Reconnecting up to %u times, from %u ms to %u ms\n",
+			policy.max_attempts, policy.initial_delay_ms,
+			policy.max_delay_ms);
+
+	return 1;
+}
+
+int test_vpn_traffic(void)
+{
+	vpn_traffic_stats_s stats;
+	vpn_h handle = NULL;
+	int rv = 0;
+
+	_test_get_vpn_handle(&handle);
+
+	/* Sample the rates every second from now on */
+	vpn_set_traffic_rate_interval(1000);
+
+	rv = vpn_get_traffic_stats(handle, &stats);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to get VPN traffic stats [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	printf("rx %llu bytes %llu packets %llu errors, %llu B/s %llu p/s\n",
+			stats.rx_bytes, stats.rx_packets, stats.rx_errors,
+			stats.rx_bytes_rate, stats.rx_packets_rate);
+	printf("tx %llu bytes %llu packets %llu errors, %llu B/s %llu p/s\n",
+			stats.tx_bytes, stats.tx_packets, stats.tx_errors,
+			stats.tx_bytes_rate, stats.tx_packets_rate);
+
+	return 1;
+}
+
+static void __test_agent_input_callback(vpn_h handle, const char **fields,
+		void *user_data)
+{
+	int i;
+
+	printf("VPN profile %p needs:", handle);
+	for (i = 0; fields[i] != NULL; i++)
+		printf(" %s", fields[i]);
+	printf("\nUse the agent menu again to provide them\n");
+}
+
+int test_vpn_agent(void)
+{
+	char field[128] = { 0 };
+	char value[128] = { 0 };
+	vpn_h handle = NULL;
+	int rv = 0;
+
+	rv = vpn_agent_register(__test_agent_input_callback, NULL);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to register the VPN agent [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	_test_get_vpn_handle(&handle);
+	_test_get_user_input(&field[0], "Field (e.g. Password)");
+	_test_get_user_input(&value[0], "Value");
+
+	/* Good for a reconnect within the next 10 minutes */
+	rv = vpn_set_secret(handle, field, value, 600);
+	memset(value, 0, sizeof(value));
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to cache the VPN secret [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	printf("%s cached for 600 s\n", field);
+
+	return 1;
+}
+
+static void __test_connect_any_callback(vpn_h winner, vpn_error_e result,
+		void *user_data)
+{
+	const char *name = NULL;
+
+	if (winner == NULL) {
+		printf("No VPN profile came up [%s]\n",
+				__test_convert_error_to_string(result));
+		return;
+	}
+
+	vpn_get_vpn_info_name(winner, &name);
+	printf("VPN profile %p (%s) came up first\n", winner, name);
+}
+
+int test_vpn_connect_any(void)
+{
+	vpn_h handles[2] = { NULL, NULL };
+	int rv = 0;
+
+	printf("First VPN profile\n");
+	_test_get_vpn_handle(&handles[0]);
+	printf("Second VPN profile\n");
+	_test_get_vpn_handle(&handles[1]);
+
+	rv = vpn_connect_any(handles, 2, 2000,
+				__test_connect_any_callback, NULL);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to connect any VPN profile [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	return 1;
+}
+
+static void __test_rank_callback(GList *handles, void *user_data)
+{
+	const char *name = NULL;
+	const char *host = NULL;
+	long long latency = 0;
+	GList *iter;
+
+	for (iter = handles; iter != NULL; iter = iter->next) {
+		vpn_get_vpn_info_name(iter->data, &name);
+		vpn_get_vpn_info_host(iter->data, &host);
+		vpn_get_latency(iter->data, 0, &latency);
+
+		if (latency == VPN_LATENCY_UNREACHABLE)
+			printf("%s (%s) unreachable\n", name, host);
+		else
+			printf("%s (%s) %lld us\n", name, host, latency);
+	}
+}
+
+int test_vpn_rank(void)
+{
+	vpn_h *handles;
+	GList *list, *iter;
+	int rv = 0, count = 0;
+
+	/* Profiles with Host 127.0.0.1 are answered by the loopback */
+	list = vpn_get_vpn_handle_list();
+	if (list == NULL) {
+		printf("No VPN profile to rank\n");
+		return -1;
+	}
+
+	handles = g_new0(vpn_h, g_list_length(list));
+	for (iter = list; iter != NULL; iter = iter->next)
+		handles[count++] = iter->data;
+	g_list_free(list);
+
+	rv = vpn_rank_by_latency(handles, count, 0,
+				__test_rank_callback, NULL);
+	g_free(handles);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to rank VPN profiles [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	return 1;
+}
+
+static int __test_queue_pending;
+
+static void __test_queue_done(void)
+{
+	/* Back to the default once every queued connect has completed */
+	vpn_set_connect_concurrency(0);
+	printf("Connect concurrency restored\n");
+}
+
+static void __test_queue_connect_callback(vpn_error_e result,
+				void *user_data)
+{
+	vpn_connect_queue_stats_s stats;
+	char *name = user_data;
+
+	printf("VPN Connect of %s done: %s\n", name,
+			__test_convert_error_to_string(result));
+	g_free(name);
+
+	if (vpn_get_connect_queue_stats(&stats) == VPN_ERROR_NONE)
+		printf("in flight %u, queued %u, dispatched %u, "
+				"wait max %llu us, total %llu us\n",
+				stats.in_flight, stats.queued,
+				stats.dispatched, stats.wait_max_us,
+				stats.wait_total_us);
+
+	if (--__test_queue_pending == 0)
+		__test_queue_done();
+}
+
+int test_vpn_connect_queue(void)
+{
+	GList *list, *iter;
+	char *name = NULL;
+	vpn_connect_priority_e priority;
+	int rv = 0;
+
+	list = vpn_get_vpn_handle_list();
+	if (list == NULL) {
+		printf("No VPN profile to connect\n");
+		return -1;
+	}
+
+	/* One at a time: the last profile jumps the queue */
+	vpn_set_connect_concurrency(1);
+
+	for (iter = list; iter != NULL; iter = iter->next) {
+		priority = iter->next ? VPN_CONNECT_PRIORITY_LOW :
+						VPN_CONNECT_PRIORITY_HIGH;
+		/* The callback outlives the Name, it gets a copy */
+		vpn_get_vpn_info_name_copy(iter->data, &name);
+
+		rv = vpn_connect_with_priority(iter->data,
+				VPN_TIMEOUT_DEFAULT, priority,
+				__test_queue_connect_callback, name);
+		if (rv != VPN_ERROR_NONE) {
+			printf("Fail to queue %s [%s]\n", name,
+					__test_convert_error_to_string(rv));
+			g_free(name);
+		} else {
+			__test_queue_pending++;
+		}
+	}
+	g_list_free(list);
+
+	if (__test_queue_pending == 0)
+		__test_queue_done();
+
+	return 1;
+}
+
+static void __test_twin_connect_callback(vpn_error_e result,
+				void *user_data)
+{
+	printf("VPN Connect %d: %s\n", GPOINTER_TO_INT(user_data),
+			__test_convert_error_to_string(result));
+}
+
+int test_vpn_connect_twice(void)
+{
+	vpn_method_stats_s before, after;
+	vpn_h handle = NULL;
+	int rv, i;
+
+	_test_get_vpn_handle(&handle);
+
+	vpn_get_stats(VPN_METHOD_CONNECT, &before);
+
+	/* Both callbacks get the result of a single Connect call */
+	for (i = 1; i <= 2; i++) {
+		rv = vpn_connect(handle, __test_twin_connect_callback,
+						GINT_TO_POINTER(i));
+		if (rv != VPN_ERROR_NONE) {
+			printf("Fail to Connect to VPN Profile [%s]\n",
+					__test_convert_error_to_string(rv));
+			return -1;
+		}
+	}
+
+	vpn_get_stats(VPN_METHOD_CONNECT, &after);
+	printf("Connect calls issued: %u\n", after.calls - before.calls);
+
+	return 1;
+}
+
+int test_vpn_connect_deadline(void)
+{
+	vpn_h handle = NULL;
+	int rv = 0;
+
+	_test_get_vpn_handle(&handle);
+
+	/* Give up on a connect stuck for 30 s and let reconnect retry */
+	rv = vpn_set_connect_deadline(handle, 30000, true);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to set VPN connect deadline [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	printf("Connects now time out after 30000 ms\n");
+
+	return 1;
+}
+
+static void __test_import_record_callback(int index, int line,
+		const char *name, vpn_error_e result, void *user_data)
+{
+	if (result == VPN_ERROR_NONE)
+		return;
+
+	printf("Profile #%d (%s) at line %d not created [%s]\n",
+			index, name ? name : "no name", line,
+			__test_convert_error_to_string(result));
+}
+
+static void __test_import_done_callback(vpn_error_e result,
+		int succeeded, int failed, void *user_data)
+{
+	printf("VPN Import done [%s]: %d created, %d failed\n",
+			__test_convert_error_to_string(result),
+			succeeded, failed);
+}
+
+int test_vpn_import(void)
+{
+	int rv = 0;
+	char path[256];
+	char buf[16];
+
+	_test_get_user_input(&path[0], "Profile file");
+	_test_get_user_input(&buf[0], "Creations in flight");
+
+	rv = vpn_import_profiles(path, atoi(buf),
+			__test_import_record_callback,
+			__test_import_done_callback, NULL);
+
+	if (rv != VPN_ERROR_NONE) {
+		printf("Fail to Import VPN Profiles [%s]\n",
+				__test_convert_error_to_string(rv));
+		return -1;
+	}
+
+	return 1;
+}
+
+#define TEST_STRESS_THREADS 8
+#define TEST_STRESS_ITERATIONS 10000
+
+struct test_stress_data {
+	int id;
+	char host[128];
+	char domain[128];
+	GMainContext *context;
+	int pending;
+	int completed;
+	int misrouted;
+};
+
+static void __test_stress_connect_callback(vpn_error_e result,
+				void *user_data)
+{
+	struct test_stress_data *data = user_data;
+
+	/* Must run on the context of the thread that called vpn_connect() */
+	if (!g_main_context_is_owner(data->context))
+		data->misrouted++;
+
+	data->pending--;
+	data->completed++;
+}
+
+static gpointer __test_stress_thread(gpointer user_data)
+{
+	struct test_stress_data *data = user_data;
+	char *name = NULL;
+	const char *type = NULL;
+	char *host = NULL;
+	char *domain = NULL;
+	vpn_h handle = NULL;
+	int lookups = 0;
+	int i;
+
+	data->context = g_main_context_new();
+	g_main_context_push_thread_default(data->context);
+
+	for (i = 0; i < TEST_STRESS_ITERATIONS; i++) {
+		/* Stays valid should the profile be removed meanwhile */
+		if (vpn_get_vpn_handle_ref(data->host, data->domain,
+					&handle) != VPN_ERROR_NONE)
+			continue;
+
+		lookups++;
+		/* Off the main loop thread, the strings must be copied */
+		vpn_get_vpn_info_name_copy(handle, &name);
+		vpn_get_vpn_info_type(handle, &type);
+		vpn_get_vpn_info_host_copy(handle, &host);
+		vpn_get_vpn_info_domain_copy(handle, &domain);
+		g_free(name);
+		g_free(host);
+		g_free(domain);
+
+		if (i % 1000 == data->id) {
+			if (vpn_connect(handle, __test_stress_connect_callback,
+						data) == VPN_ERROR_NONE)
+				data->pending++;
+			vpn_cancel(handle);
+		}
+
+		vpn_handle_unref(handle);
+
+		while (g_main_context_iteration(data->context, FALSE))
+			;
+	}
+
+	while (data->pending > 0)
+		g_main_context_iteration(data->context, TRUE);
+
+	printf("Stress thread %d: %d lookups, %d connects completed, "
+			"%d callbacks on a foreign context\n", data->id,
+			lookups, data->completed, data->misrouted);
+
+	g_main_context_pop_thread_default(data->context);
+	g_main_context_unref(data->context);
+	g_free(data);
+
+	return NULL;
+}
+
+int test_vpn_stress(void)
+{
+	char host[128];
+	char domain[128];
+	int i;
+
+	_test_get_user_input(&host[0], "Host");
+	_test_get_user_input(&domain[0], "Domain");
+
+	/*
+	 * The threads run concurrently with the main loop, which keeps
+	 * dispatching the D-Bus signals of connman-vpn meanwhile.
+	 */
+	for (i = 0; i < TEST_STRESS_THREADS; i++) {
+		struct test_stress_data *data;
+
+		data = g_new0(struct test_stress_data, 1);
+		data->id = i;
+		g_strlcpy(data->host, host, sizeof(data->host));
+		g_strlcpy(data->domain, domain, sizeof(data->domain));
+
+		g_thread_unref(g_thread_new("vpn-stress",
+					__test_stress_thread, data));
+	}
+
+	printf("Started %d stress threads\n", TEST_STRESS_THREADS);
+
+	return 1;
+}
+
 int main(int argc, char **argv)
 {
 	GMainLoop *mainloop;
@@ -404,6 +1020,21 @@ gboolean test_thread(GIOChannel *source, GIOCondition condition, gpointer data)
 		printf("8\t- VPN Remove - Removes the VPN profile\n");
 		printf("9\t- VPN Connect - Connect the VPN profile\n");
 		printf("a\t- VPN Disconnect - Disconnect the VPN profile\n");
+		printf("b\t- VPN Cancel - Cancel the operations in flight on the VPN profile\n");
+		printf("c\t- VPN Stress - Concurrent getters and connects from several threads\n");
+		printf("d\t- VPN Stats - Show the D-Bus call statistics\n");
+		printf("e\t- VPN Journal - Dump the recent events of the VPN profile\n");
+		printf("f\t- VPN Import - Create the VPN profiles listed in a file\n");
+		printf("g\t- VPN Export - Print all the VPN profiles as JSON lines\n");
+		printf("h\t- VPN Query - List the VPN profiles by type and name prefix\n");
+		printf("i\t- VPN Reconnect - Reconnect the VPN profile automatically when it drops\n");
+		printf("j\t- VPN Traffic - Show the traffic counters of the VPN profile\n");
+		printf("k\t- VPN Agent - Cache a secret of the VPN profile for the built-in agent\n");
+		printf("l\t- VPN Deadline - Abort the connects of the VPN profile stuck for 30 s\n");
+		printf("m\t- VPN Connect Any - Connect the first of two VPN profiles to come up\n");
+		printf("n\t- VPN Rank - Order the VPN profiles by the latency of their server\n");
+		printf("o\t- VPN Connect Queue - Connect every VPN profile, one at a time\n");
+		printf("p\t- VPN Connect Twice - Connect the VPN profile from two callers at once\n");
 		printf("0\t- Exit\n");
 
 		printf("ENTER  - Show options menu.......\n");
@@ -440,6 +1071,51 @@ gboolean test_thread(GIOChannel *source, GIOCondition condition, gpointer data)
 	case 'a':
 		rv = test_vpn_disconnect();
 		break;
+	case 'b':
+		rv = test_vpn_cancel();
+		break;
+	case 'c':
+		rv = test_vpn_stress();
+		break;
+	case 'd':
+		rv = test_vpn_stats();
+		break;
+	case 'e':
+		rv = test_vpn_dump_journal();
+		break;
+	case 'f':
+		rv = test_vpn_import();
+		break;
+	case 'g':
+		rv = test_vpn_export();
+		break;
+	case 'h':
+		rv = test_vpn_query();
+		break;
+	case 'i':
+		rv = test_vpn_reconnect();
+		break;
+	case 'j':
+		rv = test_vpn_traffic();
+		break;
+	case 'k':
+		rv = test_vpn_agent();
+		break;
+	case 'l':
+		rv = test_vpn_connect_deadline();
+		break;
+	case 'm':
+		rv = test_vpn_connect_any();
+		break;
+	case 'n':
+		rv = test_vpn_rank();
+		break;
+	case 'o':
+		rv = test_vpn_connect_queue();
+		break;
+	case 'p':
+		rv = test_vpn_connect_twice();
+		break;
 	default:
 		break;
 	}